@@ -11,6 +11,9 @@ namespace
 	PFN_vkDestroyDebugUtilsMessengerEXT pfnVkDestroyDebugUtilsMessengerEXT = nullptr;
 
 	PFN_vkSetDebugUtilsObjectNameEXT pfnVkSetDebugUtilsObjectNameEXT = nullptr;
+
+	PFN_vkCmdBeginDebugUtilsLabelEXT pfnVkCmdBeginDebugUtilsLabelEXT = nullptr;
+	PFN_vkCmdEndDebugUtilsLabelEXT pfnVkCmdEndDebugUtilsLabelEXT = nullptr;
 }
 
 void VulkanDebug::LoadDebugUtilsExtension(const vk::Instance& instance)
@@ -24,9 +27,20 @@ void VulkanDebug::LoadDebugUtilsExtension(const vk::Instance& instance)
 	assert(pfnVkSetDebugUtilsObjectNameEXT == nullptr);
 	pfnVkSetDebugUtilsObjectNameEXT = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(instance.getProcAddr("vkSetDebugUtilsObjectNameEXT"));
 
+	assert(pfnVkCmdBeginDebugUtilsLabelEXT == nullptr);
+	pfnVkCmdBeginDebugUtilsLabelEXT = reinterpret_cast<PFN_vkCmdBeginDebugUtilsLabelEXT>(instance.getProcAddr("vkCmdBeginDebugUtilsLabelEXT"));
+
+	assert(pfnVkCmdEndDebugUtilsLabelEXT == nullptr);
+	pfnVkCmdEndDebugUtilsLabelEXT = reinterpret_cast<PFN_vkCmdEndDebugUtilsLabelEXT>(instance.getProcAddr("vkCmdEndDebugUtilsLabelEXT"));
+
 	assert(pfnVkCreateDebugUtilsMessengerEXT && "Required " VK_EXT_DEBUG_UTILS_EXTENSION_NAME " extension");
 }
 
+bool VulkanDebug::IsDebugUtilsExtensionLoaded()
+{
+	return pfnVkSetDebugUtilsObjectNameEXT != nullptr;
+}
+
 
 
 // Define the Debug  functions, which are delcared in the vulkan header and are used by the DispatchLoaderStatic
@@ -58,6 +72,18 @@ extern "C"
 		assert(pfnVkSetDebugUtilsObjectNameEXT && "Need to call VulkanDebug::LoadDebugUtilsExtension before this can be used");
 		return ::pfnVkSetDebugUtilsObjectNameEXT(device, pNameInfo);
 	}
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdBeginDebugUtilsLabelEXT(VkCommandBuffer commandBuffer, const VkDebugUtilsLabelEXT* pLabelInfo)
+	{
+		assert(pfnVkCmdBeginDebugUtilsLabelEXT && "Need to call VulkanDebug::LoadDebugUtilsExtension before this can be used");
+		pfnVkCmdBeginDebugUtilsLabelEXT(commandBuffer, pLabelInfo);
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdEndDebugUtilsLabelEXT(VkCommandBuffer commandBuffer)
+	{
+		assert(pfnVkCmdEndDebugUtilsLabelEXT && "Need to call VulkanDebug::LoadDebugUtilsExtension before this can be used");
+		pfnVkCmdEndDebugUtilsLabelEXT(commandBuffer);
+	}
 }
 
 
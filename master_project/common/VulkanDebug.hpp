@@ -5,6 +5,9 @@ namespace VulkanDebug
 {
 	void LoadDebugUtilsExtension(const vk::Instance& instance);
 
+	// false if LoadDebugUtilsExtension was not called, object names are skipped then
+	bool IsDebugUtilsExtensionLoaded();
+
 	template<typename T>
 	constexpr vk::ObjectType GetObjectType()
 	{
@@ -53,6 +56,11 @@ namespace VulkanDebug
 	template<typename T>
 	void SetObjectName(vk::Device device, T Object, const char* name)
 	{
+		if (!IsDebugUtilsExtensionLoaded())
+		{
+			return;
+		}
+
 		uint64_t handle = 0;
 		if constexpr(sizeof(Object) == sizeof(uint64_t))
 		{
@@ -55,6 +55,26 @@ bool VulkanUtils::SupportsValidationLayers(gsl::span<const char*> layerNames)
 		});
 }
 
+bool VulkanUtils::SupportsInstanceExtension(const char* extensionName, gsl::span<const char*> layerNames)
+{
+	const auto hasExtension = [extensionName](const std::vector<vk::ExtensionProperties>& availableExtensions)
+	{
+		return std::any_of(availableExtensions.cbegin(), availableExtensions.cend(), [extensionName](const vk::ExtensionProperties& availableExtension)
+			{
+				return std::strcmp(availableExtension.extensionName, extensionName) == 0;
+			});
+	};
+
+	if (hasExtension(vk::enumerateInstanceExtensionProperties()))
+	{
+		return true;
+	}
+	return std::any_of(layerNames.cbegin(), layerNames.cend(), [&hasExtension](const char* layerName)
+		{
+			return hasExtension(vk::enumerateInstanceExtensionProperties(std::string(layerName)));
+		});
+}
+
 vk::SurfaceFormatKHR VulkanUtils::ChooseSurfaceFormat(gsl::span<const vk::SurfaceFormatKHR> availableFormats, gsl::span<const vk::SurfaceFormatKHR> preferedFormat)
 {
 	assert(availableFormats.size() >= 1);
@@ -31,6 +31,9 @@ namespace VulkanUtils
 
 	bool SupportsValidationLayers(gsl::span<const char*> layerNames);
 
+	// the extension can come from the implementation or from one of the layers
+	bool SupportsInstanceExtension(const char* extensionName, gsl::span<const char*> layerNames);
+
 	vk::SurfaceFormatKHR ChooseSurfaceFormat(
 		gsl::span<const vk::SurfaceFormatKHR> availableFormats,
 		gsl::span<const vk::SurfaceFormatKHR> preferedFormat);
@@ -0,0 +1,86 @@
+#include "pch.hpp"
+#include "AllocationTracker.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	// zero initialized before any dynamic initialization, so allocations of static constructors are counted as well
+	std::atomic<uint64_t> allocationCounts[AllocationTracker::subsystemCount];
+	std::atomic<uint64_t> allocatedBytes[AllocationTracker::subsystemCount];
+
+	thread_local AllocationTracker::Subsystem currentSubsystem = AllocationTracker::Subsystem::Other;
+}
+
+const char* AllocationTracker::GetSubsystemName(Subsystem subsystem)
+{
+	switch (subsystem)
+	{
+	case Subsystem::Other:
+		return "other";
+	case Subsystem::Loading:
+		return "loading";
+	case Subsystem::Application:
+		return "application";
+	case Subsystem::Render:
+		return "render";
+	case Subsystem::Recording:
+		return "recording";
+	default:
+		assert(false);
+		return "";
+	}
+}
+
+AllocationTracker::SubsystemCounters AllocationTracker::TakeCounters()
+{
+	SubsystemCounters counters;
+	for (size_t i = 0; i < subsystemCount; ++i)
+	{
+		counters[i].allocationCount = allocationCounts[i].exchange(0, std::memory_order_relaxed);
+		counters[i].allocatedBytes = allocatedBytes[i].exchange(0, std::memory_order_relaxed);
+	}
+	return counters;
+}
+
+AllocationTracker::Scope::Scope(Subsystem subsystem)
+	: m_previousSubsystem(currentSubsystem)
+{
+	currentSubsystem = subsystem;
+}
+
+AllocationTracker::Scope::~Scope()
+{
+	currentSubsystem = m_previousSubsystem;
+}
+
+#if ALLOCATION_TRACKING_ENABLED
+
+// the array and nothrow forms of the default library forward to these
+void* operator new(std::size_t size)
+{
+	const size_t subsystemIndex = static_cast<size_t>(currentSubsystem);
+	allocationCounts[subsystemIndex].fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes[subsystemIndex].fetch_add(size, std::memory_order_relaxed);
+
+	// a zero sized allocation still has to return a unique pointer
+	void* memory = std::malloc(size == 0 ? 1 : size);
+	if (!memory)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+#endif
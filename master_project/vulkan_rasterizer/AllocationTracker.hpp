@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// define ALLOCATION_TRACKING_ENABLED as 0 to keep the default operator new, the counters stay 0 then
+#ifndef ALLOCATION_TRACKING_ENABLED
+#define ALLOCATION_TRACKING_ENABLED 1
+#endif
+
+// counts the heap allocations made through the global operator new
+// each allocation is counted for the subsystem its thread is in, see Scope
+namespace AllocationTracker
+{
+	enum class Subsystem : uint8_t
+	{
+		Other,
+		Loading,
+		Application,
+		Render,
+		Recording,
+		enum_size_Subsystem
+	};
+
+	constexpr size_t subsystemCount = static_cast<size_t>(Subsystem::enum_size_Subsystem);
+
+	struct Counters
+	{
+		uint64_t allocationCount = 0;
+		uint64_t allocatedBytes = 0;
+	};
+
+	using SubsystemCounters = std::array<Counters, subsystemCount>;
+
+	const char* GetSubsystemName(Subsystem subsystem);
+
+	// the allocations since the last call, called once per frame this gives the allocations of the frame
+	SubsystemCounters TakeCounters();
+
+	// the allocations of this thread are counted for subsystem until the scope ends, scopes can be nested
+	class Scope
+	{
+	public:
+		explicit Scope(Subsystem subsystem);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		Subsystem m_previousSubsystem;
+	};
+}
@@ -1,66 +1,131 @@
 #include "pch.hpp"
 #include "Application_Rasterizer.hpp"
+#include "LevelLoader.hpp"
+#include "Profiler.hpp"
 #include <iostream>
 
 
 namespace
 {
-	std::string printTestCase(gsl::span<const int> testcase)
+	// printed directly, so sampling a test case does not build strings
+	void printTestCase(gsl::span<const int> testcase)
 	{
 		if (testcase.size() == 0)
 		{
-			return std::string("Testcase - No recursions");
+			std::printf("Testcase - No recursions");
+			return;
 		}
 
-		std::string result("Testcase ");
-		result += std::to_string(testcase[0]);
+		std::printf("Testcase %d", testcase[0]);
 		for (int i = 1; i < testcase.size(); ++i)
 		{
-			result += std::string("-") + std::to_string(testcase[i]);
+			std::printf("-%d", testcase[i]);
 		}
+	}
 
-		return result;
+	const char* GetRendererName(RendererType rendererType)
+	{
+		switch (rendererType)
+		{
+		case RendererType::BreadthFirst:
+			return "breadth first";
+		case RendererType::DepthFirstStencil:
+			return "depth first stencil";
+		case RendererType::TextureAtlas:
+			return "texture atlas";
+		default:
+			assert(false);
+			return "";
+		}
 	}
 
-	double calcMedian(gsl::span<double> range)
+	// the level cameras are the keys if there is no camera path file, the start camera if the level has none
+	CameraPath LoadBenchmarkCameraPath(const std::string& cameraPathFile, gsl::span<const LevelLoader::CameraObject> levelCameras, const Camera& startCamera)
 	{
-		const auto size = range.size();
-		auto n = size / 2;
-		int remainder = size % 2;
+		if (!cameraPathFile.empty())
+		{
+			std::optional<CameraPath> cameraPath = CameraPath::LoadFromFile(cameraPathFile.c_str());
+			if (!cameraPath)
+			{
+				throw std::runtime_error("could not load the camera path " + cameraPathFile);
+			}
+			return *cameraPath;
+		}
+
+		std::vector<CameraPath::Key> keys;
+		for (const LevelLoader::CameraObject& levelCamera : levelCameras)
+		{
+			keys.push_back(CameraPath::Key{ levelCamera.positon, levelCamera.direction });
+		}
+
+		if (keys.empty())
+		{
+			keys.push_back(CameraPath::Key{ startCamera.CalcPosition(), startCamera.CalcForwardVector() });
+		}
+		return CameraPath(std::move(keys));
+	}
+
+	double ChooseTargetFrameRate(double requestedFrameRate, SDL_Window* window)
+	{
+		if (requestedFrameRate > 0.0)
+		{
+			return requestedFrameRate;
+		}
 
-		std::nth_element(range.begin(), range.begin() + n, range.end());
-		auto med = range[n];
-		if (remainder == 0) {
-			auto max_it = std::max_element(range.begin(), range.begin() + n);
-			med = (*max_it + med) / 2.0;
+		SDL_DisplayMode displayMode;
+		if (window && SDL_GetWindowDisplayMode(window, &displayMode) == 0 && displayMode.refresh_rate > 0)
+		{
+			return displayMode.refresh_rate;
 		}
-		return med;
+
+		constexpr double defaultFrameRate = 60.0;
+		return defaultFrameRate;
 	}
 
 }
 
-Application_Rasterizer::Application_Rasterizer()
+Application_Rasterizer::Application_Rasterizer(const ApplicationOptions& options)
 {
+	Profiler::SetThreadName("main thread");
+	const AllocationTracker::Scope allocationScope(AllocationTracker::Subsystem::Loading);
+
 	constexpr int width = static_cast<int>(1920);// / 1.5);
 	constexpr int height = static_cast<int>(1080);// / 1.5);
 
-	m_sdlWindow = WindowPtr{
-		SDL_CreateWindow(
-		"An SDL2 window",
-		SDL_WINDOWPOS_UNDEFINED,
-		SDL_WINDOWPOS_UNDEFINED,
-		width,
-		height,
-		SDL_WindowFlags::SDL_WINDOW_VULKAN | SDL_WindowFlags::SDL_WINDOW_RESIZABLE
-		)
-	};
+	if (options.isHeadless && options.benchmarkOutputPrefix.empty())
+	{
+		m_remainingHeadlessFrames = options.headlessFrameCount;
+	}
+
+	if (!options.isHeadless)
+	{
+		m_sdlWindow = WindowPtr{
+			SDL_CreateWindow(
+			"An SDL2 window",
+			SDL_WINDOWPOS_UNDEFINED,
+			SDL_WINDOWPOS_UNDEFINED,
+			width,
+			height,
+			SDL_WindowFlags::SDL_WINDOW_VULKAN | SDL_WindowFlags::SDL_WINDOW_RESIZABLE
+			)
+		};
+	}
 
 
 	m_camera.SetPerspection_InverseZBuffer( 1.f, glm::radians(45.f), glm::vec2(width, height));
 
 	m_camera.SetPosition(glm::vec3(0.f, 0.05f, 3.f) * 20.f);
 	m_camera.LookDir(glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	m_graphcisBackend.Init(m_sdlWindow.get(), m_camera);
+	m_graphcisBackend.Init(m_sdlWindow.get(), vk::Extent2D(width, height), m_camera, options.rendererType);
+	m_rendererType = options.rendererType;
+
+	// the other renderers draw every recursion layer at full resolution, so the option reads as off for them
+	if (m_rendererType != RendererType::TextureAtlas)
+	{
+		m_drawOptions.recursionResolutionScales.clear();
+	}
+
+	m_graphcisBackend.SetFrameOutputPrefix(options.frameOutputPrefix);
 	m_oldCameraPos = m_camera.CalcPosition();
 	m_lastTime = ClockType::now();
 
@@ -86,37 +151,152 @@ Application_Rasterizer::Application_Rasterizer()
 		std::vector<int>{0},
 	};
 	m_graphcisBackend.SetMaxVisiblePortalsForRecursion(testCases[1]);
+	{
+		RecursionBudgetController::Settings budgetSettings;
+		budgetSettings.targetFrameSeconds = 1.0 / ChooseTargetFrameRate(options.targetFrameRate, m_sdlWindow.get());
+		m_recursionBudgetController.emplace(testCases[1], budgetSettings);
+	}
+
+	if (!options.benchmarkOutputPrefix.empty())
+	{
+		m_benchmarkRun.emplace(LoadBenchmarkCameraPath(options.cameraPathFile, m_graphcisBackend.GetLevelCameras(), m_camera), testCases, options.benchmarkSettings);
+		m_benchmarkOutputPrefix = options.benchmarkOutputPrefix;
+		m_benchmarkDescription = std::string(GetRendererName(options.rendererType)) + " renderer, "
+			+ m_graphcisBackend.GetDeviceName() + ", "
+			+ std::to_string(width) + "x" + std::to_string(height)
+			+ (options.isHeadless ? ", headless" : ", windowed");
+	}
+
+	m_drawOptions.extraLines.reserve(DrawOptions::maxExtraLineCount);
+
+	// the first frame only counts its own allocations
+	AllocationTracker::TakeCounters();
 }
 
 bool Application_Rasterizer::Update()
 {
+	PROFILE_SCOPE("Application_Rasterizer::Update");
+	const AllocationTracker::Scope allocationScope(AllocationTracker::Subsystem::Application);
+
 	ClockType::time_point currentTime = ClockType::now();
 	const float DeltaSeconds = std::chrono::duration<float>(currentTime - m_lastTime).count();
 	m_lastTime = currentTime;
 
 	m_inputManager.StartNewFrame();
-	SDL_Event event;
-	while (SDL_PollEvent(&event))
+	if (m_sdlWindow)
+	{
+		SDL_Event event;
+		while (SDL_PollEvent(&event))
+		{
+			if (SDL_WINDOWEVENT == event.type && SDL_WINDOWEVENT_CLOSE == event.window.event)
+			{
+				m_graphcisBackend.WaitIdle();
+				return false;
+			}
+			HandleEvent(event);
+		}
+	}
+
+	// the window stays responsive while the level is uploaded, the headless frames and the benchmark start once it is drawn
+	constexpr uint64_t levelUploadPollTimeoutNanoseconds = 1'000'000;
+	if (!m_graphcisBackend.PollLevelUploads(levelUploadPollTimeoutNanoseconds))
+	{
+		return true;
+	}
+
+	if (m_remainingHeadlessFrames)
+	{
+		if (*m_remainingHeadlessFrames <= 0)
+		{
+			m_graphcisBackend.WaitIdle();
+			return false;
+		}
+		--(*m_remainingHeadlessFrames);
+	}
+
+	if (m_benchmarkRun)
 	{
-		if (SDL_WINDOWEVENT == event.type && SDL_WINDOWEVENT_CLOSE == event.window.event)
+		if (m_benchmarkRun->IsFinished())
 		{
 			m_graphcisBackend.WaitIdle();
+			if (m_benchmarkRun->WriteResults(m_benchmarkOutputPrefix, m_benchmarkDescription))
+			{
+				std::printf("benchmark results written to %s.csv and %s.json \n", m_benchmarkOutputPrefix.c_str(), m_benchmarkOutputPrefix.c_str());
+			}
+			else
+			{
+				std::printf("could not write the benchmark results to %s \n", m_benchmarkOutputPrefix.c_str());
+			}
+			std::cout.flush();
 			return false;
 		}
-		HandleEvent(event);
+
+		if (m_benchmarkRun->PrepareFrame(m_camera))
+		{
+			m_graphcisBackend.SetMaxVisiblePortalsForRecursion(m_benchmarkRun->GetRecursionConfig());
+			std::printf("benchmark config: %s \n", BenchmarkRun::ConfigName(m_benchmarkRun->GetRecursionConfig()).c_str());
+			std::cout.flush();
+		}
+	}
+	else
+	{
+		PROFILE_SCOPE("Application_Rasterizer::GameUpdate");
+		GameUpdate(DeltaSeconds);
 	}
-	GameUpdate(DeltaSeconds);
 
 	ClockType::time_point beforeRender = ClockType::now();
 	m_graphcisBackend.Render(m_camera, m_drawOptions);
 	ClockType::time_point afterRender = ClockType::now();
 
 	m_frameTimeBuckets[m_currentFrameBucketIndex] = DoubleSeconds(afterRender - beforeRender).count();
+
+	if (m_benchmarkRun)
+	{
+		BenchmarkRun::FrameTimes frameTimes = {};
+		frameTimes.gpuWaitSeconds = m_graphcisBackend.GetLastFenceWaitSeconds();
+		// fifo blocks in acquire and present for vsync, which is no cpu work
+		frameTimes.cpuSeconds = m_frameTimeBuckets[m_currentFrameBucketIndex] - frameTimes.gpuWaitSeconds - m_graphcisBackend.GetLastPresentWaitSeconds();
+		frameTimes.gpuTimings = m_graphcisBackend.GetLastGpuFrameTimings();
+		m_benchmarkRun->AddFrameTimes(frameTimes);
+	}
+
+	{
+		RecursionBudgetController::FrameTimings frameTimings = {};
+		frameTimings.gpuWaitSeconds = m_graphcisBackend.GetLastFenceWaitSeconds();
+		frameTimings.cpuSeconds = m_frameTimeBuckets[m_currentFrameBucketIndex] - frameTimings.gpuWaitSeconds - m_graphcisBackend.GetLastPresentWaitSeconds();
+		if (const std::optional<GpuFrameTimings>& gpuTimings = m_graphcisBackend.GetLastGpuFrameTimings())
+		{
+			frameTimings.gpuSeconds = gpuTimings->frameSeconds;
+		}
+		frameTimings.isPresentModeFifo = m_graphcisBackend.IsPresentModeFifo();
+
+		m_budgetFrameTimeBuckets[m_currentFrameBucketIndex] = RecursionBudgetController::CalcFrameSeconds(frameTimings);
+	}
+
+	if (m_useAdaptiveRecursion)
+	{
+		if (m_recursionBudgetController->Update(m_budgetFrameTimeBuckets, m_currentFrameBucketIndex))
+		{
+			m_graphcisBackend.SetMaxVisiblePortalsForRecursion(m_recursionBudgetController->GetVisiblePortalsForRecursion());
+		}
+	}
+
 	m_currentFrameBucketIndex = (m_currentFrameBucketIndex + 1) % frameTimeBuckedSize;
 
+	// the recording threads finished their jobs of this frame in Render
+	m_lastFrameAllocations = AllocationTracker::TakeCounters();
+	++m_renderedFrameCount;
 
+	// the storage of the breadth first renderer is reserved in Init or grows in its first frames, after that Render must not allocate
+	constexpr int allocationWarmupFrameCount = 16;
+	assert(m_rendererType != RendererType::BreadthFirst || m_renderedFrameCount <= allocationWarmupFrameCount
+		|| m_lastFrameAllocations[static_cast<size_t>(AllocationTracker::Subsystem::Render)].allocationCount == 0);
 
-	SDL_UpdateWindowSurface(m_sdlWindow.get());
+
+	if (m_sdlWindow)
+	{
+		SDL_UpdateWindowSurface(m_sdlWindow.get());
+	}
 	return true;
 }
 
@@ -147,6 +327,15 @@ void Application_Rasterizer::SetTestCase(int i)
 	currentCase = i;
 }
 
+void Application_Rasterizer::AddExtraLine(const Line& line)
+{
+	if (m_drawOptions.extraLines.size() >= DrawOptions::maxExtraLineCount)
+	{
+		m_drawOptions.extraLines.erase(m_drawOptions.extraLines.begin());
+	}
+	m_drawOptions.extraLines.push_back(line);
+}
+
 void Application_Rasterizer::GameUpdate(float Seconds)
 {
 	constexpr float movementMultiplicator = 500.f;
@@ -263,7 +452,7 @@ void Application_Rasterizer::GameUpdate(float Seconds)
 
 		const PortalManager& portalmanger = m_graphcisBackend.GetPortalManager();
 
-		m_drawOptions.extraLines.push_back(Line(glm::vec4(m_savedLocation, 1.f), glm::vec4(currentLocation, 1.f)));
+		AddExtraLine(Line(glm::vec4(m_savedLocation, 1.f), glm::vec4(currentLocation, 1.f)));
 
 		const Ray ray = Ray::FromStartAndEndpoint(m_savedLocation, currentLocation);
 
@@ -273,7 +462,7 @@ void Application_Rasterizer::GameUpdate(float Seconds)
 		if (maybeResult.has_value())
 		{
 			const glm::vec3 hitPos = maybeResult->hitLocation;
-			m_drawOptions.extraLines.push_back(Line(glm::vec4(hitPos.x, -100.f, hitPos.z, 1.f), glm::vec4(hitPos.x, +100.f, hitPos.z, 1.f)));
+			AddExtraLine(Line(glm::vec4(hitPos.x, -100.f, hitPos.z, 1.f), glm::vec4(hitPos.x, +100.f, hitPos.z, 1.f)));
 		}
 
 
@@ -294,7 +483,7 @@ void Application_Rasterizer::GameUpdate(float Seconds)
 
 		if (!maybeResult.has_value())
 		{
-			m_drawOptions.extraLines.push_back(Line(missedA, missedB));
+			AddExtraLine(Line(missedA, missedB));
 		}
 
 		const bool b = maybeResult.has_value();
@@ -305,6 +494,99 @@ void Application_Rasterizer::GameUpdate(float Seconds)
 		m_drawOptions.maxRecursion = m_drawOptions.maxRecursion == 0 ? std::numeric_limits<int>::max() : 0;
 	}
 
+	if (m_inputManager.GetKey(KeyCode::KEY_O).GetNumPressed() > 0)
+	{
+		m_drawOptions.minPortalCoverage = m_drawOptions.minPortalCoverage == 0 ? DrawOptions{}.minPortalCoverage : 0;
+		std::printf("min portal coverage: %d \n", m_drawOptions.minPortalCoverage);
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_H).GetNumPressed() > 0)
+	{
+		m_drawOptions.useHardwareStencil = !m_drawOptions.useHardwareStencil;
+		std::printf("hardware stencil: %s%s \n", m_drawOptions.useHardwareStencil ? "on" : "off",
+			m_graphcisBackend.IsHardwareStencilSupported() ? "" : " (not supported)");
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_I).GetNumPressed() > 0)
+	{
+		// the deepest layers change the least while the camera moves
+		constexpr int impostorStartDepth = 2;
+
+		m_drawOptions.impostorCache.startDepth = m_drawOptions.impostorCache.startDepth == 0 ? impostorStartDepth : 0;
+		std::printf("impostor cache: %s (texture atlas renderer only) \n", m_drawOptions.impostorCache.startDepth > 0 ? "on" : "off");
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_U).GetNumPressed() > 0)
+	{
+		if (m_rendererType == RendererType::TextureAtlas)
+		{
+			const bool isFullResolution = m_drawOptions.recursionResolutionScales.empty();
+			m_drawOptions.recursionResolutionScales = isFullResolution ? DrawOptions{}.recursionResolutionScales : std::vector<float>();
+			std::printf("recursion resolution scaling: %s \n", isFullResolution ? "on" : "off");
+		}
+		else
+		{
+			std::printf("recursion resolution scaling is not supported by the %s renderer \n", GetRendererName(m_rendererType));
+		}
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_N).GetNumPressed() > 0)
+	{
+		m_drawOptions.useMeshLods = !m_drawOptions.useMeshLods;
+		std::printf("mesh lods: %s \n", m_drawOptions.useMeshLods ? "on" : "off");
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_V).GetNumPressed() > 0)
+	{
+		m_drawOptions.visibilityReuseMarginLayers = m_drawOptions.visibilityReuseMarginLayers < 0 ? DrawOptions{}.visibilityReuseMarginLayers : -1;
+		std::printf("visibility reuse: %s \n", m_drawOptions.visibilityReuseMarginLayers >= 0 ? "on" : "off");
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_G).GetNumPressed() > 0)
+	{
+		m_drawOptions.useSecondaryCommandBuffers = !m_drawOptions.useSecondaryCommandBuffers;
+		std::printf("secondary command buffers: %s \n", m_drawOptions.useSecondaryCommandBuffers ? "on" : "off");
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_T).GetNumPressed() > 0)
+	{
+		m_drawOptions.cacheSubpassCommands = !m_drawOptions.cacheSubpassCommands;
+		std::printf("cached subpass commands: %s \n", m_drawOptions.cacheSubpassCommands ? "on" : "off");
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_X).GetNumPressed() > 0)
+	{
+		m_drawOptions.collectLayerStatistics = !m_drawOptions.collectLayerStatistics;
+		std::printf("layer statistics: %s (printed with the render milliseconds) \n", m_drawOptions.collectLayerStatistics ? "on" : "off");
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_Y).GetNumPressed() > 0)
+	{
+		constexpr const char* heatmapModeNames[] = { "off", "overdraw", "recursion depth" };
+		static_assert(std::size(heatmapModeNames) == static_cast<size_t>(HeatmapMode::enum_size_HeatmapMode));
+
+		const uint32_t nextMode = (static_cast<uint32_t>(m_drawOptions.heatmap) + 1) % static_cast<uint32_t>(HeatmapMode::enum_size_HeatmapMode);
+		m_drawOptions.heatmap = static_cast<HeatmapMode>(nextMode);
+		std::printf("heatmap: %s \n", heatmapModeNames[nextMode]);
+		std::cout.flush();
+	}
+
+	if (m_inputManager.GetKey(KeyCode::KEY_3).GetNumPressed() > 0)
+	{
+		constexpr const char* traceFile = "profile_trace.json";
+		std::printf(Profiler::WriteChromeTrace(traceFile) ? "profiler trace written to %s \n" : "could not write the profiler trace to %s \n", traceFile);
+		std::cout.flush();
+	}
+
 	if (m_inputManager.GetKey(KeyCode::KEY_F).GetNumPressed() > 0)
 	{
 		m_showRenderMilliseconds = !m_showRenderMilliseconds;
@@ -315,12 +597,56 @@ void Application_Rasterizer::GameUpdate(float Seconds)
 		double avarage = std::accumulate(m_frameTimeBuckets.begin(), m_frameTimeBuckets.end(), 0.0) / frameTimeBuckedSize;
 		std::printf("render Milliseconds: %f \n", avarage * 1000.f);
 
+		// vertex and fragment shader invocations, clipped primitives and the fragments discarded by the stencil and depth test
+		const std::vector<LayerStatistics>& layerStatistics = m_graphcisBackend.GetLastLayerStatistics();
+		for (size_t layerIndex = 0; layerIndex < layerStatistics.size(); ++layerIndex)
+		{
+			const LayerStatistics& statistics = layerStatistics[layerIndex];
+			std::printf("layer %zu scene: vs %llu, prims %llu, fs %llu, discards %llu / %llu | portal: vs %llu, prims %llu, fs %llu, discards %llu / %llu \n",
+				layerIndex,
+				static_cast<unsigned long long>(statistics.scenePass.vertexShaderInvocations),
+				static_cast<unsigned long long>(statistics.scenePass.clippingPrimitives),
+				static_cast<unsigned long long>(statistics.scenePass.fragmentShaderInvocations),
+				static_cast<unsigned long long>(statistics.sceneStencilDiscards),
+				static_cast<unsigned long long>(statistics.sceneDepthDiscards),
+				static_cast<unsigned long long>(statistics.portalPass.vertexShaderInvocations),
+				static_cast<unsigned long long>(statistics.portalPass.clippingPrimitives),
+				static_cast<unsigned long long>(statistics.portalPass.fragmentShaderInvocations),
+				static_cast<unsigned long long>(statistics.portalStencilDiscards),
+				static_cast<unsigned long long>(statistics.portalDepthDiscards));
+		}
+
+		// the steady state render loop should not allocate, see GraphicsBackend::Render
+		std::printf("heap allocations last frame:");
+		for (size_t subsystemIndex = 0; subsystemIndex < AllocationTracker::subsystemCount; ++subsystemIndex)
+		{
+			const AllocationTracker::Counters& counters = m_lastFrameAllocations[subsystemIndex];
+			std::printf(" %s %llu (%llu bytes)%s",
+				AllocationTracker::GetSubsystemName(static_cast<AllocationTracker::Subsystem>(subsystemIndex)),
+				static_cast<unsigned long long>(counters.allocationCount),
+				static_cast<unsigned long long>(counters.allocatedBytes),
+				subsystemIndex + 1 < AllocationTracker::subsystemCount ? "," : "");
+		}
+		std::printf(" \n");
+
 		std::cout.flush();
 		m_showRenderMilliseconds = false;
 	}
 
+	if (m_inputManager.GetKey(KeyCode::KEY_B).GetNumPressed() > 0)
+	{
+		m_useAdaptiveRecursion = !m_useAdaptiveRecursion;
+		m_recursionBudgetController->Reset();
+		m_graphcisBackend.SetMaxVisiblePortalsForRecursion(m_recursionBudgetController->GetVisiblePortalsForRecursion());
+		std::printf("adaptive recursion: %s, target %.2f ms \n", m_useAdaptiveRecursion ? "on" : "off",
+			m_recursionBudgetController->GetTargetFrameSeconds() * 1000.0);
+		std::cout.flush();
+	}
+
 	if (m_inputManager.GetKey(KeyCode::KEY_M).GetNumPressed() > 0)
 	{
+		// the test cases measure fixed budgets
+		m_useAdaptiveRecursion = false;
 		SetTestCase(0);
 		framesTillSample = sampleWaitFrames;
 		std::printf("testCase;average;median;min;max;\n");
@@ -340,11 +666,10 @@ void Application_Rasterizer::GameUpdate(float Seconds)
 			const double minTime = *mintIter;
 			const double maxTime = *maxIter;
 
-			const double median = calcMedian(m_frameTimeBuckets);
+			const double median = BenchmarkRun::CalcMedian(m_frameTimeBuckets);
 
-			std::string testcaseString = printTestCase(testCases[currentCase]);
-			std::printf("%s;%f;%f;%f;%f;\n"
-				, testcaseString.c_str()
+			printTestCase(testCases[currentCase]);
+			std::printf(";%f;%f;%f;%f;\n"
 				, avarage * 1000.0
 				, median * 1000.0
 				, minTime * 1000.0
@@ -406,7 +731,7 @@ void Application_Rasterizer::GameUpdate(float Seconds)
 			const double minTime = *mintIter;
 			const double maxTime = *maxIter;
 
-			const double median = calcMedian(results);
+			const double median = BenchmarkRun::CalcMedian(results);
 
 			std::printf("%d;%f;%f;%f;%f;%d;%d\n"
 				, i
@@ -7,12 +7,36 @@
 #include "Camera.hpp"
 #include "InputManager.hpp"
 #include "LineDrawer.hpp"
+#include "RecursionBudgetController.hpp"
+#include "BenchmarkRun.hpp"
+#include "AllocationTracker.hpp"
+
+struct ApplicationOptions
+{
+	RendererType rendererType = RendererType::BreadthFirst;
+
+	// frame rate the adaptive recursion aims for, 0 uses the refresh rate of the display and 60 if that is unknown
+	double targetFrameRate = 0.0;
+
+	// renders into offscreen images without creating a window, Update returns false after headlessFrameCount frames
+	bool isHeadless = false;
+	int headlessFrameCount = 1000;
+
+	// only used headless, see GraphicsBackend::SetFrameOutputPrefix
+	std::string frameOutputPrefix;
+
+	// runs each of the test cases along the camera path and writes the results to <benchmarkOutputPrefix>.csv and .json, then quits
+	// without a camera path file the cameras of the level are used as keys, empty disables the benchmark
+	std::string benchmarkOutputPrefix;
+	std::string cameraPathFile;
+	BenchmarkRun::Settings benchmarkSettings;
+};
 
 class Application_Rasterizer
 {
 
 public:
-	Application_Rasterizer();
+	explicit Application_Rasterizer(const ApplicationOptions& options = {});
 	bool Update();
 
 private:
@@ -20,14 +44,27 @@ private:
 	using ClockType = std::chrono::steady_clock;
 	using DoubleSeconds = std::chrono::duration<double>;
 
+	// null if headless
 	WindowPtr m_sdlWindow;
+
+	// only used headless without a benchmark
+	std::optional<int> m_remainingHeadlessFrames;
+
+	// the benchmark controls the camera and the recursion, the input is ignored
+	std::optional<BenchmarkRun> m_benchmarkRun;
+	std::string m_benchmarkOutputPrefix;
+	std::string m_benchmarkDescription;
 	GraphicsBackend m_graphcisBackend;
+	RendererType m_rendererType;
 	Camera m_camera;
 	InputManager m_inputManager;
 	bool m_shouldLockrotation = false;
 	void HandleEvent(SDL_Event event);
 	void SetTestCase(int i);
 	void GameUpdate(float Seconds);
+
+	// drops the oldest line once DrawOptions::maxExtraLineCount are drawn, the lines are part of the subpass commands key
+	void AddExtraLine(const Line& line);
 	ClockType::time_point m_lastTime;
 	DrawOptions m_drawOptions;
 	glm::vec3 m_savedLocation;
@@ -36,10 +73,20 @@ private:
 
 	constexpr static int frameTimeBuckedSize = 128;
 	std::array<double, frameTimeBuckedSize> m_frameTimeBuckets;
+	// the same frames as the recursion budget sees them, without the vsync wait, see RecursionBudgetController::CalcFrameSeconds
+	std::array<double, frameTimeBuckedSize> m_budgetFrameTimeBuckets = {};
 	int m_currentFrameBucketIndex = 0;
 
+	// the heap allocations of the last frame
+	AllocationTracker::SubsystemCounters m_lastFrameAllocations = {};
+	int m_renderedFrameCount = 0;
+
 	std::vector<std::vector<int>> testCases;
 
+	// adjusts the recursion to hold the frame time, created with the default test case as maximum budget
+	std::optional<RecursionBudgetController> m_recursionBudgetController;
+	bool m_useAdaptiveRecursion = false;
+
 	int currentCase = -1;
 
 	static constexpr int sampleWaitFrames = frameTimeBuckedSize * 2;
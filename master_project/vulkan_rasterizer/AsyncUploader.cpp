@@ -0,0 +1,108 @@
+#include "pch.hpp"
+#include "AsyncUploader.hpp"
+#include "CommandBufferUtils.hpp"
+
+AsyncUploader::AsyncUploader(vk::Device device, VmaAllocator allocator, UploadRingBuffer& uploadRing, vk::Queue transferQueue, uint32_t transferFamilyIndex, uint32_t graphicsFamilyIndex)
+	: m_device(device)
+	, m_allocator(allocator)
+	, m_uploadRing(&uploadRing)
+	, m_transferQueue(transferQueue)
+	, m_queueFamilyIndices{ transferFamilyIndex, graphicsFamilyIndex }
+{
+	m_commandPool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo{}
+		.setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+		.setQueueFamilyIndex(transferFamilyIndex));
+}
+
+AsyncUploader::~AsyncUploader()
+{
+	constexpr uint64_t noTimeout = std::numeric_limits<uint64_t>::max();
+	for (const PendingUpload& upload : m_pendingUploads)
+	{
+		m_device.waitForFences(upload.fence.get(), true, noTimeout);
+	}
+}
+
+vk::SharingMode AsyncUploader::GetDestinationSharingMode() const
+{
+	return HasDedicatedQueue() ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
+}
+
+gsl::span<const uint32_t> AsyncUploader::GetDestinationQueueFamilies() const
+{
+	// exclusive sharing ignores the families
+	return HasDedicatedQueue() ? gsl::make_span(m_queueFamilyIndices) : gsl::span<const uint32_t>();
+}
+
+AsyncUploader::Ticket AsyncUploader::Upload(vk::DeviceSize stagingSize, const RecordFunction& recordFunction)
+{
+	PendingUpload upload;
+	upload.ticket = ++m_lastTicket;
+
+	Staging staging;
+	upload.ringStaging = m_uploadRing->AllocateStaging(stagingSize);
+	if (upload.ringStaging)
+	{
+		staging.buffer = upload.ringStaging->buffer;
+		staging.offset = upload.ringStaging->offset;
+		staging.mappedMemory = upload.ringStaging->mappedMemory;
+	}
+	else
+	{
+		const vk::BufferCreateInfo stagingBufferCreateInfo = vk::BufferCreateInfo{}
+			.setSize(std::max<vk::DeviceSize>(stagingSize, 1))
+			.setUsage(vk::BufferUsageFlagBits::eTransferSrc)
+			.setSharingMode(vk::SharingMode::eExclusive);
+
+		// mapped until the upload is released
+		VmaAllocationCreateInfo vmaAllocCreateInfo = {};
+		vmaAllocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_ONLY;
+		vmaAllocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		upload.staging = UniqueVmaBuffer(m_allocator, stagingBufferCreateInfo, vmaAllocCreateInfo);
+
+		VmaAllocationInfo stagingAllocationInfo;
+		vmaGetAllocationInfo(m_allocator, upload.staging.GetAllocation(), &stagingAllocationInfo);
+
+		staging.buffer = upload.staging.Get();
+		staging.mappedMemory = static_cast<std::byte*>(stagingAllocationInfo.pMappedData);
+	}
+
+	upload.commandBuffer = CbUtils::AllocateSingle(m_device, m_commandPool.get());
+	upload.commandBuffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	recordFunction(staging, upload.commandBuffer.get());
+	upload.commandBuffer->end();
+
+	upload.fence = m_device.createFenceUnique(vk::FenceCreateInfo{});
+	m_transferQueue.submit(vk::SubmitInfo{}
+		.setCommandBufferCount(1)
+		.setPCommandBuffers(&(upload.commandBuffer.get())), upload.fence.get());
+
+	m_pendingUploads.push_back(std::move(upload));
+	return m_lastTicket;
+}
+
+void AsyncUploader::Poll(uint64_t timeoutNanoseconds)
+{
+	if (m_pendingUploads.empty())
+	{
+		return;
+	}
+
+	if (timeoutNanoseconds > 0)
+	{
+		// a timeout is no error, the upload is still pending then
+		m_device.waitForFences(m_pendingUploads.front().fence.get(), true, timeoutNanoseconds);
+	}
+
+	// stops at the first pending upload, so the completed tickets stay in order and the ring staging is released in the order of its allocation
+	while (!m_pendingUploads.empty() && m_device.getFenceStatus(m_pendingUploads.front().fence.get()) == vk::Result::eSuccess)
+	{
+		const PendingUpload& upload = m_pendingUploads.front();
+		if (upload.ringStaging)
+		{
+			m_uploadRing->ReleaseStaging(*upload.ringStaging);
+		}
+		m_completedTicket = upload.ticket;
+		m_pendingUploads.pop_front();
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <gsl/gsl>
+#include <array>
+#include <deque>
+#include <functional>
+#include <optional>
+#include "UniqueVmaObject.hpp"
+#include "UploadRingBuffer.hpp"
+
+// copies data into device local buffers and images without waiting for the copy
+// the uploads go to a transfer queue, which is of its own family if the device has one, so they run beside the rendering
+// each upload has its staging in the staging ring of the upload ring buffer, a command buffer and a fence, which are released by the first Poll after the upload finished
+// staging that doesn't fit into the free part of the ring gets a buffer of its own
+class AsyncUploader
+{
+public:
+	// uploads finish in the order they were submitted, so a ticket also stands for all previous uploads
+	using Ticket = uint64_t;
+	static constexpr Ticket noUpload = 0;
+
+	// the staging starts at offset in buffer, mappedMemory points to that offset
+	struct Staging
+	{
+		vk::Buffer buffer;
+		vk::DeviceSize offset = 0;
+		std::byte* mappedMemory = nullptr;
+	};
+
+	// writes the data into the mapped staging buffer and records the copies from it
+	using RecordFunction = std::function<void(const Staging&, vk::CommandBuffer)>;
+
+	// uploadRing has to outlive the uploader and to be shared with transferFamilyIndex
+	AsyncUploader(vk::Device device, VmaAllocator allocator, UploadRingBuffer& uploadRing, vk::Queue transferQueue, uint32_t transferFamilyIndex, uint32_t graphicsFamilyIndex);
+
+	// waits for the pending uploads
+	~AsyncUploader();
+
+	AsyncUploader(const AsyncUploader&) = delete;
+	AsyncUploader& operator=(const AsyncUploader&) = delete;
+
+	// the buffers and images written by the uploads are read by the graphics queue
+	// with a transfer queue of another family they are shared concurrently, so they need no ownership transfer
+	vk::SharingMode GetDestinationSharingMode() const;
+	gsl::span<const uint32_t> GetDestinationQueueFamilies() const;
+
+	// the command buffer is begun before and submitted right after recordFunction
+	// the transfer queue can't use the graphics stages, so the barriers of recordFunction end at the transfer or bottom of pipe stage
+	Ticket Upload(vk::DeviceSize stagingSize, const RecordFunction& recordFunction);
+
+	// releases the finished uploads, waits at most timeoutNanoseconds for the oldest one
+	void Poll(uint64_t timeoutNanoseconds = 0);
+
+	// whether the upload finished as of the last Poll, its destination can be used by the graphics queue then
+	bool IsComplete(Ticket ticket) const { return ticket <= m_completedTicket; }
+
+	bool HasDedicatedQueue() const { return m_queueFamilyIndices[0] != m_queueFamilyIndices[1]; }
+
+private:
+	struct PendingUpload
+	{
+		Ticket ticket;
+
+		// one of them holds the staging
+		std::optional<UploadRingBuffer::Allocation> ringStaging;
+		UniqueVmaBuffer staging;
+		vk::UniqueCommandBuffer commandBuffer;
+		vk::UniqueFence fence;
+	};
+
+	vk::Device m_device;
+	VmaAllocator m_allocator;
+	UploadRingBuffer* m_uploadRing;
+	vk::Queue m_transferQueue;
+
+	// transfer family, graphics family
+	std::array<uint32_t, 2> m_queueFamilyIndices;
+
+	vk::UniqueCommandPool m_commandPool;
+
+	// in the order of their tickets
+	std::deque<PendingUpload> m_pendingUploads;
+	Ticket m_lastTicket = noUpload;
+	Ticket m_completedTicket = noUpload;
+};
@@ -0,0 +1,270 @@
+#include "pch.hpp"
+#include "BenchmarkRun.hpp"
+#include <cstdio>
+#include <numeric>
+
+namespace
+{
+	struct Statistics
+	{
+		double average;
+		double median;
+		double percentile90;
+		double percentile99;
+		double min;
+		double max;
+	};
+
+	Statistics CalcStatistics(std::vector<double> seconds)
+	{
+		Statistics statistics;
+		statistics.average = std::accumulate(seconds.begin(), seconds.end(), 0.0) / seconds.size();
+		const auto [minIter, maxIter] = std::minmax_element(seconds.begin(), seconds.end());
+		statistics.min = *minIter;
+		statistics.max = *maxIter;
+		statistics.median = BenchmarkRun::CalcMedian(seconds);
+		statistics.percentile90 = BenchmarkRun::CalcPercentile(seconds, 0.9);
+		statistics.percentile99 = BenchmarkRun::CalcPercentile(seconds, 0.99);
+		return statistics;
+	}
+
+	void WriteStatistics(std::FILE* file, const char* name, const Statistics& statistics)
+	{
+		std::fprintf(file,
+			"\t\t\t\"%s\": { \"average\": %f, \"median\": %f, \"p90\": %f, \"p99\": %f, \"min\": %f, \"max\": %f }",
+			name,
+			statistics.average * 1000.0,
+			statistics.median * 1000.0,
+			statistics.percentile90 * 1000.0,
+			statistics.percentile99 * 1000.0,
+			statistics.min * 1000.0,
+			statistics.max * 1000.0);
+	}
+
+	// one entry per recursion layer, each with the statistics of the frames which rendered the layer
+	void WriteLayerStatistics(std::FILE* file, const char* name, const std::vector<std::vector<double>>& layerSeconds)
+	{
+		std::fprintf(file, "\t\t\t\"%s\": [", name);
+		for (size_t layerIndex = 0; layerIndex < layerSeconds.size(); ++layerIndex)
+		{
+			const Statistics statistics = CalcStatistics(layerSeconds[layerIndex]);
+			std::fprintf(file, "%s\n\t\t\t\t{ \"average\": %f, \"median\": %f, \"p90\": %f, \"max\": %f }",
+				layerIndex == 0 ? "" : ",",
+				statistics.average * 1000.0,
+				statistics.median * 1000.0,
+				statistics.percentile90 * 1000.0,
+				statistics.max * 1000.0);
+		}
+		std::fprintf(file, "\n\t\t\t]");
+	}
+
+	std::string EscapeJson(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+			}
+			escaped += c;
+		}
+		return escaped;
+	}
+}
+
+BenchmarkRun::BenchmarkRun(CameraPath cameraPath, std::vector<std::vector<int>> recursionConfigs, const Settings& settings)
+	: m_cameraPath(std::move(cameraPath))
+	, m_recursionConfigs(std::move(recursionConfigs))
+	, m_settings(settings)
+	, m_frameTimes(m_recursionConfigs.size())
+{
+	assert(m_settings.measuredFrameCount > 0);
+	for (std::vector<FrameTimes>& configFrameTimes : m_frameTimes)
+	{
+		configFrameTimes.reserve(m_settings.measuredFrameCount);
+	}
+}
+
+bool BenchmarkRun::PrepareFrame(Camera& camera) const
+{
+	assert(!IsFinished());
+
+	// warmup frames stay at the start of the path
+	const int measuredFrameIndex = std::max(m_frameIndex - m_settings.warmupFrameCount, 0);
+	const float t = m_settings.measuredFrameCount > 1
+		? static_cast<float>(measuredFrameIndex) / static_cast<float>(m_settings.measuredFrameCount - 1)
+		: 0.f;
+	m_cameraPath.Apply(t, camera);
+
+	return m_frameIndex == 0;
+}
+
+void BenchmarkRun::AddFrameTimes(const FrameTimes& frameTimes)
+{
+	assert(!IsFinished());
+
+	if (m_frameIndex >= m_settings.warmupFrameCount)
+	{
+		m_frameTimes[m_configIndex].push_back(frameTimes);
+	}
+
+	++m_frameIndex;
+	if (m_frameIndex == m_settings.warmupFrameCount + m_settings.measuredFrameCount)
+	{
+		m_frameIndex = 0;
+		++m_configIndex;
+	}
+}
+
+bool BenchmarkRun::WriteResults(const std::string& outputPrefix, const std::string& description) const
+{
+	{
+		std::FILE* csvFile = std::fopen((outputPrefix + ".csv").c_str(), "w");
+		if (!csvFile)
+		{
+			return false;
+		}
+
+		// gpu_ms stays empty without timestamps
+		std::fprintf(csvFile, "config,frame,cpu_ms,gpu_wait_ms,total_ms,gpu_ms\n");
+		for (size_t configIndex = 0; configIndex < m_frameTimes.size(); ++configIndex)
+		{
+			const std::string configName = ConfigName(m_recursionConfigs[configIndex]);
+			for (size_t frame = 0; frame < m_frameTimes[configIndex].size(); ++frame)
+			{
+				const FrameTimes& frameTimes = m_frameTimes[configIndex][frame];
+				std::fprintf(csvFile, "%s,%zu,%f,%f,%f,", configName.c_str(), frame,
+					frameTimes.cpuSeconds * 1000.0,
+					frameTimes.gpuWaitSeconds * 1000.0,
+					(frameTimes.cpuSeconds + frameTimes.gpuWaitSeconds) * 1000.0);
+				if (frameTimes.gpuTimings)
+				{
+					std::fprintf(csvFile, "%f", frameTimes.gpuTimings->frameSeconds * 1000.0);
+				}
+				std::fprintf(csvFile, "\n");
+			}
+		}
+		std::fclose(csvFile);
+	}
+
+	std::FILE* jsonFile = std::fopen((outputPrefix + ".json").c_str(), "w");
+	if (!jsonFile)
+	{
+		return false;
+	}
+
+	std::fprintf(jsonFile, "{\n");
+	std::fprintf(jsonFile, "\t\"description\": \"%s\",\n", EscapeJson(description).c_str());
+	std::fprintf(jsonFile, "\t\"cameraPathKeys\": %d,\n", m_cameraPath.GetKeyCount());
+	std::fprintf(jsonFile, "\t\"warmupFrames\": %d,\n", m_settings.warmupFrameCount);
+	std::fprintf(jsonFile, "\t\"measuredFrames\": %d,\n", m_settings.measuredFrameCount);
+	std::fprintf(jsonFile, "\t\"unit\": \"ms\",\n");
+	std::fprintf(jsonFile, "\t\"configs\": [");
+	bool isFirstConfig = true;
+	for (size_t configIndex = 0; configIndex < m_frameTimes.size(); ++configIndex)
+	{
+		// configs which were not reached have no frames
+		const std::vector<FrameTimes>& configFrameTimes = m_frameTimes[configIndex];
+		if (configFrameTimes.empty())
+		{
+			continue;
+		}
+
+		std::vector<double> cpuSeconds;
+		std::vector<double> gpuWaitSeconds;
+		std::vector<double> totalSeconds;
+		std::vector<double> gpuSeconds;
+		std::vector<std::vector<double>> sceneLayerSeconds;
+		std::vector<std::vector<double>> portalLayerSeconds;
+		for (const FrameTimes& frameTimes : configFrameTimes)
+		{
+			cpuSeconds.push_back(frameTimes.cpuSeconds);
+			gpuWaitSeconds.push_back(frameTimes.gpuWaitSeconds);
+			totalSeconds.push_back(frameTimes.cpuSeconds + frameTimes.gpuWaitSeconds);
+
+			if (!frameTimes.gpuTimings)
+			{
+				continue;
+			}
+
+			const GpuFrameTimings& gpuTimings = *frameTimes.gpuTimings;
+			gpuSeconds.push_back(gpuTimings.frameSeconds);
+
+			const size_t layerCount = gpuTimings.sceneSubpassSeconds.size();
+			sceneLayerSeconds.resize(std::max(sceneLayerSeconds.size(), layerCount));
+			portalLayerSeconds.resize(std::max(portalLayerSeconds.size(), layerCount));
+			for (size_t layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+			{
+				sceneLayerSeconds[layerIndex].push_back(gpuTimings.sceneSubpassSeconds[layerIndex]);
+				portalLayerSeconds[layerIndex].push_back(gpuTimings.portalSubpassSeconds[layerIndex]);
+			}
+		}
+
+		std::fprintf(jsonFile, "%s\n\t\t{\n", isFirstConfig ? "" : ",");
+		isFirstConfig = false;
+		std::fprintf(jsonFile, "\t\t\t\"config\": \"%s\",\n", ConfigName(m_recursionConfigs[configIndex]).c_str());
+		WriteStatistics(jsonFile, "cpu", CalcStatistics(std::move(cpuSeconds)));
+		std::fprintf(jsonFile, ",\n");
+		WriteStatistics(jsonFile, "gpuWait", CalcStatistics(std::move(gpuWaitSeconds)));
+		std::fprintf(jsonFile, ",\n");
+		WriteStatistics(jsonFile, "total", CalcStatistics(std::move(totalSeconds)));
+		if (!gpuSeconds.empty())
+		{
+			std::fprintf(jsonFile, ",\n");
+			WriteStatistics(jsonFile, "gpu", CalcStatistics(std::move(gpuSeconds)));
+		}
+		if (!sceneLayerSeconds.empty())
+		{
+			std::fprintf(jsonFile, ",\n");
+			WriteLayerStatistics(jsonFile, "gpuScenePasses", sceneLayerSeconds);
+			std::fprintf(jsonFile, ",\n");
+			WriteLayerStatistics(jsonFile, "gpuPortalPasses", portalLayerSeconds);
+		}
+		std::fprintf(jsonFile, "\n\t\t}");
+	}
+	std::fprintf(jsonFile, "\n\t]\n}\n");
+	std::fclose(jsonFile);
+
+	return true;
+}
+
+std::string BenchmarkRun::ConfigName(gsl::span<const int> recursionConfig)
+{
+	if (recursionConfig.empty())
+	{
+		return "none";
+	}
+
+	std::string name = std::to_string(recursionConfig[0]);
+	for (gsl::index i = 1; i < recursionConfig.size(); ++i)
+	{
+		name += '-' + std::to_string(recursionConfig[i]);
+	}
+	return name;
+}
+
+double BenchmarkRun::CalcMedian(gsl::span<double> range)
+{
+	const auto size = range.size();
+	auto n = size / 2;
+	int remainder = size % 2;
+
+	std::nth_element(range.begin(), range.begin() + n, range.end());
+	auto med = range[n];
+	if (remainder == 0) {
+		auto max_it = std::max_element(range.begin(), range.begin() + n);
+		med = (*max_it + med) / 2.0;
+	}
+	return med;
+}
+
+double BenchmarkRun::CalcPercentile(gsl::span<double> range, double percentile)
+{
+	// nearest rank, the smallest value which is greater or equal to the given fraction of the values
+	const gsl::index rank = static_cast<gsl::index>(std::ceil(percentile * range.size()));
+	const gsl::index index = std::clamp<gsl::index>(rank - 1, 0, range.size() - 1);
+
+	std::nth_element(range.begin(), range.begin() + index, range.end());
+	return range[index];
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "CameraPath.hpp"
+#include "GpuTimestamps.hpp"
+#include <gsl/gsl>
+#include <string>
+#include <vector>
+
+// plays the camera path once for each recursion config and collects the frame times of each frame
+// the camera only depends on the frame index, not on the measured time, so runs are reproducible and can be compared between builds
+class BenchmarkRun
+{
+public:
+	struct Settings
+	{
+		// frames rendered at the start of the path before measuring a config, they fill the frames in flight and the reused visibility
+		int warmupFrameCount = 32;
+		int measuredFrameCount = 512;
+	};
+
+	struct FrameTimes
+	{
+		// time spent recording and submitting on the cpu, without the fence, acquire and present waits
+		double cpuSeconds;
+
+		// time the cpu waited for the gpu to finish the frame in flight
+		double gpuWaitSeconds;
+
+		// see GraphicsBackend::GetLastGpuFrameTimings, they belong to an earlier frame, which the warmup frames make up for
+		std::optional<GpuFrameTimings> gpuTimings;
+	};
+
+	BenchmarkRun(CameraPath cameraPath, std::vector<std::vector<int>> recursionConfigs, const Settings& settings);
+
+	bool IsFinished() const { return m_configIndex == m_recursionConfigs.size(); }
+
+	// moves the camera to the next frame, returns true if the frame starts a new recursion config
+	bool PrepareFrame(Camera& camera) const;
+
+	// the returned span is valid as long as the run lives
+	gsl::span<const int> GetRecursionConfig() const { return m_recursionConfigs[m_configIndex]; }
+
+	// advances to the next frame, the times of warmup frames are dropped
+	void AddFrameTimes(const FrameTimes& frameTimes);
+
+	// <outputPrefix>.csv has one line per measured frame, <outputPrefix>.json the statistics of each config
+	// description is written into the json, so results of different builds and machines can be told apart
+	bool WriteResults(const std::string& outputPrefix, const std::string& description) const;
+
+	// name of a recursion config, the visible portals of each layer joined with '-'
+	static std::string ConfigName(gsl::span<const int> recursionConfig);
+
+	// both reorder the range
+	static double CalcMedian(gsl::span<double> range);
+	static double CalcPercentile(gsl::span<double> range, double percentile);
+
+private:
+	CameraPath m_cameraPath;
+	std::vector<std::vector<int>> m_recursionConfigs;
+	Settings m_settings;
+
+	size_t m_configIndex = 0;
+	int m_frameIndex = 0;
+
+	// [configIndex][measured frame]
+	std::vector<std::vector<FrameTimes>> m_frameTimes;
+};
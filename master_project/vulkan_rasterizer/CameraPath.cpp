@@ -0,0 +1,73 @@
+#include "pch.hpp"
+#include "CameraPath.hpp"
+#include "Camera.hpp"
+#include "gtx/spline.hpp"
+#include <fstream>
+#include <sstream>
+
+CameraPath::CameraPath(std::vector<Key> keys)
+	: m_keys(std::move(keys))
+{
+	assert(!m_keys.empty());
+}
+
+std::optional<CameraPath> CameraPath::LoadFromFile(const char* fileName)
+{
+	std::ifstream file(fileName);
+	if (!file.is_open())
+	{
+		return std::nullopt;
+	}
+
+	std::vector<Key> keys;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		Key key;
+		std::istringstream lineStream(line);
+		if (lineStream
+			>> key.position.x >> key.position.y >> key.position.z
+			>> key.direction.x >> key.direction.y >> key.direction.z)
+		{
+			keys.push_back(key);
+		}
+	}
+
+	if (keys.empty())
+	{
+		return std::nullopt;
+	}
+	return CameraPath(std::move(keys));
+}
+
+void CameraPath::Apply(float t, Camera& camera) const
+{
+	const int keyCount = GetKeyCount();
+
+	glm::vec3 position = m_keys[0].position;
+	glm::vec3 direction = m_keys[0].direction;
+	if (keyCount > 1)
+	{
+		const float segment = glm::clamp(t, 0.f, 1.f) * static_cast<float>(keyCount - 1);
+		const int segmentIndex = std::min(static_cast<int>(segment), keyCount - 2);
+		const float segmentT = segment - static_cast<float>(segmentIndex);
+
+		// the end keys are repeated, so the spline starts and ends at them
+		const Key& before = m_keys[std::max(segmentIndex - 1, 0)];
+		const Key& start = m_keys[segmentIndex];
+		const Key& end = m_keys[segmentIndex + 1];
+		const Key& after = m_keys[std::min(segmentIndex + 2, keyCount - 1)];
+
+		position = glm::catmullRom(before.position, start.position, end.position, after.position, segmentT);
+		direction = glm::mix(start.direction, end.direction, segmentT);
+	}
+
+	camera.m_coordinateSystem = glm::mat4(1.f);
+	camera.SetPosition(position);
+	camera.LookDir(glm::normalize(direction), glm::vec3(0.f, 1.f, 0.f));
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "glm.hpp"
+#include <optional>
+#include <vector>
+
+class Camera;
+
+// camera keys played back by benchmark runs, the positions follow a catmull rom spline through the keys
+// directions are interpolated linearly, the up vector is always +y
+class CameraPath
+{
+public:
+	struct Key
+	{
+		glm::vec3 position;
+		glm::vec3 direction;
+	};
+
+	// needs at least one key
+	explicit CameraPath(std::vector<Key> keys);
+
+	// one key per line: position x y z and direction x y z, empty lines and lines starting with # are skipped
+	// returns nullopt if the file can't be read or contains no keys
+	static std::optional<CameraPath> LoadFromFile(const char* fileName);
+
+	// t goes from 0 (first key) to 1 (last key), the camera is moved in world space, previous portal teleports are dropped
+	void Apply(float t, Camera& camera) const;
+
+	int GetKeyCount() const { return static_cast<int>(m_keys.size()); }
+
+private:
+	std::vector<Key> m_keys;
+};
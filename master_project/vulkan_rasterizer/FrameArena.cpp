@@ -0,0 +1,39 @@
+#include "pch.hpp"
+#include "FrameArena.hpp"
+
+FrameArena::FrameArena(size_t initialCapacity)
+	: m_buffer(initialCapacity > 0 ? std::make_unique<std::byte[]>(initialCapacity) : nullptr)
+	, m_capacity(initialCapacity)
+{
+}
+
+void FrameArena::Reset()
+{
+	// the alignment padding of the overflow allocations is included, so the same allocations fit next time
+	if (m_overflowBytes > 0)
+	{
+		m_capacity = m_usedBytes + m_overflowBytes;
+		m_buffer = std::make_unique<std::byte[]>(m_capacity);
+		m_overflowBlocks.clear();
+		m_overflowBytes = 0;
+	}
+
+	m_usedBytes = 0;
+}
+
+void* FrameArena::AllocateBytes(size_t size, size_t alignment)
+{
+	// the buffer and the blocks are only aligned for the fundamental types
+	assert(alignment <= alignof(std::max_align_t));
+
+	const size_t alignedOffset = (m_usedBytes + alignment - 1) / alignment * alignment;
+	if (m_overflowBlocks.empty() && alignedOffset + size <= m_capacity)
+	{
+		m_usedBytes = alignedOffset + size;
+		return m_buffer.get() + alignedOffset;
+	}
+
+	m_overflowBytes += size + alignment - 1;
+	m_overflowBlocks.push_back(std::make_unique<std::byte[]>(std::max<size_t>(size, 1)));
+	return m_overflowBlocks.back().get();
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <gsl/gsl>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// bump allocator for data which only lives until the next Reset, usually the end of the frame
+// allocations which don't fit get their own block and the next Reset grows the buffer to fit all of them,
+// so an arena which is reset every frame stops allocating once it has seen its largest frame
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t initialCapacity = 0);
+
+	// value initialized, the arena never calls destructors
+	template<typename T>
+	gsl::span<T> Allocate(size_t count)
+	{
+		static_assert(std::is_trivially_destructible_v<T>, "the elements are never destroyed");
+
+		T* elements = static_cast<T*>(AllocateBytes(count * sizeof(T), alignof(T)));
+		std::uninitialized_value_construct_n(elements, count);
+		return gsl::make_span(elements, count);
+	}
+
+	// invalidates all allocations
+	void Reset();
+
+	size_t GetCapacity() const { return m_capacity; }
+
+private:
+	void* AllocateBytes(size_t size, size_t alignment);
+
+	std::unique_ptr<std::byte[]> m_buffer;
+	size_t m_capacity = 0;
+	size_t m_usedBytes = 0;
+
+	// the allocations since the last Reset which did not fit into the buffer
+	std::vector<std::unique_ptr<std::byte[]>> m_overflowBlocks;
+	size_t m_overflowBytes = 0;
+};
@@ -0,0 +1,72 @@
+#include "pch.hpp"
+#include "GpuTimestamps.hpp"
+
+GpuTimestamps::GpuTimestamps(vk::Device device, vk::PhysicalDevice physicalDevice, uint32_t queueFamilyIndex, int frameCount, uint32_t queriesPerFrame)
+	: m_device(device)
+	, m_queriesPerFrame(queriesPerFrame)
+{
+	const uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+	if (validBits == 0)
+	{
+		return;
+	}
+
+	m_validBitsMask = validBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << validBits) - 1;
+
+	// timestampPeriod is in nanoseconds per tick
+	m_secondsPerTick = physicalDevice.getProperties().limits.timestampPeriod * 1e-9;
+
+	const vk::QueryPoolCreateInfo queryPoolCreateInfo = vk::QueryPoolCreateInfo{}
+		.setQueryType(vk::QueryType::eTimestamp)
+		.setQueryCount(queriesPerFrame);
+
+	for (int i = 0; i < frameCount; ++i)
+	{
+		m_queryPools.push_back(device.createQueryPoolUnique(queryPoolCreateInfo));
+	}
+
+	m_ticks.resize(queriesPerFrame);
+}
+
+void GpuTimestamps::Reset(vk::CommandBuffer commandBuffer, int frameIndex) const
+{
+	if (IsSupported())
+	{
+		commandBuffer.resetQueryPool(m_queryPools[frameIndex].get(), 0, m_queriesPerFrame);
+	}
+}
+
+void GpuTimestamps::Write(vk::CommandBuffer commandBuffer, int frameIndex, uint32_t queryIndex, vk::PipelineStageFlagBits stage) const
+{
+	assert(queryIndex < m_queriesPerFrame);
+	if (IsSupported())
+	{
+		commandBuffer.writeTimestamp(stage, m_queryPools[frameIndex].get(), queryIndex);
+	}
+}
+
+bool GpuTimestamps::Read(int frameIndex, gsl::span<double> outSeconds)
+{
+	const uint32_t queryCount = gsl::narrow<uint32_t>(outSeconds.size());
+	assert(queryCount <= m_queriesPerFrame);
+	if (!IsSupported() || queryCount == 0)
+	{
+		return false;
+	}
+
+	// without the wait flag, eNotReady instead of a stall if the frame was never submitted
+	const vk::Result result = m_device.getQueryPoolResults(m_queryPools[frameIndex].get(), 0, queryCount,
+		queryCount * sizeof(uint64_t), m_ticks.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+
+	if (result != vk::Result::eSuccess)
+	{
+		return false;
+	}
+
+	// masked difference, so a counter wrapping around between the queries still gives the right duration
+	for (uint32_t i = 0; i < queryCount; ++i)
+	{
+		outSeconds[i] = static_cast<double>((m_ticks[i] - m_ticks[0]) & m_validBitsMask) * m_secondsPerTick;
+	}
+	return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <gsl/gsl>
+#include <vector>
+
+struct GpuFrameTimings
+{
+	// from the start of the command buffer to the end of the last render pass
+	double frameSeconds = 0.0;
+
+	// only the breadth first renderer, the buffer fills and the culling before the render pass
+	double setupSeconds = 0.0;
+
+	// only the breadth first renderer, one element per rendered recursion layer
+	std::vector<double> sceneSubpassSeconds;
+	std::vector<double> portalSubpassSeconds;
+};
+
+// a timestamp query pool for each frame in flight
+// the results of a frame are read after its fence was waited for, so reading never stalls
+class GpuTimestamps
+{
+public:
+	GpuTimestamps() = default;
+
+	// stays unsupported if the queue family has no timestamps
+	GpuTimestamps(vk::Device device, vk::PhysicalDevice physicalDevice, uint32_t queueFamilyIndex, int frameCount, uint32_t queriesPerFrame);
+
+	bool IsSupported() const { return !m_queryPools.empty(); }
+
+	// outside of a render pass, before the first Write of the frame
+	void Reset(vk::CommandBuffer commandBuffer, int frameIndex) const;
+
+	// the time at which all previous commands finished the stage, can be recorded into secondary command buffers
+	void Write(vk::CommandBuffer commandBuffer, int frameIndex, uint32_t queryIndex,
+		vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eBottomOfPipe) const;
+
+	// the frame fence has to be waited for, the first outSeconds.size() queries have to be written
+	// writes the seconds of each query relative to the first one, returns false if a result is not available
+	bool Read(int frameIndex, gsl::span<double> outSeconds);
+
+private:
+	vk::Device m_device;
+	double m_secondsPerTick = 0.0;
+	uint64_t m_validBitsMask = 0;
+	uint32_t m_queriesPerFrame = 0;
+	std::vector<vk::UniqueQueryPool> m_queryPools;
+
+	// the ticks of a Read, kept so reading does not allocate
+	std::vector<uint64_t> m_ticks;
+};
@@ -14,10 +14,12 @@
 #include "Camera.hpp"
 #include "UniformBufferObjects.hpp"
 #include "ShaderSpecialisation.hpp"
-#include "UniqueVmaMemoryMap.hpp"
 #include "RecursionTree.hpp"
 #include "LevelLoader.hpp"
 #include "Hsv.hpp"
+#include "PngWriter.hpp"
+#include "Profiler.hpp"
+#include "AllocationTracker.hpp"
 
 namespace
 {
@@ -87,11 +89,41 @@ namespace
 		};
 	}
 
+	const std::array<float, 4> backgroundColor = { 100.f / 255.f, 149.f / 255.f, 237.f / 255.f, 1.f };
+
+	// the buffer has to be created with VMA_ALLOCATION_CREATE_MAPPED_BIT, it stays mapped for its whole lifetime
+	const void* GetMappedMemory(const UniqueVmaBuffer& buffer)
+	{
+		VmaAllocationInfo allocationInfo;
+		vmaGetAllocationInfo(buffer.GetAllocator(), buffer.GetAllocation(), &allocationInfo);
+		assert(allocationInfo.pMappedData);
+		return allocationInfo.pMappedData;
+	}
+
+	// converts screen bounds in normalized device coordinates to pixels, rounding outwards
+	vk::Rect2D ScreenBoundsToRect(const glm::vec4& screenBounds, vk::Extent2D extent)
+	{
+		const glm::vec2 extentPixels(static_cast<float>(extent.width), static_cast<float>(extent.height));
+		const glm::vec2 minPixels = glm::clamp(glm::floor((glm::vec2(screenBounds.x, screenBounds.y) * 0.5f + 0.5f) * extentPixels), glm::vec2(0.f), extentPixels);
+		const glm::vec2 maxPixels = glm::clamp(glm::ceil((glm::vec2(screenBounds.z, screenBounds.w) * 0.5f + 0.5f) * extentPixels), glm::vec2(0.f), extentPixels);
+
+		// empty bounds result in an empty rect
+		const glm::vec2 sizePixels = glm::max(maxPixels - minPixels, glm::vec2(0.f));
+
+		return vk::Rect2D(
+			vk::Offset2D(static_cast<int32_t>(minPixels.x), static_cast<int32_t>(minPixels.y)),
+			vk::Extent2D(static_cast<uint32_t>(sizePixels.x), static_cast<uint32_t>(sizePixels.y)));
+	}
 }
 
 
-void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
+void GraphicsBackend::Init(SDL_Window* window, vk::Extent2D extent, Camera& camera, RendererType rendererType)
 {
+	PROFILE_SCOPE("GraphicsBackend::Init");
+	const AllocationTracker::Scope allocationScope(AllocationTracker::Subsystem::Loading);
+
+	const bool isHeadless = window == nullptr;
+
 	const char* enabledValidationLayers[] =
 	{
 		// Enable standard validation layer to find as much errors as possible!
@@ -99,29 +131,39 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		"VK_LAYER_LUNARG_standard_validation"
 	};
 
-	std::vector<const char*> enabledExtensions = GetSdlExtensions(window);
-	const char* additonalExtensions[] = {
-		VK_EXT_DEBUG_UTILS_EXTENSION_NAME,
-
-	};
-
-	enabledExtensions.insert(enabledExtensions.end(), std::begin(additonalExtensions), std::end(additonalExtensions));
-
+	std::vector<const char*> enabledExtensions = isHeadless ? std::vector<const char*>{} : GetSdlExtensions(window);
 
-	assert(VulkanUtils::SupportsValidationLayers(enabledValidationLayers));
+	// build servers often have no validation layers installed, headless runs go on without them
+	const bool useValidationLayers = !isHeadless || VulkanUtils::SupportsValidationLayers(enabledValidationLayers);
+	assert(!useValidationLayers || VulkanUtils::SupportsValidationLayers(enabledValidationLayers));
+	const gsl::span<const char*> validationLayers = useValidationLayers ? gsl::make_span(enabledValidationLayers) : gsl::span<const char*>{};
 
-	m_vkInstance = CreateVulkanInstance("Vulkan Rasterizer", enabledValidationLayers, enabledExtensions);
-	VulkanDebug::LoadDebugUtilsExtension(m_vkInstance.get());
+	// messages, object names and labels are only for debugging, drivers without the extension render the same
+	m_hasDebugUtils = VulkanUtils::SupportsInstanceExtension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME, validationLayers);
+	if (m_hasDebugUtils)
+	{
+		enabledExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	}
 
-	m_debugUtilsMessenger = DebugUtils::CreateDebugUtilsMessenger(m_vkInstance.get());
-	m_surface = CreateSurface(m_vkInstance.get(), window);
+	m_vkInstance = CreateVulkanInstance("Vulkan Rasterizer", validationLayers, enabledExtensions);
+	if (m_hasDebugUtils)
+	{
+		VulkanDebug::LoadDebugUtilsExtension(m_vkInstance.get());
+		m_debugUtilsMessenger = DebugUtils::CreateDebugUtilsMessenger(m_vkInstance.get());
+	}
+	if (!isHeadless)
+	{
+		m_surface = CreateSurface(m_vkInstance.get(), window);
+	}
 
-	const char* deviceExtensions[] = {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-	};
+	std::vector<const char*> deviceExtensions;
+	if (!isHeadless)
+	{
+		deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
 
 	VulkanDevice::QueueRequirement queueRequirement[1];
-	queueRequirement[0].canPresent = true;
+	queueRequirement[0].canPresent = !isHeadless;
 	queueRequirement[0].mincount = 1;
 	queueRequirement[0].minFlags = vk::QueueFlagBits::eGraphics;
 
@@ -132,15 +174,64 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		.setSamplerAnisotropy(true)
 		.setVertexPipelineStoresAndAtomics(true)
 		.setFragmentStoresAndAtomics(true)
+		.setMultiDrawIndirect(true)
+		.setDrawIndirectFirstInstance(true)
+		.setShaderClipDistance(true)
 		;
 
 	std::optional<VulkanDevice::PickDeviceResult> maybeDeviceResult =
-		VulkanDevice::PickPhysicalDevice(m_vkInstance.get(), deviceRequirements, &(m_surface.get()));
+		VulkanDevice::PickPhysicalDevice(m_vkInstance.get(), deviceRequirements, isHeadless ? nullptr : &(m_surface.get()));
 
-	assert(maybeDeviceResult);
+	if (!maybeDeviceResult)
+	{
+		throw std::runtime_error("no vulkan device fulfills the requirements");
+	}
 	m_physicalDevice = maybeDeviceResult->device;
+	std::printf("device: %s \n", m_physicalDevice.getProperties().deviceName);
+	std::cout.flush();
+
+	// exporting the stencil value from the portal shader is optional, without it we only use the stencil attachments
+	std::vector<const char*> enabledDeviceExtensions = deviceExtensions;
+	{
+		const std::vector<vk::ExtensionProperties> availableExtensions = m_physicalDevice.enumerateDeviceExtensionProperties();
+		m_supportsStencilExport = std::any_of(availableExtensions.begin(), availableExtensions.end(),
+			[](const vk::ExtensionProperties& extension) { return std::strcmp(extension.extensionName, VK_EXT_SHADER_STENCIL_EXPORT_EXTENSION_NAME) == 0; });
+
+		if (m_supportsStencilExport)
+		{
+			enabledDeviceExtensions.push_back(VK_EXT_SHADER_STENCIL_EXPORT_EXTENSION_NAME);
+		}
+	}
+
+	// pipeline statistics are optional as well, see DrawOptions::collectLayerStatistics
+	vk::PhysicalDeviceFeatures enabledFeatures = deviceRequirements.requiredFeatures;
+	enabledFeatures.setPipelineStatisticsQuery(m_physicalDevice.getFeatures().pipelineStatisticsQuery);
+
+	// a queue family with transfer but without graphics and compute is usually backed by a copy engine, the uploads run beside the rendering there
+	// without one the uploads go to the graphics queue
+	std::vector<VulkanDevice::QueueResult> queueResults = maybeDeviceResult->queueResult;
+	{
+		const std::vector<vk::QueueFamilyProperties> queueFamilies = m_physicalDevice.getQueueFamilyProperties();
+		for (uint32_t familyIndex = 0; familyIndex < queueFamilies.size(); ++familyIndex)
+		{
+			const vk::QueueFlags flags = queueFamilies[familyIndex].queueFlags;
+			if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))
+				&& queueFamilies[familyIndex].queueCount > 0)
+			{
+				VulkanDevice::QueueResult transferQueueResult = {};
+				transferQueueResult.familyIndex = familyIndex;
+				transferQueueResult.count = 1;
+				transferQueueResult.offset = 0;
+				transferQueueResult.flags = flags;
+				transferQueueResult.canPresent = false;
+				queueResults.push_back(transferQueueResult);
+				break;
+			}
+		}
+	}
+
 	m_device = VulkanDevice::CreateLogicalDevice(
-		m_physicalDevice, maybeDeviceResult->queueResult, enabledValidationLayers, deviceExtensions, deviceRequirements.requiredFeatures);
+		m_physicalDevice, queueResults, validationLayers, enabledDeviceExtensions, enabledFeatures);
 
 
 	VmaAllocatorCreateInfo vmaAllocCreateInfo = {};
@@ -162,8 +253,44 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		}
 	}
 
+	for (int i = 0; i < MaxInFlightFrames; ++i)
+	{
+
+		m_frameFence[i] = m_device->createFenceUnique(vk::FenceCreateInfo{}.setFlags(vk::FenceCreateFlagBits::eSignaled));
+		m_imageAvailableSem[i] = m_device->createSemaphoreUnique(vk::SemaphoreCreateInfo{});
+		m_renderFinishedSem[i] = m_device->createSemaphoreUnique(vk::SemaphoreCreateInfo{});
+	}
+
+	m_gpuTimestamps = GpuTimestamps(m_device.get(), m_physicalDevice, m_graphicsPresentQueueInfo.familyIndex, MaxInFlightFrames, timestampQueriesPerFrame);
 
-	m_meshData = std::make_unique<MeshDataManager>(m_allocator.get());
+	{
+		// the graphics queue result if there is no transfer family
+		const VulkanDevice::QueueResult& transferQueueInfo = queueResults.back();
+		const bool hasTransferFamily = transferQueueInfo.familyIndex != m_graphicsPresentQueueInfo.familyIndex;
+		const uint32_t uploadQueueFamilies[] = { transferQueueInfo.familyIndex, m_graphicsPresentQueueInfo.familyIndex };
+
+		// the frame regions hold the ubo, camera mats and the camera clip data, which are the screen bounds and clip plane for each camera of the NTree
+		const vk::DeviceSize frameRegionSizes[] = {
+			sizeof(Ubo_GlobalRenderData),
+			cameraMatricesMaxCount * sizeof(glm::mat4),
+			cameraMatricesMaxCount * sizeof(Ssbo_CameraClipData),
+		};
+		static_assert(std::size(frameRegionSizes) == cameraClipDataFrameRegion + 1, "a size for each frame region");
+
+		// enough for the object data and small meshes, larger uploads like the texture get their own staging buffer
+		constexpr vk::DeviceSize stagingSize = 16 * 1024 * 1024;
+		m_uploadRing = UploadRingBuffer(m_allocator.get(), m_physicalDevice.getProperties().limits, MaxInFlightFrames, frameRegionSizes, stagingSize,
+			gsl::make_span(uploadQueueFamilies, hasTransferFamily ? 2 : 1));
+		VulkanDebug::SetObjectName(m_device.get(), m_uploadRing.GetFrameRegion(uboFrameRegion, 0).buffer, "upload ring");
+
+		m_asyncUploader = std::make_unique<AsyncUploader>(m_device.get(), m_allocator.get(), m_uploadRing,
+			m_device->getQueue(transferQueueInfo.familyIndex, transferQueueInfo.offset), transferQueueInfo.familyIndex, m_graphicsPresentQueueInfo.familyIndex);
+
+		std::printf("uploads use %s \n", m_asyncUploader->HasDedicatedQueue() ? "a transfer queue" : "the graphics queue");
+		std::cout.flush();
+	}
+
+	m_meshData = std::make_unique<MeshDataManager>(m_allocator.get(), *m_asyncUploader);
 	m_scene = std::make_unique<Scene>(m_allocator.get());
 	{
 		LevelLoader::LoadLevelResult levelLoadResult = LevelLoader::LoadLevel("level.xml");
@@ -173,6 +300,7 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			camera.SetPosition(levelLoadResult.cameras[0].positon);
 			camera.LookDir(levelLoadResult.cameras[0].direction, glm::vec3(0.f, 1.f, 0.f));
 		}
+		m_levelCameras = levelLoadResult.cameras;
 
 		{
 			std::vector<const char*> objFileNames;
@@ -181,7 +309,7 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 				objFileNames.push_back(levelLoadResult.objFileNames[i].c_str());
 			}
 
-			m_meshData->LoadObjs(objFileNames, m_device.get(), m_graphicsPresentCommandPools[0].get(), m_graphicsPresentQueues);
+			m_levelUploadTicket = m_meshData->LoadObjs(objFileNames, *m_asyncUploader);
 			for (const char* obj : objFileNames)
 			{
 				m_triangleMeshes.emplace_back();
@@ -206,6 +334,14 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			m_portalManager.Add(Portal::CreateWithPortalTransforms(portal.meshId, portal.transformA.ToMat(), portal.transformB.ToMat()));
 		}
 
+		// the renderers without camera NTree draw each object directly, but the scene still needs a draw command set
+		const int drawCommandSetCount = rendererType != RendererType::BreadthFirst ? 1 : (worstRecursionCount + 1) * drawCommandSetsPerLayer;
+		m_levelUploadTicket = std::max(m_levelUploadTicket, m_scene->CreateGpuData(*m_meshData, m_triangleMeshes, MaxInFlightFrames, drawCommandSetCount,
+			m_physicalDevice.getProperties().limits.minStorageBufferOffsetAlignment, *m_asyncUploader));
+
+		// uses the bounding spheres of the scene objects
+		m_portalManager.CreatePotentiallyVisibleSets(m_triangleMeshes, *m_scene);
+
 	}
 
 	// Load Textures 
@@ -217,23 +353,7 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		vk::DeviceSize imageSize = static_cast<vk::DeviceSize>(texWidth) * texHeight * rgbaPixelSize;
 
 
-		vk::BufferCreateInfo stagingBufferInfo = vk::BufferCreateInfo{}
-			.setUsage(vk::BufferUsageFlagBits::eTransferSrc)
-			.setSize(imageSize)
-			.setSharingMode(vk::SharingMode::eExclusive);
-
-		VmaAllocationCreateInfo vmaAllocInfo = {};
-		vmaAllocInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_ONLY;
-		UniqueVmaBuffer stageBuffer(m_allocator.get(), stagingBufferInfo, vmaAllocInfo);
-
-		{
-			UniqueVmaMemoryMap memoryMap(stageBuffer.GetAllocator(), stageBuffer.GetAllocation());
-			std::memcpy(memoryMap.GetMappedMemoryPtr(), pixels, static_cast<size_t>(imageSize));
-		}
-
-		stbi_image_free(pixels);
-
-
+		const gsl::span<const uint32_t> queueFamilies = m_asyncUploader->GetDestinationQueueFamilies();
 		vk::ImageCreateInfo imageCreateInfo = vk::ImageCreateInfo{}
 			.setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
 			.setFormat(vk::Format::eR8G8B8A8Unorm)
@@ -242,6 +362,9 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			.setMipLevels(1)
 			.setArrayLayers(1)
 			.setImageType(vk::ImageType::e2D)
+			.setSharingMode(m_asyncUploader->GetDestinationSharingMode())
+			.setQueueFamilyIndexCount(gsl::narrow<uint32_t>(queueFamilies.size()))
+			.setPQueueFamilyIndices(queueFamilies.data())
 			;
 
 		VmaAllocationCreateInfo vmaAllocImage = {};
@@ -252,74 +375,68 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 
 		VulkanDebug::SetObjectName(m_device.get(), m_textureImage.Get(), "texture Image");
 
-		vk::UniqueCommandBuffer loadBuffer = CbUtils::AllocateSingle(m_device.get(), m_graphicsPresentCommandPools[0].get());
-		loadBuffer->begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-
-		{
-			vk::ImageMemoryBarrier imageMemoryBarier = vk::ImageMemoryBarrier{}
-				.setOldLayout(vk::ImageLayout::eUndefined)
-				.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
-				.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-				.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-				.setImage(m_textureImage.Get())
-				.setSubresourceRange(vk::ImageSubresourceRange()
-					.setAspectMask(vk::ImageAspectFlagBits::eColor)
-					.setBaseMipLevel(0)
-					.setLevelCount(1)
-					.setBaseArrayLayer(0)
-					.setLayerCount(1))
-				.setSrcAccessMask(vk::AccessFlags())
-				.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
-
-			loadBuffer->pipelineBarrier(
-				vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, imageMemoryBarier);
-		}
-		{
-			vk::BufferImageCopy bufferImageCopy = vk::BufferImageCopy()
-				.setBufferOffset(0)
-				.setBufferRowLength(0)
-				.setBufferImageHeight(0)
-				.setImageSubresource(vk::ImageSubresourceLayers()
-					.setAspectMask(vk::ImageAspectFlagBits::eColor)
-					.setMipLevel(0)
-					.setBaseArrayLayer(0)
-					.setLayerCount(1))
-				.setImageOffset(vk::Offset3D(0, 0, 0))
-				.setImageExtent(vk::Extent3D(texWidth, texHeight, 1));
-
-			loadBuffer->copyBufferToImage(stageBuffer.Get(), m_textureImage.Get(), vk::ImageLayout::eTransferDstOptimal, bufferImageCopy);
-		}
+		m_levelUploadTicket = m_asyncUploader->Upload(imageSize, [&](const AsyncUploader::Staging& staging, vk::CommandBuffer loadBuffer)
 		{
-			vk::ImageMemoryBarrier imageMemoryBarier1 = vk::ImageMemoryBarrier{}
-				.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
-				.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-				.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-				.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-				.setImage(m_textureImage.Get())
-				.setSubresourceRange(vk::ImageSubresourceRange()
-					.setAspectMask(vk::ImageAspectFlagBits::eColor)
-					.setBaseMipLevel(0)
-					.setLevelCount(1)
-					.setBaseArrayLayer(0)
-					.setLayerCount(1))
-				.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
-				.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-
-			loadBuffer->pipelineBarrier(
-				vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {}, imageMemoryBarier1);
-
-		}
+			std::memcpy(staging.mappedMemory, pixels, static_cast<size_t>(imageSize));
 
-		loadBuffer->end();
-
-		// Todo keep buffer around and wait only when required instead of immediately
-		vk::SubmitInfo submitInfo = vk::SubmitInfo()
-			.setCommandBufferCount(1)
-			.setPCommandBuffers(&(loadBuffer.get()))
-			;
+			{
+				vk::ImageMemoryBarrier imageMemoryBarier = vk::ImageMemoryBarrier{}
+					.setOldLayout(vk::ImageLayout::eUndefined)
+					.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+					.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+					.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+					.setImage(m_textureImage.Get())
+					.setSubresourceRange(vk::ImageSubresourceRange()
+						.setAspectMask(vk::ImageAspectFlagBits::eColor)
+						.setBaseMipLevel(0)
+						.setLevelCount(1)
+						.setBaseArrayLayer(0)
+						.setLayerCount(1))
+					.setSrcAccessMask(vk::AccessFlags())
+					.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+
+				loadBuffer.pipelineBarrier(
+					vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, imageMemoryBarier);
+			}
+			{
+				vk::BufferImageCopy bufferImageCopy = vk::BufferImageCopy()
+					.setBufferOffset(staging.offset)
+					.setBufferRowLength(0)
+					.setBufferImageHeight(0)
+					.setImageSubresource(vk::ImageSubresourceLayers()
+						.setAspectMask(vk::ImageAspectFlagBits::eColor)
+						.setMipLevel(0)
+						.setBaseArrayLayer(0)
+						.setLayerCount(1))
+					.setImageOffset(vk::Offset3D(0, 0, 0))
+					.setImageExtent(vk::Extent3D(texWidth, texHeight, 1));
+
+				loadBuffer.copyBufferToImage(staging.buffer, m_textureImage.Get(), vk::ImageLayout::eTransferDstOptimal, bufferImageCopy);
+			}
+			{
+				// the graphics queue only reads the image after the upload is complete, which is observed on the host
+				// so the barrier only needs the layout transition, the fragment shader stage doesn't exist on a transfer queue
+				vk::ImageMemoryBarrier imageMemoryBarier1 = vk::ImageMemoryBarrier{}
+					.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+					.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+					.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+					.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+					.setImage(m_textureImage.Get())
+					.setSubresourceRange(vk::ImageSubresourceRange()
+						.setAspectMask(vk::ImageAspectFlagBits::eColor)
+						.setBaseMipLevel(0)
+						.setLevelCount(1)
+						.setBaseArrayLayer(0)
+						.setLayerCount(1))
+					.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+					.setDstAccessMask(vk::AccessFlags());
+
+				loadBuffer.pipelineBarrier(
+					vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, imageMemoryBarier1);
+			}
+		});
 
-		m_graphicsPresentQueues.submit(submitInfo, vk::Fence());
-		m_graphicsPresentQueues.waitIdle();
+		stbi_image_free(pixels);
 
 		vk::ImageViewCreateInfo imageViewCreateInfo = vk::ImageViewCreateInfo{}
 			.setImage(m_textureImage.Get())
@@ -357,13 +474,31 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 
 	}
 
-	int windowWidth, windowHeight;
-	SDL_GetWindowSize(window, &windowWidth, &windowHeight);
+	if (isHeadless)
+	{
+		m_swapchain = Swapchain::CreateOffscreen(m_device.get(), m_allocator.get(), extent, MaxInFlightFrames);
+
+		const vk::BufferCreateInfo frameReadbackCreateInfo = vk::BufferCreateInfo{}
+			.setSize(vk::DeviceSize(extent.width) * extent.height * 4)
+			.setUsage(vk::BufferUsageFlagBits::eTransferDst)
+			.setSharingMode(vk::SharingMode::eExclusive);
+
+		VmaAllocationCreateInfo frameReadbackAllocCreateInfo = {};
+		frameReadbackAllocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_TO_CPU;
+		frameReadbackAllocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
 
-	m_swapchain = Swapchain::Create(m_physicalDevice, m_device.get(), m_surface.get(), vk::Extent2D(windowWidth, windowHeight));
+		for (UniqueVmaBuffer& frameReadbackBuffer : m_frameReadbackBuffer)
+		{
+			frameReadbackBuffer = UniqueVmaBuffer(m_allocator.get(), frameReadbackCreateInfo, frameReadbackAllocCreateInfo);
+		}
+	}
+	else
+	{
+		m_swapchain = Swapchain::Create(m_physicalDevice, m_device.get(), m_surface.get(), extent);
+	}
 
-	// currently we only require depth component
-	vk::Format preferedDepthFormats[] = {
+	// the stencil component is only used by the hardware stencil layers, which need the stencil export
+	const vk::Format preferedDepthFormats[] = {
 		vk::Format::eD32Sfloat,
 		vk::Format::eD32SfloatS8Uint,
 		vk::Format::eD24UnormS8Uint,
@@ -371,8 +506,25 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		vk::Format::eD16UnormS8Uint,
 	};
 
-	m_depthStencilFormat = VulkanUtils::ChooseFormat(m_physicalDevice, preferedDepthFormats, vk::ImageTiling::eOptimal,
-		vk::FormatFeatureFlagBits::eDepthStencilAttachment);
+	const vk::Format preferedDepthStencilFormats[] = {
+		vk::Format::eD32SfloatS8Uint,
+		vk::Format::eD24UnormS8Uint,
+		vk::Format::eD16UnormS8Uint,
+		vk::Format::eD32Sfloat,
+		vk::Format::eD16Unorm,
+	};
+
+	const bool needsStencil = m_supportsStencilExport || rendererType == RendererType::DepthFirstStencil;
+	m_depthStencilFormat = VulkanUtils::ChooseFormat(m_physicalDevice,
+		needsStencil ? gsl::span<const vk::Format>(preferedDepthStencilFormats) : gsl::span<const vk::Format>(preferedDepthFormats),
+		vk::ImageTiling::eOptimal, vk::FormatFeatureFlagBits::eDepthStencilAttachment);
+
+	m_isHardwareStencilSupported = m_supportsStencilExport && VulkanUtils::HasStencilComponent(m_depthStencilFormat);
+
+	if (rendererType == RendererType::DepthFirstStencil && !VulkanUtils::HasStencilComponent(m_depthStencilFormat))
+	{
+		throw std::runtime_error("depth first rendering requires a depth format with stencil");
+	}
 
 	// Create Depth Stencil Buffer
 	{
@@ -408,6 +560,115 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 				.setLayerCount(1)));
 
 	}
+
+	m_maxVisiblePortalsForRecursion = gsl::make_span(std::data(worstMaxVisiblePortalsForRecursion), std::size(worstMaxVisiblePortalsForRecursion));
+
+	// pipeline creation compiles the shaders, a cache written by an earlier run of the same driver skips most of it
+	m_pipelineCache = PersistentPipelineCache(m_device.get(), m_physicalDevice.getProperties(), "pipeline_cache.bin");
+	const auto finishPipelineCreation = [this](std::chrono::steady_clock::time_point creationStart)
+	{
+		const std::chrono::duration<double, std::milli> creationTime = std::chrono::steady_clock::now() - creationStart;
+		std::printf("pipeline creation: %.1f ms (%s start) \n", creationTime.count(), m_pipelineCache.IsLoadedFromFile() ? "warm" : "cold");
+		std::cout.flush();
+
+		m_pipelineCache.Save();
+	};
+
+	// the depth first and the texture atlas renderer have their own render passes and pipelines and need none of the per camera buffers
+	if (rendererType != RendererType::BreadthFirst)
+	{
+		const vk::DescriptorBufferInfo sceneObjects = vk::DescriptorBufferInfo{}
+			.setBuffer(m_scene->GetObjectBuffer())
+			.setOffset(0)
+			.setRange(m_scene->GetObjectBufferSize());
+
+		if (rendererType == RendererType::DepthFirstStencil)
+		{
+			RecursiveStencilRenderer::CreateInfo createInfo;
+			createInfo.logicalDevice = m_device.get();
+			createInfo.pipelineCache = m_pipelineCache.Get();
+			createInfo.swapchainExtent = m_swapchain.extent;
+			createInfo.colorFormat = m_swapchain.surfaceFormat.format;
+			createInfo.colorFinalLayout = m_swapchain.finalLayout;
+			createInfo.swapchainImageViews = m_swapchain.imageViews;
+			createInfo.depthStencilFormat = m_depthStencilFormat;
+			createInfo.depthStencilView = m_depthBufferView.get();
+			createInfo.textureView = m_textureImageView.get();
+			createInfo.textureSampler = m_textureSampler.get();
+			createInfo.sceneObjects = sceneObjects;
+
+			const auto creationStart = std::chrono::steady_clock::now();
+			m_recursiveStencilRenderer = std::make_unique<RecursiveStencilRenderer>(createInfo);
+			finishPipelineCreation(creationStart);
+		}
+		else
+		{
+			TextureAtlasRenderer::CreateInfo createInfo;
+			createInfo.logicalDevice = m_device.get();
+			createInfo.pipelineCache = m_pipelineCache.Get();
+			createInfo.allocator = m_allocator.get();
+			createInfo.swapchainExtent = m_swapchain.extent;
+			createInfo.colorFormat = m_swapchain.surfaceFormat.format;
+			createInfo.colorFinalLayout = m_swapchain.finalLayout;
+			createInfo.swapchainImageViews = m_swapchain.imageViews;
+			createInfo.depthFormat = m_depthStencilFormat;
+			createInfo.depthView = m_depthBufferView.get();
+			createInfo.textureView = m_textureImageView.get();
+			createInfo.textureSampler = m_textureSampler.get();
+			createInfo.sceneObjects = sceneObjects;
+
+			const auto creationStart = std::chrono::steady_clock::now();
+			m_textureAtlasRenderer = std::make_unique<TextureAtlasRenderer>(createInfo);
+			finishPipelineCreation(creationStart);
+		}
+		return;
+	}
+
+	// the subpasses of the breadth first renderer are recorded on worker threads, the main thread records the primary command buffer
+	{
+		const int recordingThreadCount = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, maxRecordingThreadCount);
+		m_secondaryCommandRecorder = std::make_unique<SecondaryCommandRecorder>(
+			m_device.get(), m_graphicsPresentQueueInfo.familyIndex, MaxInFlightFrames, recordingThreadCount, 2 * (worstRecursionCount + 1));
+	}
+
+	m_pipelineStatisticsQueries = PipelineStatisticsQueries(m_device.get(), m_physicalDevice, MaxInFlightFrames, 2 * (worstRecursionCount + 1));
+	for (size_t i = 0; i < m_layerClearBuffers.size(); ++i)
+	{
+		m_layerClearBuffers[i] = m_device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{}
+			.setCommandPool(m_graphicsPresentCommandPools[i].get())
+			.setLevel(vk::CommandBufferLevel::eSecondary)
+			.setCommandBufferCount(2 * (worstRecursionCount + 1)));
+	}
+
+	m_lastLayerStatistics.reserve(worstRecursionCount + 1);
+	for (CachedSubpassCommands& cachedCommands : m_cachedSubpassCommands)
+	{
+		cachedCommands.extraLines.reserve(DrawOptions::maxExtraLineCount);
+		cachedCommands.buffers.reserve(2 * (worstRecursionCount + 1));
+	}
+
+	for (size_t subpassIndex = 0; subpassIndex < m_subpassRecordFunctions.size(); ++subpassIndex)
+	{
+		m_subpassRecordFunctions[subpassIndex] = [this, subpassIndex = gsl::narrow<uint32_t>(subpassIndex)](vk::CommandBuffer drawBuffer)
+		{
+			RecordSubpass(drawBuffer, subpassIndex);
+		};
+		m_subpassLabels[subpassIndex] = (subpassIndex % 2 == 0 ? "scene pass " : "portal pass ") + std::to_string(subpassIndex / 2);
+	}
+
+	// sized for the deepest recursion of this level, so changing the recursion never allocates in Render
+	{
+		const size_t maxCameraCount = m_portalManager.GetCurrentCameraBufferElementCount(worstRecursionCount);
+		const size_t maxLayerCount = worstRecursionCount + 1;
+		const size_t alignmentPadding = 4 * alignof(std::max_align_t);
+
+		m_frameArena = FrameArena(
+			maxCameraCount * (sizeof(glm::mat4) + sizeof(Ssbo_CameraClipData) + sizeof(int))
+			+ maxLayerCount * (sizeof(glm::vec4) + sizeof(vk::Rect2D))
+			+ alignmentPadding);
+		m_activeCameras.reserve(maxCameraCount);
+	}
+
 	// create rendered Depth buffer
 	{
 		vk::DeviceSize texelSize = sizeof(float);
@@ -500,7 +761,7 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 
 
 	std::vector<std::string> debugRenderpass;
-	m_portalRenderPass = Renderpass::Portals_One_Pass_dynamicState(m_device.get(), m_swapchain.surfaceFormat.format,
+	m_portalRenderPass = Renderpass::Portals_One_Pass_dynamicState(m_device.get(), m_swapchain.surfaceFormat.format, m_swapchain.finalLayout,
 		m_depthStencilFormat, renderedDepthFormat, renderedStencilFormat, worstRecursionCount);
 
 	// create Framebuffer
@@ -540,10 +801,35 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		m_fragShaderModule_lines_subsequent = VulkanUtils::CreateShaderModuleFromFile("line_subsequent.frag.spv", m_device.get());
 
 		m_vertShaderModule_portal = VulkanUtils::CreateShaderModuleFromFile("portal.vert.spv", m_device.get());
-		m_fragShaderModule_portal = VulkanUtils::CreateShaderModuleFromFile("portal.frag.spv", m_device.get());
-		m_fragShaderModule_portal_subsequent = VulkanUtils::CreateShaderModuleFromFile("portal_subsequent.frag.spv", m_device.get());
+
+		// the stencil export variants declare the extension, so they can only be loaded if the device supports it
+		if (m_isHardwareStencilSupported)
+		{
+			m_fragShaderModule_portal = VulkanUtils::CreateShaderModuleFromFile("portal_stencilExport.frag.spv", m_device.get());
+			m_fragShaderModule_portal_subsequent = VulkanUtils::CreateShaderModuleFromFile("portal_subsequent_stencilExport.frag.spv", m_device.get());
+		}
+		else
+		{
+			m_fragShaderModule_portal = VulkanUtils::CreateShaderModuleFromFile("portal.frag.spv", m_device.get());
+			m_fragShaderModule_portal_subsequent = VulkanUtils::CreateShaderModuleFromFile("portal_subsequent.frag.spv", m_device.get());
+		}
+
+		m_compShaderModule_cull = VulkanUtils::CreateShaderModuleFromFile("cull.comp.spv", m_device.get());
 	}
 
+	// buffers must not be empty, so we use at least one object
+	const int cullingObjectCount = std::max(m_scene->GetObjectCount(), 1);
+	const vk::DeviceSize instanceListBufferSize =
+		static_cast<vk::DeviceSize>(RecursionTree::GetCameraIndexBufferElementCount(worstMaxVisiblePortalsForRecursion)) * cullingObjectCount * sizeof(int32_t);
+	const vk::DeviceSize objectVisibilityBufferSize =
+		static_cast<vk::DeviceSize>(cameraMatricesMaxCount) * ((cullingObjectCount + 31) / 32) * sizeof(uint32_t);
+	const vk::DeviceSize portalCoverageBufferSize = cameraMatricesMaxCount * sizeof(uint32_t);
+	const vk::DeviceSize objectLodBufferSize = static_cast<vk::DeviceSize>(worstRecursionCount + 1) * cullingObjectCount * sizeof(uint32_t);
+	const vk::DeviceSize discardCounterBufferSize =
+		sizeof(uint32_t) + static_cast<vk::DeviceSize>(RecursionTree::GetCameraIndexBufferElementCount(worstMaxVisiblePortalsForRecursion)) * 4 * sizeof(uint32_t);
+	const vk::DeviceSize heatmapBufferSize =
+		sizeof(Ssbo_HeatmapHeader) + static_cast<vk::DeviceSize>(m_swapchain.extent.width) * m_swapchain.extent.height * 2 * sizeof(uint32_t);
+
 	// Creating Descriptor Set Buffers
 	{
 
@@ -551,23 +837,10 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		{
 			std::string indexAsString = std::to_string(i);
 
-			{
-				const vk::BufferCreateInfo cameraMatBufferCreateInfo = vk::BufferCreateInfo{}
-					.setSize(cameraMatricesMaxCount * sizeof(glm::mat4))
-					.setUsage(vk::BufferUsageFlagBits::eUniformBuffer)
-					.setSharingMode(vk::SharingMode::eExclusive);
-
-				VmaAllocationCreateInfo allocCreateInfo = {};
-				allocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
-
-				m_cameratMat_buffer[i] = UniqueVmaBuffer(m_allocator.get(), cameraMatBufferCreateInfo, allocCreateInfo);
-				VulkanDebug::SetObjectName(m_device.get(), m_cameratMat_buffer[i].Get(), (std::string("camera mat") + indexAsString).c_str());
-			}
-
 			{
 				const vk::BufferCreateInfo cameraIndexBufferCreateInfo = vk::BufferCreateInfo{}
 					.setSize(RecursionTree::GetCameraIndexBufferElementCount(worstMaxVisiblePortalsForRecursion) * sizeof(uint32_t))
-					.setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst)
+					.setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc)
 					.setSharingMode(vk::SharingMode::eExclusive);
 
 				VmaAllocationCreateInfo cameraIndexBufferAllocCreateInfo = {};
@@ -575,6 +848,18 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 
 				m_cameraIndexBuffer[i] = UniqueVmaBuffer(m_allocator.get(), cameraIndexBufferCreateInfo, cameraIndexBufferAllocCreateInfo);
 				VulkanDebug::SetObjectName(m_device.get(), m_cameraIndexBuffer[i].Get(), (std::string("camera index") + indexAsString).c_str());
+
+				const vk::BufferCreateInfo cameraIndexReadbackCreateInfo = vk::BufferCreateInfo{}
+					.setSize(cameraIndexBufferCreateInfo.size)
+					.setUsage(vk::BufferUsageFlagBits::eTransferDst)
+					.setSharingMode(vk::SharingMode::eExclusive);
+
+				VmaAllocationCreateInfo cameraIndexReadbackAllocCreateInfo = {};
+				cameraIndexReadbackAllocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_TO_CPU;
+				cameraIndexReadbackAllocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+				m_cameraIndexReadbackBuffer[i] = UniqueVmaBuffer(m_allocator.get(), cameraIndexReadbackCreateInfo, cameraIndexReadbackAllocCreateInfo);
+				VulkanDebug::SetObjectName(m_device.get(), m_cameraIndexReadbackBuffer[i].Get(), (std::string("camera index readback") + indexAsString).c_str());
 			}
 			{
 				const gsl::index indexhelperBufferElementCount =
@@ -592,19 +877,67 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 				VulkanDebug::SetObjectName(m_device.get(), m_portalIndexHelperBuffer[i].Get(), (std::string("portal idx helper") + indexAsString).c_str());
 			}
 			{
-				const vk::BufferCreateInfo uboBufferCreateInfo = vk::BufferCreateInfo{}
-					.setSize(sizeof(Ubo_GlobalRenderData))
-					.setUsage(vk::BufferUsageFlagBits::eUniformBuffer)
+				VmaAllocationCreateInfo cullingAllocCreateInfo = {};
+				cullingAllocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+
+				const vk::BufferCreateInfo instanceListCreateInfo = vk::BufferCreateInfo{}
+					.setSize(instanceListBufferSize)
+					.setUsage(vk::BufferUsageFlagBits::eStorageBuffer)
+					.setSharingMode(vk::SharingMode::eExclusive);
+
+				m_instanceListBuffer[i] = UniqueVmaBuffer(m_allocator.get(), instanceListCreateInfo, cullingAllocCreateInfo);
+				VulkanDebug::SetObjectName(m_device.get(), m_instanceListBuffer[i].Get(), (std::string("instance list") + indexAsString).c_str());
+
+				const vk::BufferCreateInfo objectVisibilityCreateInfo = vk::BufferCreateInfo{}
+					.setSize(objectVisibilityBufferSize)
+					.setUsage(vk::BufferUsageFlagBits::eStorageBuffer)
+					.setSharingMode(vk::SharingMode::eExclusive);
+
+				m_objectVisibilityBuffer[i] = UniqueVmaBuffer(m_allocator.get(), objectVisibilityCreateInfo, cullingAllocCreateInfo);
+				VulkanDebug::SetObjectName(m_device.get(), m_objectVisibilityBuffer[i].Get(), (std::string("object visibility") + indexAsString).c_str());
+
+				const vk::BufferCreateInfo portalCoverageCreateInfo = vk::BufferCreateInfo{}
+					.setSize(portalCoverageBufferSize)
+					.setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst)
+					.setSharingMode(vk::SharingMode::eExclusive);
+
+				m_portalCoverageBuffer[i] = UniqueVmaBuffer(m_allocator.get(), portalCoverageCreateInfo, cullingAllocCreateInfo);
+				VulkanDebug::SetObjectName(m_device.get(), m_portalCoverageBuffer[i].Get(), (std::string("portal coverage") + indexAsString).c_str());
+
+				const vk::BufferCreateInfo objectLodCreateInfo = vk::BufferCreateInfo{}
+					.setSize(objectLodBufferSize)
+					.setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst)
+					.setSharingMode(vk::SharingMode::eExclusive);
+
+				m_objectLodBuffer[i] = UniqueVmaBuffer(m_allocator.get(), objectLodCreateInfo, cullingAllocCreateInfo);
+				VulkanDebug::SetObjectName(m_device.get(), m_objectLodBuffer[i].Get(), (std::string("object lod") + indexAsString).c_str());
+			}
+			{
+				const vk::BufferCreateInfo discardCounterCreateInfo = vk::BufferCreateInfo{}
+					.setSize(discardCounterBufferSize)
+					.setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst)
 					.setSharingMode(vk::SharingMode::eExclusive);
 
-				VmaAllocationCreateInfo uboAllocCreateInfo = {};
-				uboAllocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
+				// only read when the layer statistics are collected, so the atomics may as well go to host memory
+				VmaAllocationCreateInfo discardCounterAllocCreateInfo = {};
+				discardCounterAllocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_TO_CPU;
+				discardCounterAllocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
 
-				m_ubo_buffer[i] = UniqueVmaBuffer(m_allocator.get(), uboBufferCreateInfo, uboAllocCreateInfo);
-				VulkanDebug::SetObjectName(m_device.get(), m_ubo_buffer[i].Get(), (std::string("ubo buffer") + indexAsString).c_str());
+				m_discardCounterBuffer[i] = UniqueVmaBuffer(m_allocator.get(), discardCounterCreateInfo, discardCounterAllocCreateInfo);
+				VulkanDebug::SetObjectName(m_device.get(), m_discardCounterBuffer[i].Get(), (std::string("discard counter") + indexAsString).c_str());
 			}
+			{
+				const vk::BufferCreateInfo heatmapCreateInfo = vk::BufferCreateInfo{}
+					.setSize(heatmapBufferSize)
+					.setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst)
+					.setSharingMode(vk::SharingMode::eExclusive);
 
+				VmaAllocationCreateInfo heatmapAllocCreateInfo = {};
+				heatmapAllocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
 
+				m_heatmapBuffer[i] = UniqueVmaBuffer(m_allocator.get(), heatmapCreateInfo, heatmapAllocCreateInfo);
+				VulkanDebug::SetObjectName(m_device.get(), m_heatmapBuffer[i].Get(), (std::string("heatmap") + indexAsString).c_str());
+			}
 		}
 	}
 
@@ -637,7 +970,7 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 					.setBinding(0) // matches Shader code
 					.setDescriptorType(vk::DescriptorType::eUniformBuffer)
 					.setDescriptorCount(1)
-					.setStageFlags(vk::ShaderStageFlagBits::eVertex),
+					.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute),
 			};
 
 			vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo_ubo = vk::DescriptorSetLayoutCreateInfo()
@@ -656,7 +989,7 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 					.setBinding(0) // matches Shader code
 					.setDescriptorType(vk::DescriptorType::eUniformBuffer)
 					.setDescriptorCount(1)
-					.setStageFlags(vk::ShaderStageFlagBits::eVertex),
+					.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute),
 			};
 
 			vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo_cameraMat = vk::DescriptorSetLayoutCreateInfo()
@@ -733,6 +1066,101 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			m_descriptorSetLayout_rendered = m_device->createDescriptorSetLayoutUnique(descriptorSetLayoutInfo_rendered);
 		}
 
+		// scene objects
+		{
+			vk::DescriptorSetLayoutBinding descriptorSetBinding_sceneObjects[] =
+			{
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(0) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute),
+			};
+
+			vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo_sceneObjects = vk::DescriptorSetLayoutCreateInfo()
+				.setBindingCount(GetSizeUint32(descriptorSetBinding_sceneObjects))
+				.setPBindings(descriptorSetBinding_sceneObjects)
+				;
+
+			m_descriptorSetLayout_sceneObjects = m_device->createDescriptorSetLayoutUnique(descriptorSetLayoutInfo_sceneObjects);
+		}
+
+		// culling
+		{
+			vk::DescriptorSetLayoutBinding descriptorSetBinding_culling[] =
+			{
+				// draw commands
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(0) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eFragment),
+
+				// instance lists
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(1) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment),
+
+				// object visibility
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(2) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eFragment),
+
+				// camera clip data
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(3) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment),
+
+				// portal coverage
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(4) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+				// portal coverage of the previous frame
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(5) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+				// object lods
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(6) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eCompute),
+
+				// discard counters
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(7) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+				// heatmap
+				vk::DescriptorSetLayoutBinding{}
+					.setBinding(8) // matches Shader code
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+			};
+
+			vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo_culling = vk::DescriptorSetLayoutCreateInfo()
+				.setBindingCount(GetSizeUint32(descriptorSetBinding_culling))
+				.setPBindings(descriptorSetBinding_culling)
+				;
+
+			m_descriptorSetLayout_culling = m_device->createDescriptorSetLayoutUnique(descriptorSetLayoutInfo_culling);
+		}
+
 
 	}
 
@@ -750,9 +1178,15 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			.setDescriptorCount(
 				GetSizeUint32(m_descriptorSet_ubo)
 				+ GetSizeUint32(m_descriptorSet_cameratMat)
-				+ GetSizeUint32(m_descriptorSet_cameraIndices)
-				+ GetSizeUint32(m_descriptorSet_portalIndexHelper)
+			),
 
+		vk::DescriptorPoolSize{}
+			.setType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(
+				GetSizeUint32(m_descriptorSet_cameraIndices)
+				+ GetSizeUint32(m_descriptorSet_portalIndexHelper)
+				+ 1 // scene objects
+				+ GetSizeUint32(m_descriptorSet_culling) * 9
 			),
 
 			vk::DescriptorPoolSize{}
@@ -770,6 +1204,8 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 				+ GetSizeUint32(m_descriptorSet_cameraIndices)
 				+ GetSizeUint32(m_descriptorSet_portalIndexHelper)
 				+ GetSizeUint32(m_descriptorSet_rendered)
+				+ 1 // scene objects
+				+ GetSizeUint32(m_descriptorSet_culling)
 			);
 
 
@@ -791,6 +1227,9 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			m_descriptorSetLayout_cameraIndices.get(),
 			m_descriptorSetLayout_portalIndexHelper.get(),
 			m_descriptorSetLayout_portalIndexHelper.get(),
+			m_descriptorSetLayout_sceneObjects.get(),
+			m_descriptorSetLayout_culling.get(),
+			m_descriptorSetLayout_culling.get(),
 		};
 
 		vk::DescriptorSetAllocateInfo descritproSetAllocateInfo = vk::DescriptorSetAllocateInfo{}
@@ -811,6 +1250,9 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		m_descriptorSet_cameraIndices[1] = std::move(descriptorSets[8]);
 		m_descriptorSet_portalIndexHelper[0] = std::move(descriptorSets[9]);
 		m_descriptorSet_portalIndexHelper[1] = std::move(descriptorSets[10]);
+		m_descriptorSet_sceneObjects = std::move(descriptorSets[11]);
+		m_descriptorSet_culling[0] = std::move(descriptorSets[12]);
+		m_descriptorSet_culling[1] = std::move(descriptorSets[13]);
 	}
 
 	// write descriptor sets
@@ -865,17 +1307,33 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			device.updateDescriptorSets(writeDescriptorSets, {});
 		};
 
-		// write ubo buffer descriptor set
-		updateDescriptorSetsBuffers(m_device.get(), m_ubo_buffer, m_descriptorSet_ubo, sizeof(Ubo_GlobalRenderData),
-			vk::DescriptorType::eUniformBuffer, 0 /*matches shader code*/);
-
-		// write camera mat descriptor set
-		updateDescriptorSetsBuffers(m_device.get(), m_cameratMat_buffer, m_descriptorSet_cameratMat,
-			cameraMatricesMaxCount * sizeof(glm::mat4), vk::DescriptorType::eUniformBuffer, 0 /*matches shader code*/);
+		// write ubo and camera mat descriptor sets, their frame regions stay at the same place
+		for (int i = 0; i < MaxInFlightFrames; ++i)
+		{
+			const vk::DescriptorBufferInfo uboBufferInfo = m_uploadRing.GetFrameRegion(uboFrameRegion, i).GetDescriptorBufferInfo();
+			const vk::DescriptorBufferInfo cameraMatBufferInfo = m_uploadRing.GetFrameRegion(cameraMatFrameRegion, i).GetDescriptorBufferInfo();
 
-		// write camera index descriptor set
-		updateDescriptorSetsBuffers(m_device.get(), m_cameraIndexBuffer, m_descriptorSet_cameraIndices,
-			RecursionTree::GetCameraIndexBufferElementCount(worstMaxVisiblePortalsForRecursion) * sizeof(uint32_t),
+			const std::array<vk::WriteDescriptorSet, 2> writeDescriptorSets = {
+				vk::WriteDescriptorSet{}
+					.setDstSet(m_descriptorSet_ubo[i])
+					.setDstBinding(0) // matches shader code
+					.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+					.setDstArrayElement(0)
+					.setDescriptorCount(1).setPBufferInfo(&uboBufferInfo),
+				vk::WriteDescriptorSet{}
+					.setDstSet(m_descriptorSet_cameratMat[i])
+					.setDstBinding(0) // matches shader code
+					.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+					.setDstArrayElement(0)
+					.setDescriptorCount(1).setPBufferInfo(&cameraMatBufferInfo),
+			};
+
+			m_device->updateDescriptorSets(writeDescriptorSets, {});
+		}
+
+		// write camera index descriptor set
+		updateDescriptorSetsBuffers(m_device.get(), m_cameraIndexBuffer, m_descriptorSet_cameraIndices,
+			RecursionTree::GetCameraIndexBufferElementCount(worstMaxVisiblePortalsForRecursion) * sizeof(uint32_t),
 			vk::DescriptorType::eStorageBuffer, 0 /*matches shader code*/);
 
 		// write portal index helper descriptor set
@@ -883,6 +1341,55 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			RecursionTree::GetCameraIndexBufferElementCount(worstMaxVisiblePortalsForRecursion) * maxPortalCount * sizeof(uint32_t),
 			vk::DescriptorType::eStorageBuffer, 0 /*matches shader code*/);
 
+		// write scene object descriptor set
+		{
+			vk::DescriptorBufferInfo descriptorBufferInfo = vk::DescriptorBufferInfo{}
+				.setBuffer(m_scene->GetObjectBuffer())
+				.setOffset(0)
+				.setRange(m_scene->GetObjectBufferSize());
+
+			vk::WriteDescriptorSet writeDescriptorSet = vk::WriteDescriptorSet{}
+				.setDstSet(m_descriptorSet_sceneObjects)
+				.setDstBinding(0) // matches shader code
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+				.setDstArrayElement(0)
+				.setDescriptorCount(1).setPBufferInfo(&descriptorBufferInfo);
+
+			m_device->updateDescriptorSets(writeDescriptorSet, {});
+		}
+
+		// write culling descriptor sets
+		for (int i = 0; i < MaxInFlightFrames; ++i)
+		{
+			const int previousFrame = (i + MaxInFlightFrames - 1) % MaxInFlightFrames;
+
+			const vk::DescriptorBufferInfo descriptorBufferInfos[] =
+			{
+				m_scene->GetDrawCommandBufferInfo(i),
+				vk::DescriptorBufferInfo{}.setBuffer(m_instanceListBuffer[i].Get()).setOffset(0).setRange(instanceListBufferSize),
+				vk::DescriptorBufferInfo{}.setBuffer(m_objectVisibilityBuffer[i].Get()).setOffset(0).setRange(objectVisibilityBufferSize),
+				m_uploadRing.GetFrameRegion(cameraClipDataFrameRegion, i).GetDescriptorBufferInfo(),
+				vk::DescriptorBufferInfo{}.setBuffer(m_portalCoverageBuffer[i].Get()).setOffset(0).setRange(portalCoverageBufferSize),
+				vk::DescriptorBufferInfo{}.setBuffer(m_portalCoverageBuffer[previousFrame].Get()).setOffset(0).setRange(portalCoverageBufferSize),
+				vk::DescriptorBufferInfo{}.setBuffer(m_objectLodBuffer[i].Get()).setOffset(0).setRange(objectLodBufferSize),
+				vk::DescriptorBufferInfo{}.setBuffer(m_discardCounterBuffer[i].Get()).setOffset(0).setRange(discardCounterBufferSize),
+				vk::DescriptorBufferInfo{}.setBuffer(m_heatmapBuffer[i].Get()).setOffset(0).setRange(heatmapBufferSize),
+			};
+
+			std::array<vk::WriteDescriptorSet, std::size(descriptorBufferInfos)> writeDescriptorSets;
+			for (size_t binding = 0; binding < std::size(descriptorBufferInfos); ++binding)
+			{
+				// bindings match the index in descriptorBufferInfos
+				writeDescriptorSets[binding] = vk::WriteDescriptorSet{}
+					.setDstSet(m_descriptorSet_culling[i])
+					.setDstBinding(gsl::narrow<uint32_t>(binding))
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+					.setDstArrayElement(0)
+					.setDescriptorCount(1).setPBufferInfo(&descriptorBufferInfos[binding]);
+			}
+
+			m_device->updateDescriptorSets(writeDescriptorSets, {});
+		}
 
 		// write rendered Depth descriptor Set
 		{
@@ -950,6 +1457,8 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			m_descriptorSetLayout_rendered.get(),
 			m_descriptorSetLayout_cameraIndices.get(),
 			m_descriptorSetLayout_portalIndexHelper.get(),
+			m_descriptorSetLayout_sceneObjects.get(),
+			m_descriptorSetLayout_culling.get(),
 		};
 
 		vk::PipelineLayoutCreateInfo pipelineLayoutcreateInfo = vk::PipelineLayoutCreateInfo{}
@@ -995,6 +1504,8 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 			m_descriptorSetLayout_rendered.get(),
 			m_descriptorSetLayout_cameraIndices.get(),
 			m_descriptorSetLayout_portalIndexHelper.get(),
+			m_descriptorSetLayout_sceneObjects.get(),
+			m_descriptorSetLayout_culling.get(),
 		};
 
 		vk::PipelineLayoutCreateInfo pipelineLayoutcreateInfo = vk::PipelineLayoutCreateInfo{}
@@ -1003,6 +1514,30 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 
 		m_pipelineLayout_scene = m_device->createPipelineLayoutUnique(pipelineLayoutcreateInfo);
 	}
+	{
+		vk::PushConstantRange pushConstantRange = vk::PushConstantRange{}
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute)
+			.setOffset(0)
+			.setSize(sizeof(PushConstant_cull));
+
+		// same set numbers as the graphic pipelines, so the shared sets can use the same numbers in the shader
+		vk::DescriptorSetLayout layouts[] = {
+			m_descriptorSetLayout_texture.get(),
+			m_descriptorSetLayout_ubo.get(),
+			m_descriptorSetLayout_cameraMat.get(),
+			m_descriptorSetLayout_rendered.get(),
+			m_descriptorSetLayout_cameraIndices.get(),
+			m_descriptorSetLayout_portalIndexHelper.get(),
+			m_descriptorSetLayout_sceneObjects.get(),
+			m_descriptorSetLayout_culling.get(),
+		};
+
+		vk::PipelineLayoutCreateInfo pipelineLayoutcreateInfo = vk::PipelineLayoutCreateInfo{}
+			.setSetLayoutCount(GetSizeUint32(layouts)).setPSetLayouts(layouts)
+			.setPushConstantRangeCount(1).setPPushConstantRanges(&pushConstantRange);
+
+		m_pipelineLayout_cull = m_device->createPipelineLayoutUnique(pipelineLayoutcreateInfo);
+	}
 
 
 	if(false)
@@ -1165,8 +1700,11 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		};
 
 
+		const auto creationStart = std::chrono::steady_clock::now();
+
 		GraphicsPipeline::PipelinesCreateInfo createInfo;
 		createInfo.logicalDevice = m_device.get();
+		createInfo.pipelineCache = m_pipelineCache.Get();
 		createInfo.pipelineLayout_portal = m_pipelineLayout_portal.get();
 		createInfo.pipelineLayout_lines = m_pipelineLayout_lines.get();
 		createInfo.pipelineLayout_scene = m_pipelineLayout_scene.get();
@@ -1182,21 +1720,56 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		createInfo.pipelineShaderStageCreationInfos_portalInitial = shaderStage_portal_initial;
 		createInfo.pipelineShaderStageCreationInfos_portalSubsequent = shaderStage_portal_subsequent;
 
+		// hardware stencil layers don't need the manual tests of the subsequent scene shader, so early fragment tests stay enabled
+		createInfo.portalWritesStencil = m_isHardwareStencilSupported;
+		if (m_isHardwareStencilSupported)
+		{
+			createInfo.pipelineShaderStageCreationInfos_sceneHardwareStencil = shaderStage_scene_initial;
+		}
+
 		GraphicsPipeline::PipelinesCreateResult result = GraphicsPipeline::CreateGraphicPipelines_dynamicState(
 			createInfo, worstRecursionCount);
 
 		m_pipelines.scenePass.scene = std::move(result.scenePassPipelines.scene);
+		m_pipelines.scenePass.sceneHardwareStencil = std::move(result.scenePassPipelines.sceneHardwareStencil);
 		m_pipelines.scenePass.line = std::move(result.scenePassPipelines.lines);
 		m_pipelines.portalPass.portal = std::move(result.portalPassPipelines.regularPortal);
 
-	}
+		// culling
+		{
+			const vk::ComputePipelineCreateInfo cullPipelineCreateInfo = vk::ComputePipelineCreateInfo{}
+				.setStage(vk::PipelineShaderStageCreateInfo{}
+					.setStage(vk::ShaderStageFlagBits::eCompute)
+					.setModule(m_compShaderModule_cull.get())
+					.setPName("main")
+					.setPSpecializationInfo(&setCameraMats))
+				.setLayout(m_pipelineLayout_cull.get());
+
+			m_pipeline_cull = m_device->createComputePipelineUnique(m_pipelineCache.Get(), cullPipelineCreateInfo);
+		}
 
-	for (int i = 0; i < MaxInFlightFrames; ++i)
-	{
+		// heatmap
+		{
+			std::array<vk::DescriptorBufferInfo, MaxInFlightFrames> heatmapBuffers;
+			for (int i = 0; i < MaxInFlightFrames; ++i)
+			{
+				heatmapBuffers[i] = vk::DescriptorBufferInfo{}.setBuffer(m_heatmapBuffer[i].Get()).setOffset(0).setRange(heatmapBufferSize);
+			}
+
+			HeatmapPass::CreateInfo heatmapCreateInfo;
+			heatmapCreateInfo.logicalDevice = m_device.get();
+			heatmapCreateInfo.pipelineCache = m_pipelineCache.Get();
+			heatmapCreateInfo.swapchainExtent = m_swapchain.extent;
+			heatmapCreateInfo.colorFormat = m_swapchain.surfaceFormat.format;
+			heatmapCreateInfo.colorFinalLayout = m_swapchain.finalLayout;
+			heatmapCreateInfo.swapchainImageViews = m_swapchain.imageViews;
+			heatmapCreateInfo.heatmapBuffers = heatmapBuffers;
+
+			m_heatmapPass = std::make_unique<HeatmapPass>(heatmapCreateInfo);
+		}
+
+		finishPipelineCreation(creationStart);
 
-		m_frameFence[i] = m_device->createFenceUnique(vk::FenceCreateInfo{}.setFlags(vk::FenceCreateFlagBits::eSignaled));
-		m_imageAvailableSem[i] = m_device->createSemaphoreUnique(vk::SemaphoreCreateInfo{});
-		m_renderFinishedSem[i] = m_device->createSemaphoreUnique(vk::SemaphoreCreateInfo{});
 	}
 
 	 if(m_portalManager.GetPortalCount() > maxPortalCount)
@@ -1210,49 +1783,133 @@ void GraphicsBackend::Init(SDL_Window* window, Camera& camera)
 		|| renderedStencilFormat == vk::Format::eR16Uint && maxStencilValue <= std::numeric_limits<uint16_t>::max()
 		|| renderedStencilFormat == vk::Format::eR32Uint && maxStencilValue <= std::numeric_limits<uint32_t>::max()	
 		);
+}
 
-	m_maxVisiblePortalsForRecursion = gsl::make_span(std::data(worstMaxVisiblePortalsForRecursion), std::size(worstMaxVisiblePortalsForRecursion));
+bool GraphicsBackend::PollLevelUploads(uint64_t timeoutNanoseconds)
+{
+	if (!m_asyncUploader->IsComplete(m_levelUploadTicket))
+	{
+		m_asyncUploader->Poll(timeoutNanoseconds);
+	}
+	return m_asyncUploader->IsComplete(m_levelUploadTicket);
 }
 
 void GraphicsBackend::Render(const Camera& camera, const DrawOptions& drawoptions)
 {
+	PROFILE_SCOPE("GraphicsBackend::Render");
+	const AllocationTracker::Scope allocationScope(AllocationTracker::Subsystem::Render);
+	assert(m_asyncUploader->IsComplete(m_levelUploadTicket));
+
 	constexpr uint64_t noTimeout = std::numeric_limits<uint64_t>::max();
-	m_device->waitForFences(m_frameFence[m_currentframe].get(), true, noTimeout);
+	{
+		PROFILE_SCOPE("wait for frame fence");
+		const auto beforeWait = std::chrono::steady_clock::now();
+		m_device->waitForFences(m_frameFence[m_currentframe].get(), true, noTimeout);
+		m_lastFenceWaitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - beforeWait).count();
+	}
 	m_device->resetFences(m_frameFence[m_currentframe].get());
+	m_lastPresentWaitSeconds = 0.0;
+
+	// releases the staging of the finished background uploads
+	m_asyncUploader->Poll();
+
+	ReadGpuFrameTimings();
+	ReadLayerStatistics();
+
+	if (m_recursiveStencilRenderer || m_textureAtlasRenderer)
+	{
+		RenderCpuPortalViews(camera, drawoptions);
+		return;
+	}
+
 	const int recursionCount = m_maxVisiblePortalsForRecursion.size();
 	const int currentCameraBufferElementCount = m_portalManager.GetCurrentCameraBufferElementCount(recursionCount);
 
+	// the previous use of the arena ended with the last Render
+	m_frameArena.Reset();
+
+	// the cameras which got a stencil value the last time this frame index was used, the fence above already waited for them
+	m_activeCameras.clear();
+	if (drawoptions.visibilityReuseMarginLayers >= 0 && m_cameraIndexReadbackCounts[m_currentframe] > 0)
+	{
+		const UniqueVmaBuffer& readbackBuffer = m_cameraIndexReadbackBuffer[m_currentframe];
+		vmaInvalidateAllocation(m_allocator.get(), readbackBuffer.GetAllocation(), 0, VK_WHOLE_SIZE);
+
+		const gsl::span<const uint32_t> visibleCameraIndices(
+			static_cast<const uint32_t*>(GetMappedMemory(readbackBuffer)), m_cameraIndexReadbackCounts[m_currentframe]);
+		m_portalManager.CreateActiveCameraMask(recursionCount, visibleCameraIndices, drawoptions.visibilityReuseMarginLayers,
+			m_frameArena.Allocate<int>(currentCameraBufferElementCount), m_activeCameras);
+	}
+
+	// a layer can use the hardware stencil if each of its cameras gets a stencil value, the root layer never needs a mask
+	std::array<bool, worstRecursionCount + 1> isLayerHardwareStencil = {};
+	for (int layerIndex = 1; layerIndex <= recursionCount; ++layerIndex)
+	{
+		isLayerHardwareStencil[layerIndex] = m_isHardwareStencilSupported && drawoptions.useHardwareStencil
+			&& RecursionTree::CalcLayerElementCount(layerIndex - 1, m_maxVisiblePortalsForRecursion) <= hardwareStencilMaxLayerSize;
+	}
+
+	const glm::mat4 projectionMatrix = camera.GetProjectionMatrix();
 	{
-		VmaAllocation ubo_Allocation = m_ubo_buffer[m_currentframe].GetAllocation();
-		UniqueVmaMemoryMap memoryMap(m_allocator.get(), ubo_Allocation);
 		Ubo_GlobalRenderData renderData;
-		renderData.proj = camera.GetProjectionMatrix();
+		renderData.proj = projectionMatrix;
+		renderData.mainCameraMat = camera.CalcMat();
 
-		std::memcpy(memoryMap.GetMappedMemoryPtr(), &renderData, sizeof(renderData));
+		std::memcpy(m_uploadRing.GetFrameRegion(uboFrameRegion, m_currentframe).mappedMemory, &renderData, sizeof(renderData));
 	}
 
+	const gsl::span<glm::mat4> cameraViewMats = m_frameArena.Allocate<glm::mat4>(currentCameraBufferElementCount);
 	{
-		std::vector<glm::mat4> cameraViewMats;
-		cameraViewMats.resize(currentCameraBufferElementCount);
+		m_portalManager.CreateCameraMats(camera.CalcMat(), recursionCount, cameraViewMats, m_activeCameras);
 
-		m_portalManager.CreateCameraMats(camera.CalcMat(), recursionCount, cameraViewMats);
-		std::transform(std::begin(cameraViewMats), std::end(cameraViewMats), std::begin(cameraViewMats), [](const glm::mat4& e)
+		std::byte* const cameraMatMemory = m_uploadRing.GetFrameRegion(cameraMatFrameRegion, m_currentframe).mappedMemory;
+
+		// inactive cameras have empty clip data, the gpu never reads their matrices
+		for (int cameraIndex = 0; cameraIndex < currentCameraBufferElementCount; ++cameraIndex)
+		{
+			if (!m_activeCameras.empty() && !m_activeCameras[cameraIndex])
 			{
-				return glm::inverse(e);
-			});
+				continue;
+			}
 
+			// copy runs of active cameras at once
+			int runEnd = cameraIndex + 1;
+			while (runEnd < currentCameraBufferElementCount && (m_activeCameras.empty() || m_activeCameras[runEnd]))
+			{
+				++runEnd;
+			}
 
-		VmaAllocation cameraMat_Allocation = m_cameratMat_buffer[m_currentframe].GetAllocation();
-		UniqueVmaMemoryMap memoryMap(m_allocator.get(), cameraMat_Allocation);
+			std::transform(std::begin(cameraViewMats) + cameraIndex, std::begin(cameraViewMats) + runEnd, std::begin(cameraViewMats) + cameraIndex,
+				[](const glm::mat4& e)
+				{
+					return glm::inverse(e);
+				});
 
-		std::memcpy(memoryMap.GetMappedMemoryPtr(), std::data(cameraViewMats), sizeof(cameraViewMats[0]) * std::size(cameraViewMats));
+			std::memcpy(cameraMatMemory + sizeof(cameraViewMats[0]) * cameraIndex, std::data(cameraViewMats) + cameraIndex,
+				sizeof(cameraViewMats[0]) * (runEnd - cameraIndex));
+			cameraIndex = runEnd - 1;
+		}
 	}
 
+	// the vertex shaders clip each camera to the screen bounds of its portals and the plane of the destination portal
+	// the union of the bounds of a layer is used as scissor and clear rect
+	const gsl::span<vk::Rect2D> layerScissors = m_frameArena.Allocate<vk::Rect2D>(recursionCount + 1);
+	{
+		const gsl::span<Ssbo_CameraClipData> cameraClipData = m_frameArena.Allocate<Ssbo_CameraClipData>(currentCameraBufferElementCount);
+		const gsl::span<glm::vec4> layerScreenBounds = m_frameArena.Allocate<glm::vec4>(recursionCount + 1);
+		m_portalManager.CreateCameraClipData(projectionMatrix, cameraViewMats, recursionCount, m_triangleMeshes, cameraClipData, layerScreenBounds,
+			m_activeCameras);
 
-	uint32_t imageIndex;
-	vk::Result aquireResult = m_device->acquireNextImageKHR(
-		m_swapchain.swapchain.get(), noTimeout, m_imageAvailableSem[m_currentframe].get(), {}, &imageIndex);
-	assert(aquireResult == vk::Result::eSuccess);
+		std::transform(std::begin(layerScreenBounds), std::end(layerScreenBounds), std::begin(layerScissors), [this](const glm::vec4& screenBounds)
+			{
+				return ScreenBoundsToRect(screenBounds, m_swapchain.extent);
+			});
+
+		std::memcpy(m_uploadRing.GetFrameRegion(cameraClipDataFrameRegion, m_currentframe).mappedMemory, cameraClipData.data(), cameraClipData.size_bytes());
+	}
+
+
+	const uint32_t imageIndex = AcquireImage();
 
 	m_device->resetCommandPool(m_graphicsPresentCommandPools[m_currentframe].get(), {});
 	vk::CommandBuffer drawBuffer = m_graphicsPresentBuffer[m_currentframe].get();
@@ -1283,7 +1940,7 @@ void GraphicsBackend::Render(const Camera& camera, const DrawOptions& drawoption
 	{
 		vk::ClearValue clearValues[] = {
 			// output
-			vk::ClearColorValue(std::array<float, 4>{ 100.f / 255.f, 149.f / 255.f, 237.f / 255.f, 1.f }),
+			vk::ClearColorValue(backgroundColor),
 			// depth Stencil
 			clearDepthStencilValue,
 
@@ -1296,6 +1953,63 @@ void GraphicsBackend::Render(const Camera& camera, const DrawOptions& drawoption
 
 		drawBuffer.begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 
+		m_gpuTimestamps.Reset(drawBuffer, m_currentframe);
+		m_gpuTimestamps.Write(drawBuffer, m_currentframe, 0, vk::PipelineStageFlagBits::eTopOfPipe);
+
+		// the previous frame might still read our coverage buffer and write the one we read
+		{
+			vk::MemoryBarrier barrier = vk::MemoryBarrier{}
+				.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+				.setDstAccessMask(vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderRead);
+
+			drawBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eFragmentShader,
+				vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eFragmentShader,
+				vk::DependencyFlags{}, barrier, {}, {});
+		}
+
+		// the first frame reads the coverage of the "previous" frame, which no frame wrote, so it clears all of them
+		if (!m_isPortalCoverageCleared)
+		{
+			for (const UniqueVmaBuffer& coverageBuffer : m_portalCoverageBuffer)
+			{
+				drawBuffer.fillBuffer(coverageBuffer.Get(), 0, VK_WHOLE_SIZE, 0);
+			}
+			m_isPortalCoverageCleared = true;
+		}
+		else
+		{
+			drawBuffer.fillBuffer(m_portalCoverageBuffer[m_currentframe].Get(), 0, VK_WHOLE_SIZE, 0);
+		}
+
+		// the first word enables the counting in the shaders, the ranges don't overlap, so the fills need no barrier between them
+		drawBuffer.fillBuffer(m_discardCounterBuffer[m_currentframe].Get(), 0, sizeof(uint32_t), drawoptions.collectLayerStatistics ? 1 : 0);
+		if (drawoptions.collectLayerStatistics)
+		{
+			drawBuffer.fillBuffer(m_discardCounterBuffer[m_currentframe].Get(), sizeof(uint32_t), VK_WHOLE_SIZE, 0);
+			m_pipelineStatisticsQueries.Reset(drawBuffer, m_currentframe);
+		}
+
+		// the shaders read the mode from the header, so it is written even if the heatmap is off
+		{
+			static_assert(std::size(Ssbo_HeatmapHeader{}.layerStartIndices) >= worstRecursionCount, "each layer after the first needs a start index");
+
+			Ssbo_HeatmapHeader heatmapHeader = {};
+			heatmapHeader.mode = static_cast<uint32_t>(drawoptions.heatmap);
+			heatmapHeader.width = m_swapchain.extent.width;
+			heatmapHeader.layerCount = gsl::narrow<uint32_t>(recursionCount + 1);
+			for (int i = 0; i < recursionCount; ++i)
+			{
+				heatmapHeader.layerStartIndices[i] = RecursionTree::CalcLayerStartIndex(i, m_maxVisiblePortalsForRecursion);
+			}
+
+			drawBuffer.updateBuffer(m_heatmapBuffer[m_currentframe].Get(), 0, sizeof(heatmapHeader), &heatmapHeader);
+			if (drawoptions.heatmap != HeatmapMode::Off)
+			{
+				drawBuffer.fillBuffer(m_heatmapBuffer[m_currentframe].Get(), sizeof(heatmapHeader), VK_WHOLE_SIZE, 0);
+			}
+		}
+
 		const gsl::index indexhelperBufferElementCount = RecursionTree::GetCameraIndexBufferElementCount(m_maxVisiblePortalsForRecursion) * maxPortalCount;
 
 		// clear the helper buffer
@@ -1306,36 +2020,368 @@ void GraphicsBackend::Render(const Camera& camera, const DrawOptions& drawoption
 		drawBuffer.fillBuffer(m_cameraIndexBuffer[m_currentframe].Get(), 0,
 			RecursionTree::GetCameraIndexBufferElementCount(m_maxVisiblePortalsForRecursion) * sizeof(uint32_t), ~(uint32_t(0)));
 
-		// render pass
+		const int objectCount = m_scene->GetObjectCount();
+
+		// cull the objects for each camera of the NTree and reset the draw commands of each layer
+		// the draw commands are filled by the portal pass, when a camera gets a stencil value
+		if (objectCount > 0)
 		{
+			if (m_hasDebugUtils)
+			{
+				drawBuffer.beginDebugUtilsLabelEXT(vk::DebugUtilsLabelEXT{}.setPLabelName("culling"));
+			}
+
+			// each object and camera of a layer which can see it lowers the lod of the object in the layer
+			drawBuffer.fillBuffer(m_objectLodBuffer[m_currentframe].Get(), 0, VK_WHOLE_SIZE, static_cast<uint32_t>(MeshDataRef::maxLodCount - 1));
+			drawBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eTransfer,
+				vk::PipelineStageFlagBits::eComputeShader,
+				vk::DependencyFlags{}, vk::MemoryBarrier{}
+					.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+					.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite), {}, {});
+
+			drawBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline_cull.get());
+
+			// only bind the sets used by the culling, the others contain attachments of the render pass
+			std::array<vk::DescriptorSet, 2> cameraDescriptorSets = {
+				m_descriptorSet_ubo[m_currentframe],
+				m_descriptorSet_cameratMat[m_currentframe],
+			};
+
+			std::array<vk::DescriptorSet, 2> cullingDescriptorSets = {
+				m_descriptorSet_sceneObjects,
+				m_descriptorSet_culling[m_currentframe],
+			};
 
-			const auto lineDrawingFunction = [this, &drawoptions]
-			(vk::PipelineLayout layout, vk::CommandBuffer drawBuffer, int cameraIndex, uint32_t stencilCompareVal)
+			drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout_cull.get(), 1, cameraDescriptorSets, {});
+			drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout_cull.get(), 6, cullingDescriptorSets, {});
+
+			const uint32_t portalCount = gsl::narrow<uint32_t>(m_portalManager.GetPortalCount());
+
+			const auto createPushConstant = [&](int layerIndex)
 			{
-				//LineDrawer::Draw(layout, drawBuffer, cameraIndex, m_portalAABBLines, stencilCompareVal);
-				LineDrawer::Draw(layout, drawBuffer, drawoptions.extraLines, stencilCompareVal);
+				PushConstant_cull pushConstant = {};
+				pushConstant.layerIndex = layerIndex;
+				pushConstant.layerInstanceCount = layerIndex == 0 ? 1 : RecursionTree::CalcLayerElementCount(layerIndex - 1, m_maxVisiblePortalsForRecursion);
+				pushConstant.firstCameraIndex = gsl::narrow<int32_t>(NTree::CalcFirstLayerIndex(portalCount, layerIndex));
+				pushConstant.cameraCount = gsl::narrow<int32_t>(ipow(portalCount, layerIndex));
+				pushConstant.portalCount = gsl::narrow<int32_t>(portalCount);
+				pushConstant.objectCount = objectCount;
+				pushConstant.drawCommandSetIndex = layerIndex * drawCommandSetsPerLayer;
+				pushConstant.isDrawCommandSetPerCamera = isLayerHardwareStencil[layerIndex] ? 1 : 0;
+				pushConstant.isLodEnabled = drawoptions.useMeshLods ? 1 : 0;
+				return pushConstant;
 			};
 
-			// initial / iteration 0
+			// workgroup count is only guaranteed to be 65535 per dimension
+			const auto dispatchWorkgroups = [drawBuffer](uint32_t workgroupCount)
+			{
+				constexpr uint32_t maxWorkgroupCountX = 65535;
+				const uint32_t workgroupCountX = std::min(workgroupCount, maxWorkgroupCountX);
+				const uint32_t workgroupCountY = (workgroupCount + workgroupCountX - 1) / workgroupCountX;
+				drawBuffer.dispatch(workgroupCountX, workgroupCountY, 1);
+			};
+
+			// one workgroup per camera, the root layer resets its draw commands as well
+			for (int layerIndex = 0; layerIndex <= recursionCount; ++layerIndex)
+			{
+				const PushConstant_cull pushConstant = createPushConstant(layerIndex);
+				if (pushConstant.cameraCount > 0)
+				{
+					drawBuffer.pushConstants<PushConstant_cull>(m_pipelineLayout_cull.get(), vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+					dispatchWorkgroups(pushConstant.cameraCount);
+				}
+			}
+
+			// the lods of a layer are known once all of its cameras are culled
+			drawBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eComputeShader,
+				vk::PipelineStageFlagBits::eComputeShader,
+				vk::DependencyFlags{}, vk::MemoryBarrier{}
+					.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+					.setDstAccessMask(vk::AccessFlagBits::eShaderRead), {}, {});
+
+			// one invocation per object resets the draw commands of the other layers with their lod
+			constexpr uint32_t cullWorkgroupSize = 64;
+			for (int layerIndex = 1; layerIndex <= recursionCount; ++layerIndex)
+			{
+				PushConstant_cull pushConstant = createPushConstant(layerIndex);
+				pushConstant.isResetPass = 1;
+
+				drawBuffer.pushConstants<PushConstant_cull>(m_pipelineLayout_cull.get(), vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+				dispatchWorkgroups((gsl::narrow<uint32_t>(objectCount) + cullWorkgroupSize - 1) / cullWorkgroupSize);
+			}
+			if (m_hasDebugUtils)
+			{
+				drawBuffer.endDebugUtilsLabelEXT();
+			}
+		}
+
+		// the render pass consumes the draw commands and instance lists, the portal pass appends to them
+		// also covers the fill of the camera index and helper buffer
+		{
+			vk::MemoryBarrier barrier = vk::MemoryBarrier{}
+				.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite)
+				.setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+
+			drawBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+				vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader,
+				vk::DependencyFlags{}, barrier, {}, {});
+		}
+
+		// render pass
+		{
+
+			// cached commands are reused while the camera moves, so they draw the whole screen in each layer
+			// the vertex shaders still clip each camera to its screen bounds
+			const bool isCachingSubpassCommands = drawoptions.useSecondaryCommandBuffers && drawoptions.cacheSubpassCommands;
+
+			// the key is checked first, valid cached commands need no recording
+			SubpassCommandsKey key = {};
+			std::copy(std::begin(m_maxVisiblePortalsForRecursion), std::end(m_maxVisiblePortalsForRecursion), std::begin(key.maxVisiblePortalsForRecursion));
+			key.recursionCount = recursionCount;
+			key.isLayerHardwareStencil = isLayerHardwareStencil;
+			key.maxRecursion = drawoptions.maxRecursion;
+			key.minPortalCoverage = drawoptions.minPortalCoverage;
+			key.collectLayerStatistics = drawoptions.collectLayerStatistics;
+
+			CachedSubpassCommands& cachedCommands = m_cachedSubpassCommands[m_currentframe];
+			const bool isCacheValid = isCachingSubpassCommands && cachedCommands.key && *cachedCommands.key == key
+				&& cachedCommands.extraLines == drawoptions.extraLines;
+
+			// everything RecordSubpass reads besides the members, the subpasses are recorded before Render returns
+			m_subpassRecordState.drawoptions = &drawoptions;
+			m_subpassRecordState.layerScissors = layerScissors;
+			m_subpassRecordState.isLayerHardwareStencil = isLayerHardwareStencil;
+			m_subpassRecordState.recursionCount = recursionCount;
+			m_subpassRecordState.objectCount = objectCount;
+			m_subpassRecordState.isUsingLayerScissors = !isCachingSubpassCommands;
+			m_subpassRecordState.clearDepthStencilValue = clearDepthStencilValue;
+
+			// a scene and a portal subpass per layer
+			const size_t subpassCount = 2 * (recursionCount + 1);
+
+			const vk::RenderPassBeginInfo renderPassBeginInfo = vk::RenderPassBeginInfo{}
+				.setRenderPass(m_portalRenderPass.get())
+				.setFramebuffer(m_framebuffer[m_currentframe].get())
+				.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), m_swapchain.extent))
+				.setClearValueCount(GetSizeUint32(clearValues)).setPClearValues(clearValues);
+
+			if (drawoptions.useSecondaryCommandBuffers)
 			{
+				if (!isCacheValid)
+				{
+					PROFILE_SCOPE("record subpasses");
+					m_secondaryCommandRecorder->BeginFrame(m_currentframe);
+					for (size_t subpassIndex = 0; subpassIndex < subpassCount; ++subpassIndex)
+					{
+						m_secondaryCommandRecorder->Record(vk::CommandBufferInheritanceInfo{}
+							.setRenderPass(m_portalRenderPass.get())
+							.setSubpass(gsl::narrow<uint32_t>(subpassIndex))
+							.setFramebuffer(m_framebuffer[m_currentframe].get()),
+							m_subpassRecordFunctions[subpassIndex]);
+					}
+
+					m_secondaryCommandRecorder->Finish(cachedCommands.buffers);
+
+					// uncached commands use the layer scissors of this frame
+					if (isCachingSubpassCommands)
+					{
+						cachedCommands.key = key;
+						cachedCommands.extraLines.assign(std::begin(drawoptions.extraLines), std::end(drawoptions.extraLines));
+					}
+					else
+					{
+						cachedCommands.key.reset();
+					}
+				}
+
+				const std::vector<vk::CommandBuffer>& subpassBuffers = cachedCommands.buffers;
 
-				const int renderedInputIdx = 1;
-				constexpr int initialPipelineIndex = 0;
-				constexpr int cameraIndexAndStencilCompare = 0;
-				constexpr int layerStartIndex = 0;
-				constexpr int layerEndIndex = 1;
-				// render Scene Subpass
+				drawBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+				for (size_t subpassIndex = 0; subpassIndex < subpassBuffers.size(); ++subpassIndex)
 				{
-					drawBuffer.beginRenderPass(
-						vk::RenderPassBeginInfo{}
-						.setRenderPass(m_portalRenderPass.get())
-						.setFramebuffer(m_framebuffer[m_currentframe].get())
-						.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), m_swapchain.extent))
-						.setClearValueCount(GetSizeUint32(clearValues)).setPClearValues(clearValues),
-						vk::SubpassContents::eInline);
+					if (subpassIndex != 0)
+					{
+						drawBuffer.nextSubpass(vk::SubpassContents::eSecondaryCommandBuffers);
+					}
+
+					if (const std::optional<vk::ClearAttachment> layerClear = GetLayerClear(gsl::narrow<uint32_t>(subpassIndex)))
+					{
+						const vk::CommandBufferInheritanceInfo inheritanceInfo = vk::CommandBufferInheritanceInfo{}
+							.setRenderPass(m_portalRenderPass.get())
+							.setSubpass(gsl::narrow<uint32_t>(subpassIndex))
+							.setFramebuffer(m_framebuffer[m_currentframe].get());
+
+						const vk::CommandBuffer clearBuffer = m_layerClearBuffers[m_currentframe][subpassIndex].get();
+						clearBuffer.begin(vk::CommandBufferBeginInfo{}
+							.setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit)
+							.setPInheritanceInfo(&inheritanceInfo));
+						clearBuffer.clearAttachments(*layerClear, vk::ClearRect(layerScissors[subpassIndex / 2], 0, 1));
+						clearBuffer.end();
+
+						drawBuffer.executeCommands(clearBuffer);
+					}
+					drawBuffer.executeCommands(subpassBuffers[subpassIndex]);
+				}
+			}
+			else
+			{
+				drawBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+				for (size_t subpassIndex = 0; subpassIndex < subpassCount; ++subpassIndex)
+				{
+					if (subpassIndex != 0)
+					{
+						drawBuffer.nextSubpass(vk::SubpassContents::eInline);
+					}
+
+					if (const std::optional<vk::ClearAttachment> layerClear = GetLayerClear(gsl::narrow<uint32_t>(subpassIndex)))
+					{
+						drawBuffer.clearAttachments(*layerClear, vk::ClearRect(layerScissors[subpassIndex / 2], 0, 1));
+					}
+					RecordSubpass(drawBuffer, gsl::narrow<uint32_t>(subpassIndex));
+				}
+			}
+
+			// make up for skipped passes
+			for (int i = recursionCount; i < worstRecursionCount; ++i)
+			{
+				drawBuffer.nextSubpass(vk::SubpassContents::eInline);
+				drawBuffer.nextSubpass(vk::SubpassContents::eInline);
+			}
+
+			drawBuffer.endRenderPass();
+
+			// the subpasses of cached commands wrote the timestamps before it as well
+			const uint32_t endQueryIndex = gsl::narrow<uint32_t>(1 + 2 * (recursionCount + 1));
+			m_gpuTimestamps.Write(drawBuffer, m_currentframe, endQueryIndex);
+			m_timestampQueryCounts[m_currentframe] = endQueryIndex + 1;
+		}
+
+		// not part of the measured frame, the render pass dependency waits for the counters of the fragment shaders
+		if (drawoptions.heatmap != HeatmapMode::Off)
+		{
+			m_heatmapPass->Draw(drawBuffer, m_currentframe, imageIndex);
+		}
+
+		// the camera indices of this frame are read when the frame index is used again
+		{
+			const int cameraIndexElementCount = RecursionTree::GetCameraIndexBufferElementCount(m_maxVisiblePortalsForRecursion);
+
+			drawBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eFragmentShader,
+				vk::PipelineStageFlagBits::eTransfer,
+				vk::DependencyFlags{}, vk::MemoryBarrier{}
+					.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+					.setDstAccessMask(vk::AccessFlagBits::eTransferRead), {}, {});
+
+			drawBuffer.copyBuffer(m_cameraIndexBuffer[m_currentframe].Get(), m_cameraIndexReadbackBuffer[m_currentframe].Get(),
+				vk::BufferCopy(0, 0, cameraIndexElementCount * sizeof(uint32_t)));
+
+			drawBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eTransfer,
+				vk::PipelineStageFlagBits::eHost,
+				vk::DependencyFlags{}, vk::MemoryBarrier{}
+					.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+					.setDstAccessMask(vk::AccessFlagBits::eHostRead), {}, {});
+
+			m_cameraIndexReadbackCounts[m_currentframe] = cameraIndexElementCount;
+		}
+
+		// the discard counters are read directly from their host visible memory
+		if (drawoptions.collectLayerStatistics)
+		{
+			drawBuffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eFragmentShader,
+				vk::PipelineStageFlagBits::eHost,
+				vk::DependencyFlags{}, vk::MemoryBarrier{}
+					.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+					.setDstAccessMask(vk::AccessFlagBits::eHostRead), {}, {});
+
+			LayerStatisticsConfig& config = m_layerStatisticsConfigs[m_currentframe];
+			config.isCollected = true;
+			config.recursionCount = recursionCount;
+			std::copy(std::begin(m_maxVisiblePortalsForRecursion), std::end(m_maxVisiblePortalsForRecursion), std::begin(config.maxVisiblePortalsForRecursion));
+		}
+		else
+		{
+			m_layerStatisticsConfigs[m_currentframe].isCollected = false;
+		}
+
+		RecordFrameReadback(drawBuffer, imageIndex);
+		drawBuffer.end();
 
-					drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.scenePass.scene[initialPipelineIndex].get());
+		SubmitAndPresent(drawBuffer, imageIndex);
+	}
+
+}
+
+void GraphicsBackend::RecordSubpass(vk::CommandBuffer drawBuffer, uint32_t subpassIndex)
+{
+	const DrawOptions& drawoptions = *m_subpassRecordState.drawoptions;
+	const gsl::span<const vk::Rect2D> layerScissors = m_subpassRecordState.layerScissors;
+	const std::array<bool, worstRecursionCount + 1>& isLayerHardwareStencil = m_subpassRecordState.isLayerHardwareStencil;
+	const int recursionCount = m_subpassRecordState.recursionCount;
+	const int objectCount = m_subpassRecordState.objectCount;
+
+	const auto lineDrawingFunction = [this, &drawoptions]
+	(vk::PipelineLayout layout, vk::CommandBuffer drawBuffer, int cameraIndex, uint32_t stencilCompareVal)
+	{
+		//LineDrawer::Draw(layout, drawBuffer, cameraIndex, m_portalAABBLines, stencilCompareVal);
+		LineDrawer::Draw(layout, drawBuffer, drawoptions.extraLines, stencilCompareVal);
+	};
+
+	// each subpass starts with its timestamp and is labeled for frame captures
+	// the timestamps are part of the recorded commands, so the cached ones write into the pool of their frame index as well
+	m_gpuTimestamps.Write(drawBuffer, m_currentframe, 1 + subpassIndex);
+	if (m_hasDebugUtils)
+	{
+		drawBuffer.beginDebugUtilsLabelEXT(vk::DebugUtilsLabelEXT{}.setPLabelName(m_subpassLabels[subpassIndex].c_str()));
+	}
+	if (drawoptions.collectLayerStatistics)
+	{
+		m_pipelineStatisticsQueries.Begin(drawBuffer, m_currentframe, subpassIndex);
+	}
+
+	// initial / iteration 0
+	if (subpassIndex < 2)
+	{
+		constexpr int renderedInputIdx = 1;
+		constexpr int initialPipelineIndex = 0;
+		constexpr int cameraIndexAndStencilCompare = 0;
+		constexpr int layerStartIndex = 0;
+		constexpr int layerEndIndex = 1;
+
+		// render Scene Subpass
+		if (subpassIndex == 0)
+		{
+			{
+				drawBuffer.setScissor(0, layerScissors[0]);
+				drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.scenePass.scene[initialPipelineIndex].get());
+
+				std::array<vk::DescriptorSet, 8> descriptorSets = {
+					m_descriptorSet_texture,
+					m_descriptorSet_ubo[m_currentframe],
+					m_descriptorSet_cameratMat[m_currentframe],
+					m_descriptorSet_rendered[renderedInputIdx],
+					m_descriptorSet_cameraIndices[m_currentframe],
+					m_descriptorSet_portalIndexHelper[m_currentframe],
+					m_descriptorSet_sceneObjects,
+					m_descriptorSet_culling[m_currentframe],
+				};
+
+				drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_scene.get(), 0, descriptorSets, {});
+
+
+				m_scene->Draw(*m_meshData, m_pipelineLayout_scene.get(), drawBuffer, m_currentframe, 0, layerStartIndex, layerEndIndex);
+			}
 
+			{
+				drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.scenePass.line[initialPipelineIndex].get());
+
+				// for now just bind it, we can use a different pipeline layout later
+				{
 					std::array<vk::DescriptorSet, 6> descriptorSets = {
 						m_descriptorSet_texture,
 						m_descriptorSet_ubo[m_currentframe],
@@ -1343,243 +2389,529 @@ void GraphicsBackend::Render(const Camera& camera, const DrawOptions& drawoption
 						m_descriptorSet_rendered[renderedInputIdx],
 						m_descriptorSet_cameraIndices[m_currentframe],
 						m_descriptorSet_portalIndexHelper[m_currentframe],
-
 					};
 
-					drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_scene.get(), 0, descriptorSets, {});
-
+					drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_lines.get(), 0, descriptorSets, {});
 
-					m_scene->Draw(*m_meshData, m_pipelineLayout_scene.get(), drawBuffer, layerStartIndex, layerEndIndex);
+					lineDrawingFunction(m_pipelineLayout_lines.get(), drawBuffer, cameraIndexAndStencilCompare, cameraIndexAndStencilCompare);
 				}
+			}
+		}
+		// First Portal Pass
+		else
+		{
+			drawBuffer.setScissor(0, layerScissors[0]);
+			drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.portalPass.portal[initialPipelineIndex].get());
 
+			// for now just bind it, we can use a different pipeline layout later
+			{
+				std::array<vk::DescriptorSet, 8> descriptorSets = {
+					m_descriptorSet_texture,
+					m_descriptorSet_ubo[m_currentframe],
+					m_descriptorSet_cameratMat[m_currentframe],
+					m_descriptorSet_rendered[renderedInputIdx],
+					m_descriptorSet_cameraIndices[m_currentframe],
+					m_descriptorSet_portalIndexHelper[m_currentframe],
+					m_descriptorSet_sceneObjects,
+					m_descriptorSet_culling[m_currentframe],
+				};
+
+				drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_portal.get(), 0, descriptorSets, {});
+			}
+
+			// draw Portals
+			{
+				DrawPortalsInfo info = {};
+				info.drawBuffer = drawBuffer;
+				info.layout = m_pipelineLayout_portal.get();
+				info.maxVisiblePortalCount = recursionCount == 0 ? 0 : m_maxVisiblePortalsForRecursion[0];
+				info.meshDataManager = m_meshData.get();
+				info.layerStartIndex = layerStartIndex;
+				info.nextLayerStartIndex = layerEndIndex;
+				info.objectCount = objectCount;
+				info.nextDrawCommandSetIndex = drawCommandSetsPerLayer;
+				info.nextLayerInstanceCount = recursionCount == 0 ? 0 : RecursionTree::CalcLayerElementCount(0, m_maxVisiblePortalsForRecursion);
+				info.isNextLayerHardwareStencil = isLayerHardwareStencil[1];
+				info.minPortalCoverage = drawoptions.minPortalCoverage;
+
+				if (drawoptions.maxRecursion == 0)
 				{
-					drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.scenePass.line[initialPipelineIndex].get());
+					info.maxVisiblePortalCount = 0;
+				}
 
-					// for now just bind it, we can use a different pipeline layout later
-					{
-						std::array<vk::DescriptorSet, 6> descriptorSets = {
+				m_portalManager.DrawPortals(info);
+
+			}
+		}
+	}
+	else
+	{
+		const int iteration = gsl::narrow<int>(subpassIndex / 2) - 1;
+		const int renderedInputIdx = iteration % 2;
+		const bool isLastIteration = (iteration == (recursionCount - 1));
+		const int pipelineIndex = iteration + 1;
+
+		// nothing of this layer is rendered outside of the portals of the previous layer
+		const vk::Rect2D layerScissor = m_subpassRecordState.isUsingLayerScissors
+			? layerScissors[iteration + 1]
+			: vk::Rect2D(vk::Offset2D(0, 0), m_swapchain.extent);
+
+		const bool isHardwareStencil = isLayerHardwareStencil[iteration + 1];
+
+		// last iteration draw all portals
+		const int maxVisiblePortalCount = gsl::narrow<int>((iteration == recursionCount - 1)
+			? 0
+			: m_maxVisiblePortalsForRecursion[iteration + 1]);
+
+		const int layerStartIndex = RecursionTree::CalcLayerStartIndex(iteration, m_maxVisiblePortalsForRecursion);
+		const int layerEndIndex = layerStartIndex + RecursionTree::CalcLayerElementCount(iteration, m_maxVisiblePortalsForRecursion);
+
+		if (subpassIndex % 2 == 0)
+		{
+			drawBuffer.setScissor(0, layerScissor);
+
+			//draw Scene
+			{
+				drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, isHardwareStencil
+					? m_pipelines.scenePass.sceneHardwareStencil[pipelineIndex].get()
+					: m_pipelines.scenePass.scene[pipelineIndex].get());
+
+				{
+					std::array<vk::DescriptorSet, 8> descriptorSets = {
 							m_descriptorSet_texture,
 							m_descriptorSet_ubo[m_currentframe],
 							m_descriptorSet_cameratMat[m_currentframe],
 							m_descriptorSet_rendered[renderedInputIdx],
 							m_descriptorSet_cameraIndices[m_currentframe],
 							m_descriptorSet_portalIndexHelper[m_currentframe],
-						};
+							m_descriptorSet_sceneObjects,
+							m_descriptorSet_culling[m_currentframe],
+					};
+
+					drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_scene.get(), 0, descriptorSets, {});
+				}
 
-						drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_lines.get(), 0, descriptorSets, {});
+				const int drawCommandSetIndex = (iteration + 1) * drawCommandSetsPerLayer;
 
-						lineDrawingFunction(m_pipelineLayout_lines.get(), drawBuffer, cameraIndexAndStencilCompare, cameraIndexAndStencilCompare);
+				// each camera is drawn with its own stencil reference, the stencil test happens before the fragment shader
+				if (isHardwareStencil)
+				{
+					for (int localCameraIndex = 0; localCameraIndex < layerEndIndex - layerStartIndex; ++localCameraIndex)
+					{
+						drawBuffer.setStencilReference(vk::StencilFaceFlagBits::eFront | vk::StencilFaceFlagBits::eBack, localCameraIndex + 1);
+						m_scene->Draw(*m_meshData, m_pipelineLayout_scene.get(), drawBuffer, m_currentframe,
+							drawCommandSetIndex + 1 + localCameraIndex, layerStartIndex, layerEndIndex);
 					}
 				}
+				else
+				{
+					m_scene->Draw(*m_meshData, m_pipelineLayout_scene.get(), drawBuffer, m_currentframe, drawCommandSetIndex, layerStartIndex, layerEndIndex);
+				}
 
 
-				// First Portal Pass
+				// draw Camera
 				{
-					drawBuffer.nextSubpass(vk::SubpassContents::eInline);
-					drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.portalPass.portal[initialPipelineIndex].get());
 
-					// for now just bind it, we can use a different pipeline layout later
+#if 1
+					drawBuffer.bindIndexBuffer(m_meshData->GetIndexBuffer(), 0, MeshDataManager::IndexBufferIndexType);
+					vk::DeviceSize vertexBufferOffset = 0;
+					drawBuffer.bindVertexBuffers(0, m_meshData->GetVertexBuffer(), vertexBufferOffset);
+
+					const MeshDataRef& cameraMeshRef = m_meshData->GetMeshes()[m_meshData->GetMeshes().size() - 1];
+					//const MeshDataRef& cameraMeshRef2 = m_meshData->GetMeshes()[1];
+
+					PushConstant_sceneObject pushConstant = {};
+					pushConstant.objectInstanceStride = -1;
+					pushConstant.layerStartIndex = layerStartIndex;
+
+					drawBuffer.pushConstants<PushConstant_sceneObject>(m_pipelineLayout_scene.get(), vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pushConstant);
+					if (isHardwareStencil)
 					{
-						std::array<vk::DescriptorSet, 6> descriptorSets = {
+						for (int localCameraIndex = 0; localCameraIndex < layerEndIndex - layerStartIndex; ++localCameraIndex)
+						{
+							drawBuffer.setStencilReference(vk::StencilFaceFlagBits::eFront | vk::StencilFaceFlagBits::eBack, localCameraIndex + 1);
+							drawBuffer.drawIndexed(cameraMeshRef.indexCount, 1, cameraMeshRef.firstIndex, 0, localCameraIndex);
+						}
+					}
+					else
+					{
+						drawBuffer.drawIndexed(cameraMeshRef.indexCount, layerEndIndex - layerStartIndex, cameraMeshRef.firstIndex, 0, 0);
+					}
+#if 0
+					cameraTransform.translation += glm::vec3(0.f, 1.f, 0.f);
+					pushConstant.model = cameraTransform.ToMat();
+					drawBuffer.pushConstants<PushConstant>(m_pipelineLayout_scene.get(), vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pushConstant);
+					drawBuffer.drawIndexed(cameraMeshRef2.indexCount, 1, cameraMeshRef2.firstIndex, 0, 1);
+#endif
+#endif
+				}
+
+			}
+
+			// draw lines
+			{
+
+				drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.scenePass.line[pipelineIndex].get());
+
+				{
+					std::array<vk::DescriptorSet, 6> descriptorSets = {
 							m_descriptorSet_texture,
 							m_descriptorSet_ubo[m_currentframe],
 							m_descriptorSet_cameratMat[m_currentframe],
 							m_descriptorSet_rendered[renderedInputIdx],
 							m_descriptorSet_cameraIndices[m_currentframe],
 							m_descriptorSet_portalIndexHelper[m_currentframe],
-						};
+					};
 
-						drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_portal.get(), 0, descriptorSets, {});
-					}
+					drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_lines.get(), 0, descriptorSets, {});
+				}
 
-					// draw Portals
-					{
-						DrawPortalsInfo info = {};
-						info.drawBuffer = drawBuffer;
-						info.layout = m_pipelineLayout_portal.get();
-						info.maxVisiblePortalCount = recursionCount == 0 ? 0 : m_maxVisiblePortalsForRecursion[0];
-						info.meshDataManager = m_meshData.get();
-						info.layerStartIndex = layerStartIndex;
-						info.nextLayerStartIndex = layerEndIndex;
-
-						if (drawoptions.maxRecursion == 0)
-						{
-							info.maxVisiblePortalCount = 0;
-						}
+				for (int elementIdx = layerStartIndex; elementIdx < layerEndIndex; ++elementIdx)
+				{
+					lineDrawingFunction(m_pipelineLayout_lines.get(), drawBuffer, elementIdx, elementIdx);
+				}
+			}
+		}
+		// Draw Portals
+		else
+		{
+			drawBuffer.setScissor(0, layerScissor);
+			drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.portalPass.portal[pipelineIndex].get());
 
-						m_portalManager.DrawPortals(info);
+			{
+				std::array<vk::DescriptorSet, 8> descriptorSets = {
+						m_descriptorSet_texture,
+						m_descriptorSet_ubo[m_currentframe],
+						m_descriptorSet_cameratMat[m_currentframe],
+						m_descriptorSet_rendered[renderedInputIdx],
+						m_descriptorSet_cameraIndices[m_currentframe],
+						m_descriptorSet_portalIndexHelper[m_currentframe],
+						m_descriptorSet_sceneObjects,
+						m_descriptorSet_culling[m_currentframe],
+				};
 
-					}
-				}
+				drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_portal.get(), 0, descriptorSets, {});
 			}
 
-			for (int iteration = 0; iteration < recursionCount; ++iteration)
+			const bool isNextLayerHardwareStencil = !isLastIteration && isLayerHardwareStencil[iteration + 2];
+
+			DrawPortalsInfo info = {};
+			info.drawBuffer = drawBuffer;
+			info.layout = m_pipelineLayout_portal.get();
+			info.maxVisiblePortalCount = maxVisiblePortalCount;
+			info.meshDataManager = m_meshData.get();
+			info.layerStartIndex = layerStartIndex;
+			info.nextLayerStartIndex = layerEndIndex;
+			info.objectCount = objectCount;
+			info.nextDrawCommandSetIndex = (iteration + 2) * drawCommandSetsPerLayer;
+			info.nextLayerInstanceCount = isLastIteration ? 0 : RecursionTree::CalcLayerElementCount(iteration + 1, m_maxVisiblePortalsForRecursion);
+			info.isNextLayerHardwareStencil = isNextLayerHardwareStencil;
+			info.minPortalCoverage = drawoptions.minPortalCoverage;
+			if (drawoptions.maxRecursion < iteration)
 			{
-				const int renderedInputIdx = iteration % 2;
-				const bool isLastIteration = (iteration == (recursionCount - 1));
-				const int pipelineIndex = iteration + 1;
+				info.maxVisiblePortalCount = 0;
+			}
+			m_portalManager.DrawPortals(info);
+		}
+	}
 
-				drawBuffer.nextSubpass(vk::SubpassContents::eInline);
+	if (drawoptions.collectLayerStatistics)
+	{
+		m_pipelineStatisticsQueries.End(drawBuffer, m_currentframe, subpassIndex);
+	}
+	if (m_hasDebugUtils)
+	{
+		drawBuffer.endDebugUtilsLabelEXT();
+	}
+}
 
-				// clear depth attachment, to be able to render objects "behind" the portal
-				{
-					vk::ClearAttachment clearDepthStencil = vk::ClearAttachment{}
-						.setColorAttachment(1)
-						.setAspectMask(VulkanUtils::GetDepthStencilAspectMask(m_depthStencilFormat))
-						.setClearValue(clearDepthStencilValue);
+std::optional<vk::ClearAttachment> GraphicsBackend::GetLayerClear(uint32_t subpassIndex) const
+{
+	// the first layer is cleared by the render pass
+	if (subpassIndex < 2)
+	{
+		return std::nullopt;
+	}
 
+	// a clear rect must not be empty, if it is, nothing is drawn anyway
+	const vk::Rect2D& layerScissor = m_subpassRecordState.layerScissors[subpassIndex / 2];
+	if (layerScissor.extent.width == 0 || layerScissor.extent.height == 0)
+	{
+		return std::nullopt;
+	}
 
-					const vk::ClearRect wholeScreen(vk::Rect2D(vk::Offset2D(0, 0), m_swapchain.extent), 0, 1);
-					std::array<vk::ClearAttachment, 1> clearAttachments = { clearDepthStencil, };
-					drawBuffer.clearAttachments(clearAttachments, wholeScreen);
-				}
+	const int layer = gsl::narrow<int>(subpassIndex / 2);
+	const std::array<bool, worstRecursionCount + 1>& isLayerHardwareStencil = m_subpassRecordState.isLayerHardwareStencil;
 
-				// last iteration draw all portals
-				const int maxVisiblePortalCount = gsl::narrow<int>((iteration == recursionCount - 1)
-					? 0
-					: m_maxVisiblePortalsForRecursion[iteration + 1]);
+	// clear depth attachment, to be able to render objects "behind" the portal
+	// hardware stencil layers keep the stencil, the previous portal pass wrote the camera masks into it
+	if (subpassIndex % 2 == 0)
+	{
+		return vk::ClearAttachment{}
+			.setColorAttachment(1)
+			.setAspectMask(isLayerHardwareStencil[layer]
+				? vk::ImageAspectFlagBits::eDepth
+				: VulkanUtils::GetDepthStencilAspectMask(m_depthStencilFormat))
+			.setClearValue(m_subpassRecordState.clearDepthStencilValue);
+	}
 
-				const int layerStartIndex = RecursionTree::CalcLayerStartIndex(iteration, m_maxVisiblePortalsForRecursion);
-				const int layerEndIndex = layerStartIndex + RecursionTree::CalcLayerElementCount(iteration, m_maxVisiblePortalsForRecursion);
+	// the stencil still holds the masks of this layer, the portals only overwrite the pixels they cover
+	const bool isNextLayerHardwareStencil = layer < m_subpassRecordState.recursionCount && isLayerHardwareStencil[layer + 1];
+	if (!isNextLayerHardwareStencil)
+	{
+		return std::nullopt;
+	}
 
-				//draw Scene
-				{
-					drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.scenePass.scene[pipelineIndex].get());
+	return vk::ClearAttachment{}
+		.setAspectMask(vk::ImageAspectFlagBits::eStencil)
+		.setClearValue(m_subpassRecordState.clearDepthStencilValue);
+}
 
-					{
-						std::array<vk::DescriptorSet, 6> descriptorSets = {
-								m_descriptorSet_texture,
-								m_descriptorSet_ubo[m_currentframe],
-								m_descriptorSet_cameratMat[m_currentframe],
-								m_descriptorSet_rendered[renderedInputIdx],
-								m_descriptorSet_cameraIndices[m_currentframe],
-								m_descriptorSet_portalIndexHelper[m_currentframe],
-						};
-
-						drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_scene.get(), 0, descriptorSets, {});
-					}
+bool GraphicsBackend::SubpassCommandsKey::operator==(const SubpassCommandsKey& rhs) const
+{
+	return maxVisiblePortalsForRecursion == rhs.maxVisiblePortalsForRecursion
+		&& recursionCount == rhs.recursionCount
+		&& isLayerHardwareStencil == rhs.isLayerHardwareStencil
+		&& maxRecursion == rhs.maxRecursion
+		&& minPortalCoverage == rhs.minPortalCoverage
+		&& collectLayerStatistics == rhs.collectLayerStatistics;
+}
 
-					m_scene->Draw(*m_meshData, m_pipelineLayout_scene.get(), drawBuffer, layerStartIndex, layerEndIndex);
+void GraphicsBackend::RenderCpuPortalViews(const Camera& camera, const DrawOptions& drawoptions)
+{
+	const uint32_t imageIndex = AcquireImage();
 
+	m_device->resetCommandPool(m_graphicsPresentCommandPools[m_currentframe].get(), {});
+	vk::CommandBuffer drawBuffer = m_graphicsPresentBuffer[m_currentframe].get();
 
-					// draw Camera
-					{
+	drawBuffer.begin(vk::CommandBufferBeginInfo{}.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+	// the views are not split into subpasses, only the whole frame is timed
+	m_gpuTimestamps.Reset(drawBuffer, m_currentframe);
+	m_gpuTimestamps.Write(drawBuffer, m_currentframe, 0, vk::PipelineStageFlagBits::eTopOfPipe);
+
+	const int recursionCount = std::min(gsl::narrow<int>(m_maxVisiblePortalsForRecursion.size()), drawoptions.maxRecursion);
+
+	RecursiveStencilRenderer::DrawInfo drawInfo;
+	drawInfo.drawBuffer = drawBuffer;
+	drawInfo.imageIndex = imageIndex;
+	drawInfo.cameraMat = camera.CalcMat();
+	drawInfo.projection = camera.GetProjectionMatrix();
+	drawInfo.clearColor = vk::ClearColorValue(backgroundColor);
+	drawInfo.maxVisiblePortalsForRecursion = m_maxVisiblePortalsForRecursion.first(recursionCount);
+	drawInfo.minPortalCoverage = drawoptions.minPortalCoverage;
+	drawInfo.useMeshLods = drawoptions.useMeshLods;
+	drawInfo.meshDataManager = m_meshData.get();
+	drawInfo.scene = m_scene.get();
+	drawInfo.portalManager = &m_portalManager;
+	drawInfo.triangleMeshes = m_triangleMeshes;
+
+	if (m_recursiveStencilRenderer)
+	{
+		m_recursiveStencilRenderer->Draw(drawInfo);
+	}
+	else
+	{
+		m_textureAtlasRenderer->Draw(drawInfo, drawoptions.impostorCache, drawoptions.recursionResolutionScales);
+	}
 
-#if 1
-						drawBuffer.bindIndexBuffer(m_meshData->GetIndexBuffer(), 0, MeshDataManager::IndexBufferIndexType);
-						vk::DeviceSize vertexBufferOffset = 0;
-						drawBuffer.bindVertexBuffers(0, m_meshData->GetVertexBuffer(), vertexBufferOffset);
+	m_gpuTimestamps.Write(drawBuffer, m_currentframe, 1);
+	m_timestampQueryCounts[m_currentframe] = 2;
 
-						const MeshDataRef& cameraMeshRef = m_meshData->GetMeshes()[m_meshData->GetMeshes().size() - 1];
-						//const MeshDataRef& cameraMeshRef2 = m_meshData->GetMeshes()[1];
+	RecordFrameReadback(drawBuffer, imageIndex);
+	drawBuffer.end();
 
-						PushConstant_sceneObject pushConstant = {};
-						pushConstant.model = camera.CalcMat();
-						pushConstant.layerStartIndex = layerStartIndex;
+	SubmitAndPresent(drawBuffer, imageIndex);
+}
 
-						drawBuffer.pushConstants<PushConstant_sceneObject>(m_pipelineLayout_scene.get(), vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pushConstant);
-						drawBuffer.drawIndexed(cameraMeshRef.indexCount, layerEndIndex - layerStartIndex, cameraMeshRef.firstIndex, 0, 0);
-#if 0
-						cameraTransform.translation += glm::vec3(0.f, 1.f, 0.f);
-						pushConstant.model = cameraTransform.ToMat();
-						drawBuffer.pushConstants<PushConstant>(m_pipelineLayout_scene.get(), vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pushConstant);
-						drawBuffer.drawIndexed(cameraMeshRef2.indexCount, 1, cameraMeshRef2.firstIndex, 0, 1);
-#endif
-#endif
-					}
+void GraphicsBackend::ReadGpuFrameTimings()
+{
+	const uint32_t queryCount = m_timestampQueryCounts[m_currentframe];
+	std::array<double, timestampQueriesPerFrame> timestampStorage;
+	const gsl::span<double> timestamps = gsl::make_span(timestampStorage).first(queryCount);
+	if (!m_gpuTimestamps.Read(m_currentframe, timestamps))
+	{
+		m_lastGpuFrameTimings.reset();
+		return;
+	}
 
-				}
+	// the vectors of the last timings are reused, so reading them does not allocate each frame
+	if (!m_lastGpuFrameTimings)
+	{
+		m_lastGpuFrameTimings.emplace();
+		m_lastGpuFrameTimings->sceneSubpassSeconds.reserve(worstRecursionCount + 1);
+		m_lastGpuFrameTimings->portalSubpassSeconds.reserve(worstRecursionCount + 1);
+	}
+	GpuFrameTimings& timings = *m_lastGpuFrameTimings;
+	timings.frameSeconds = timestamps[queryCount - 1];
+	timings.setupSeconds = 0.0;
+	timings.sceneSubpassSeconds.clear();
+	timings.portalSubpassSeconds.clear();
+
+	// breadth first layout: query 1 + s starts subpass s, scene and portal subpass alternate, the last query ends the render pass
+	if (queryCount > 2)
+	{
+		timings.setupSeconds = timestamps[1];
 
-				// draw lines
-				{
+		const uint32_t layerCount = (queryCount - 2) / 2;
+		for (uint32_t layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+		{
+			const uint32_t sceneQueryIndex = 1 + 2 * layerIndex;
+			timings.sceneSubpassSeconds.push_back(timestamps[sceneQueryIndex + 1] - timestamps[sceneQueryIndex]);
+			timings.portalSubpassSeconds.push_back(timestamps[sceneQueryIndex + 2] - timestamps[sceneQueryIndex + 1]);
+		}
+	}
+}
 
-					drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.scenePass.line[pipelineIndex].get());
+void GraphicsBackend::ReadLayerStatistics()
+{
+	m_lastLayerStatistics.clear();
 
-					{
-						std::array<vk::DescriptorSet, 6> descriptorSets = {
-								m_descriptorSet_texture,
-								m_descriptorSet_ubo[m_currentframe],
-								m_descriptorSet_cameratMat[m_currentframe],
-								m_descriptorSet_rendered[renderedInputIdx],
-								m_descriptorSet_cameraIndices[m_currentframe],
-								m_descriptorSet_portalIndexHelper[m_currentframe],
-						};
-
-						drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_lines.get(), 0, descriptorSets, {});
-					}
+	const LayerStatisticsConfig& config = m_layerStatisticsConfigs[m_currentframe];
+	if (!config.isCollected)
+	{
+		return;
+	}
 
-					for (int elementIdx = layerStartIndex; elementIdx < layerEndIndex; ++elementIdx)
-					{
-						lineDrawingFunction(m_pipelineLayout_lines.get(), drawBuffer, elementIdx, elementIdx);
-					}
-				}
-				// Draw Portals
-				{
-					drawBuffer.nextSubpass(vk::SubpassContents::eInline);
-					drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.portalPass.portal[pipelineIndex].get());
+	const gsl::span<const int> recursionConfig = config.GetMaxVisiblePortalsForRecursion();
+	const int layerCount = config.recursionCount + 1;
+	m_lastLayerStatistics.resize(layerCount);
 
-					const int cameraIndicesLayerStartIndex =
-						isLastIteration ? 0 : RecursionTree::CalcLayerStartIndex(iteration + 1, m_maxVisiblePortalsForRecursion);
+	// query 2 * layer is the scene pass of the layer, the next one its portal pass
+	std::array<PipelineStatistics, 2 * (worstRecursionCount + 1)> statisticsStorage;
+	const gsl::span<PipelineStatistics> subpassStatistics = gsl::make_span(statisticsStorage).first(2 * layerCount);
+	const bool hasSubpassStatistics = m_pipelineStatisticsQueries.Read(m_currentframe, subpassStatistics);
+	for (int layerIndex = 0; layerIndex < layerCount && hasSubpassStatistics; ++layerIndex)
+	{
+		m_lastLayerStatistics[layerIndex].scenePass = subpassStatistics[2 * layerIndex];
+		m_lastLayerStatistics[layerIndex].portalPass = subpassStatistics[2 * layerIndex + 1];
+	}
 
-					const int firstCameraIndicesOffsetForLayer =
-						isLastIteration ? 0 : m_maxVisiblePortalsForRecursion[iteration + 1];
+	const UniqueVmaBuffer& counterBuffer = m_discardCounterBuffer[m_currentframe];
+	vmaInvalidateAllocation(m_allocator.get(), counterBuffer.GetAllocation(), 0, VK_WHOLE_SIZE);
 
-					{
-						std::array<vk::DescriptorSet, 6> descriptorSets = {
-								m_descriptorSet_texture,
-								m_descriptorSet_ubo[m_currentframe],
-								m_descriptorSet_cameratMat[m_currentframe],
-								m_descriptorSet_rendered[renderedInputIdx],
-								m_descriptorSet_cameraIndices[m_currentframe],
-								m_descriptorSet_portalIndexHelper[m_currentframe],
-						};
-
-						drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout_portal.get(), 0, descriptorSets, {});
-					}
+	// the counters of the stencil values follow the enable flag, the stencil values of a layer are its camera index range
+	const uint32_t* counters = static_cast<const uint32_t*>(GetMappedMemory(counterBuffer)) + 1;
+	for (int layerIndex = 1; layerIndex < layerCount; ++layerIndex)
+	{
+		const int layerStartIndex = RecursionTree::CalcLayerStartIndex(layerIndex - 1, recursionConfig);
+		const int layerEndIndex = layerStartIndex + RecursionTree::CalcLayerElementCount(layerIndex - 1, recursionConfig);
 
-					DrawPortalsInfo info = {};
-					info.drawBuffer = drawBuffer;
-					info.layout = m_pipelineLayout_portal.get();
-					info.maxVisiblePortalCount = maxVisiblePortalCount;
-					info.meshDataManager = m_meshData.get();
-					info.layerStartIndex = layerStartIndex;
-					info.nextLayerStartIndex = layerEndIndex;
-					if (drawoptions.maxRecursion < iteration)
-					{
-						info.maxVisiblePortalCount = 0;
-					}
-					m_portalManager.DrawPortals(info);
+		LayerStatistics& statistics = m_lastLayerStatistics[layerIndex];
+		for (int stencilValue = layerStartIndex; stencilValue < layerEndIndex; ++stencilValue)
+		{
+			statistics.sceneStencilDiscards += counters[stencilValue * 4 + 0];
+			statistics.sceneDepthDiscards += counters[stencilValue * 4 + 1];
+			statistics.portalStencilDiscards += counters[stencilValue * 4 + 2];
+			statistics.portalDepthDiscards += counters[stencilValue * 4 + 3];
+		}
+	}
+}
 
-				}
+uint32_t GraphicsBackend::AcquireImage()
+{
+	if (IsHeadless())
+	{
+		return gsl::narrow<uint32_t>(m_currentframe);
+	}
 
-			
-			}
+	constexpr uint64_t noTimeout = std::numeric_limits<uint64_t>::max();
 
-			// make up for skipped passes
-			for (int i = recursionCount; i < worstRecursionCount; ++i)
-			{
-				drawBuffer.nextSubpass(vk::SubpassContents::eInline);
-				drawBuffer.nextSubpass(vk::SubpassContents::eInline);
-			}
+	const auto beforeAcquire = std::chrono::steady_clock::now();
+	uint32_t imageIndex;
+	vk::Result aquireResult = m_device->acquireNextImageKHR(
+		m_swapchain.swapchain.get(), noTimeout, m_imageAvailableSem[m_currentframe].get(), {}, &imageIndex);
+	assert(aquireResult == vk::Result::eSuccess);
+	m_lastPresentWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - beforeAcquire).count();
 
-			drawBuffer.endRenderPass();
-		}
-		drawBuffer.end();
+	return imageIndex;
+}
+
+void GraphicsBackend::RecordFrameReadback(vk::CommandBuffer drawBuffer, uint32_t imageIndex)
+{
+	if (!IsHeadless() || m_frameOutputPrefix.empty())
+	{
+		return;
+	}
+
+	// the render pass already left the image in the transfer layout
+	drawBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eColorAttachmentOutput,
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::DependencyFlags{}, vk::MemoryBarrier{}
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eTransferRead), {}, {});
+
+	drawBuffer.copyImageToBuffer(m_swapchain.images[imageIndex], vk::ImageLayout::eTransferSrcOptimal, m_frameReadbackBuffer[m_currentframe].Get(),
+		vk::BufferImageCopy{}
+			.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1))
+			.setImageExtent(vk::Extent3D(m_swapchain.extent.width, m_swapchain.extent.height, 1)));
+
+	drawBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer,
+		vk::PipelineStageFlagBits::eHost,
+		vk::DependencyFlags{}, vk::MemoryBarrier{}
+			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead), {}, {});
+}
 
+void GraphicsBackend::SubmitAndPresent(vk::CommandBuffer drawBuffer, uint32_t imageIndex)
+{
+	PROFILE_SCOPE("GraphicsBackend::SubmitAndPresent");
 
-		vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+	// offscreen images are neither acquired nor presented, so there is nothing to wait for or signal
+	if (IsHeadless())
+	{
 		m_graphicsPresentQueues.submit(vk::SubmitInfo{}
 			.setCommandBufferCount(1).setPCommandBuffers(&drawBuffer)
-			.setWaitSemaphoreCount(1).setPWaitSemaphores(&(m_imageAvailableSem[m_currentframe].get())).setPWaitDstStageMask(waitStages)
-			.setSignalSemaphoreCount(1).setPSignalSemaphores(&(m_renderFinishedSem[m_currentframe].get()))
 			, m_frameFence[m_currentframe].get());
 
-		m_graphicsPresentQueues.presentKHR(vk::PresentInfoKHR{}
-			.setWaitSemaphoreCount(1).setPWaitSemaphores(&(m_renderFinishedSem[m_currentframe].get()))
-			.setSwapchainCount(1).setPSwapchains(&(m_swapchain.swapchain.get())).setPImageIndices(&imageIndex)
-		);
-		m_currentframe = (m_currentframe + 1) % MaxInFlightFrames;
+		if (!m_frameOutputPrefix.empty())
+		{
+			WriteFrame();
+		}
 
+		m_currentframe = (m_currentframe + 1) % MaxInFlightFrames;
+		return;
 	}
 
+	vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+	m_graphicsPresentQueues.submit(vk::SubmitInfo{}
+		.setCommandBufferCount(1).setPCommandBuffers(&drawBuffer)
+		.setWaitSemaphoreCount(1).setPWaitSemaphores(&(m_imageAvailableSem[m_currentframe].get())).setPWaitDstStageMask(waitStages)
+		.setSignalSemaphoreCount(1).setPSignalSemaphores(&(m_renderFinishedSem[m_currentframe].get()))
+		, m_frameFence[m_currentframe].get());
+
+	const auto beforePresent = std::chrono::steady_clock::now();
+	m_graphicsPresentQueues.presentKHR(vk::PresentInfoKHR{}
+		.setWaitSemaphoreCount(1).setPWaitSemaphores(&(m_renderFinishedSem[m_currentframe].get()))
+		.setSwapchainCount(1).setPSwapchains(&(m_swapchain.swapchain.get())).setPImageIndices(&imageIndex)
+	);
+	m_lastPresentWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - beforePresent).count();
+	m_currentframe = (m_currentframe + 1) % MaxInFlightFrames;
+}
+
+void GraphicsBackend::WriteFrame()
+{
+	// the fence stays signaled, so the wait at the start of the next use of the frame returns immediately
+	constexpr uint64_t noTimeout = std::numeric_limits<uint64_t>::max();
+	m_device->waitForFences(m_frameFence[m_currentframe].get(), true, noTimeout);
+
+	const UniqueVmaBuffer& readbackBuffer = m_frameReadbackBuffer[m_currentframe];
+	vmaInvalidateAllocation(m_allocator.get(), readbackBuffer.GetAllocation(), 0, VK_WHOLE_SIZE);
+
+	// the offscreen images are bgra
+	const size_t pixelCount = size_t(m_swapchain.extent.width) * m_swapchain.extent.height;
+	const gsl::span<const uint8_t> bgraPixels(static_cast<const uint8_t*>(GetMappedMemory(readbackBuffer)), pixelCount * 4);
+
+	// the path and the png storage keep their capacity, so only the first written frame allocates
+	char frameNumber[16];
+	std::snprintf(frameNumber, std::size(frameNumber), "%05d", m_writtenFrameCount++);
+	m_frameOutputPath.assign(m_frameOutputPrefix).append(frameNumber).append(".png");
+	if (!PngWriter::Write(m_frameOutputPath.c_str(), m_swapchain.extent.width, m_swapchain.extent.height, bgraPixels,
+		PngWriter::PixelFormat::Bgra, m_pngStorage))
+	{
+		std::printf("could not write %s \n", m_frameOutputPath.c_str());
+		std::cout.flush();
+	}
 }
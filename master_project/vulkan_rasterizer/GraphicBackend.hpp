@@ -14,44 +14,213 @@
 #include "NTree.hpp"
 #include "TriangleMesh.hpp"
 #include "LineDrawer.hpp"
+#include "RecursiveStencilRenderer.hpp"
+#include "TextureAtlasRenderer.hpp"
+#include "SecondaryCommandRecorder.hpp"
+#include "PersistentPipelineCache.hpp"
+#include "GpuTimestamps.hpp"
+#include "PipelineStatisticsQueries.hpp"
+#include "HeatmapPass.hpp"
+#include "FrameArena.hpp"
+#include "UploadRingBuffer.hpp"
+#include "AsyncUploader.hpp"
+#include "LevelLoader.hpp"
 
 class Camera;
 
+// debug output of the breadth first renderer, replaces the rendered image
+enum class HeatmapMode : uint32_t
+{
+	Off,
+
+	// fragments shaded per pixel, summed over all subpasses
+	Overdraw,
+
+	// deepest recursion layer drawn into each pixel
+	RecursionDepth,
+
+	enum_size_HeatmapMode
+};
+
 struct DrawOptions
 {
+	// the render loop reserves its copy of the lines for maxExtraLineCount of them
 	std::vector<Line> extraLines;
+	static constexpr size_t maxExtraLineCount = 64;
+
 	int maxRecursion = std::numeric_limits<int>::max();
+
+	// portals covering less pixels (in the previous frame) don't spawn a camera and are shaded flat, 0 disables it
+	int minPortalCoverage = 64;
+
+	// only used by the breadth first renderer, cameras are only created if they or one of their closest ancestors were rendered
+	// in the last finished frame, see PortalManager::CreateActiveCameraMask. The value is the number of layers below them, negative disables it
+	int visibilityReuseMarginLayers = 2;
+
+	// only used by the breadth first renderer, each subpass is recorded into a secondary command buffer on a worker thread
+	bool useSecondaryCommandBuffers = true;
+
+	// the secondary command buffers are kept while the recursion configuration and these options stay the same
+	// secondary command buffers can't inherit the scissor, so the cached ones draw the whole screen in each layer
+	// the layer clears use the layer scissors of each frame, they are recorded into small secondaries every frame
+	bool cacheSubpassCommands = true;
+
+	// masks layers with the stencil attachment instead of the rendered stencil, only used if the hardware supports it
+	bool useHardwareStencil = true;
+
+	// scene objects use coarser lods in deeper layers and when they are small on screen, see MeshLodSelection
+	bool useMeshLods = true;
+
+	// only used by the breadth first renderer, queries the pipeline statistics of each subpass and counts the fragments
+	// discarded by the rendered stencil and depth tests, see GraphicsBackend::GetLastLayerStatistics
+	bool collectLayerStatistics = false;
+
+	// only used by the breadth first renderer, see HeatmapPass
+	HeatmapMode heatmap = HeatmapMode::Off;
+
+	// only used by the texture atlas renderer, disabled by default
+	TextureAtlasRenderer::ImpostorCacheOptions impostorCache;
+
+	// only used by the texture atlas renderer, fraction of the screen resolution a view is rendered at, starting with recursion depth 1
+	// deeper views use the last scale
+	std::vector<float> recursionResolutionScales = { 1.f, 0.5f, 0.25f };
+};
+
+// shading work of a recursion layer of the breadth first renderer
+struct LayerStatistics
+{
+	// all zero if the device has no pipeline statistics queries
+	PipelineStatistics scenePass;
+	PipelineStatistics portalPass;
+
+	// fragments which were shaded and then discarded by the tests against the rendered stencil and depth
+	// the first layer has no rendered attachments to test against, so they stay zero
+	uint64_t sceneStencilDiscards = 0;
+	uint64_t sceneDepthDiscards = 0;
+	uint64_t portalStencilDiscards = 0;
+	uint64_t portalDepthDiscards = 0;
+};
+
+enum class RendererType
+{
+	// one scene and one portal subpass per recursion layer, all cameras of the NTree are allocated up front
+	BreadthFirst,
+
+	// see RecursiveStencilRenderer, portal lines are not drawn
+	DepthFirstStencil,
+
+	// see TextureAtlasRenderer, portal lines are not drawn
+	TextureAtlas,
 };
 
 class GraphicsBackend
 {
 public:
-	void Init(SDL_Window* window, Camera& camera);
+	// without a window the frames are rendered into offscreen images of the extent, no surface or swapchain extension is needed,
+	// so any device can be used, including software rasterizers
+	void Init(SDL_Window* window, vk::Extent2D extent, Camera& camera, RendererType rendererType = RendererType::BreadthFirst);
+	// the level has to be resident, see PollLevelUploads
 	void Render(const Camera& camera, const DrawOptions&  drawoptions);
 	void WaitIdle() { m_device->waitIdle(); }
 
+	// the meshes, objects and texture of the level are uploaded in the background after Init
+	// returns whether they can be drawn, waits at most timeoutNanoseconds for the uploads if they can't yet
+	bool PollLevelUploads(uint64_t timeoutNanoseconds);
+
 	gsl::span<const TriangleMesh> GetTriangleMeshes() const { return m_triangleMeshes; }
 	const PortalManager& GetPortalManager() const { return m_portalManager; }
 
+	// the cameras of the level loaded by Init, Init already placed the camera at the first one
+	gsl::span<const LevelLoader::CameraObject> GetLevelCameras() const { return m_levelCameras; }
+
 	void SetMaxVisiblePortalsForRecursion(gsl::span<const int> visiblePortals) { m_maxVisiblePortalsForRecursion = visiblePortals; }
+
+	// time the last Render call waited for the gpu to finish the previous use of the frame resources
+	double GetLastFenceWaitSeconds() const { return m_lastFenceWaitSeconds; }
+
+	// time the last Render call spent in acquiring and presenting the swapchain image, this is where fifo usually blocks for vsync
+	double GetLastPresentWaitSeconds() const { return m_lastPresentWaitSeconds; }
+
+	// with fifo presentation the fence wait can include waiting for vsync, so it says nothing about the gpu load
+	bool IsPresentModeFifo() const { return !IsHeadless() && m_swapchain.presentMode == vk::PresentModeKHR::eFifo; }
+
+	// gpu times of the frame whose fence the last Render call waited for, so they lag MaxInFlightFrames behind
+	// nullopt if the queue has no timestamps or the frame index was not used yet
+	const std::optional<GpuFrameTimings>& GetLastGpuFrameTimings() const { return m_lastGpuFrameTimings; }
+
+	// one element per rendered layer of the frame whose fence the last Render call waited for
+	// empty if that frame did not collect them, see DrawOptions::collectLayerStatistics
+	const std::vector<LayerStatistics>& GetLastLayerStatistics() const { return m_lastLayerStatistics; }
+
+	// requires VK_EXT_shader_stencil_export and a depth format with stencil
+	bool IsHardwareStencilSupported() const { return m_isHardwareStencilSupported; }
+
+	bool IsHeadless() const { return !m_swapchain.swapchain; }
+
+	std::string GetDeviceName() const { return m_physicalDevice.getProperties().deviceName; }
+
+	// only used without a window, each following frame is written to <prefix>00000.png, <prefix>00001.png and so on
+	// waits for the frame to finish, empty disables it
+	void SetFrameOutputPrefix(std::string prefix) { m_frameOutputPrefix = std::move(prefix); }
 private:
+	// renderers which find the portal views on the cpu
+	void RenderCpuPortalViews(const Camera& camera, const DrawOptions& drawoptions);
+
+	// offscreen images are used in the order of the frames, their fences already guard them
+	uint32_t AcquireImage();
+
+	// records a subpass of the breadth first render pass, on a recording thread or inline, see m_subpassRecordState
+	// secondary command buffers don't inherit any state, so each subpass sets its scissor and binds everything it uses
+	void RecordSubpass(vk::CommandBuffer drawBuffer, uint32_t subpassIndex);
+	// the depth and stencil clear of the layer rect at the start of the subpass, if it has one
+	// recorded by Render each frame, so the subpass commands don't depend on the layer scissors
+	std::optional<vk::ClearAttachment> GetLayerClear(uint32_t subpassIndex) const;
+
+	// copies the rendered image into the frame readback buffer, if the frames are written to files
+	void RecordFrameReadback(vk::CommandBuffer drawBuffer, uint32_t imageIndex);
+	void SubmitAndPresent(vk::CommandBuffer drawBuffer, uint32_t imageIndex);
+	void WriteFrame();
+
+	// reads the timestamps of the current frame index, its fence has to be waited for
+	void ReadGpuFrameTimings();
+
+	// reads the queries and discard counters of the current frame index, its fence has to be waited for
+	void ReadLayerStatistics();
+
 	static constexpr int MaxInFlightFrames = 2;	
+	static constexpr int maxRecordingThreadCount = 8;
 	static constexpr int maxPortalCount = 12;
 	static constexpr int worstMaxVisiblePortalsForRecursion[] = 
 		{ maxPortalCount, maxPortalCount, maxPortalCount, maxPortalCount, maxPortalCount };
 	static constexpr int worstRecursionCount = gsl::narrow<int>(std::size(worstMaxVisiblePortalsForRecursion));
 
 
+	// start of the command buffer, start of each subpass and end of the render pass
+	static constexpr uint32_t timestampQueriesPerFrame = 2 + 2 * (worstRecursionCount + 1);
+
 	static constexpr int cameraMatricesMaxCount = NTree::CalcTotalElements(maxPortalCount, worstRecursionCount + 1);
 	static_assert(cameraMatricesMaxCount <= 3257437);
 
+	// each camera of a hardware stencil layer records its own draws and needs its own draw command set
+	// so only small layers use it, larger ones fall back to the rendered stencil, it has to stay below 256 stencil values
+	static constexpr int hardwareStencilMaxLayerSize = 16;
+	static_assert(hardwareStencilMaxLayerSize < 256);
+
+	// one set for layers using the rendered stencil, followed by one set per camera for hardware stencil layers
+	static constexpr int drawCommandSetsPerLayer = 1 + hardwareStencilMaxLayerSize;
+
 	gsl::span<const int> m_maxVisiblePortalsForRecursion;
 
 	vk::UniqueInstance m_vkInstance;
 	vk::PhysicalDevice m_physicalDevice;
 	vk::UniqueDevice m_device;
+	PersistentPipelineCache m_pipelineCache;
+	bool m_supportsStencilExport = false;
+	bool m_isHardwareStencilSupported = false;
 	VmaRAII::UniqueVmaAllocator m_allocator;
 
+	// VK_EXT_debug_utils, without it there is no messenger and no labels
+	bool m_hasDebugUtils = false;
 	vk::UniqueDebugUtilsMessengerEXT m_debugUtilsMessenger;
 
 	vk::UniqueSurfaceKHR m_surface;
@@ -71,6 +240,9 @@ private:
 	vk::UniqueShaderModule m_fragShaderModule_portal;
 	vk::UniqueShaderModule m_fragShaderModule_portal_subsequent;
 
+	vk::UniqueShaderModule m_compShaderModule_cull;
+
+	// offscreen images without a window, see Swapchain::CreateOffscreen
 	Swapchain m_swapchain;
 	vk::Format m_depthStencilFormat;
 	UniqueVmaImage m_depthBuffer;
@@ -86,15 +258,49 @@ private:
 	UniqueVmaImage m_textureImage;
 	vk::UniqueImageView m_textureImageView;
 
-	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_ubo_buffer;
-	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_cameratMat_buffer;
+	// the ubo, camera mats and camera clip data are frame regions of the upload ring, the async uploader stages in its staging ring
+	UploadRingBuffer m_uploadRing;
+	static constexpr int uboFrameRegion = 0;
+	static constexpr int cameraMatFrameRegion = 1;
+	static constexpr int cameraClipDataFrameRegion = 2;
 
 	// Stores indices to access the camera mat buffer
 	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_cameraIndexBuffer;
 
+	// copy of the camera index buffer, read when the frame fence of the same frame index is waited for
+	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_cameraIndexReadbackBuffer;
+
+	// element count copied into the readback buffers, 0 if the frame index was not used by the breadth first renderer yet
+	std::array<int, MaxInFlightFrames> m_cameraIndexReadbackCounts = {};
+
+	// see PortalManager::CreateActiveCameraMask, empty if all cameras are created
+	std::vector<bool> m_activeCameras;
+
+	// the transient data of Render, reset at its start
+	FrameArena m_frameArena;
+
 	// only used by portal rendering, to calc its index, so it can write into the correct location of cameraMatIndexBuffer
 	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_portalIndexHelperBuffer;
 
+	// cameras (local stencil values) which can see an object, for each layer and object, see cull.comp
+	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_instanceListBuffer;
+
+	// bitmask of the objects which are inside the frustum of a camera, for each camera of the NTree
+	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_objectVisibilityBuffer;
+
+	// pixels covered by each camera of the NTree, the portal pass uses the counts of the previous frame
+	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_portalCoverageBuffer;
+	bool m_isPortalCoverageCleared = false;
+
+	// the lod of each object in each layer, chosen by the cameras which can see it, see cull.comp
+	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_objectLodBuffer;
+
+	// see DrawOptions::collectLayerStatistics, an enable flag followed by four counters per stencil value, read by the cpu
+	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_discardCounterBuffer;
+
+	// see DrawOptions::heatmap, a Ssbo_HeatmapHeader followed by the counters of each pixel
+	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_heatmapBuffer;
+
 	std::array<UniqueVmaImage, 2> m_image_renderedDepth;
 	std::array<vk::UniqueImageView, 2> m_imageview_renderedDepth;
 
@@ -107,6 +313,8 @@ private:
 	vk::UniqueDescriptorSetLayout m_descriptorSetLayout_cameraIndices;
 	vk::UniqueDescriptorSetLayout m_descriptorSetLayout_portalIndexHelper;
 	vk::UniqueDescriptorSetLayout m_descriptorSetLayout_rendered;
+	vk::UniqueDescriptorSetLayout m_descriptorSetLayout_sceneObjects;
+	vk::UniqueDescriptorSetLayout m_descriptorSetLayout_culling;
 
 	vk::DescriptorSet m_descriptorSet_texture;
 	std::array<vk::DescriptorSet, MaxInFlightFrames> m_descriptorSet_ubo;
@@ -114,12 +322,17 @@ private:
 	std::array<vk::DescriptorSet, MaxInFlightFrames> m_descriptorSet_cameraIndices;
 	std::array<vk::DescriptorSet, MaxInFlightFrames> m_descriptorSet_portalIndexHelper;
 	std::array<vk::DescriptorSet, 2> m_descriptorSet_rendered;
+	vk::DescriptorSet m_descriptorSet_sceneObjects;
+	std::array<vk::DescriptorSet, MaxInFlightFrames> m_descriptorSet_culling;
 
 	
 
 	vk::UniquePipelineLayout m_pipelineLayout_portal;
 	vk::UniquePipelineLayout m_pipelineLayout_scene;
 	vk::UniquePipelineLayout m_pipelineLayout_lines;
+	vk::UniquePipelineLayout m_pipelineLayout_cull;
+
+	vk::UniquePipeline m_pipeline_cull;
 
 	std::array<vk::UniqueCommandPool, MaxInFlightFrames> m_graphicsPresentCommandPools;
 	std::array<vk::UniqueCommandBuffer, MaxInFlightFrames> m_graphicsPresentBuffer;
@@ -128,12 +341,43 @@ private:
 	std::array<vk::UniqueSemaphore, MaxInFlightFrames> m_imageAvailableSem;
 	std::array<vk::UniqueSemaphore, MaxInFlightFrames> m_renderFinishedSem;
 	int m_currentframe = 0;
+	double m_lastFenceWaitSeconds = 0.0;
+	double m_lastPresentWaitSeconds = 0.0;
+
+	// queries written into the pool of each frame index, 0 if it was not used yet
+	GpuTimestamps m_gpuTimestamps;
+	std::array<uint32_t, MaxInFlightFrames> m_timestampQueryCounts = {};
+	std::optional<GpuFrameTimings> m_lastGpuFrameTimings;
+
+	// one query per breadth first subpass
+	PipelineStatisticsQueries m_pipelineStatisticsQueries;
+
+	// the recursion config each frame index collected the layer statistics with, fixed size so collecting them does not allocate
+	struct LayerStatisticsConfig
+	{
+		bool isCollected = false;
+		int recursionCount = 0;
+		std::array<int, worstRecursionCount> maxVisiblePortalsForRecursion = {};
+
+		gsl::span<const int> GetMaxVisiblePortalsForRecursion() const { return gsl::make_span(maxVisiblePortalsForRecursion).first(recursionCount); }
+	};
+
+	std::array<LayerStatisticsConfig, MaxInFlightFrames> m_layerStatisticsConfigs;
+	std::vector<LayerStatistics> m_lastLayerStatistics;
+
+	// see SetFrameOutputPrefix, the buffers only exist without a window
+	std::string m_frameOutputPrefix;
+	std::array<UniqueVmaBuffer, MaxInFlightFrames> m_frameReadbackBuffer;
+	int m_writtenFrameCount = 0;
+	std::string m_frameOutputPath;
+	std::vector<uint8_t> m_pngStorage;
 
 
 	struct ScenePassPipelines
 	{
 
 		std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> scene;
+		std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> sceneHardwareStencil;
 		std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> line;
 	};
 
@@ -154,7 +398,75 @@ private:
 
 	std::unique_ptr<MeshDataManager> m_meshData;
 	std::vector<TriangleMesh> m_triangleMeshes;
+	std::vector<LevelLoader::CameraObject> m_levelCameras;
 	std::unique_ptr<Scene> m_scene;
+
+	// destroyed before the resources it writes, it waits for the pending uploads
+	std::unique_ptr<AsyncUploader> m_asyncUploader;
+	// the uploads finish in order, so the last upload of the level stands for all of them
+	AsyncUploader::Ticket m_levelUploadTicket = AsyncUploader::noUpload;
 	PortalManager m_portalManager;
 	std::vector<Line> m_portalAABBLines;
+
+	// only created for their RendererType, none of the breadth first resources exist in that case
+	std::unique_ptr<RecursiveStencilRenderer> m_recursiveStencilRenderer;
+	std::unique_ptr<TextureAtlasRenderer> m_textureAtlasRenderer;
+
+	// only created for the breadth first renderer
+	std::unique_ptr<SecondaryCommandRecorder> m_secondaryCommandRecorder;
+	std::unique_ptr<HeatmapPass> m_heatmapPass;
+
+	// the values of Render which RecordSubpass reads, set before the subpasses are recorded
+	struct SubpassRecordState
+	{
+		const DrawOptions* drawoptions = nullptr;
+		gsl::span<const vk::Rect2D> layerScissors;
+		std::array<bool, worstRecursionCount + 1> isLayerHardwareStencil = {};
+		int recursionCount = 0;
+		int objectCount = 0;
+
+		// cached commands draw the whole screen in each layer instead
+		bool isUsingLayerScissors = true;
+
+		vk::ClearDepthStencilValue clearDepthStencilValue;
+	};
+
+	SubpassRecordState m_subpassRecordState;
+
+	// created in Init, so recording the subpasses allocates neither the functions nor their labels
+	// each function only captures this and its subpass index, which fits into the storage of the std::function
+	std::array<SecondaryCommandRecorder::RecordFunction, 2 * (worstRecursionCount + 1)> m_subpassRecordFunctions;
+	std::array<std::string, 2 * (worstRecursionCount + 1)> m_subpassLabels;
+
+	// everything the recorded subpass commands depend on, besides the contents of the buffers
+	// fixed size, so the key of each frame is created without allocating
+	struct SubpassCommandsKey
+	{
+		// the elements after recursionCount are 0
+		std::array<int, worstRecursionCount> maxVisiblePortalsForRecursion;
+		int recursionCount;
+		std::array<bool, worstRecursionCount + 1> isLayerHardwareStencil;
+		int maxRecursion;
+		int minPortalCoverage;
+		bool collectLayerStatistics;
+
+		bool operator==(const SubpassCommandsKey& rhs) const;
+	};
+
+	// see DrawOptions::cacheSubpassCommands, the buffers belong to the recorder
+	struct CachedSubpassCommands
+	{
+		std::optional<SubpassCommandsKey> key;
+
+		// part of the key, compared without copying it each frame
+		std::vector<Line> extraLines;
+
+		std::vector<vk::CommandBuffer> buffers;
+	};
+
+	std::array<CachedSubpassCommands, MaxInFlightFrames> m_cachedSubpassCommands;
+
+	// [frameIndex][subpassIndex], recorded each frame and executed before the secondary of their subpass
+	// allocated from m_graphicsPresentCommandPools, which are reset each frame
+	std::array<std::vector<vk::UniqueCommandBuffer>, MaxInFlightFrames> m_layerClearBuffers;
 };
@@ -4,6 +4,8 @@
 #include "GetSizeUint32.hpp"
 #include "NTree.hpp"
 #include <charconv>
+#include <future>
+#include <thread>
 
 namespace
 {
@@ -44,7 +46,34 @@ namespace
 		.setPVertexAttributeDescriptions(nullptr)
 		;
 
-
+	// the shaders are compiled when the pipelines are created, so the create infos are split into one batch per thread
+	// pipeline caches are internally synchronized, all threads can use the same one
+	std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> CreateGraphicsPipelinesParallel(
+		vk::Device device, vk::PipelineCache pipelineCache, gsl::span<const vk::GraphicsPipelineCreateInfo> createInfos)
+	{
+		const gsl::index createInfoCount = createInfos.size();
+		const gsl::index threadCount = std::clamp<gsl::index>(std::thread::hardware_concurrency(), 1, std::max<gsl::index>(createInfoCount, 1));
+		const gsl::index batchSize = (createInfoCount + threadCount - 1) / threadCount;
+
+		std::vector<std::future<std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>>>> batches;
+		for (gsl::index batchStart = 0; batchStart < createInfoCount; batchStart += batchSize)
+		{
+			const gsl::span<const vk::GraphicsPipelineCreateInfo> batch = createInfos.subspan(batchStart, std::min(batchSize, createInfoCount - batchStart));
+			batches.push_back(std::async(std::launch::async, [device, pipelineCache, batch]()
+				{
+					return device.createGraphicsPipelinesUnique(pipelineCache, { GetSizeUint32(batch), std::data(batch) });
+				}));
+		}
+
+		std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> pipelines;
+		pipelines.reserve(createInfoCount);
+		for (auto& batch : batches)
+		{
+			std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> batchPipelines = batch.get();
+			pipelines.insert(pipelines.end(), std::make_move_iterator(batchPipelines.begin()), std::make_move_iterator(batchPipelines.end()));
+		}
+		return pipelines;
+	}
 }
 
 const vk::PipelineColorBlendStateCreateInfo GraphicsPipeline::colorblendstate_override_1 = vk::PipelineColorBlendStateCreateInfo()
@@ -104,6 +133,18 @@ GraphicsPipeline::PipelinesCreateResult GraphicsPipeline::CreateGraphicPipelines
 		1, &viewport,
 		1, &scissor);
 
+	// the scissor is narrowed to the portals visible in each recursion layer
+	const vk::DynamicState dynamicStates[] = { vk::DynamicState::eScissor };
+	const vk::PipelineDynamicStateCreateInfo dynamicStateCreateInfo = vk::PipelineDynamicStateCreateInfo{}
+		.setDynamicStateCount(GetSizeUint32(dynamicStates))
+		.setPDynamicStates(dynamicStates);
+
+	// hardware stencil layers draw each camera with its own stencil reference
+	const vk::DynamicState dynamicStates_hardwareStencil[] = { vk::DynamicState::eScissor, vk::DynamicState::eStencilReference };
+	const vk::PipelineDynamicStateCreateInfo dynamicStateCreateInfo_hardwareStencil = vk::PipelineDynamicStateCreateInfo{}
+		.setDynamicStateCount(GetSizeUint32(dynamicStates_hardwareStencil))
+		.setPDynamicStates(dynamicStates_hardwareStencil);
+
 
 	const vk::PipelineRasterizationStateCreateInfo rasterizationStateCreateInfo_scene = vk::PipelineRasterizationStateCreateInfo{}
 		.setDepthClampEnable(false)
@@ -127,6 +168,41 @@ GraphicsPipeline::PipelinesCreateResult GraphicsPipeline::CreateGraphicPipelines
 		.setDepthCompareOp(inverseDepthBufferCompareOp)
 		.setStencilTestEnable(false)
 		;
+
+	// the portal exports the stencil value of the camera it spawns, the reference is ignored
+	const vk::StencilOpState stencilOpState_replace = vk::StencilOpState{}
+		.setFailOp(vk::StencilOp::eKeep)
+		.setPassOp(vk::StencilOp::eReplace)
+		.setDepthFailOp(vk::StencilOp::eKeep)
+		.setCompareOp(vk::CompareOp::eAlways)
+		.setCompareMask(0xff)
+		.setWriteMask(0xff)
+		.setReference(0);
+
+	const vk::PipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo_depthTestStencilWrite =
+		vk::PipelineDepthStencilStateCreateInfo{ depthStencilStateCreateInfo_onlyDepthTest }
+		.setStencilTestEnable(true)
+		.setFront(stencilOpState_replace)
+		.setBack(stencilOpState_replace)
+		;
+
+	// only the fragments of the camera set as dynamic reference pass, the stencil is not modified
+	const vk::StencilOpState stencilOpState_equal = vk::StencilOpState{}
+		.setFailOp(vk::StencilOp::eKeep)
+		.setPassOp(vk::StencilOp::eKeep)
+		.setDepthFailOp(vk::StencilOp::eKeep)
+		.setCompareOp(vk::CompareOp::eEqual)
+		.setCompareMask(0xff)
+		.setWriteMask(0)
+		.setReference(0);
+
+	const vk::PipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo_depthTestStencilEqual =
+		vk::PipelineDepthStencilStateCreateInfo{ depthStencilStateCreateInfo_onlyDepthTest }
+		.setStencilTestEnable(true)
+		.setFront(stencilOpState_equal)
+		.setBack(stencilOpState_equal)
+		;
+
 	const vk::PipelineRasterizationStateCreateInfo rasterizationStateCreateInfo_portal = vk::PipelineRasterizationStateCreateInfo{}
 		.setDepthClampEnable(false)
 		.setRasterizerDiscardEnable(false)
@@ -150,7 +226,7 @@ GraphicsPipeline::PipelinesCreateResult GraphicsPipeline::CreateGraphicPipelines
 		&multisampleState_noMultisampling,
 		nullptr, // depthStencilState info needs to be set!
 		nullptr, // color blend state needs to be set!
-		nullptr, // dynamic device state
+		&dynamicStateCreateInfo,
 		nullptr,
 		createInfo.renderpass,
 		-1, // subpass needs to be set!
@@ -175,6 +251,15 @@ GraphicsPipeline::PipelinesCreateResult GraphicsPipeline::CreateGraphicPipelines
 		.setSubpass(-1)
 		;
 
+	const vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo_sceneHardwareStencil_prototype =
+		vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_sceneInitial }
+		.setStageCount(GetSizeUint32(createInfo.pipelineShaderStageCreationInfos_sceneHardwareStencil))
+		.setPStages(std::data(createInfo.pipelineShaderStageCreationInfos_sceneHardwareStencil))
+		.setPDepthStencilState(&depthStencilStateCreateInfo_depthTestStencilEqual)
+		.setPDynamicState(&dynamicStateCreateInfo_hardwareStencil)
+		.setSubpass(-1)
+		;
+
 	const vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo_linesInitial = vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_prototype }
 		.setStageCount(GetSizeUint32(createInfo.pipelineShaderStageCreationInfos_linesInitial))
 		.setPStages(std::data(createInfo.pipelineShaderStageCreationInfos_linesInitial))
@@ -200,7 +285,9 @@ GraphicsPipeline::PipelinesCreateResult GraphicsPipeline::CreateGraphicPipelines
 		.setStageCount(GetSizeUint32(createInfo.pipelineShaderStageCreationInfos_portalInitial))
 		.setPStages(std::data(createInfo.pipelineShaderStageCreationInfos_portalInitial))
 		.setPRasterizationState(&rasterizationStateCreateInfo_portal)
-		.setPDepthStencilState(&depthStencilStateCreateInfo_onlyDepthTest)
+		.setPDepthStencilState(createInfo.portalWritesStencil
+			? &depthStencilStateCreateInfo_depthTestStencilWrite
+			: &depthStencilStateCreateInfo_onlyDepthTest)
 		.setLayout(createInfo.pipelineLayout_portal)
 		.setPColorBlendState(&colorblendstate_override_3)
 		.setSubpass(1)
@@ -215,61 +302,317 @@ GraphicsPipeline::PipelinesCreateResult GraphicsPipeline::CreateGraphicPipelines
 
 
 
-	vk::PipelineCache cache;
+	// one create info per layer and pipeline type, each type is followed by the next
+	const bool hasHardwareStencilPipelines = !createInfo.pipelineShaderStageCreationInfos_sceneHardwareStencil.empty();
+	const uint32_t layerCount = iterationCount + 1;
+
+	std::vector<vk::GraphicsPipelineCreateInfo> pipelineCreateInfos;
+	pipelineCreateInfos.reserve(layerCount * (hasHardwareStencilPipelines ? 4 : 3));
 
-	vk::GraphicsPipelineCreateInfo intitialCreateInfos[] =
+	pipelineCreateInfos.push_back(graphicsPipelineCreateInfo_sceneInitial);
+	for (uint32_t layer = 1; layer <= iterationCount; ++layer)
 	{
-		graphicsPipelineCreateInfo_sceneInitial,
-		graphicsPipelineCreateInfo_linesInitial,
-		graphicsPipelineCreateInfo_portalInitial,
-	};
+		pipelineCreateInfos.push_back(vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_sceneSubsequent_prototype }
+			.setSubpass(layer * 2));
+	}
 
+	pipelineCreateInfos.push_back(graphicsPipelineCreateInfo_linesInitial);
+	for (uint32_t layer = 1; layer <= iterationCount; ++layer)
+	{
+		pipelineCreateInfos.push_back(vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_linesSubsequent_prototype }
+			.setSubpass(layer * 2));
+	}
 
-	std::vector<vk::GraphicsPipelineCreateInfo> linePipelineCreateInfos;
+	pipelineCreateInfos.push_back(graphicsPipelineCreateInfo_portalInitial);
+	for (uint32_t layer = 1; layer <= iterationCount; ++layer)
+	{
+		pipelineCreateInfos.push_back(vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_portalSubsequent_prototype }
+			.setSubpass(layer * 2 + 1));
+	}
 
-	auto intialPipelines =
-		createInfo.logicalDevice.createGraphicsPipelinesUnique(cache, { GetSizeUint32(intitialCreateInfos), std::data(intitialCreateInfos) });
+	// the initial layer has no previous portal pass, its pipeline stays empty
+	if (hasHardwareStencilPipelines)
+	{
+		for (uint32_t layer = 1; layer <= iterationCount; ++layer)
+		{
+			pipelineCreateInfos.push_back(vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_sceneHardwareStencil_prototype }
+				.setSubpass(layer * 2));
+		}
+	}
+
+	std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> pipelines =
+		CreateGraphicsPipelinesParallel(createInfo.logicalDevice, createInfo.pipelineCache, pipelineCreateInfos);
+
+	auto nextPipeline = std::make_move_iterator(pipelines.begin());
+	const auto takePipelines = [&nextPipeline](std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>>& outPipelines, uint32_t count)
+	{
+		outPipelines.insert(outPipelines.end(), nextPipeline, nextPipeline + count);
+		nextPipeline += count;
+	};
 
 	PipelinesCreateResult result;
-	result.scenePassPipelines.scene.push_back(std::move(intialPipelines[0]));
-	result.scenePassPipelines.lines.push_back(std::move(intialPipelines[1]));
-	result.portalPassPipelines.regularPortal.push_back(std::move(intialPipelines[2]));
+	takePipelines(result.scenePassPipelines.scene, layerCount);
+	takePipelines(result.scenePassPipelines.lines, layerCount);
+	takePipelines(result.portalPassPipelines.regularPortal, layerCount);
+
+	if (hasHardwareStencilPipelines)
+	{
+		// keep the indices the same as the other pipelines
+		result.scenePassPipelines.sceneHardwareStencil.emplace_back();
+		takePipelines(result.scenePassPipelines.sceneHardwareStencil, iterationCount);
+	}
+
+	return result;
+}
+
 
-	std::vector<vk::GraphicsPipelineCreateInfo> scenePipelineCreateInfos(iterationCount);
-	std::vector<vk::GraphicsPipelineCreateInfo> linePipelineCreateInfoss(iterationCount);
-	std::vector<vk::GraphicsPipelineCreateInfo> portalPipelineCreateInfos(iterationCount);
 
-	for (uint32_t layer = 1; layer <= iterationCount ; ++layer)
+
+GraphicsPipeline::RecursiveStencilPipelines GraphicsPipeline::CreateRecursiveStencilPipelines(const RecursiveStencilPipelinesCreateInfo& createInfo)
+{
+	const vk::Viewport viewport = vk::Viewport()
+		.setX(0.f)
+		.setY(0.f)
+		.setWidth(static_cast<float>(createInfo.swapchainExtent.width))
+		.setHeight(static_cast<float>(createInfo.swapchainExtent.height))
+		.setMinDepth(0.f)
+		.setMaxDepth(1.f);
+
+	// a depth range of zero maps every fragment to the far plane of the inverse depth buffer
+	const vk::Viewport viewport_farDepth = vk::Viewport{ viewport }
+		.setMaxDepth(0.f);
+
+	const vk::Rect2D scissor(vk::Offset2D(0, 0), createInfo.swapchainExtent);
+
+	const vk::PipelineViewportStateCreateInfo viewportStateCreateInfo(
+		vk::PipelineViewportStateCreateFlags(),
+		1, &viewport,
+		1, &scissor);
+
+	const vk::PipelineViewportStateCreateInfo viewportStateCreateInfo_farDepth(
+		vk::PipelineViewportStateCreateFlags(),
+		1, &viewport_farDepth,
+		1, &scissor);
+
+	// the stencil reference is the recursion depth of the view
+	const vk::DynamicState dynamicStates[] = { vk::DynamicState::eStencilReference };
+	const vk::PipelineDynamicStateCreateInfo dynamicStateCreateInfo = vk::PipelineDynamicStateCreateInfo{}
+		.setDynamicStateCount(GetSizeUint32(dynamicStates))
+		.setPDynamicStates(dynamicStates);
+
+	// portals can be seen from both sides and the camera might be inside of a portal volume
+	const vk::PipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = vk::PipelineRasterizationStateCreateInfo{}
+		.setDepthClampEnable(false)
+		.setRasterizerDiscardEnable(false)
+		.setPolygonMode(vk::PolygonMode::eFill)
+		.setLineWidth(1.f)
+		.setCullMode(vk::CullModeFlagBits::eNone)
+		.setFrontFace(vk::FrontFace::eCounterClockwise)
+		.setDepthBiasEnable(false)
+		.setDepthBiasConstantFactor(0.f)
+		.setDepthBiasClamp(0.f)
+		.setDepthBiasSlopeFactor(0.f);
+
+	constexpr vk::CompareOp inverseDepthBufferCompareOp = vk::CompareOp::eGreater;
+
+	const auto createStencilOpState = [](vk::StencilOp passOp)
 	{
-		const int sceneSubpassIndex = layer * 2;
-		const int portalSubpassIndex = sceneSubpassIndex + 1;
-		const int creationInfoIndex = layer - 1;
+		return vk::StencilOpState{}
+			.setFailOp(vk::StencilOp::eKeep)
+			.setPassOp(passOp)
+			.setDepthFailOp(vk::StencilOp::eKeep)
+			.setCompareOp(vk::CompareOp::eEqual)
+			.setCompareMask(0xff)
+			.setWriteMask(0xff)
+			.setReference(0);
+	};
 
-		scenePipelineCreateInfos[creationInfoIndex] = vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_sceneSubsequent_prototype }
-			.setSubpass(sceneSubpassIndex);
+	const auto createDepthStencilState = [&createStencilOpState](vk::CompareOp depthCompareOp, bool depthWrite, vk::StencilOp stencilPassOp)
+	{
+		return vk::PipelineDepthStencilStateCreateInfo{}
+			.setDepthTestEnable(true)
+			.setDepthWriteEnable(depthWrite)
+			.setDepthCompareOp(depthCompareOp)
+			.setStencilTestEnable(true)
+			.setFront(createStencilOpState(stencilPassOp))
+			.setBack(createStencilOpState(stencilPassOp));
+	};
 
-		linePipelineCreateInfoss[creationInfoIndex] = vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_linesSubsequent_prototype }
-			.setSubpass(sceneSubpassIndex);
+	const vk::PipelineDepthStencilStateCreateInfo depthStencilState_scene =
+		createDepthStencilState(inverseDepthBufferCompareOp, true, vk::StencilOp::eKeep);
+	const vk::PipelineDepthStencilStateCreateInfo depthStencilState_portalMark =
+		createDepthStencilState(inverseDepthBufferCompareOp, false, vk::StencilOp::eIncrementAndClamp);
+	const vk::PipelineDepthStencilStateCreateInfo depthStencilState_portalDepthReset =
+		createDepthStencilState(vk::CompareOp::eAlways, true, vk::StencilOp::eKeep);
+	const vk::PipelineDepthStencilStateCreateInfo depthStencilState_portalRestore =
+		createDepthStencilState(vk::CompareOp::eAlways, true, vk::StencilOp::eDecrementAndClamp);
+
+	// the portal passes only touch the depth stencil attachment
+	const vk::PipelineColorBlendAttachmentState colorblend_noWrite = vk::PipelineColorBlendAttachmentState{ colorblend_override_arr4[0] }
+		.setColorWriteMask(vk::ColorComponentFlags());
+
+	const vk::PipelineColorBlendStateCreateInfo colorblendstate_noWrite = vk::PipelineColorBlendStateCreateInfo{ colorblendstate_override_1 }
+		.setPAttachments(&colorblend_noWrite);
+
+	const vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo_scene = vk::GraphicsPipelineCreateInfo{}
+		.setStageCount(GetSizeUint32(createInfo.pipelineShaderStageCreationInfos))
+		.setPStages(std::data(createInfo.pipelineShaderStageCreationInfos))
+		.setPVertexInputState(&Vertex::pipelineVertexState_simple)
+		.setPInputAssemblyState(&inputAssembly_triangleList)
+		.setPViewportState(&viewportStateCreateInfo)
+		.setPRasterizationState(&rasterizationStateCreateInfo)
+		.setPMultisampleState(&multisampleState_noMultisampling)
+		.setPDepthStencilState(&depthStencilState_scene)
+		.setPColorBlendState(&colorblendstate_override_1)
+		.setPDynamicState(&dynamicStateCreateInfo)
+		.setLayout(createInfo.pipelineLayout)
+		.setRenderPass(createInfo.renderpass)
+		.setSubpass(0)
+		;
 
-		portalPipelineCreateInfos[creationInfoIndex] = vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_portalSubsequent_prototype }
-			.setSubpass(portalSubpassIndex);
-	}
+	const vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo_portalMark = vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_scene }
+		.setPDepthStencilState(&depthStencilState_portalMark)
+		.setPColorBlendState(&colorblendstate_noWrite)
+		;
 
-	auto scenePipes = createInfo.logicalDevice.createGraphicsPipelinesUnique(cache, scenePipelineCreateInfos);
-	auto linePipes = createInfo.logicalDevice.createGraphicsPipelinesUnique(cache, linePipelineCreateInfoss);
-	auto portalPipes = createInfo.logicalDevice.createGraphicsPipelinesUnique(cache, portalPipelineCreateInfos);
+	const vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo_portalDepthReset = vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_portalMark }
+		.setPViewportState(&viewportStateCreateInfo_farDepth)
+		.setPDepthStencilState(&depthStencilState_portalDepthReset)
+		;
+
+	const vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo_portalRestore = vk::GraphicsPipelineCreateInfo{ graphicsPipelineCreateInfo_portalMark }
+		.setPDepthStencilState(&depthStencilState_portalRestore)
+		;
 
-	const auto append = [](
-		std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>>& base,
-		std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>>&& toAppend)
+	enum PipelineIdx
 	{
-		base.insert(base.end(), std::make_move_iterator(toAppend.begin()), std::make_move_iterator(toAppend.end()));
+		scene,
+		portalMark,
+		portalDepthReset,
+		portalRestore,
+
+		enum_size_PipelineIdx
 	};
 
-	append(result.scenePassPipelines.scene, std::move(scenePipes));
-	append(result.scenePassPipelines.lines, std::move(linePipes));
-	append(result.portalPassPipelines.regularPortal, std::move(portalPipes));
+	const std::array<vk::GraphicsPipelineCreateInfo, enum_size_PipelineIdx> pipelineCreateInfos = {
+		graphicsPipelineCreateInfo_scene,
+		graphicsPipelineCreateInfo_portalMark,
+		graphicsPipelineCreateInfo_portalDepthReset,
+		graphicsPipelineCreateInfo_portalRestore,
+	};
+
+	auto pipelines = createInfo.logicalDevice.createGraphicsPipelinesUnique(createInfo.pipelineCache,
+		{ GetSizeUint32(pipelineCreateInfos), std::data(pipelineCreateInfos) });
+
+	RecursiveStencilPipelines result;
+	result.scene = std::move(pipelines[scene]);
+	result.portalMark = std::move(pipelines[portalMark]);
+	result.portalDepthReset = std::move(pipelines[portalDepthReset]);
+	result.portalRestore = std::move(pipelines[portalRestore]);
 	return result;
 }
 
+vk::UniquePipeline GraphicsPipeline::CreateTextureAtlasPipeline(const TextureAtlasPipelineCreateInfo& createInfo)
+{
+	// each view is drawn into its own atlas slot
+	const vk::PipelineViewportStateCreateInfo viewportStateCreateInfo = vk::PipelineViewportStateCreateInfo{}
+		.setViewportCount(1)
+		.setScissorCount(1);
+
+	const vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+	const vk::PipelineDynamicStateCreateInfo dynamicStateCreateInfo = vk::PipelineDynamicStateCreateInfo{}
+		.setDynamicStateCount(GetSizeUint32(dynamicStates))
+		.setPDynamicStates(dynamicStates);
+
+	// portals can be seen from both sides
+	const vk::PipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = vk::PipelineRasterizationStateCreateInfo{}
+		.setDepthClampEnable(false)
+		.setRasterizerDiscardEnable(false)
+		.setPolygonMode(vk::PolygonMode::eFill)
+		.setLineWidth(1.f)
+		.setCullMode(vk::CullModeFlagBits::eNone)
+		.setFrontFace(vk::FrontFace::eCounterClockwise)
+		.setDepthBiasEnable(false)
+		.setDepthBiasConstantFactor(0.f)
+		.setDepthBiasClamp(0.f)
+		.setDepthBiasSlopeFactor(0.f);
+
+	constexpr vk::CompareOp inverseDepthBufferCompareOp = vk::CompareOp::eGreater;
+
+	const vk::PipelineDepthStencilStateCreateInfo depthStencilState = vk::PipelineDepthStencilStateCreateInfo{}
+		.setDepthTestEnable(true)
+		.setDepthWriteEnable(true)
+		.setDepthCompareOp(inverseDepthBufferCompareOp)
+		.setStencilTestEnable(false);
+
+	const vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo = vk::GraphicsPipelineCreateInfo{}
+		.setStageCount(GetSizeUint32(createInfo.pipelineShaderStageCreationInfos))
+		.setPStages(std::data(createInfo.pipelineShaderStageCreationInfos))
+		.setPVertexInputState(&Vertex::pipelineVertexState_simple)
+		.setPInputAssemblyState(&inputAssembly_triangleList)
+		.setPViewportState(&viewportStateCreateInfo)
+		.setPRasterizationState(&rasterizationStateCreateInfo)
+		.setPMultisampleState(&multisampleState_noMultisampling)
+		.setPDepthStencilState(&depthStencilState)
+		.setPColorBlendState(&colorblendstate_override_1)
+		.setPDynamicState(&dynamicStateCreateInfo)
+		.setLayout(createInfo.pipelineLayout)
+		.setRenderPass(createInfo.renderpass)
+		.setSubpass(0)
+		;
+
+	return createInfo.logicalDevice.createGraphicsPipelineUnique(createInfo.pipelineCache, graphicsPipelineCreateInfo);
+}
+
+vk::UniquePipeline GraphicsPipeline::CreateFullscreenPipeline(const FullscreenPipelineCreateInfo& createInfo)
+{
+	const vk::PipelineVertexInputStateCreateInfo vertexInputState = vk::PipelineVertexInputStateCreateInfo{}
+		.setVertexBindingDescriptionCount(0)
+		.setPVertexBindingDescriptions(nullptr)
+		.setVertexAttributeDescriptionCount(0)
+		.setPVertexAttributeDescriptions(nullptr)
+		;
+
+	const vk::Viewport viewport = vk::Viewport{}
+		.setX(0.f)
+		.setY(0.f)
+		.setWidth(static_cast<float>(createInfo.extent.width))
+		.setHeight(static_cast<float>(createInfo.extent.height))
+		.setMinDepth(0.f)
+		.setMaxDepth(1.f);
+
+	const vk::Rect2D scissor(vk::Offset2D(0, 0), createInfo.extent);
 
+	const vk::PipelineViewportStateCreateInfo viewportStateCreateInfo = vk::PipelineViewportStateCreateInfo{}
+		.setViewportCount(1).setPViewports(&viewport)
+		.setScissorCount(1).setPScissors(&scissor);
+
+	const vk::PipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = vk::PipelineRasterizationStateCreateInfo{}
+		.setDepthClampEnable(false)
+		.setRasterizerDiscardEnable(false)
+		.setPolygonMode(vk::PolygonMode::eFill)
+		.setLineWidth(1.f)
+		.setCullMode(vk::CullModeFlagBits::eNone)
+		.setFrontFace(vk::FrontFace::eCounterClockwise)
+		.setDepthBiasEnable(false)
+		.setDepthBiasConstantFactor(0.f)
+		.setDepthBiasClamp(0.f)
+		.setDepthBiasSlopeFactor(0.f);
+
+	const vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo = vk::GraphicsPipelineCreateInfo{}
+		.setStageCount(GetSizeUint32(createInfo.pipelineShaderStageCreationInfos))
+		.setPStages(std::data(createInfo.pipelineShaderStageCreationInfos))
+		.setPVertexInputState(&vertexInputState)
+		.setPInputAssemblyState(&inputAssembly_triangleList)
+		.setPViewportState(&viewportStateCreateInfo)
+		.setPRasterizationState(&rasterizationStateCreateInfo)
+		.setPMultisampleState(&multisampleState_noMultisampling)
+		.setPDepthStencilState(nullptr)
+		.setPColorBlendState(&colorblendstate_override_1)
+		.setLayout(createInfo.pipelineLayout)
+		.setRenderPass(createInfo.renderpass)
+		.setSubpass(0)
+		;
+
+	return createInfo.logicalDevice.createGraphicsPipelineUnique(createInfo.pipelineCache, graphicsPipelineCreateInfo);
+}
@@ -12,6 +12,9 @@ namespace GraphicsPipeline
 		struct ScenePassPipelines
 		{
 			std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> scene;
+
+			// tests the stencil attachment instead of the rendered stencil, empty for the initial layer and if not supported
+			std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> sceneHardwareStencil;
 			std::vector<vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic>> lines;
 		};
 
@@ -30,6 +33,7 @@ namespace GraphicsPipeline
 		struct PipelinesCreateInfo
 		{
 			vk::Device logicalDevice;
+			vk::PipelineCache pipelineCache;
 			vk::Extent2D swapchainExtent;
 			vk::RenderPass renderpass;
 			vk::PipelineLayout pipelineLayout_portal;
@@ -43,7 +47,68 @@ namespace GraphicsPipeline
 			gsl::span<const vk::PipelineShaderStageCreateInfo> pipelineShaderStageCreationInfos_linesSubsequent;
 			gsl::span<const vk::PipelineShaderStageCreateInfo> pipelineShaderStageCreationInfos_portalSubsequent;
 
+			// the portal shaders export the stencil value of the next layer, empty stages skip the hardware stencil pipelines
+			bool portalWritesStencil = false;
+			gsl::span<const vk::PipelineShaderStageCreateInfo> pipelineShaderStageCreationInfos_sceneHardwareStencil;
+
 		};
 
+		// the pipelines of all iterations are created at once, spread over several threads
 		PipelinesCreateResult CreateGraphicPipelines_dynamicState(const PipelinesCreateInfo& createInfo, uint32_t iterationCount);
+
+
+		// pipelines of the depth first renderer, all of them use a dynamic stencil reference, see RecursiveStencilRenderer
+		struct RecursiveStencilPipelines
+		{
+			// draws where the stencil equals the reference, also used for the portals which are not recursed
+			vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic> scene;
+
+			// increments the stencil where the portal is visible, no color or depth writes
+			vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic> portalMark;
+
+			// writes the far depth where the stencil equals the reference, so the view behind the portal can be drawn
+			vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic> portalDepthReset;
+
+			// decrements the stencil and writes the depth of the portal, so the parent view continues as if the portal was opaque
+			vk::UniqueHandle<vk::Pipeline, vk::DispatchLoaderStatic> portalRestore;
+		};
+
+		struct RecursiveStencilPipelinesCreateInfo
+		{
+			vk::Device logicalDevice;
+			vk::PipelineCache pipelineCache;
+			vk::Extent2D swapchainExtent;
+			vk::RenderPass renderpass;
+			vk::PipelineLayout pipelineLayout;
+			gsl::span<const vk::PipelineShaderStageCreateInfo> pipelineShaderStageCreationInfos;
+		};
+
+		RecursiveStencilPipelines CreateRecursiveStencilPipelines(const RecursiveStencilPipelinesCreateInfo& createInfo);
+
+
+		struct TextureAtlasPipelineCreateInfo
+		{
+			vk::Device logicalDevice;
+			vk::PipelineCache pipelineCache;
+			vk::RenderPass renderpass;
+			vk::PipelineLayout pipelineLayout;
+			gsl::span<const vk::PipelineShaderStageCreateInfo> pipelineShaderStageCreationInfos;
+		};
+
+		// draws the scene and the portals of the texture atlas renderer, viewport and scissor are set for each view
+		vk::UniquePipeline CreateTextureAtlasPipeline(const TextureAtlasPipelineCreateInfo& createInfo);
+
+
+		struct FullscreenPipelineCreateInfo
+		{
+			vk::Device logicalDevice;
+			vk::PipelineCache pipelineCache;
+			vk::Extent2D extent;
+			vk::RenderPass renderpass;
+			vk::PipelineLayout pipelineLayout;
+			gsl::span<const vk::PipelineShaderStageCreateInfo> pipelineShaderStageCreationInfos;
+		};
+
+		// draws a single triangle covering the whole extent, the vertex shader creates it from the vertex index, no depth or stencil
+		vk::UniquePipeline CreateFullscreenPipeline(const FullscreenPipelineCreateInfo& createInfo);
 }
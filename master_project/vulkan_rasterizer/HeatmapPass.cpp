@@ -0,0 +1,126 @@
+#include "pch.hpp"
+#include "HeatmapPass.hpp"
+#include "common/VulkanUtils.hpp"
+#include "common/VulkanDebug.hpp"
+#include "GetSizeUint32.hpp"
+#include "Renderpass.hpp"
+#include "GraphicsPipeline.hpp"
+
+HeatmapPass::HeatmapPass(const CreateInfo& createInfo)
+	: m_extent(createInfo.swapchainExtent)
+{
+	const vk::Device device = createInfo.logicalDevice;
+
+	m_renderPass = Renderpass::Overlay(device, createInfo.colorFormat, createInfo.colorFinalLayout);
+
+	for (const vk::UniqueImageView& imageView : createInfo.swapchainImageViews)
+	{
+		const vk::ImageView fbAttachment = imageView.get();
+		m_framebuffers.push_back(device.createFramebufferUnique(vk::FramebufferCreateInfo{}
+			.setWidth(m_extent.width)
+			.setHeight(m_extent.height)
+			.setRenderPass(m_renderPass.get())
+			.setLayers(1)
+			.setAttachmentCount(1)
+			.setPAttachments(&fbAttachment)));
+	}
+
+	m_vertShaderModule = VulkanUtils::CreateShaderModuleFromFile("heatmap.vert.spv", device);
+	m_fragShaderModule = VulkanUtils::CreateShaderModuleFromFile("heatmap.frag.spv", device);
+
+	// one set for each frame in flight, holding its heatmap buffer
+	{
+		const vk::DescriptorSetLayoutBinding heatmapBinding = vk::DescriptorSetLayoutBinding{}
+			.setBinding(0) // matches Shader code
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+		m_descriptorSetLayout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{}
+			.setBindingCount(1)
+			.setPBindings(&heatmapBinding));
+
+		const uint32_t setCount = GetSizeUint32(createInfo.heatmapBuffers);
+
+		const vk::DescriptorPoolSize descriptorPoolSize = vk::DescriptorPoolSize{}
+			.setType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(setCount);
+
+		m_descriptorPool = device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{}
+			.setPoolSizeCount(1).setPPoolSizes(&descriptorPoolSize)
+			.setMaxSets(setCount));
+
+		const std::vector<vk::DescriptorSetLayout> setLayouts(setCount, m_descriptorSetLayout.get());
+		m_descriptorSets = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{}
+			.setDescriptorPool(m_descriptorPool.get())
+			.setDescriptorSetCount(setCount)
+			.setPSetLayouts(setLayouts.data()));
+
+		std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
+		for (uint32_t i = 0; i < setCount; ++i)
+		{
+			writeDescriptorSets.push_back(vk::WriteDescriptorSet{}
+				.setDstSet(m_descriptorSets[i])
+				.setDstBinding(0)
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+				.setDstArrayElement(0)
+				.setDescriptorCount(1).setPBufferInfo(&createInfo.heatmapBuffers[i]));
+		}
+
+		device.updateDescriptorSets(writeDescriptorSets, {});
+	}
+
+	m_pipelineLayout = device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{}
+		.setSetLayoutCount(1).setPSetLayouts(&(m_descriptorSetLayout.get())));
+
+	// create Graphic pipeline
+	{
+		const vk::PipelineShaderStageCreateInfo shaderStages[] =
+		{
+			vk::PipelineShaderStageCreateInfo{}
+				.setStage(vk::ShaderStageFlagBits::eVertex)
+				.setModule(m_vertShaderModule.get())
+				.setPName("main"),
+
+			vk::PipelineShaderStageCreateInfo{}
+				.setStage(vk::ShaderStageFlagBits::eFragment)
+				.setModule(m_fragShaderModule.get())
+				.setPName("main"),
+		};
+
+		GraphicsPipeline::FullscreenPipelineCreateInfo pipelineCreateInfo;
+		pipelineCreateInfo.logicalDevice = device;
+		pipelineCreateInfo.pipelineCache = createInfo.pipelineCache;
+		pipelineCreateInfo.extent = m_extent;
+		pipelineCreateInfo.renderpass = m_renderPass.get();
+		pipelineCreateInfo.pipelineLayout = m_pipelineLayout.get();
+		pipelineCreateInfo.pipelineShaderStageCreationInfos = shaderStages;
+
+		m_pipeline = GraphicsPipeline::CreateFullscreenPipeline(pipelineCreateInfo);
+	}
+}
+
+void HeatmapPass::Draw(vk::CommandBuffer commandBuffer, int frameIndex, uint32_t imageIndex) const
+{
+	const bool useLabel = VulkanDebug::IsDebugUtilsExtensionLoaded();
+	if (useLabel)
+	{
+		commandBuffer.beginDebugUtilsLabelEXT(vk::DebugUtilsLabelEXT{}.setPLabelName("heatmap"));
+	}
+
+	commandBuffer.beginRenderPass(vk::RenderPassBeginInfo{}
+		.setRenderPass(m_renderPass.get())
+		.setFramebuffer(m_framebuffers[imageIndex].get())
+		.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), m_extent)),
+		vk::SubpassContents::eInline);
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipeline.get());
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout.get(), 0, m_descriptorSets[frameIndex], {});
+	commandBuffer.draw(3, 1, 0, 0);
+
+	commandBuffer.endRenderPass();
+	if (useLabel)
+	{
+		commandBuffer.endDebugUtilsLabelEXT();
+	}
+}
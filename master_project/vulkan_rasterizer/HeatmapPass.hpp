@@ -0,0 +1,45 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <gsl/gsl>
+#include <vector>
+
+// debug view of the breadth first renderer, see DrawOptions::heatmap
+// the scene and portal shaders count into a heatmap buffer (Ssbo_HeatmapHeader), which is drawn over the rendered image
+// overdraw and recursion depth share the buffer, the header tells the shaders which of them to show
+class HeatmapPass
+{
+public:
+	struct CreateInfo
+	{
+		vk::Device logicalDevice;
+		vk::PipelineCache pipelineCache;
+		vk::Extent2D swapchainExtent;
+		vk::Format colorFormat;
+		vk::ImageLayout colorFinalLayout;
+		gsl::span<const vk::UniqueImageView> swapchainImageViews;
+
+		// the heatmap buffer of each frame in flight
+		gsl::span<const vk::DescriptorBufferInfo> heatmapBuffers;
+	};
+
+	explicit HeatmapPass(const CreateInfo& createInfo);
+
+	// outside of a render pass, after the pass which wrote the heatmap buffer of the frame
+	void Draw(vk::CommandBuffer commandBuffer, int frameIndex, uint32_t imageIndex) const;
+
+private:
+	vk::Extent2D m_extent;
+
+	vk::UniqueRenderPass m_renderPass;
+	std::vector<vk::UniqueFramebuffer> m_framebuffers;
+
+	vk::UniqueShaderModule m_vertShaderModule;
+	vk::UniqueShaderModule m_fragShaderModule;
+
+	vk::UniqueDescriptorSetLayout m_descriptorSetLayout;
+	vk::UniqueDescriptorPool m_descriptorPool;
+	std::vector<vk::DescriptorSet> m_descriptorSets;
+
+	vk::UniquePipelineLayout m_pipelineLayout;
+	vk::UniquePipeline m_pipeline;
+};
@@ -5,6 +5,7 @@
 #include <gsl/gsl>
 #include "AABB.hpp"
 #include "Triangle.hpp"
+#include "Profiler.hpp"
 
 
 
@@ -179,6 +180,8 @@ namespace DetailKdTree
 
 inline void KdTree::Init(gsl::span<const Triangle> triangles, const AABB& triangleBoundingBox /*= InvalidAABB*/)
 {
+	PROFILE_SCOPE("KdTree::Init");
+
 	const DataIndex_t elementCount = gsl::narrow<DataIndex_t>(triangles.size());
 
 	AABB totalBoundingBox(triangleBoundingBox);
@@ -5,6 +5,7 @@
 #include "rapidxml/rapidxml_utils.hpp"
 
 #include "Transform.hpp"
+#include "Profiler.hpp"
 
 namespace
 {
@@ -92,6 +93,7 @@ namespace
 
 LevelLoader::LoadLevelResult LevelLoader::LoadLevel(const char* fileName)
 {
+	PROFILE_SCOPE("LevelLoader::LoadLevel");
 
 	LoadLevelResult result;
 
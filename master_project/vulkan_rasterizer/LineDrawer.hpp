@@ -23,6 +23,11 @@ struct Line
 		, colorA(colorA)
 		, colorB(colorB)
 	{}
+
+	bool operator==(const Line& rhs) const
+	{
+		return pointA == rhs.pointA && pointB == rhs.pointB && colorA == rhs.colorA && colorB == rhs.colorB;
+	}
 };
 
 class LineDrawer
@@ -2,11 +2,11 @@
 #include "MeshDataManager.hpp"
 #include "GetSizeUint32.hpp"
 #include "UniqueVmaObject.hpp"
-#include "UniqueVmaMemoryMap.hpp"
-#include "CommandBufferUtils.hpp"
+#include "MeshSimplifier.hpp"
+#include "Profiler.hpp"
 
 
-MeshDataManager::MeshDataManager(VmaAllocator allocator)
+MeshDataManager::MeshDataManager(VmaAllocator allocator, const AsyncUploader& uploader)
 	: m_vertexBufferElementCount(0)
 	, m_indexBufferElementCount(0)
 	, m_allocator(allocator)
@@ -20,11 +20,16 @@ MeshDataManager::MeshDataManager(VmaAllocator allocator)
 	VmaAllocationCreateInfo vmaAllocInfo_gpuOnly = {};
 	vmaAllocInfo_gpuOnly.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
 
+	const gsl::span<const uint32_t> queueFamilies = uploader.GetDestinationQueueFamilies();
+
 	{
 		m_vertexBufferMaxElements = MaxVertices;
 		const vk::BufferCreateInfo vertexBufferCreateInfo = vk::BufferCreateInfo{}
 			.setUsage(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst)
-			.setSize(m_vertexBufferMaxElements * sizeof(VertexType));
+			.setSize(m_vertexBufferMaxElements * sizeof(VertexType))
+			.setSharingMode(uploader.GetDestinationSharingMode())
+			.setQueueFamilyIndexCount(gsl::narrow<uint32_t>(queueFamilies.size()))
+			.setPQueueFamilyIndices(queueFamilies.data());
 
 		m_vertexBuffer = UniqueVmaBuffer(allocator, vertexBufferCreateInfo, vmaAllocInfo_gpuOnly);
 	}
@@ -33,16 +38,19 @@ MeshDataManager::MeshDataManager(VmaAllocator allocator)
 		m_indexBufferMaxElements = MaxIndices;
 		const vk::BufferCreateInfo indexBufferCreateInfo = vk::BufferCreateInfo{}
 			.setUsage(vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst)
-			.setSize(m_indexBufferMaxElements * sizeof(IndexType));
+			.setSize(m_indexBufferMaxElements * sizeof(IndexType))
+			.setSharingMode(uploader.GetDestinationSharingMode())
+			.setQueueFamilyIndexCount(gsl::narrow<uint32_t>(queueFamilies.size()))
+			.setPQueueFamilyIndices(queueFamilies.data());
 
 		m_indexBuffer = UniqueVmaBuffer(allocator, indexBufferCreateInfo, vmaAllocInfo_gpuOnly);
 	}
 }
 
 
-void MeshDataManager::LoadObjs(gsl::span<const char* const> objFileNames,
-	vk::Device device, vk::CommandPool transferPool, vk::Queue transferQueue)
+AsyncUploader::Ticket MeshDataManager::LoadObjs(gsl::span<const char* const> objFileNames, AsyncUploader& uploader)
 {
+	PROFILE_SCOPE("MeshDataManager::LoadObjs");
 
 	const int initialIndexElementCount = m_indexBufferElementCount;
 	const int initialVertexElementCount = m_vertexBufferElementCount;
@@ -64,13 +72,42 @@ void MeshDataManager::LoadObjs(gsl::span<const char* const> objFileNames,
 
 		Vertex::LoadObjWithIndices_append(filename, vertices, indices);
 		staticSceneMesh.indexCount = gsl::narrow<uint32_t>(gsl::narrow<int>(indices.size()) - previousIndexSize);
-		
+		staticSceneMesh.lods[0] = MeshLod{ staticSceneMesh.firstIndex, staticSceneMesh.indexCount };
+
+		// the lods are appended behind the full detail mesh, each one is simplified from the previous one
+		std::vector<IndexType> lodIndices(std::begin(indices) + previousIndexSize, std::end(indices));
+		for (int lodIndex = 1; lodIndex < MeshDataRef::maxLodCount; ++lodIndex)
+		{
+			staticSceneMesh.lods[lodIndex] = staticSceneMesh.lods[lodIndex - 1];
+
+			if (lodIndices.size() < minLodIndexCount)
+			{
+				continue;
+			}
+
+			std::vector<IndexType> simplifiedIndices = MeshSimplifier::Simplify(vertices, lodIndices, lodIndices.size() / 2);
+
+			// locked borders and seams, not worth another index range
+			if (simplifiedIndices.size() * 4 > lodIndices.size() * 3)
+			{
+				continue;
+			}
+
+			staticSceneMesh.lods[lodIndex] = MeshLod{
+				gsl::narrow<uint32_t>(initialIndexElementCount + indices.size()),
+				GetSizeUint32(simplifiedIndices) };
+
+			indices.insert(std::end(indices), std::begin(simplifiedIndices), std::end(simplifiedIndices));
+			lodIndices = std::move(simplifiedIndices);
+		}
+
 		m_meshes.push_back(std::move(staticSceneMesh));
 	}
 
 	assert(m_vertexBufferElementCount + vertices.size() <= m_vertexBufferMaxElements);
 	assert(m_indexBufferElementCount + indices.size() <= m_indexBufferMaxElements);
 	// Copy Buffer to GPU
+	AsyncUploader::Ticket uploadTicket;
 	{
 		const uint32_t indexBufferSizeBytes = sizeof(indices[0]) * GetSizeUint32(indices);
 		const uint32_t vertexBufferSizeBytes = sizeof(vertices[0]) * GetSizeUint32(vertices);
@@ -83,55 +120,28 @@ void MeshDataManager::LoadObjs(gsl::span<const char* const> objFileNames,
 
 		const uint32_t stageBufferSize = stageBufferVertexEnd;
 
-
-		const vk::BufferCreateInfo stagingBufferCreateInfo = vk::BufferCreateInfo{}
-			.setSize(stageBufferSize)
-			.setUsage(vk::BufferUsageFlagBits::eTransferSrc)
-			.setSharingMode(vk::SharingMode::eExclusive);
-
-
-		VmaAllocationCreateInfo vmaAllocCreateInfo = {};
-		vmaAllocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_ONLY;
-		UniqueVmaBuffer stagingBuffer(m_allocator, stagingBufferCreateInfo, vmaAllocCreateInfo);
-
-		{
-			UniqueVmaMemoryMap memoryMap(stagingBuffer.GetAllocator(), stagingBuffer.GetAllocation());
-			std::memcpy(memoryMap.GetMappedMemoryPtr() + stageBufferIndicesBegin, indices.data(), indexBufferSizeBytes);
-			std::memcpy(memoryMap.GetMappedMemoryPtr() + stageBufferVertexBegin, vertices.data(), vertexBufferSizeBytes);
-		}
-
-		vk::UniqueCommandBuffer copyCommandBuffer = CbUtils::AllocateSingle(device, transferPool);
-		vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-		copyCommandBuffer->begin(beginInfo);
-
 		const vk::DeviceSize indicesByteSize = indices.size() * sizeof(IndexType);
 		const vk::DeviceSize verticesByteSize = vertices.size() * sizeof(Vertex);
 
-		
-		{
-			const vk::BufferCopy bufferCopyIndices(stageBufferIndicesBegin, indexBufferOffset, indicesByteSize);
-			copyCommandBuffer->copyBuffer(stagingBuffer.Get(), m_indexBuffer.Get(), bufferCopyIndices);
-		}
-		{
-			const vk::BufferCopy bufferCopyVertices(stageBufferVertexBegin, vertexBufferOffset, verticesByteSize);
-			copyCommandBuffer->copyBuffer(stagingBuffer.Get(), m_vertexBuffer.Get(), bufferCopyVertices);
-		}
-
-	
-		copyCommandBuffer->end();
-
-		vk::SubmitInfo submitInfo = vk::SubmitInfo{}
-			.setCommandBufferCount(1)
-			.setPCommandBuffers(&(copyCommandBuffer.get()));
-
-		transferQueue.submit(submitInfo, vk::Fence{});
-
-		// for now we just wait for finish
-		// could be improved to not block, but we would need to store the command buffer and the staging buffer until the operation is over
-		transferQueue.waitIdle();
-
+		// the new ranges are behind the ones in use, so the copy doesn't touch anything the gpu may be drawing
+		uploadTicket = uploader.Upload(stageBufferSize, [&](const AsyncUploader::Staging& staging, vk::CommandBuffer copyCommandBuffer)
+			{
+				std::memcpy(staging.mappedMemory + stageBufferIndicesBegin, indices.data(), indexBufferSizeBytes);
+				std::memcpy(staging.mappedMemory + stageBufferVertexBegin, vertices.data(), vertexBufferSizeBytes);
+
+				{
+					const vk::BufferCopy bufferCopyIndices(staging.offset + stageBufferIndicesBegin, indexBufferOffset, indicesByteSize);
+					copyCommandBuffer.copyBuffer(staging.buffer, m_indexBuffer.Get(), bufferCopyIndices);
+				}
+				{
+					const vk::BufferCopy bufferCopyVertices(staging.offset + stageBufferVertexBegin, vertexBufferOffset, verticesByteSize);
+					copyCommandBuffer.copyBuffer(staging.buffer, m_vertexBuffer.Get(), bufferCopyVertices);
+				}
+			});
 	}
 	// increment Elemement count to match our new size
 	m_indexBufferElementCount += GetSizeUint32(indices);
 	m_vertexBufferElementCount += GetSizeUint32(vertices);
+
+	return uploadTicket;
 }
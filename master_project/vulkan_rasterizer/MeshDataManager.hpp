@@ -6,6 +6,7 @@
 #include "common/VulkanUtils.hpp"
 #include "UniqueVmaObject.hpp"
 #include "MeshDataRef.hpp"
+#include "AsyncUploader.hpp"
 
 
 // contains data to draw meshes
@@ -17,10 +18,12 @@ public:
 	using IndexType = uint32_t;
 	static constexpr vk::IndexType IndexBufferIndexType = VulkanUtils::GetIndexBufferType_v<IndexType>;
 
-	MeshDataManager(VmaAllocator allocator);
+	// the buffers are written by the uploads of uploader
+	MeshDataManager(VmaAllocator allocator, const AsyncUploader& uploader);
 
-	void LoadObjs(gsl::span<const char* const> objFileNames, vk::Device device,
-		vk::CommandPool transferPool, vk::Queue transferQueue);
+	// also creates the lods of each mesh, see MeshDataRef::lods
+	// the meshes can be drawn once the returned upload is complete
+	AsyncUploader::Ticket LoadObjs(gsl::span<const char* const> objFileNames, AsyncUploader& uploader);
 
 	MeshDataManager(const MeshDataManager&) = delete;
 	MeshDataManager& operator=(const MeshDataManager&) = delete;
@@ -34,7 +37,8 @@ public:
 	vk::Buffer GetIndexBuffer() { return m_indexBuffer.Get(); }
 	gsl::span<const MeshDataRef> GetMeshes() const { return m_meshes; }
 private:
-	// TODO: Handle Queue Ownerships?
+	// smaller meshes are cheap enough, they keep the full detail for all lods
+	static constexpr size_t minLodIndexCount = 3 * 256;
 
 
 	// stores all vertices of the Scene
@@ -1,12 +1,54 @@
 #pragma once
 #include <string>
+#include <array>
+#include <algorithm>
+#include <cmath>
 #include <vulkan/vulkan.hpp>
 
 
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
 struct MeshDataRef
 {
+	static constexpr int maxLodCount = 4;
+
 	std::string meshName;
+
+	// the full detail mesh, the same as lods[0]
 	uint32_t firstIndex;
 	uint32_t indexCount;
+
+	// each lod has about half the triangles of the previous one and uses the same vertices
+	// a mesh which can't be simplified any further repeats its last lod
+	std::array<MeshLod, maxLodCount> lods;
 };
 
+// the lod of an object is chosen by its recursion depth and its size on screen, the same as SelectLod in cull.comp
+namespace MeshLodSelection
+{
+	// bounding sphere radius in normalized device coordinates, bigger objects are drawn with full detail
+	constexpr float fullDetailProjectedRadius = 0.25f;
+
+	// radius * projection[1][1] / distance, the camera inside the sphere gets the full detail
+	inline float CalcProjectedRadius(float sphereRadius, float distance, float projectionScale)
+	{
+		return sphereRadius * projectionScale / std::max(distance, sphereRadius);
+	}
+
+	inline int Select(float projectedRadius, int recursionDepth)
+	{
+		// the first view through a portal is usually as big as the main view
+		const int depthLod = std::max(0, recursionDepth - 1);
+
+		// half the triangles once the object covers half the area
+		const int sizeLod = projectedRadius >= fullDetailProjectedRadius
+			? 0
+			: static_cast<int>(2.f * std::log2(fullDetailProjectedRadius / std::max(projectedRadius, 1e-6f)));
+
+		return std::min(std::max(depthLod, sizeLod), MeshDataRef::maxLodCount - 1);
+	}
+}
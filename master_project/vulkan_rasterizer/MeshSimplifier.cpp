@@ -0,0 +1,337 @@
+#include "pch.hpp"
+#include "MeshSimplifier.hpp"
+#include <queue>
+
+namespace
+{
+	// symmetric 4x4 matrix of the summed squared plane distances, only the upper triangle is stored
+	struct Quadric
+	{
+		std::array<double, 10> m = {};
+
+		static Quadric FromPlane(const glm::dvec4& plane, double weight)
+		{
+			const double a = plane.x;
+			const double b = plane.y;
+			const double c = plane.z;
+			const double d = plane.w;
+
+			Quadric quadric;
+			quadric.m = {
+				a * a, a * b, a * c, a * d,
+				b * b, b * c, b * d,
+				c * c, c * d,
+				d * d,
+			};
+
+			for (double& e : quadric.m)
+			{
+				e *= weight;
+			}
+			return quadric;
+		}
+
+		Quadric& operator+=(const Quadric& rhs)
+		{
+			for (size_t i = 0; i < m.size(); ++i)
+			{
+				m[i] += rhs.m[i];
+			}
+			return *this;
+		}
+
+		// summed squared distance of the position to the planes
+		double Evaluate(const glm::dvec3& p) const
+		{
+			return m[0] * p.x * p.x + 2.0 * m[1] * p.x * p.y + 2.0 * m[2] * p.x * p.z + 2.0 * m[3] * p.x
+				+ m[4] * p.y * p.y + 2.0 * m[5] * p.y * p.z + 2.0 * m[6] * p.y
+				+ m[7] * p.z * p.z + 2.0 * m[8] * p.z
+				+ m[9];
+		}
+	};
+
+	// moves the vertex "from" onto the vertex "to"
+	struct Collapse
+	{
+		double cost;
+		uint32_t from;
+		uint32_t to;
+
+		bool operator>(const Collapse& rhs) const { return cost > rhs.cost; }
+	};
+
+	using Triangle = std::array<uint32_t, 3>;
+
+	bool ContainsVertex(const Triangle& triangle, uint32_t vertex)
+	{
+		return triangle[0] == vertex || triangle[1] == vertex || triangle[2] == vertex;
+	}
+
+	glm::dvec3 CalcTriangleCross(const std::vector<glm::dvec3>& positions, const Triangle& triangle)
+	{
+		return glm::cross(positions[triangle[1]] - positions[triangle[0]], positions[triangle[2]] - positions[triangle[0]]);
+	}
+
+	uint64_t CalcEdgeKey(uint32_t a, uint32_t b)
+	{
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	}
+}
+
+std::vector<uint32_t> MeshSimplifier::Simplify(gsl::span<const Vertex> vertices, gsl::span<const uint32_t> indices, size_t targetIndexCount)
+{
+	assert(indices.size() % 3 == 0);
+
+	// the vertex buffer is shared by all meshes, so we only work on the vertices used by this one
+	std::vector<uint32_t> localToGlobal;
+	std::vector<Triangle> triangles(indices.size() / 3);
+	{
+		std::unordered_map<uint32_t, uint32_t> globalToLocal;
+		for (gsl::index i = 0; i < gsl::narrow<gsl::index>(indices.size()); ++i)
+		{
+			const auto insertResult = globalToLocal.emplace(indices[i], gsl::narrow<uint32_t>(localToGlobal.size()));
+			if (insertResult.second)
+			{
+				localToGlobal.push_back(indices[i]);
+			}
+			triangles[i / 3][i % 3] = insertResult.first->second;
+		}
+	}
+
+	const size_t vertexCount = localToGlobal.size();
+	std::vector<glm::dvec3> positions(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		positions[i] = glm::dvec3(vertices[localToGlobal[i]].pos);
+	}
+
+	std::vector<bool> isLocked(vertexCount, false);
+
+	// seams, the vertices on the other side would not follow the collapse
+	{
+		std::unordered_map<glm::vec3, int> positionCounts;
+		for (uint32_t globalIndex : localToGlobal)
+		{
+			++positionCounts[vertices[globalIndex].pos];
+		}
+
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			isLocked[i] = positionCounts[vertices[localToGlobal[i]].pos] > 1;
+		}
+	}
+
+	// open borders, edges with a single triangle
+	{
+		std::unordered_map<uint64_t, int> edgeTriangleCounts;
+		for (const Triangle& triangle : triangles)
+		{
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				++edgeTriangleCounts[CalcEdgeKey(triangle[corner], triangle[(corner + 1) % 3])];
+			}
+		}
+
+		for (const auto& edgeTriangleCount : edgeTriangleCounts)
+		{
+			if (edgeTriangleCount.second == 1)
+			{
+				isLocked[static_cast<uint32_t>(edgeTriangleCount.first >> 32)] = true;
+				isLocked[static_cast<uint32_t>(edgeTriangleCount.first & 0xffffffff)] = true;
+			}
+		}
+	}
+
+	// area weighted planes of the adjacent triangles
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+	for (uint32_t triangleIndex = 0; triangleIndex < triangles.size(); ++triangleIndex)
+	{
+		const Triangle& triangle = triangles[triangleIndex];
+		const glm::dvec3 cross = CalcTriangleCross(positions, triangle);
+		const double crossLength = glm::length(cross);
+
+		if (crossLength > 0.0)
+		{
+			const glm::dvec3 normal = cross / crossLength;
+			const Quadric quadric = Quadric::FromPlane(glm::dvec4(normal, -glm::dot(normal, positions[triangle[0]])), crossLength * 0.5);
+			for (uint32_t vertex : triangle)
+			{
+				quadrics[vertex] += quadric;
+			}
+		}
+
+		for (uint32_t vertex : triangle)
+		{
+			vertexTriangles[vertex].push_back(triangleIndex);
+		}
+	}
+
+	const auto calcCollapseCost = [&quadrics, &positions](uint32_t from, uint32_t to)
+	{
+		Quadric quadric = quadrics[from];
+		quadric += quadrics[to];
+		return quadric.Evaluate(positions[to]);
+	};
+
+	// costs only grow, so outdated entries are recalculated when they are popped instead of being removed
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+	const auto pushCollapse = [&](uint32_t from, uint32_t to)
+	{
+		if (!isLocked[from])
+		{
+			collapses.push(Collapse{ calcCollapseCost(from, to), from, to });
+		}
+	};
+
+	for (const Triangle& triangle : triangles)
+	{
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			pushCollapse(triangle[corner], triangle[(corner + 1) % 3]);
+			pushCollapse(triangle[(corner + 1) % 3], triangle[corner]);
+		}
+	}
+
+	std::vector<bool> isTriangleRemoved(triangles.size(), false);
+	std::vector<bool> isVertexRemoved(vertexCount, false);
+	size_t triangleCount = triangles.size();
+
+	// neighbours of a vertex, reused between the collapses
+	std::vector<uint32_t> fromNeighbours;
+	std::vector<uint32_t> toNeighbours;
+	const auto collectNeighbours = [&](uint32_t vertex, std::vector<uint32_t>& outNeighbours)
+	{
+		outNeighbours.clear();
+		for (uint32_t triangleIndex : vertexTriangles[vertex])
+		{
+			if (isTriangleRemoved[triangleIndex])
+			{
+				continue;
+			}
+
+			for (uint32_t neighbour : triangles[triangleIndex])
+			{
+				if (neighbour != vertex)
+				{
+					outNeighbours.push_back(neighbour);
+				}
+			}
+		}
+		std::sort(std::begin(outNeighbours), std::end(outNeighbours));
+		outNeighbours.erase(std::unique(std::begin(outNeighbours), std::end(outNeighbours)), std::end(outNeighbours));
+	};
+
+	while (triangleCount * 3 > targetIndexCount && !collapses.empty())
+	{
+		const Collapse collapse = collapses.top();
+		collapses.pop();
+
+		if (isVertexRemoved[collapse.from] || isVertexRemoved[collapse.to])
+		{
+			continue;
+		}
+
+		const double cost = calcCollapseCost(collapse.from, collapse.to);
+		if (cost > collapse.cost)
+		{
+			collapses.push(Collapse{ cost, collapse.from, collapse.to });
+			continue;
+		}
+
+		int sharedTriangleCount = 0;
+		bool isFlipping = false;
+		for (uint32_t triangleIndex : vertexTriangles[collapse.from])
+		{
+			if (isTriangleRemoved[triangleIndex])
+			{
+				continue;
+			}
+
+			const Triangle& triangle = triangles[triangleIndex];
+			if (ContainsVertex(triangle, collapse.to))
+			{
+				++sharedTriangleCount;
+				continue;
+			}
+
+			Triangle collapsedTriangle = triangle;
+			std::replace(std::begin(collapsedTriangle), std::end(collapsedTriangle), collapse.from, collapse.to);
+
+			const glm::dvec3 oldCross = CalcTriangleCross(positions, triangle);
+			const glm::dvec3 newCross = CalcTriangleCross(positions, collapsedTriangle);
+			if (glm::dot(oldCross, newCross) <= 0.0)
+			{
+				isFlipping = true;
+				break;
+			}
+		}
+
+		// the edge is gone or the collapse would flip a triangle
+		if (sharedTriangleCount == 0 || isFlipping)
+		{
+			continue;
+		}
+
+		// the only common neighbours may be the opposite vertices of the collapsed triangles, otherwise the mesh gets non manifold
+		collectNeighbours(collapse.from, fromNeighbours);
+		collectNeighbours(collapse.to, toNeighbours);
+		std::vector<uint32_t> commonNeighbours;
+		std::set_intersection(std::begin(fromNeighbours), std::end(fromNeighbours), std::begin(toNeighbours), std::end(toNeighbours),
+			std::back_inserter(commonNeighbours));
+
+		if (gsl::narrow<int>(commonNeighbours.size()) > sharedTriangleCount)
+		{
+			continue;
+		}
+
+		for (uint32_t triangleIndex : vertexTriangles[collapse.from])
+		{
+			if (isTriangleRemoved[triangleIndex])
+			{
+				continue;
+			}
+
+			Triangle& triangle = triangles[triangleIndex];
+			if (ContainsVertex(triangle, collapse.to))
+			{
+				isTriangleRemoved[triangleIndex] = true;
+				--triangleCount;
+			}
+			else
+			{
+				std::replace(std::begin(triangle), std::end(triangle), collapse.from, collapse.to);
+				vertexTriangles[collapse.to].push_back(triangleIndex);
+			}
+		}
+
+		isVertexRemoved[collapse.from] = true;
+		vertexTriangles[collapse.from].clear();
+		quadrics[collapse.to] += quadrics[collapse.from];
+
+		// the edges around the kept vertex changed their cost
+		collectNeighbours(collapse.to, toNeighbours);
+		for (uint32_t neighbour : toNeighbours)
+		{
+			pushCollapse(neighbour, collapse.to);
+			pushCollapse(collapse.to, neighbour);
+		}
+	}
+
+	std::vector<uint32_t> simplifiedIndices;
+	simplifiedIndices.reserve(triangleCount * 3);
+	for (size_t triangleIndex = 0; triangleIndex < triangles.size(); ++triangleIndex)
+	{
+		if (isTriangleRemoved[triangleIndex])
+		{
+			continue;
+		}
+
+		for (uint32_t vertex : triangles[triangleIndex])
+		{
+			simplifiedIndices.push_back(localToGlobal[vertex]);
+		}
+	}
+
+	return simplifiedIndices;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <vector>
+#include <gsl/gsl>
+#include "Vertex.hpp"
+
+// quadric error edge collapse, see Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics"
+// a vertex is always collapsed into one of its neighbours, no vertex is moved or created,
+// so the simplified indices can use the vertex buffer of the full mesh
+namespace MeshSimplifier
+{
+	// collapses the cheapest edges until at most targetIndexCount indices are left or no edge can be collapsed
+	// without flipping a triangle. Vertices on open borders and on seams (the same position with another normal or uv) are kept,
+	// so the mesh does not tear
+	std::vector<uint32_t> Simplify(gsl::span<const Vertex> vertices, gsl::span<const uint32_t> indices, size_t targetIndexCount);
+}
@@ -0,0 +1,82 @@
+#include "pch.hpp"
+#include "PersistentPipelineCache.hpp"
+#include <fstream>
+
+namespace
+{
+	// VkPipelineCacheHeaderVersionOne, read field by field as the data has no alignment guarantees
+	constexpr size_t cacheHeaderSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+
+	uint32_t ReadUint32(const std::vector<char>& data, size_t offset)
+	{
+		uint32_t value;
+		std::memcpy(&value, data.data() + offset, sizeof(value));
+		return value;
+	}
+
+	bool IsMatchingCacheData(const std::vector<char>& data, const vk::PhysicalDeviceProperties& deviceProperties)
+	{
+		if (data.size() < cacheHeaderSize)
+		{
+			return false;
+		}
+
+		const uint32_t headerSize = ReadUint32(data, 0);
+		const uint32_t headerVersion = ReadUint32(data, 4);
+		const uint32_t vendorId = ReadUint32(data, 8);
+		const uint32_t deviceId = ReadUint32(data, 12);
+
+		return headerSize >= cacheHeaderSize
+			&& headerVersion == static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne)
+			&& vendorId == deviceProperties.vendorID
+			&& deviceId == deviceProperties.deviceID
+			&& std::memcmp(data.data() + 16, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	std::vector<char> LoadFileIfExists(const std::string& filePath)
+	{
+		std::ifstream file(filePath, std::ios::ate | std::ios::binary);
+		if (!file.is_open())
+		{
+			return {};
+		}
+
+		std::vector<char> content(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(content.data(), content.size());
+		return content;
+	}
+}
+
+PersistentPipelineCache::PersistentPipelineCache(vk::Device device, const vk::PhysicalDeviceProperties& deviceProperties, std::string filePath)
+	: m_device(device)
+	, m_filePath(std::move(filePath))
+{
+	std::vector<char> cacheData = LoadFileIfExists(m_filePath);
+	m_isLoadedFromFile = IsMatchingCacheData(cacheData, deviceProperties);
+	if (!m_isLoadedFromFile)
+	{
+		cacheData.clear();
+	}
+
+	m_pipelineCache = device.createPipelineCacheUnique(vk::PipelineCacheCreateInfo{}
+		.setInitialDataSize(cacheData.size())
+		.setPInitialData(cacheData.data()));
+}
+
+void PersistentPipelineCache::Save() const
+{
+	if (!m_pipelineCache)
+	{
+		return;
+	}
+
+	const std::vector<uint8_t> cacheData = m_device.getPipelineCacheData(m_pipelineCache.get());
+
+	// a failed write only costs the next start its warm cache
+	std::ofstream file(m_filePath, std::ios::binary | std::ios::trunc);
+	if (file.is_open())
+	{
+		file.write(reinterpret_cast<const char*>(cacheData.data()), cacheData.size());
+	}
+}
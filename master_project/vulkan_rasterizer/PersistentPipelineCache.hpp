@@ -0,0 +1,26 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <string>
+
+// pipeline cache which is loaded from a file and written back by Save
+// the file is only used if its header matches the device (vendor, device id and pipeline cache uuid),
+// otherwise the cache starts empty and the file is overwritten
+class PersistentPipelineCache
+{
+public:
+	PersistentPipelineCache() = default;
+	PersistentPipelineCache(vk::Device device, const vk::PhysicalDeviceProperties& deviceProperties, std::string filePath);
+
+	void Save() const;
+
+	vk::PipelineCache Get() const { return m_pipelineCache.get(); }
+
+	// false if the file was missing or written by another device or driver
+	bool IsLoadedFromFile() const { return m_isLoadedFromFile; }
+
+private:
+	vk::Device m_device;
+	std::string m_filePath;
+	vk::UniquePipelineCache m_pipelineCache;
+	bool m_isLoadedFromFile = false;
+};
@@ -0,0 +1,85 @@
+#include "pch.hpp"
+#include "PipelineStatisticsQueries.hpp"
+
+namespace
+{
+	// the results are written in the order of the flag bits, which matches the members of PipelineStatistics
+	const vk::QueryPipelineStatisticFlags queriedStatistics =
+		vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+		| vk::QueryPipelineStatisticFlagBits::eClippingPrimitives
+		| vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+
+	constexpr uint32_t queriedStatisticsCount = 3;
+}
+
+PipelineStatisticsQueries::PipelineStatisticsQueries(vk::Device device, vk::PhysicalDevice physicalDevice, int frameCount, uint32_t queriesPerFrame)
+	: m_device(device)
+	, m_queriesPerFrame(queriesPerFrame)
+{
+	if (!physicalDevice.getFeatures().pipelineStatisticsQuery)
+	{
+		return;
+	}
+
+	const vk::QueryPoolCreateInfo queryPoolCreateInfo = vk::QueryPoolCreateInfo{}
+		.setQueryType(vk::QueryType::ePipelineStatistics)
+		.setQueryCount(queriesPerFrame)
+		.setPipelineStatistics(queriedStatistics);
+
+	for (int i = 0; i < frameCount; ++i)
+	{
+		m_queryPools.push_back(device.createQueryPoolUnique(queryPoolCreateInfo));
+	}
+	m_values.resize(queriesPerFrame * queriedStatisticsCount);
+}
+
+void PipelineStatisticsQueries::Reset(vk::CommandBuffer commandBuffer, int frameIndex) const
+{
+	if (IsSupported())
+	{
+		commandBuffer.resetQueryPool(m_queryPools[frameIndex].get(), 0, m_queriesPerFrame);
+	}
+}
+
+void PipelineStatisticsQueries::Begin(vk::CommandBuffer commandBuffer, int frameIndex, uint32_t queryIndex) const
+{
+	assert(queryIndex < m_queriesPerFrame);
+	if (IsSupported())
+	{
+		commandBuffer.beginQuery(m_queryPools[frameIndex].get(), queryIndex, vk::QueryControlFlags{});
+	}
+}
+
+void PipelineStatisticsQueries::End(vk::CommandBuffer commandBuffer, int frameIndex, uint32_t queryIndex) const
+{
+	if (IsSupported())
+	{
+		commandBuffer.endQuery(m_queryPools[frameIndex].get(), queryIndex);
+	}
+}
+
+bool PipelineStatisticsQueries::Read(int frameIndex, gsl::span<PipelineStatistics> outStatistics)
+{
+	const uint32_t queryCount = gsl::narrow<uint32_t>(outStatistics.size());
+	assert(queryCount <= m_queriesPerFrame);
+	if (!IsSupported() || queryCount == 0)
+	{
+		return false;
+	}
+
+	const vk::Result result = m_device.getQueryPoolResults(m_queryPools[frameIndex].get(), 0, queryCount,
+		queryCount * queriedStatisticsCount * sizeof(uint64_t), m_values.data(), queriedStatisticsCount * sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+
+	if (result != vk::Result::eSuccess)
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < queryCount; ++i)
+	{
+		outStatistics[i].vertexShaderInvocations = m_values[i * queriedStatisticsCount + 0];
+		outStatistics[i].clippingPrimitives = m_values[i * queriedStatisticsCount + 1];
+		outStatistics[i].fragmentShaderInvocations = m_values[i * queriedStatisticsCount + 2];
+	}
+	return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <gsl/gsl>
+#include <vector>
+
+struct PipelineStatistics
+{
+	uint64_t vertexShaderInvocations = 0;
+
+	// primitives which passed the clipping, so they reached the rasterizer
+	uint64_t clippingPrimitives = 0;
+
+	uint64_t fragmentShaderInvocations = 0;
+};
+
+// a pipeline statistics query pool for each frame in flight, used like GpuTimestamps
+class PipelineStatisticsQueries
+{
+public:
+	PipelineStatisticsQueries() = default;
+
+	// stays unsupported if the device lacks the pipelineStatisticsQuery feature, it has to be enabled on the device otherwise
+	PipelineStatisticsQueries(vk::Device device, vk::PhysicalDevice physicalDevice, int frameCount, uint32_t queriesPerFrame);
+
+	bool IsSupported() const { return !m_queryPools.empty(); }
+
+	// outside of a render pass, before the first Begin of the frame
+	void Reset(vk::CommandBuffer commandBuffer, int frameIndex) const;
+
+	// Begin and End have to be in the same subpass, they can be recorded into secondary command buffers
+	void Begin(vk::CommandBuffer commandBuffer, int frameIndex, uint32_t queryIndex) const;
+	void End(vk::CommandBuffer commandBuffer, int frameIndex, uint32_t queryIndex) const;
+
+	// the frame fence has to be waited for, the first outStatistics.size() queries have to be ended
+	// returns false if a result is not available
+	bool Read(int frameIndex, gsl::span<PipelineStatistics> outStatistics);
+
+private:
+	vk::Device m_device;
+	uint32_t m_queriesPerFrame = 0;
+	std::vector<vk::UniqueQueryPool> m_queryPools;
+
+	// the values of a Read, kept so reading does not allocate
+	std::vector<uint64_t> m_values;
+};
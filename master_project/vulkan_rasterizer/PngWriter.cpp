@@ -0,0 +1,177 @@
+#include "pch.hpp"
+#include "PngWriter.hpp"
+
+namespace
+{
+	constexpr size_t maxStoredBlockSize = 0xFFFF;
+
+	std::array<uint32_t, 256> CreateCrcTable()
+	{
+		std::array<uint32_t, 256> table;
+		for (uint32_t n = 0; n < 256; ++n)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; ++k)
+			{
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+		return table;
+	}
+
+	uint32_t Crc(gsl::span<const uint8_t> data)
+	{
+		static const std::array<uint32_t, 256> crcTable = CreateCrcTable();
+
+		uint32_t c = 0xFFFFFFFFu;
+		for (uint8_t byte : data)
+		{
+			c = crcTable[(c ^ byte) & 0xFF] ^ (c >> 8);
+		}
+		return c ^ 0xFFFFFFFFu;
+	}
+
+	void AppendUint32BigEndian(std::vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value >> 24));
+		out.push_back(static_cast<uint8_t>(value >> 16));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	void AppendUint16LittleEndian(std::vector<uint8_t>& out, uint16_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+	}
+
+	// length, type, data and the crc of type and data, appendData appends the data to out
+	template<typename AppendDataFunction>
+	void AppendChunk(std::vector<uint8_t>& out, const char(&type)[5], AppendDataFunction appendData)
+	{
+		// the length is known once the data is appended
+		const size_t lengthStart = out.size();
+		AppendUint32BigEndian(out, 0);
+
+		const size_t typeStart = out.size();
+		out.insert(out.end(), type, type + 4);
+		appendData(out);
+
+		const uint32_t length = gsl::narrow<uint32_t>(out.size() - typeStart - 4);
+		for (int i = 0; i < 4; ++i)
+		{
+			out[lengthStart + i] = static_cast<uint8_t>(length >> (24 - 8 * i));
+		}
+
+		AppendUint32BigEndian(out, Crc(gsl::make_span(out).subspan(typeStart)));
+	}
+
+	// zlib stream of stored deflate blocks, the data are the rows, each starting with its filter type
+	void AppendZlibStream(std::vector<uint8_t>& out, uint32_t width, uint32_t height, gsl::span<const uint8_t> pixels, PngWriter::PixelFormat pixelFormat)
+	{
+		const size_t rowSize = size_t(width) * 4;
+		const size_t dataSize = (rowSize + 1) * height;
+
+		// deflate with a 32k window, no preset dictionary, fastest compression
+		out.push_back(0x78);
+		out.push_back(0x01);
+
+		size_t offset = 0;
+		size_t remainingBlockSize = 0;
+		uint32_t adlerA = 1;
+		uint32_t adlerB = 0;
+		const auto appendByte = [&](uint8_t byte)
+		{
+			if (remainingBlockSize == 0)
+			{
+				const size_t blockSize = std::min(maxStoredBlockSize, dataSize - offset);
+				const bool isFinalBlock = offset + blockSize == dataSize;
+
+				out.push_back(isFinalBlock ? 1 : 0);
+				AppendUint16LittleEndian(out, static_cast<uint16_t>(blockSize));
+				AppendUint16LittleEndian(out, static_cast<uint16_t>(~blockSize));
+				remainingBlockSize = blockSize;
+			}
+
+			out.push_back(byte);
+			--remainingBlockSize;
+			++offset;
+
+			adlerA = (adlerA + byte) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		};
+
+		// the source byte of each rgba channel
+		const std::array<int, 4> channelOrder = pixelFormat == PngWriter::PixelFormat::Bgra
+			? std::array<int, 4>{ 2, 1, 0, 3 }
+			: std::array<int, 4>{ 0, 1, 2, 3 };
+
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			// filter type 0 keeps the bytes as they are
+			appendByte(0);
+
+			const gsl::span<const uint8_t> row = pixels.subspan(y * rowSize, rowSize);
+			for (size_t pixelStart = 0; pixelStart < rowSize; pixelStart += 4)
+			{
+				for (int channel : channelOrder)
+				{
+					appendByte(row[pixelStart + channel]);
+				}
+			}
+		}
+
+		// an empty image still needs the final block
+		if (dataSize == 0)
+		{
+			out.push_back(1);
+			AppendUint16LittleEndian(out, 0);
+			AppendUint16LittleEndian(out, 0xFFFF);
+		}
+
+		AppendUint32BigEndian(out, (adlerB << 16) | adlerA);
+	}
+}
+
+bool PngWriter::Write(const char* filePath, uint32_t width, uint32_t height, gsl::span<const uint8_t> pixels, PixelFormat pixelFormat,
+	std::vector<uint8_t>& pngStorage)
+{
+	const size_t rowSize = size_t(width) * 4;
+	assert(pixels.size() == rowSize * height);
+
+	// signature, the chunks with 12 bytes of length, type and crc each, the 13 byte header and the zlib stream
+	const size_t dataSize = (rowSize + 1) * height;
+	const size_t storedBlockCount = std::max<size_t>(1, (dataSize + maxStoredBlockSize - 1) / maxStoredBlockSize);
+	const size_t zlibStreamSize = 2 + storedBlockCount * 5 + dataSize + 4;
+	pngStorage.clear();
+	pngStorage.reserve(8 + 3 * 12 + 13 + zlibStreamSize);
+
+	constexpr uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	pngStorage.insert(pngStorage.end(), std::begin(signature), std::end(signature));
+
+	AppendChunk(pngStorage, "IHDR", [width, height](std::vector<uint8_t>& out)
+		{
+			AppendUint32BigEndian(out, width);
+			AppendUint32BigEndian(out, height);
+			const uint8_t bitDepth = 8;
+			const uint8_t colorTypeRgba = 6;
+			// compression, filter and interlace method
+			const uint8_t header[] = { bitDepth, colorTypeRgba, 0, 0, 0 };
+			out.insert(out.end(), std::begin(header), std::end(header));
+		});
+	AppendChunk(pngStorage, "IDAT", [&](std::vector<uint8_t>& out)
+		{
+			AppendZlibStream(out, width, height, pixels, pixelFormat);
+		});
+	AppendChunk(pngStorage, "IEND", [](std::vector<uint8_t>&) {});
+
+	std::FILE* file = std::fopen(filePath, "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	const bool isWritten = std::fwrite(pngStorage.data(), 1, pngStorage.size(), file) == pngStorage.size();
+	return std::fclose(file) == 0 && isWritten;
+}
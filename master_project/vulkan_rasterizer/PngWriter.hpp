@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <gsl/gsl>
+
+namespace PngWriter
+{
+	// byte order of the 4 byte pixels passed to Write, the png is always rgba
+	enum class PixelFormat
+	{
+		Rgba,
+		Bgra,
+	};
+
+	// writes 8 bit pixels as rgba png, rows from top to bottom, without compression (stored deflate blocks)
+	// the file is assembled in pngStorage, which keeps its capacity, so writing further images of the same size does not allocate
+	// returns false if the file could not be written
+	bool Write(const char* filePath, uint32_t width, uint32_t height, gsl::span<const uint8_t> pixels, PixelFormat pixelFormat,
+		std::vector<uint8_t>& pngStorage);
+}
@@ -4,6 +4,10 @@
 #include "PushConstants.hpp"
 #include "NTree.hpp"
 #include "TriangleMesh.hpp"
+#include "UniformBufferObjects.hpp"
+#include "Scene.hpp"
+#include "Ray.hpp"
+#include "Profiler.hpp"
 
 void PortalManager::Add(const Portal& portal)
 {
@@ -34,7 +38,7 @@ namespace {
 
 }
 
-void PortalManager::DrawPortals(const DrawPortalsInfo& info)
+void PortalManager::DrawPortals(const DrawPortalsInfo& info) const
 {
 	const uint32_t actualPortalCount = GetSizeUint32(m_portals) * 2;
 	assert(info.meshDataManager);
@@ -54,6 +58,11 @@ void PortalManager::DrawPortals(const DrawPortalsInfo& info)
 	pushConstant.nextLayerStartIndex = info.nextLayerStartIndex;
 	pushConstant.maxVisiblePortalCount = info.maxVisiblePortalCount;
 	pushConstant.currentPortalCount = gsl::narrow<uint32_t>(GetPortalCount());
+	pushConstant.objectCount = info.objectCount;
+	pushConstant.nextDrawCommandSetIndex = info.nextDrawCommandSetIndex;
+	pushConstant.nextLayerInstanceCount = info.nextLayerInstanceCount;
+	pushConstant.minPortalCoverage = info.minPortalCoverage;
+	pushConstant.isNextLayerHardwareStencil = info.isNextLayerHardwareStencil ? 1 : 0;
 
 	const int instanceCount = info.nextLayerStartIndex - info.layerStartIndex;
 
@@ -91,8 +100,11 @@ void PortalManager::DrawPortals(const DrawPortalsInfo& info)
 	}
 }
 
-void PortalManager::CreateCameraMats(glm::mat4 cameraMat, int maxRecursionCount, gsl::span<glm::mat4> outCameraTransforms) const
+void PortalManager::CreateCameraMats(glm::mat4 cameraMat, int maxRecursionCount, gsl::span<glm::mat4> outCameraTransforms,
+	const std::vector<bool>& activeCameras) const
 {
+	PROFILE_SCOPE("PortalManager::CreateCameraMats");
+
 	// we build an NTree, with a child for each portal connections (portals are two sided so we have to connection per element in portals)
 	// layer 0  of the NTree has 1 element
 	// layer 1 has portalCount elements
@@ -117,6 +129,12 @@ void PortalManager::CreateCameraMats(glm::mat4 cameraMat, int maxRecursionCount,
 		// for each parent we iterate over all portals
 		for (uint32_t parentIdx = previousLayerStartIndex; parentIdx < layerStartIndex; ++parentIdx)
 		{
+			// the children of inactive cameras are inactive as well
+			if (!activeCameras.empty() && !activeCameras[parentIdx])
+			{
+				continue;
+			}
+
 			// we are iterating over 2 elements at once, so the actual portals are 2*i and 2*i +1!
 			for (uint32_t i = 0; i < m_portals.size(); ++i)
 			{
@@ -126,12 +144,315 @@ void PortalManager::CreateCameraMats(glm::mat4 cameraMat, int maxRecursionCount,
 				// validate that we don't got out of range
 				assert(childIdx1 < matrixCount);
 
-				outCameraTransforms[childIdx0] = m_portals[i].toOtherEndpoint[PortalEndpointIndex(PortalEndpoint::A)] * outCameraTransforms[parentIdx];
-				outCameraTransforms[childIdx1] = m_portals[i].toOtherEndpoint[PortalEndpointIndex(PortalEndpoint::B)] * outCameraTransforms[parentIdx];
+				if (activeCameras.empty() || activeCameras[childIdx0])
+				{
+					outCameraTransforms[childIdx0] = m_portals[i].toOtherEndpoint[PortalEndpointIndex(PortalEndpoint::A)] * outCameraTransforms[parentIdx];
+				}
+
+				if (activeCameras.empty() || activeCameras[childIdx1])
+				{
+					outCameraTransforms[childIdx1] = m_portals[i].toOtherEndpoint[PortalEndpointIndex(PortalEndpoint::B)] * outCameraTransforms[parentIdx];
+				}
+			}
+		}
+	}
+
+}
+
+namespace
+{
+	const glm::vec4 fullScreenBounds(-1.f, -1.f, 1.f, 1.f);
+	const glm::vec4 emptyScreenBounds(1.f, 1.f, -1.f, -1.f);
+
+	// distance is always positive, nothing gets clipped
+	const glm::vec4 noClipPlane(0.f, 0.f, 0.f, 1.f);
+
+	// moves the clip plane a bit towards the camera, so surfaces touching the portal don't flicker
+	constexpr float clipPlaneBias = 0.001f;
+
+	bool IsEmpty(const glm::vec4& screenBounds)
+	{
+		return screenBounds.x >= screenBounds.z || screenBounds.y >= screenBounds.w;
+	}
+
+	glm::vec3 GetCorner(const AABB& bounds, int cornerIdx)
+	{
+		return glm::vec3(
+			(cornerIdx & 1) == 0 ? bounds.minBounds.x : bounds.maxBounds.x,
+			(cornerIdx & 2) == 0 ? bounds.minBounds.y : bounds.maxBounds.y,
+			(cornerIdx & 4) == 0 ? bounds.minBounds.z : bounds.maxBounds.z);
+	}
+
+	// projected bounds of the portal, narrowed to the bounds of the portals we are already looking through
+	glm::vec4 CalcScreenBounds(const glm::mat4& modelViewProj, const AABB& bounds, const glm::vec4& parentScreenBounds)
+	{
+		glm::vec2 screenMin(std::numeric_limits<float>::max());
+		glm::vec2 screenMax(std::numeric_limits<float>::lowest());
+
+		for (int cornerIdx = 0; cornerIdx < 8; ++cornerIdx)
+		{
+			const glm::vec4 clipPos = modelViewProj * glm::vec4(GetCorner(bounds, cornerIdx), 1.f);
+
+			// the portal intersects the near plane, we can't narrow the bounds
+			if (clipPos.w <= 0.f)
+			{
+				return parentScreenBounds;
+			}
+
+			const glm::vec2 ndc = glm::vec2(clipPos) / clipPos.w;
+			screenMin = glm::min(screenMin, ndc);
+			screenMax = glm::max(screenMax, ndc);
+		}
+
+		return glm::vec4(
+			glm::max(screenMin, glm::vec2(parentScreenBounds.x, parentScreenBounds.y)),
+			glm::min(screenMax, glm::vec2(parentScreenBounds.z, parentScreenBounds.w)));
+	}
+
+	// model space axis of the portal normal, if the portal is flat
+	std::optional<int> FindFlatAxis(const AABB& bounds)
+	{
+		const glm::vec3 extent = bounds.maxBounds - bounds.minBounds;
+		const float maxExtent = std::max({ extent.x, extent.y, extent.z });
+
+		int thinnestAxis = 0;
+		for (int axis = 1; axis < 3; ++axis)
+		{
+			if (extent[axis] < extent[thinnestAxis])
+			{
+				thinnestAxis = axis;
+			}
+		}
+
+		if (extent[thinnestAxis] <= maxExtent * 0.001f)
+		{
+			return thinnestAxis;
+		}
+		return std::nullopt;
+	}
+
+	// view space plane which clips everything between the camera and the destination portal
+	glm::vec4 CalcClipPlane(const glm::mat4& modelView, const AABB& bounds)
+	{
+		// flat portals are clipped at their plane, this is the oblique near plane of the camera
+		if (const std::optional<int> flatAxis = FindFlatAxis(bounds))
+		{
+			glm::vec3 modelNormal(0.f);
+			modelNormal[*flatAxis] = 1.f;
+
+			const glm::vec3 normal = glm::normalize(glm::mat3(glm::transpose(glm::inverse(modelView))) * modelNormal);
+			const glm::vec3 point = glm::vec3(modelView * glm::vec4((bounds.minBounds + bounds.maxBounds) * 0.5f, 1.f));
+
+			// the camera is at the origin and has to be on the clipped side
+			glm::vec4 plane(normal, -glm::dot(normal, point));
+			if (plane.w > 0.f)
+			{
+				plane = -plane;
+			}
+
+			plane.w += clipPlaneBias;
+			return plane;
+		}
+
+		// other portals have a volume, we can only clip what is closer than their nearest corner
+		float minDistance = std::numeric_limits<float>::max();
+		for (int cornerIdx = 0; cornerIdx < 8; ++cornerIdx)
+		{
+			const glm::vec4 viewPos = modelView * glm::vec4(GetCorner(bounds, cornerIdx), 1.f);
+			minDistance = std::min(minDistance, -viewPos.z);
+		}
+
+		if (minDistance <= clipPlaneBias)
+		{
+			return noClipPlane;
+		}
+
+		// the camera looks along -z
+		return glm::vec4(0.f, 0.f, -1.f, -minDistance + clipPlaneBias);
+	}
+
+	// points further than this are on the visible side of a portal plane
+	constexpr float portalPlaneEpsilon = 0.001f;
+
+	// world space plane of a flat portal, the normal points along the flat model axis
+	std::optional<glm::vec4> CalcPortalPlane(const glm::mat4& transform, const AABB& bounds)
+	{
+		const std::optional<int> flatAxis = FindFlatAxis(bounds);
+		if (!flatAxis)
+		{
+			return std::nullopt;
+		}
+
+		glm::vec3 modelNormal(0.f);
+		modelNormal[*flatAxis] = 1.f;
+
+		const glm::vec3 normal = glm::normalize(glm::mat3(glm::transpose(glm::inverse(transform))) * modelNormal);
+		const glm::vec3 point = glm::vec3(transform * glm::vec4((bounds.minBounds + bounds.maxBounds) * 0.5f, 1.f));
+		return glm::vec4(normal, -glm::dot(normal, point));
+	}
+
+	// world space points spread over the portal, flat portals are only sampled on their plane
+	std::vector<glm::vec3> CalcPortalSamplePoints(const glm::mat4& transform, const AABB& bounds)
+	{
+		const std::array<float, 3> sampleFractions = { 0.1f, 0.5f, 0.9f };
+		const std::array<float, 1> centerFraction = { 0.5f };
+		const std::optional<int> flatAxis = FindFlatAxis(bounds);
+
+		const auto getFractions = [&](int axis)
+		{
+			return flatAxis == axis ? gsl::span<const float>(centerFraction) : gsl::span<const float>(sampleFractions);
+		};
+
+		std::vector<glm::vec3> samplePoints;
+		for (float x : getFractions(0))
+		{
+			for (float y : getFractions(1))
+			{
+				for (float z : getFractions(2))
+				{
+					const glm::vec3 modelPos = glm::mix(bounds.minBounds, bounds.maxBounds, glm::vec3(x, y, z));
+					samplePoints.push_back(glm::vec3(transform * glm::vec4(modelPos, 1.f)));
+				}
+			}
+		}
+		return samplePoints;
+	}
+}
+
+void PortalManager::CreateCameraClipData(
+	const glm::mat4& projection,
+	gsl::span<const glm::mat4> viewMats,
+	int maxRecursionCount,
+	gsl::span<const TriangleMesh> portalMeshes,
+	gsl::span<Ssbo_CameraClipData> outCameraClipData,
+	gsl::span<glm::vec4> outLayerScreenBounds,
+	const std::vector<bool>& activeCameras) const
+{
+	// same NTree as CreateCameraMats, a child looks through the portal with its child num from the parent
+	// and sees the scene behind the other endpoint of the portal
+	const uint32_t portalCount = gsl::narrow<uint32_t>(GetPortalCount());
+	const uint32_t cameraCount = NTree::CalcTotalElements(portalCount, maxRecursionCount + 1);
+	assert(viewMats.size() >= cameraCount);
+	assert(outCameraClipData.size() >= cameraCount);
+	assert(outLayerScreenBounds.size() >= maxRecursionCount + 1);
+
+	outCameraClipData[0].screenBounds = fullScreenBounds;
+	outCameraClipData[0].clipPlane = noClipPlane;
+	outLayerScreenBounds[0] = fullScreenBounds;
+
+	for (int cameraTreeLayer = 1; cameraTreeLayer <= maxRecursionCount; ++cameraTreeLayer)
+	{
+		const uint32_t previousLayerStartIndex = NTree::CalcFirstLayerIndex(portalCount, cameraTreeLayer - 1);
+		const uint32_t layerStartIndex = NTree::CalcFirstLayerIndex(portalCount, cameraTreeLayer);
+
+		glm::vec4 layerScreenBounds = emptyScreenBounds;
+
+		for (uint32_t parentIdx = previousLayerStartIndex; parentIdx < layerStartIndex; ++parentIdx)
+		{
+			const glm::vec4 parentScreenBounds = outCameraClipData[parentIdx].screenBounds;
+			const bool isParentVisible = !IsEmpty(parentScreenBounds);
+
+			// the portal the parent looked through, the main camera did not look through a portal
+			std::optional<NTree::ParentIdxAndChildNum> parentEntry;
+			glm::vec3 parentCameraPosition(0.f);
+			if (isParentVisible && parentIdx != 0)
+			{
+				parentEntry = NTree::GetParentIdxAndChildNum(portalCount, parentIdx);
+				parentCameraPosition = glm::vec3(glm::inverse(viewMats[parentIdx])[3]);
+			}
+
+			for (uint32_t i = 0; i < m_portals.size(); ++i)
+			{
+				for (auto endPoint = PortalEndpointIndex::First(); endPoint <= PortalEndpointIndex::Last(); ++endPoint)
+				{
+					const uint32_t childIdx = NTree::GetChildElementIdx(portalCount, parentIdx, 2 * i + gsl::narrow<uint32_t>(endPoint.ToIndex()));
+					Ssbo_CameraClipData& clipData = outCameraClipData[childIdx];
+
+					const bool isActive = activeCameras.empty() || activeCameras[childIdx];
+					const bool isPotentiallyVisible = !parentEntry || IsPotentiallyVisible(
+						gsl::narrow<int>(parentEntry->childNum / 2), PortalEndpointIndex(static_cast<PortalEndpoint>(parentEntry->childNum % 2)),
+						parentCameraPosition, gsl::narrow<int>(i), endPoint);
+
+					// the children of invisible cameras are invisible as well
+					if (!isParentVisible || !isActive || !isPotentiallyVisible)
+					{
+						clipData.screenBounds = emptyScreenBounds;
+						clipData.clipPlane = noClipPlane;
+						continue;
+					}
+
+					clipData = CalcChildClipData(projection, viewMats[parentIdx], parentScreenBounds, viewMats[childIdx], gsl::narrow<int>(i), endPoint, portalMeshes);
+
+					if (!IsEmpty(clipData.screenBounds))
+					{
+						layerScreenBounds = glm::vec4(
+							glm::min(glm::vec2(layerScreenBounds.x, layerScreenBounds.y), glm::vec2(clipData.screenBounds.x, clipData.screenBounds.y)),
+							glm::max(glm::vec2(layerScreenBounds.z, layerScreenBounds.w), glm::vec2(clipData.screenBounds.z, clipData.screenBounds.w)));
+					}
+				}
 			}
 		}
+
+		outLayerScreenBounds[cameraTreeLayer] = layerScreenBounds;
 	}
+}
+
+Ssbo_CameraClipData PortalManager::CalcChildClipData(
+	const glm::mat4& projection,
+	const glm::mat4& parentViewMat,
+	const glm::vec4& parentScreenBounds,
+	const glm::mat4& childViewMat,
+	int portalIndex,
+	PortalEndpointIndex endpoint,
+	gsl::span<const TriangleMesh> portalMeshes) const
+{
+	const Portal& portal = m_portals[portalIndex];
+	const AABB& portalBounds = portalMeshes[portal.meshIndex].GetModelBoundingBox();
 
+	Ssbo_CameraClipData clipData;
+	clipData.screenBounds = CalcScreenBounds(projection * parentViewMat * portal.transform[endpoint], portalBounds, parentScreenBounds);
+
+	const PortalEndpointIndex otherEndpoint(static_cast<PortalEndpoint>(1 - endpoint.ToIndex()));
+	clipData.clipPlane = CalcClipPlane(childViewMat * portal.transform[otherEndpoint], portalBounds);
+	return clipData;
+}
+
+void PortalManager::CreateActiveCameraMask(int maxRecursionCount, gsl::span<const uint32_t> visibleCameraIndices, int marginLayerCount,
+	gsl::span<int> scratchHiddenLayerCounts, std::vector<bool>& outActiveCameras) const
+{
+	const uint32_t portalCount = gsl::narrow<uint32_t>(GetPortalCount());
+	const uint32_t cameraCount = NTree::CalcTotalElements(portalCount, maxRecursionCount + 1);
+	assert(scratchHiddenLayerCounts.size() >= cameraCount);
+
+	// layers between a camera and its closest visible ancestor, the main camera is always visible
+	constexpr int unreachedLayerCount = std::numeric_limits<int>::max();
+	const gsl::span<int> hiddenLayerCounts = scratchHiddenLayerCounts.first(cameraCount);
+	std::fill(std::begin(hiddenLayerCounts), std::end(hiddenLayerCounts), unreachedLayerCount);
+	hiddenLayerCounts[0] = 0;
+
+	for (uint32_t cameraIndex : visibleCameraIndices)
+	{
+		// unused entries are all 1s, the recursion count might also have been lowered since
+		if (cameraIndex < cameraCount)
+		{
+			hiddenLayerCounts[cameraIndex] = 0;
+		}
+	}
+
+	outActiveCameras.assign(cameraCount, false);
+	outActiveCameras[0] = true;
+
+	// parents are always in front of their children
+	for (uint32_t cameraIndex = 1; cameraIndex < cameraCount; ++cameraIndex)
+	{
+		const uint32_t parentIdx = NTree::GetParentIdxAndChildNum(portalCount, cameraIndex).parentIdx;
+		if (hiddenLayerCounts[cameraIndex] != 0 && hiddenLayerCounts[parentIdx] < marginLayerCount)
+		{
+			hiddenLayerCounts[cameraIndex] = hiddenLayerCounts[parentIdx] + 1;
+		}
+
+		outActiveCameras[cameraIndex] = outActiveCameras[parentIdx] && hiddenLayerCounts[cameraIndex] <= marginLayerCount;
+	}
 }
 
 int PortalManager::GetCurrentCameraBufferElementCount(int maxRecursionCount) const
@@ -143,6 +464,8 @@ int PortalManager::GetCurrentCameraBufferElementCount(int maxRecursionCount) con
 
 std::optional<PortalManager::RayTraceResult> PortalManager::RayTrace(const Ray& ray, const gsl::span<const TriangleMesh> portalMeshes) const
 {
+	PROFILE_SCOPE("PortalManager::RayTrace");
+
 	constexpr int invalidPortalId = -1;
 	int bestPortalId = invalidPortalId;
 	PortalEndpointIndex bestPortalEndpoint(PortalEndpoint::A);
@@ -200,4 +523,113 @@ std::optional<glm::mat4> PortalManager::FindHitPortalTeleportMatrix(const Ray& r
 	return std::nullopt;
 }
 
+void PortalManager::CreatePotentiallyVisibleSets(gsl::span<const TriangleMesh> portalMeshes, const Scene& scene)
+{
+	const int endpointCount = gsl::narrow<int>(GetPortalCount());
+
+	std::vector<std::array<glm::vec3, 8>> endpointCorners(endpointCount);
+	std::vector<std::vector<glm::vec3>> endpointSamplePoints(endpointCount);
+	m_endpointPlanes.assign(endpointCount, std::nullopt);
+
+	for (int portalIndex = 0; portalIndex < gsl::narrow<int>(m_portals.size()); ++portalIndex)
+	{
+		const Portal& portal = m_portals[portalIndex];
+		const AABB& bounds = portalMeshes[portal.meshIndex].GetModelBoundingBox();
+
+		for (auto endPoint = PortalEndpointIndex::First(); endPoint <= PortalEndpointIndex::Last(); ++endPoint)
+		{
+			const int endpointNum = CalcEndpointNum(portalIndex, endPoint);
+			for (int cornerIdx = 0; cornerIdx < 8; ++cornerIdx)
+			{
+				endpointCorners[endpointNum][cornerIdx] = glm::vec3(portal.transform[endPoint] * glm::vec4(GetCorner(bounds, cornerIdx), 1.f));
+			}
+
+			endpointSamplePoints[endpointNum] = CalcPortalSamplePoints(portal.transform[endPoint], bounds);
+			m_endpointPlanes[endpointNum] = CalcPortalPlane(portal.transform[endPoint], bounds);
+		}
+	}
+
+	m_potentiallyVisible.assign(endpointCount * cameraSideCount * endpointCount, true);
+
+	for (int sourcePortalIndex = 0; sourcePortalIndex < gsl::narrow<int>(m_portals.size()); ++sourcePortalIndex)
+	{
+		for (auto sourceEndpoint = PortalEndpointIndex::First(); sourceEndpoint <= PortalEndpointIndex::Last(); ++sourceEndpoint)
+		{
+			// the camera looks out of the other endpoint
+			const PortalEndpointIndex destinationEndpoint(static_cast<PortalEndpoint>(1 - sourceEndpoint.ToIndex()));
+			const int sourceNum = CalcEndpointNum(sourcePortalIndex, sourceEndpoint);
+			const int destinationNum = CalcEndpointNum(sourcePortalIndex, destinationEndpoint);
+
+			// portals with a volume don't have a side we could exclude
+			if (!m_endpointPlanes[destinationNum])
+			{
+				continue;
+			}
+
+			for (int cameraSide = 0; cameraSide < cameraSideCount; ++cameraSide)
+			{
+				// a camera on the positive side of the plane sees what is on its negative side
+				const glm::vec4 visibleSidePlane = cameraSide == 0 ? -*m_endpointPlanes[destinationNum] : *m_endpointPlanes[destinationNum];
+				const auto isOnVisibleSide = [&visibleSidePlane](const glm::vec3& point)
+				{
+					return glm::dot(visibleSidePlane, glm::vec4(point, 1.f)) > portalPlaneEpsilon;
+				};
+
+				for (int targetNum = 0; targetNum < endpointCount; ++targetNum)
+				{
+					bool isVisible = std::any_of(std::begin(endpointCorners[targetNum]), std::end(endpointCorners[targetNum]), isOnVisibleSide);
+
+					std::vector<glm::vec3> targetPoints;
+					std::copy_if(std::begin(endpointSamplePoints[targetNum]), std::end(endpointSamplePoints[targetNum]),
+						std::back_inserter(targetPoints), isOnVisibleSide);
+
+					// portals crossing the plane with all samples behind it are kept without testing rays
+					if (isVisible && !targetPoints.empty())
+					{
+						isVisible = false;
+						for (const glm::vec3& destinationPoint : endpointSamplePoints[destinationNum])
+						{
+							// start a bit in front of the portal and stop before the target, so the frames around the portals don't block the rays
+							const glm::vec3 rayStart = destinationPoint + glm::vec3(visibleSidePlane) * portalPlaneEpsilon;
+
+							isVisible = std::any_of(std::begin(targetPoints), std::end(targetPoints), [&](const glm::vec3& targetPoint)
+								{
+									const glm::vec3 rayEnd = glm::mix(rayStart, targetPoint, 0.99f);
+									return glm::distance(rayStart, rayEnd) <= portalPlaneEpsilon
+										|| !scene.RayTrace(Ray::FromStartAndEndpoint(rayStart, rayEnd), portalMeshes).has_value();
+								});
+
+							if (isVisible)
+							{
+								break;
+							}
+						}
+					}
+
+					m_potentiallyVisible[(sourceNum * cameraSideCount + cameraSide) * endpointCount + targetNum] = isVisible;
+				}
+			}
+		}
+	}
+}
+
+bool PortalManager::IsPotentiallyVisible(int sourcePortalIndex, PortalEndpointIndex sourceEndpoint, const glm::vec3& cameraPosition,
+	int targetPortalIndex, PortalEndpointIndex targetEndpoint) const
+{
+	if (m_potentiallyVisible.empty())
+	{
+		return true;
+	}
 
+	const PortalEndpointIndex destinationEndpoint(static_cast<PortalEndpoint>(1 - sourceEndpoint.ToIndex()));
+	const std::optional<glm::vec4>& destinationPlane = m_endpointPlanes[CalcEndpointNum(sourcePortalIndex, destinationEndpoint)];
+	if (!destinationPlane)
+	{
+		return true;
+	}
+
+	const int endpointCount = gsl::narrow<int>(GetPortalCount());
+	const int cameraSide = glm::dot(*destinationPlane, glm::vec4(cameraPosition, 1.f)) >= 0.f ? 0 : 1;
+	return m_potentiallyVisible[(CalcEndpointNum(sourcePortalIndex, sourceEndpoint) * cameraSideCount + cameraSide) * endpointCount
+		+ CalcEndpointNum(targetPortalIndex, targetEndpoint)];
+}
@@ -6,8 +6,10 @@
 #include "Portal.hpp"
 
 class MeshDataManager;
+class Scene;
 struct Ray;
 class TriangleMesh;
+struct Ssbo_CameraClipData;
 
 
 struct DrawPortalsInfo
@@ -26,6 +28,17 @@ struct DrawPortalsInfo
 
 	int layerStartIndex;
 	int nextLayerStartIndex;
+
+	// the portal pass appends the visible scene objects of each new camera to the draw commands of the next layer
+	int objectCount;
+	int nextDrawCommandSetIndex;
+	int nextLayerInstanceCount;
+
+	// pixel count a portal needs to get a camera, 0 disables the cutoff
+	int minPortalCoverage;
+
+	// the next layer has a draw command set per camera and uses the hardware stencil
+	bool isNextLayerHardwareStencil;
 };
 
 
@@ -35,13 +48,61 @@ class PortalManager
 public:
 	void Add(const Portal& portal);
 
-	void DrawPortals(const DrawPortalsInfo& info);
+	void DrawPortals(const DrawPortalsInfo& info) const;
 	gsl::span<const Portal> GetPortals() const { return m_portals; }
 
+	// activeCameras, see CreateActiveCameraMask, the transforms of the other cameras are not written
 	void CreateCameraMats(
 		glm::mat4 cameraMat,
 		int maxRecursionCount,
-		gsl::span<glm::mat4> outCameraTransforms) const;
+		gsl::span<glm::mat4> outCameraTransforms,
+		const std::vector<bool>& activeCameras = {}) const;
+
+	// marks the cameras of the NTree which are worth creating, empty if all of them are
+	// visibleCameraIndices are NTree indices of cameras which were rendered recently, invalid indices are ignored
+	// a camera is active if it or one of its marginLayerCount closest ancestors is visible, so new cameras can appear
+	// while the visibility is a few frames old. Active cameras always have active parents
+	// scratchHiddenLayerCounts needs an element per camera of the NTree, its values are overwritten
+	void CreateActiveCameraMask(
+		int maxRecursionCount,
+		gsl::span<const uint32_t> visibleCameraIndices,
+		int marginLayerCount,
+		gsl::span<int> scratchHiddenLayerCounts,
+		std::vector<bool>& outActiveCameras) const;
+
+	// clip data for each camera of CreateCameraMats, viewMats are the inverse of the camera mats
+	// outLayerScreenBounds receives the union of the screen bounds of all cameras of each NTree layer
+	// cameras which are not in activeCameras get empty screen bounds
+	void CreateCameraClipData(
+		const glm::mat4& projection,
+		gsl::span<const glm::mat4> viewMats,
+		int maxRecursionCount,
+		gsl::span<const TriangleMesh> portalMeshes,
+		gsl::span<Ssbo_CameraClipData> outCameraClipData,
+		gsl::span<glm::vec4> outLayerScreenBounds,
+		const std::vector<bool>& activeCameras = {}) const;
+
+	// clip data of the camera looking through the endpoint of a portal, the same as a child in CreateCameraClipData
+	// the screen bounds are empty if the endpoint is not visible from the parent
+	Ssbo_CameraClipData CalcChildClipData(
+		const glm::mat4& projection,
+		const glm::mat4& parentViewMat,
+		const glm::vec4& parentScreenBounds,
+		const glm::mat4& childViewMat,
+		int portalIndex,
+		PortalEndpointIndex endpoint,
+		gsl::span<const TriangleMesh> portalMeshes) const;
+
+	// load time visibility between the portal endpoints, until it is called every endpoint is potentially visible
+	// a camera looking through an endpoint sees the scene behind the other endpoint of the portal, so for flat portals
+	// only the endpoints on that side of its plane are kept. Of those, the endpoints where all rays between sample points
+	// of both portals hit the scene are removed as well. This includes the way back through the same portal
+	// portalMeshes are also used for the scene objects
+	void CreatePotentiallyVisibleSets(gsl::span<const TriangleMesh> portalMeshes, const Scene& scene);
+
+	// cameraPosition belongs to the camera which looked through the source endpoint, it decides which side of the portal is seen
+	bool IsPotentiallyVisible(int sourcePortalIndex, PortalEndpointIndex sourceEndpoint, const glm::vec3& cameraPosition,
+		int targetPortalIndex, PortalEndpointIndex targetEndpoint) const;
 
 	int GetCurrentCameraBufferElementCount(int maxRecursionCount) const;
 	gsl::index GetPortalCount() const { return m_portals.size() * 2; }
@@ -58,7 +119,18 @@ public:
 	std::optional<RayTraceResult> RayTrace(const Ray& ray, const gsl::span<const TriangleMesh> portalMeshes) const;
 	std::optional<glm::mat4> FindHitPortalTeleportMatrix(const Ray& ray, const gsl::span<const TriangleMesh> portalMeshes) const;
 private:
+	// a camera can look through a portal from both sides
+	static constexpr int cameraSideCount = 2;
+
+	static int CalcEndpointNum(int portalIndex, PortalEndpointIndex endpoint) { return portalIndex * 2 + gsl::narrow<int>(endpoint.ToIndex()); }
+
 	std::vector<Portal> m_portals;
+
+	// world space plane of each endpoint (see CalcEndpointNum), only flat portals have one
+	std::vector<std::optional<glm::vec4>> m_endpointPlanes;
+
+	// (source endpoint * cameraSideCount + side of the camera) * endpoint count + target endpoint
+	std::vector<bool> m_potentiallyVisible;
 };
 
 
@@ -0,0 +1,51 @@
+#include "pch.hpp"
+#include "PortalViewUtils.hpp"
+
+bool PortalViewUtils::IsEmpty(const glm::vec4& screenBounds)
+{
+	return screenBounds.x >= screenBounds.z || screenBounds.y >= screenBounds.w;
+}
+
+float PortalViewUtils::CalcCoveredPixels(const glm::vec4& screenBounds, vk::Extent2D extent)
+{
+	return (screenBounds.z - screenBounds.x) * 0.5f * static_cast<float>(extent.width)
+		* (screenBounds.w - screenBounds.y) * 0.5f * static_cast<float>(extent.height);
+}
+
+std::array<glm::vec4, 6> PortalViewUtils::CalcCullPlanes(const glm::mat4& viewProj, const glm::vec4& screenBounds, const glm::vec4& clipPlane)
+{
+	const glm::mat4 rows = glm::transpose(viewProj);
+
+	return {
+		rows[0] - screenBounds.x * rows[3],
+		screenBounds.z * rows[3] - rows[0],
+		rows[1] - screenBounds.y * rows[3],
+		screenBounds.w * rows[3] - rows[1],
+
+		// near plane, inverse depth with an infinite far plane has no far plane
+		rows[3] - rows[2],
+		clipPlane,
+	};
+}
+
+glm::vec4 PortalViewUtils::CalcCrop(const glm::vec4& screenBounds)
+{
+	const glm::vec2 minBounds(screenBounds.x, screenBounds.y);
+	const glm::vec2 maxBounds(screenBounds.z, screenBounds.w);
+
+	const glm::vec2 scale = 2.f / (maxBounds - minBounds);
+	const glm::vec2 center = (minBounds + maxBounds) * 0.5f;
+
+	return glm::vec4(scale, -center * scale);
+}
+
+PushConstant_recursive PortalViewUtils::CreateMeshPushConstant(const glm::mat4& viewProj, const glm::vec4& clipPlane, const glm::mat4& model,
+	PushConstant_recursive::DrawMode drawMode)
+{
+	PushConstant_recursive pushConstant = {};
+	pushConstant.viewProj = viewProj * model;
+	pushConstant.clipPlane = glm::transpose(model) * clipPlane;
+	pushConstant.crop = noCrop;
+	pushConstant.drawMode = drawMode;
+	return pushConstant;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include "glm.hpp"
+#include "PushConstants.hpp"
+
+// shared by the renderers which find the portal views on the cpu, see RecursiveStencilRenderer and TextureAtlasRenderer
+namespace PortalViewUtils
+{
+	const glm::vec4 fullScreenBounds(-1.f, -1.f, 1.f, 1.f);
+
+	// distance is always positive, nothing gets clipped
+	const glm::vec4 noClipPlane(0.f, 0.f, 0.f, 1.f);
+
+	// see PushConstant_recursive::crop
+	const glm::vec4 noCrop(1.f, 1.f, 0.f, 0.f);
+
+	bool IsEmpty(const glm::vec4& screenBounds);
+
+	float CalcCoveredPixels(const glm::vec4& screenBounds, vk::Extent2D extent);
+
+	// world space planes of the frustum narrowed to the screen bounds, the same as cull.comp
+	std::array<glm::vec4, 6> CalcCullPlanes(const glm::mat4& viewProj, const glm::vec4& screenBounds, const glm::vec4& clipPlane);
+
+	// scales the screen bounds to the whole viewport
+	glm::vec4 CalcCrop(const glm::vec4& screenBounds);
+
+	// the model matrix is moved into viewProj and the world space clip plane into model space
+	PushConstant_recursive CreateMeshPushConstant(const glm::mat4& viewProj, const glm::vec4& clipPlane, const glm::mat4& model,
+		PushConstant_recursive::DrawMode drawMode);
+}
@@ -0,0 +1,150 @@
+#include "pch.hpp"
+#include "Profiler.hpp"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <mutex>
+
+namespace
+{
+	struct Zone
+	{
+		const char* name;
+		int64_t startNanoseconds;
+		int64_t durationNanoseconds;
+	};
+
+	// only written by its thread, kept alive by the registry when the thread ends
+	struct ThreadZones
+	{
+		int threadIndex = 0;
+		std::vector<Zone> zones = std::vector<Zone>(Profiler::zoneCapacity);
+		std::atomic<uint64_t> recordedCount{ 0 };
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<std::shared_ptr<ThreadZones>> threads;
+		std::vector<std::string> threadNames;
+	};
+
+	Registry& GetRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	ThreadZones& GetThreadZones()
+	{
+		thread_local const std::shared_ptr<ThreadZones> threadZones = []()
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+
+			auto zones = std::make_shared<ThreadZones>();
+			zones->threadIndex = static_cast<int>(registry.threads.size());
+			registry.threads.push_back(zones);
+			registry.threadNames.push_back("thread " + std::to_string(zones->threadIndex));
+			return zones;
+		}();
+		return *threadZones;
+	}
+
+	// the names are our own literals, only quotes and backslashes would break the json
+	std::string EscapeJson(const char* text)
+	{
+		std::string result;
+		for (; *text; ++text)
+		{
+			if (*text == '"' || *text == '\\')
+			{
+				result.push_back('\\');
+			}
+			result.push_back(*text);
+		}
+		return result;
+	}
+}
+
+void Profiler::RecordZone(const char* name, ClockType::time_point start, ClockType::time_point end)
+{
+	ThreadZones& threadZones = GetThreadZones();
+	const uint64_t recordedCount = threadZones.recordedCount.load(std::memory_order_relaxed);
+	threadZones.zones[recordedCount % zoneCapacity] = Zone{
+		name,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count(),
+		std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() };
+
+	threadZones.recordedCount.store(recordedCount + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(const std::string& name)
+{
+	const int threadIndex = GetThreadZones().threadIndex;
+
+	Registry& registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	registry.threadNames[threadIndex] = name;
+}
+
+bool Profiler::WriteChromeTrace(const std::string& filePath)
+{
+	std::ofstream file(filePath, std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	Registry& registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	// complete events ("X") with microsecond timestamps, preceded by the thread names
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool isFirstEvent = true;
+	const auto beginEvent = [&file, &isFirstEvent]()
+	{
+		file << (isFirstEvent ? "" : ",\n");
+		isFirstEvent = false;
+	};
+
+	for (const std::shared_ptr<ThreadZones>& threadZones : registry.threads)
+	{
+		beginEvent();
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << threadZones->threadIndex
+			<< ",\"args\":{\"name\":\"" << EscapeJson(registry.threadNames[threadZones->threadIndex].c_str()) << "\"}}";
+	}
+
+	// the kept zones are copied first, the trace starts with the oldest of them
+	std::vector<std::vector<Zone>> keptZones;
+	int64_t traceStartNanoseconds = std::numeric_limits<int64_t>::max();
+	for (const std::shared_ptr<ThreadZones>& threadZones : registry.threads)
+	{
+		const uint64_t recordedCount = threadZones->recordedCount.load(std::memory_order_acquire);
+		const uint64_t firstKept = recordedCount > zoneCapacity ? recordedCount - zoneCapacity : 0;
+
+		std::vector<Zone>& zones = keptZones.emplace_back();
+		for (uint64_t i = firstKept; i < recordedCount; ++i)
+		{
+			zones.push_back(threadZones->zones[i % zoneCapacity]);
+			traceStartNanoseconds = std::min(traceStartNanoseconds, zones.back().startNanoseconds);
+		}
+	}
+
+	char number[64];
+	for (size_t threadIndex = 0; threadIndex < keptZones.size(); ++threadIndex)
+	{
+		for (const Zone& zone : keptZones[threadIndex])
+		{
+			beginEvent();
+			std::snprintf(number, sizeof(number), "%.3f,\"dur\":%.3f",
+				(zone.startNanoseconds - traceStartNanoseconds) / 1000.0, zone.durationNanoseconds / 1000.0);
+			file << "{\"name\":\"" << EscapeJson(zone.name) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << threadIndex
+				<< ",\"ts\":" << number << "}";
+		}
+	}
+
+	file << "\n]}\n";
+	return file.good();
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <chrono>
+#include <string>
+
+// define PROFILER_ENABLED as 0 to compile the zones out, the trace is empty then
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// scoped cpu zones, each thread records into its own ring buffer, so recording takes no lock
+// the zones of all threads are written as chrome trace events, open the file in chrome://tracing or ui.perfetto.dev
+namespace Profiler
+{
+	using ClockType = std::chrono::steady_clock;
+
+	// the newest zones of each thread which are kept, older ones are overwritten
+	constexpr size_t zoneCapacity = 16384;
+
+	// name has to stay valid until the trace is written, string literals only
+	void RecordZone(const char* name, ClockType::time_point start, ClockType::time_point end);
+
+	// shown instead of the thread index in the trace, the name is copied
+	void SetThreadName(const std::string& name);
+
+	// threads which record while the trace is written may lose the zones they overwrite, so it is best written between frames
+	// returns false if the file could not be written
+	bool WriteChromeTrace(const std::string& filePath);
+
+	class ScopedZone
+	{
+	public:
+		explicit ScopedZone(const char* name) : m_name(name), m_start(ClockType::now()) {}
+		~ScopedZone() { RecordZone(m_name, m_start, ClockType::now()); }
+
+		ScopedZone(const ScopedZone&) = delete;
+		ScopedZone& operator=(const ScopedZone&) = delete;
+
+	private:
+		const char* m_name;
+		ClockType::time_point m_start;
+	};
+}
+
+#define PROFILER_CONCAT_IMPL(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_IMPL(a, b)
+
+#if PROFILER_ENABLED
+#define PROFILE_SCOPE(name) const Profiler::ScopedZone PROFILER_CONCAT(profilerZone_, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
@@ -10,6 +10,18 @@ struct PushConstant_portal
 	int32_t portalIndex;
 	int32_t maxVisiblePortalCount;
 	int32_t currentPortalCount;
+
+	// used to append the visible scene objects of a new camera to the draw commands of the next layer
+	int32_t objectCount;
+	int32_t nextDrawCommandSetIndex;
+	int32_t nextLayerInstanceCount;
+
+	// portals covering less pixels in the previous frame don't spawn a camera, 0 disables the cutoff
+	int32_t minPortalCoverage;
+
+	// the next layer uses a draw command set per camera and tests the hardware stencil
+	// the portal writes the local camera index + 1 to the stencil if the shader can export it
+	int32_t isNextLayerHardwareStencil;
 };
 
 constexpr size_t PushConstant_Size = sizeof(PushConstant_portal);
@@ -30,8 +42,82 @@ static_assert(PushConstant_lines_size <= 128, "Push Constant must be small or eq
 
 struct PushConstant_sceneObject
 {
+	// model and debugColor are only used when objectInstanceStride is 0, otherwise they are read from the object buffer
 	alignas(16) glm::mat4 model;
 	glm::vec4 debugColor;
 	int32_t layerStartIndex;
+
+	// instance count of each object in the current layer, the object index is gl_InstanceIndex / objectInstanceStride
+	// negative draws the camera mesh, its model is Ubo_GlobalRenderData::mainCameraMat, so recorded commands don't depend on the camera
+	int32_t objectInstanceStride;
+
+	// first element of the instance list of the layer, the camera of an instance is read from instanceListOffset + gl_InstanceIndex
+	int32_t instanceListOffset;
+};
+constexpr size_t PushConstant_sceneObject_size = sizeof(PushConstant_sceneObject);
+static_assert(PushConstant_sceneObject_size <= 128, "Push Constant must be small or equal to 128 Byte");
+
+
+struct PushConstant_cull
+{
+	// scene layer, 0 is the main camera
+	int32_t layerIndex;
+
+	// number of stencil values / camera indices of the layer, used as instance stride of the objects
+	int32_t layerInstanceCount;
+
+	// NTree index of the first camera of the layer and the number of cameras in the layer
+	int32_t firstCameraIndex;
+	int32_t cameraCount;
+
+	// N of the camera NTree
+	int32_t portalCount;
+
+	int32_t objectCount;
+
+	// first draw command set of the layer, hardware stencil layers use the following sets, one per camera
+	int32_t drawCommandSetIndex;
+	int32_t isDrawCommandSetPerCamera;
+
+	// the culling selects the lod of the draw commands, see MeshLodSelection
+	int32_t isLodEnabled;
+
+	// the second dispatch of a layer, after all layers are culled, resets its draw commands with the lods the culling chose
+	int32_t isResetPass;
 };
+constexpr size_t PushConstant_cull_size = sizeof(PushConstant_cull);
+static_assert(PushConstant_cull_size <= 128, "Push Constant must be small or equal to 128 Byte");
+
+// used by all draws of the renderers which find the portal views on the cpu, see RecursiveStencilRenderer and TextureAtlasRenderer
+struct PushConstant_recursive
+{
+	enum DrawMode : int32_t
+	{
+		// model, normal matrix and debug color are read from the object at gl_InstanceIndex
+		sceneObject = 0,
+
+		// viewProj already contains the model matrix, drawn with the texture
+		premultipliedMesh,
+
+		// same as premultipliedMesh, shaded like the portals of the last breadth first pass
+		flatPortal,
 
+		// same as premultipliedMesh, samples the view behind the portal from the texture atlas
+		atlasPortal,
+	};
+
+	alignas(16) glm::mat4 viewProj;
+
+	// plane of the destination portal in the same space as the vertices, everything with negative distance is clipped
+	glm::vec4 clipPlane;
+
+	// xy scale and zw offset of the clip space position, so only the screen bounds of the view are rendered into its atlas slot
+	glm::vec4 crop;
+
+	// xy scale and zw offset from the uncropped screen position to the atlas slot of the view behind the portal
+	glm::vec4 atlasTransform;
+
+	int32_t drawMode;
+};
+constexpr size_t PushConstant_recursive_size = sizeof(PushConstant_recursive);
+static_assert(PushConstant_recursive_size <= 128, "Push Constant must be small or equal to 128 Byte");
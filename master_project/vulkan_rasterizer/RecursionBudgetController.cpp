@@ -0,0 +1,116 @@
+#include "pch.hpp"
+#include "RecursionBudgetController.hpp"
+
+namespace
+{
+	std::vector<std::vector<int>> CreateBudgetLadder(gsl::span<const int> maxVisiblePortalsForRecursion)
+	{
+		std::vector<std::vector<int>> ladder;
+		std::vector<int> budget(std::begin(maxVisiblePortalsForRecursion), std::end(maxVisiblePortalsForRecursion));
+
+		// a layer with zero visible portals ends the recursion, so it is the same as dropping the layer
+		const auto firstZero = std::find(budget.begin(), budget.end(), 0);
+		budget.erase(firstZero, budget.end());
+
+		ladder.push_back(budget);
+		while (!budget.empty())
+		{
+			int& deepestLayer = budget.back();
+			if (deepestLayer > 1)
+			{
+				deepestLayer /= 2;
+			}
+			else
+			{
+				budget.pop_back();
+			}
+			ladder.push_back(budget);
+		}
+
+		return ladder;
+	}
+}
+
+RecursionBudgetController::RecursionBudgetController(gsl::span<const int> maxVisiblePortalsForRecursion, const Settings& settings)
+	: m_settings(settings)
+	, m_budgetLadder(CreateBudgetLadder(maxVisiblePortalsForRecursion))
+	, m_currentBudgetIndex(0)
+	, m_smoothedFrameSeconds(0.0)
+	, m_cooldownFrames(0)
+	, m_framesSinceChange(0)
+	, m_spikeFrames(0)
+{
+	assert(!m_budgetLadder.empty());
+}
+
+double RecursionBudgetController::CalcFrameSeconds(const FrameTimings& frameTimings)
+{
+	if (frameTimings.gpuSeconds)
+	{
+		return std::max(frameTimings.cpuSeconds, *frameTimings.gpuSeconds);
+	}
+
+	// without timestamps the fence wait is the part of the gpu time the cpu could not hide
+	return frameTimings.isPresentModeFifo ? frameTimings.cpuSeconds : frameTimings.cpuSeconds + frameTimings.gpuWaitSeconds;
+}
+
+bool RecursionBudgetController::Update(gsl::span<const double> frameSecondsBuckets, int newestBucketIndex)
+{
+	const int bucketCount = gsl::narrow<int>(frameSecondsBuckets.size());
+	const double frameSeconds = frameSecondsBuckets[newestBucketIndex];
+
+	m_framesSinceChange = std::min(m_framesSinceChange + 1, bucketCount);
+	const int smoothingFrameCount = std::min(m_framesSinceChange, m_settings.smoothingFrameCount);
+
+	double frameSecondsSum = 0.0;
+	for (int i = 0; i < smoothingFrameCount; ++i)
+	{
+		frameSecondsSum += frameSecondsBuckets[(newestBucketIndex - i + bucketCount) % bucketCount];
+	}
+	m_smoothedFrameSeconds = frameSecondsSum / smoothingFrameCount;
+
+	const bool isSpike = frameSeconds > m_settings.targetFrameSeconds * m_settings.spikeThreshold;
+	m_spikeFrames = isSpike ? m_spikeFrames + 1 : 0;
+
+	if (m_cooldownFrames > 0)
+	{
+		--m_cooldownFrames;
+		return false;
+	}
+
+	const gsl::index lowestBudgetIndex = gsl::narrow<gsl::index>(m_budgetLadder.size()) - 1;
+
+	// a lasting spike steps down without waiting for the average to catch up
+	const bool isOverBudget = m_smoothedFrameSeconds > m_settings.targetFrameSeconds * m_settings.decreaseThreshold
+		|| m_spikeFrames >= m_settings.spikeFrameCount;
+
+	if (isOverBudget && m_currentBudgetIndex < lowestBudgetIndex)
+	{
+		++m_currentBudgetIndex;
+		m_cooldownFrames = m_settings.decreaseCooldownFrames;
+		m_framesSinceChange = 0;
+		m_spikeFrames = 0;
+		return true;
+	}
+
+	const bool isUnderBudget = m_smoothedFrameSeconds < m_settings.targetFrameSeconds * m_settings.increaseThreshold;
+	if (isUnderBudget && m_currentBudgetIndex > 0)
+	{
+		--m_currentBudgetIndex;
+		m_cooldownFrames = m_settings.increaseCooldownFrames;
+		m_framesSinceChange = 0;
+		m_spikeFrames = 0;
+		return true;
+	}
+
+	return false;
+}
+
+void RecursionBudgetController::Reset()
+{
+	m_currentBudgetIndex = 0;
+	m_smoothedFrameSeconds = 0.0;
+	m_cooldownFrames = 0;
+	m_framesSinceChange = 0;
+	m_spikeFrames = 0;
+}
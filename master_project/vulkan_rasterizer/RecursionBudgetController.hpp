@@ -0,0 +1,85 @@
+#pragma once
+#include <gsl/gsl>
+#include <optional>
+#include <vector>
+
+// adjusts the visible portal counts of each recursion layer to hold a target frame time
+// the budgets are precomputed as a ladder, from the maximum budget down to no recursion at all
+// each step down halves the visible portal count of the deepest layer and drops the layer once it reaches zero
+// so we lose the distant layers first
+class RecursionBudgetController
+{
+public:
+	struct Settings
+	{
+		// usually one refresh interval of the display
+		double targetFrameSeconds = 1.0 / 60.0;
+
+		// we step down above targetFrameSeconds * decreaseThreshold and up below targetFrameSeconds * increaseThreshold
+		// the gap between both is the hysteresis, reducing is preferred to missing vsync, so decreasing triggers below target
+		double decreaseThreshold = 0.9;
+		double increaseThreshold = 0.6;
+
+		// frames to wait after a change, the new budget has to show up in the measurements first
+		// increasing waits longer, so we don't oscillate between two budgets
+		int decreaseCooldownFrames = 8;
+		int increaseCooldownFrames = 60;
+
+		// frames above targetFrameSeconds * spikeThreshold step down before the average catches up
+		// but only after spikeFrameCount of them in a row, a single hitch is not worth losing recursion
+		double spikeThreshold = 2.0;
+		int spikeFrameCount = 3;
+
+		// the smoothed frame time is the mean of up to this many of the newest frame time buckets
+		// only frames measured with the current budget count
+		int smoothingFrameCount = 16;
+	};
+
+	struct FrameTimings
+	{
+		// time spent recording and submitting on the cpu, without waiting for the fence, the swapchain image and the presentation
+		double cpuSeconds;
+
+		// gpu time of the frame from the timestamp queries, which lags a few frames behind
+		std::optional<double> gpuSeconds;
+
+		// time the cpu waited for the gpu to finish the frame in flight, only used without gpuSeconds
+		double gpuWaitSeconds;
+
+		// the fence wait includes the vsync wait with fifo presentation, so it is ignored then
+		bool isPresentModeFifo;
+	};
+
+	RecursionBudgetController(gsl::span<const int> maxVisiblePortalsForRecursion, const Settings& settings);
+
+	// the cpu and the gpu work in parallel, so the slower one limits the frame rate
+	static double CalcFrameSeconds(const FrameTimings& frameTimings);
+
+	// frameSecondsBuckets is a ring of CalcFrameSeconds results, the newest frame is at newestBucketIndex
+	// returns true if the budget changed
+	bool Update(gsl::span<const double> frameSecondsBuckets, int newestBucketIndex);
+
+	// restarts with the maximum budget
+	void Reset();
+
+	// the returned span is valid as long as the controller lives
+	gsl::span<const int> GetVisiblePortalsForRecursion() const { return m_budgetLadder[m_currentBudgetIndex]; }
+	double GetSmoothedFrameSeconds() const { return m_smoothedFrameSeconds; }
+	double GetTargetFrameSeconds() const { return m_settings.targetFrameSeconds; }
+
+private:
+	Settings m_settings;
+
+	// index 0 is the maximum budget, the last element is no recursion
+	std::vector<std::vector<int>> m_budgetLadder;
+	gsl::index m_currentBudgetIndex;
+
+	double m_smoothedFrameSeconds;
+	int m_cooldownFrames;
+
+	// the buckets older than this were measured with a previous budget
+	int m_framesSinceChange;
+
+	// newest frames in a row above the spike threshold
+	int m_spikeFrames;
+};
@@ -0,0 +1,308 @@
+#include "pch.hpp"
+#include "RecursiveStencilRenderer.hpp"
+#include "common/VulkanUtils.hpp"
+#include "GetSizeUint32.hpp"
+#include "Renderpass.hpp"
+#include "PushConstants.hpp"
+#include "UniformBufferObjects.hpp"
+#include "MeshDataManager.hpp"
+#include "Scene.hpp"
+#include "PortalManager.hpp"
+#include "TriangleMesh.hpp"
+#include "PortalViewUtils.hpp"
+
+RecursiveStencilRenderer::RecursiveStencilRenderer(const CreateInfo& createInfo)
+	: m_extent(createInfo.swapchainExtent)
+{
+	assert(VulkanUtils::HasStencilComponent(createInfo.depthStencilFormat));
+	const vk::Device device = createInfo.logicalDevice;
+
+	m_renderPass = Renderpass::SingleSubpass(device, createInfo.colorFormat, createInfo.colorFinalLayout, createInfo.depthStencilFormat);
+
+	// create Framebuffer
+	{
+		vk::FramebufferCreateInfo framebufferPrototype = vk::FramebufferCreateInfo{}
+			.setWidth(m_extent.width)
+			.setHeight(m_extent.height)
+			.setRenderPass(m_renderPass.get())
+			.setLayers(1);
+
+		for (const vk::UniqueImageView& imageView : createInfo.swapchainImageViews)
+		{
+			vk::ImageView fbAttachments[] = {
+				imageView.get(),
+				createInfo.depthStencilView,
+			};
+			m_framebuffers.push_back(device.createFramebufferUnique(
+				vk::FramebufferCreateInfo{ framebufferPrototype }
+				.setAttachmentCount(GetSizeUint32(fbAttachments))
+				.setPAttachments(fbAttachments))
+			);
+		}
+	}
+
+	m_vertShaderModule = VulkanUtils::CreateShaderModuleFromFile("recursive.vert.spv", device);
+	m_fragShaderModule = VulkanUtils::CreateShaderModuleFromFile("recursive.frag.spv", device);
+
+	// texture and scene objects, both never change
+	{
+		vk::DescriptorSetLayoutBinding descriptorSetBindings[] = {
+			vk::DescriptorSetLayoutBinding{}
+				.setBinding(0)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+				.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+			vk::DescriptorSetLayoutBinding{}
+				.setBinding(1)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+				.setStageFlags(vk::ShaderStageFlagBits::eVertex),
+		};
+
+		m_descriptorSetLayout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{}
+			.setBindingCount(GetSizeUint32(descriptorSetBindings))
+			.setPBindings(descriptorSetBindings));
+
+		vk::DescriptorPoolSize descriptorPoolSizes[] =
+		{
+			vk::DescriptorPoolSize{}
+				.setType(vk::DescriptorType::eCombinedImageSampler)
+				.setDescriptorCount(1),
+
+			vk::DescriptorPoolSize{}
+				.setType(vk::DescriptorType::eStorageBuffer)
+				.setDescriptorCount(1),
+		};
+
+		m_descriptorPool = device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{}
+			.setPoolSizeCount(GetSizeUint32(descriptorPoolSizes)).setPPoolSizes(descriptorPoolSizes)
+			.setMaxSets(1));
+
+		m_descriptorSet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{}
+			.setDescriptorPool(m_descriptorPool.get())
+			.setDescriptorSetCount(1)
+			.setPSetLayouts(&(m_descriptorSetLayout.get())))[0];
+
+		const vk::DescriptorImageInfo imageInfo = vk::DescriptorImageInfo{}
+			.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(createInfo.textureView)
+			.setSampler(createInfo.textureSampler);
+
+		const vk::WriteDescriptorSet writeDescriptorSets[] = {
+			vk::WriteDescriptorSet{}
+				.setDstSet(m_descriptorSet)
+				.setDstBinding(0)
+				.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+				.setDstArrayElement(0)
+				.setDescriptorCount(1).setPImageInfo(&imageInfo),
+
+			vk::WriteDescriptorSet{}
+				.setDstSet(m_descriptorSet)
+				.setDstBinding(1)
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+				.setDstArrayElement(0)
+				.setDescriptorCount(1).setPBufferInfo(&createInfo.sceneObjects),
+		};
+
+		device.updateDescriptorSets(writeDescriptorSets, {});
+	}
+
+	// create Pipeline Layout
+	{
+		const vk::PushConstantRange pushConstantRange = vk::PushConstantRange{}
+			.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)
+			.setOffset(0)
+			.setSize(sizeof(PushConstant_recursive));
+
+		m_pipelineLayout = device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{}
+			.setSetLayoutCount(1).setPSetLayouts(&(m_descriptorSetLayout.get()))
+			.setPushConstantRangeCount(1).setPPushConstantRanges(&pushConstantRange));
+	}
+
+	// create Graphic pipelines
+	{
+		const vk::PipelineShaderStageCreateInfo shaderStages[] =
+		{
+			vk::PipelineShaderStageCreateInfo{}
+				.setStage(vk::ShaderStageFlagBits::eVertex)
+				.setModule(m_vertShaderModule.get())
+				.setPName("main"),
+
+			vk::PipelineShaderStageCreateInfo{}
+				.setStage(vk::ShaderStageFlagBits::eFragment)
+				.setModule(m_fragShaderModule.get())
+				.setPName("main"),
+		};
+
+		GraphicsPipeline::RecursiveStencilPipelinesCreateInfo pipelinesCreateInfo;
+		pipelinesCreateInfo.logicalDevice = device;
+		pipelinesCreateInfo.pipelineCache = createInfo.pipelineCache;
+		pipelinesCreateInfo.swapchainExtent = m_extent;
+		pipelinesCreateInfo.renderpass = m_renderPass.get();
+		pipelinesCreateInfo.pipelineLayout = m_pipelineLayout.get();
+		pipelinesCreateInfo.pipelineShaderStageCreationInfos = shaderStages;
+
+		m_pipelines = GraphicsPipeline::CreateRecursiveStencilPipelines(pipelinesCreateInfo);
+	}
+}
+
+void RecursiveStencilRenderer::Draw(const DrawInfo& drawInfo) const
+{
+	assert(drawInfo.meshDataManager && drawInfo.scene && drawInfo.portalManager);
+
+	constexpr float inverseDepthBufferClearValue = 0.f;
+
+	const vk::ClearValue clearValues[] = {
+		drawInfo.clearColor,
+		vk::ClearDepthStencilValue(inverseDepthBufferClearValue, 0),
+	};
+
+	vk::CommandBuffer drawBuffer = drawInfo.drawBuffer;
+
+	drawBuffer.beginRenderPass(
+		vk::RenderPassBeginInfo{}
+		.setRenderPass(m_renderPass.get())
+		.setFramebuffer(m_framebuffers[drawInfo.imageIndex].get())
+		.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), m_extent))
+		.setClearValueCount(GetSizeUint32(clearValues)).setPClearValues(clearValues),
+		vk::SubpassContents::eInline);
+
+	drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout.get(), 0, m_descriptorSet, {});
+
+	// the portals and the camera use the same buffers as the scene
+	drawBuffer.bindIndexBuffer(drawInfo.meshDataManager->GetIndexBuffer(), 0, MeshDataManager::IndexBufferIndexType);
+	vk::DeviceSize vertexBufferOffset = 0;
+	drawBuffer.bindVertexBuffers(0, drawInfo.meshDataManager->GetVertexBuffer(), vertexBufferOffset);
+
+	View rootView;
+	rootView.cameraMat = drawInfo.cameraMat;
+	rootView.viewMat = glm::inverse(drawInfo.cameraMat);
+	rootView.screenBounds = PortalViewUtils::fullScreenBounds;
+	rootView.clipPlane = PortalViewUtils::noClipPlane;
+	rootView.depth = 0;
+	rootView.entryPortalIndex = -1;
+	rootView.entryEndpoint = PortalEndpoint::A;
+
+	const int maxDepth = std::min(gsl::narrow<int>(drawInfo.maxVisiblePortalsForRecursion.size()), maxRecursionDepth);
+	DrawView(drawInfo, rootView, maxDepth);
+
+	drawBuffer.endRenderPass();
+}
+
+void RecursiveStencilRenderer::DrawView(const DrawInfo& drawInfo, const View& view, int maxDepth) const
+{
+	vk::CommandBuffer drawBuffer = drawInfo.drawBuffer;
+	MeshDataManager& meshDataManager = *drawInfo.meshDataManager;
+
+	const vk::ShaderStageFlags pushConstantStages = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment;
+	const vk::StencilFaceFlags stencilFaces = vk::StencilFaceFlagBits::eFront | vk::StencilFaceFlagBits::eBack;
+
+	const glm::mat4 viewProj = drawInfo.projection * view.viewMat;
+	const uint32_t stencilReference = gsl::narrow<uint32_t>(view.depth);
+
+	// draw Scene
+	{
+		drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.scene.get());
+		drawBuffer.setStencilReference(stencilFaces, stencilReference);
+
+		PushConstant_recursive pushConstant = {};
+		pushConstant.viewProj = viewProj;
+		pushConstant.clipPlane = view.clipPlane;
+		pushConstant.crop = PortalViewUtils::noCrop;
+		pushConstant.drawMode = PushConstant_recursive::sceneObject;
+		drawBuffer.pushConstants<PushConstant_recursive>(m_pipelineLayout.get(), pushConstantStages, 0, pushConstant);
+
+		const std::array<glm::vec4, 6> cullPlanes = PortalViewUtils::CalcCullPlanes(viewProj, view.screenBounds, view.clipPlane);
+		const std::optional<Scene::LodSelectInfo> lodSelectInfo = drawInfo.useMeshLods
+			? std::make_optional(Scene::LodSelectInfo{ glm::vec3(view.cameraMat[3]), drawInfo.projection[1][1], view.depth })
+			: std::nullopt;
+		drawInfo.scene->DrawEachObject(meshDataManager, drawBuffer, cullPlanes, lodSelectInfo);
+
+		// the camera can only be seen through portals
+		if (view.depth > 0)
+		{
+			const MeshDataRef& cameraMeshRef = meshDataManager.GetMeshes()[meshDataManager.GetMeshes().size() - 1];
+
+			drawBuffer.pushConstants<PushConstant_recursive>(m_pipelineLayout.get(), pushConstantStages, 0,
+				PortalViewUtils::CreateMeshPushConstant(viewProj, view.clipPlane, drawInfo.cameraMat, PushConstant_recursive::premultipliedMesh));
+			drawBuffer.drawIndexed(cameraMeshRef.indexCount, 1, cameraMeshRef.firstIndex, 0, 0);
+		}
+	}
+
+	// draw Portals
+	const PortalManager& portalManager = *drawInfo.portalManager;
+	gsl::span<const Portal> portals = portalManager.GetPortals();
+
+	const int maxVisiblePortalCount = view.depth < maxDepth ? drawInfo.maxVisiblePortalsForRecursion[view.depth] : 0;
+	int visiblePortalCount = 0;
+
+	for (int portalIndex = 0; portalIndex < gsl::narrow<int>(portals.size()); ++portalIndex)
+	{
+		const Portal& portal = portals[portalIndex];
+		const MeshDataRef& portalMeshRef = meshDataManager.GetMeshes()[portal.meshIndex];
+
+		for (auto endPoint = PortalEndpointIndex::First(); endPoint <= PortalEndpointIndex::Last(); ++endPoint)
+		{
+			if (view.entryPortalIndex >= 0 && !portalManager.IsPotentiallyVisible(view.entryPortalIndex, PortalEndpointIndex(view.entryEndpoint),
+				glm::vec3(view.cameraMat[3]), portalIndex, endPoint))
+			{
+				continue;
+			}
+
+			View childView;
+			childView.cameraMat = portal.toOtherEndpoint[endPoint] * view.cameraMat;
+			childView.viewMat = glm::inverse(childView.cameraMat);
+			childView.depth = view.depth + 1;
+			childView.entryPortalIndex = portalIndex;
+			childView.entryEndpoint = static_cast<PortalEndpoint>(endPoint);
+
+			const Ssbo_CameraClipData clipData = portalManager.CalcChildClipData(drawInfo.projection, view.viewMat, view.screenBounds,
+				childView.viewMat, portalIndex, endPoint, drawInfo.triangleMeshes);
+
+			// outside of the view or the portals we are looking through
+			if (PortalViewUtils::IsEmpty(clipData.screenBounds))
+			{
+				continue;
+			}
+
+			childView.screenBounds = clipData.screenBounds;
+			childView.clipPlane = glm::transpose(childView.viewMat) * clipData.clipPlane;
+
+			const PushConstant_recursive portalPushConstant =
+				PortalViewUtils::CreateMeshPushConstant(viewProj, view.clipPlane, portal.transform[endPoint], PushConstant_recursive::flatPortal);
+			drawBuffer.pushConstants<PushConstant_recursive>(m_pipelineLayout.get(), pushConstantStages, 0, portalPushConstant);
+
+			const bool shouldRecurse = visiblePortalCount < maxVisiblePortalCount
+				&& PortalViewUtils::CalcCoveredPixels(clipData.screenBounds, m_extent) >= static_cast<float>(drawInfo.minPortalCoverage);
+
+			if (!shouldRecurse)
+			{
+				drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.scene.get());
+				drawBuffer.setStencilReference(stencilFaces, stencilReference);
+				drawBuffer.drawIndexed(portalMeshRef.indexCount, 1, portalMeshRef.firstIndex, 0, 0);
+				continue;
+			}
+
+			++visiblePortalCount;
+
+			// mark the visible part of the portal with the depth of the child view
+			drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.portalMark.get());
+			drawBuffer.setStencilReference(stencilFaces, stencilReference);
+			drawBuffer.drawIndexed(portalMeshRef.indexCount, 1, portalMeshRef.firstIndex, 0, 0);
+
+			// everything behind the portal has to pass the depth test
+			drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.portalDepthReset.get());
+			drawBuffer.setStencilReference(stencilFaces, stencilReference + 1);
+			drawBuffer.drawIndexed(portalMeshRef.indexCount, 1, portalMeshRef.firstIndex, 0, 0);
+
+			DrawView(drawInfo, childView, maxDepth);
+
+			// the child view changed the push constants
+			drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pipelines.portalRestore.get());
+			drawBuffer.setStencilReference(stencilFaces, stencilReference + 1);
+			drawBuffer.pushConstants<PushConstant_recursive>(m_pipelineLayout.get(), pushConstantStages, 0, portalPushConstant);
+			drawBuffer.drawIndexed(portalMeshRef.indexCount, 1, portalMeshRef.firstIndex, 0, 0);
+		}
+	}
+}
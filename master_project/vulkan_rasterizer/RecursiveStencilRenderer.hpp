@@ -0,0 +1,103 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <gsl/gsl>
+#include "glm.hpp"
+#include "GraphicsPipeline.hpp"
+
+class MeshDataManager;
+class Scene;
+class PortalManager;
+class TriangleMesh;
+
+// classic depth first portal renderer, each visible portal is recursed as soon as it is found
+// the stencil holds the recursion depth of each pixel: a portal increments it where it is visible, its view is drawn
+// where the stencil matches the new depth and afterwards the portal decrements it again and writes its own depth,
+// so the parent view continues as if the portal was opaque
+// only the recursion stack grows with the recursion depth, there are no buffers for the cameras of the NTree
+class RecursiveStencilRenderer
+{
+public:
+	struct CreateInfo
+	{
+		vk::Device logicalDevice;
+		vk::PipelineCache pipelineCache;
+		vk::Extent2D swapchainExtent;
+		vk::Format colorFormat;
+		vk::ImageLayout colorFinalLayout;
+		gsl::span<const vk::UniqueImageView> swapchainImageViews;
+
+		// must have a stencil component
+		vk::Format depthStencilFormat;
+		vk::ImageView depthStencilView;
+
+		vk::ImageView textureView;
+		vk::Sampler textureSampler;
+		vk::DescriptorBufferInfo sceneObjects;
+	};
+
+	struct DrawInfo
+	{
+		vk::CommandBuffer drawBuffer;
+		uint32_t imageIndex;
+
+		glm::mat4 cameraMat;
+		glm::mat4 projection;
+		vk::ClearColorValue clearColor;
+
+		// visible portals of each view are limited by the recursion depth of the view, the size is the max recursion depth
+		gsl::span<const int> maxVisiblePortalsForRecursion;
+
+		// portals covering less pixels are not recursed and shaded flat, 0 disables it
+		int minPortalCoverage;
+
+		// scene objects use coarser lods in deeper views and when they are small on screen, see MeshLodSelection
+		bool useMeshLods;
+
+		MeshDataManager* meshDataManager;
+		const Scene* scene;
+		const PortalManager* portalManager;
+		gsl::span<const TriangleMesh> triangleMeshes;
+	};
+
+	explicit RecursiveStencilRenderer(const CreateInfo& createInfo);
+
+	// records the whole render pass
+	void Draw(const DrawInfo& drawInfo) const;
+
+	// the stencil is 8 bit, the root view uses 0
+	static constexpr int maxRecursionDepth = 254;
+
+private:
+	struct View
+	{
+		glm::mat4 cameraMat;
+		glm::mat4 viewMat;
+
+		// see Ssbo_CameraClipData, the clip plane is in world space
+		glm::vec4 screenBounds;
+		glm::vec4 clipPlane;
+
+		int depth;
+
+		// portal the view looks through, -1 for the root view
+		int entryPortalIndex;
+		PortalEndpoint entryEndpoint;
+	};
+
+	void DrawView(const DrawInfo& drawInfo, const View& view, int maxDepth) const;
+
+	vk::Extent2D m_extent;
+
+	vk::UniqueRenderPass m_renderPass;
+	std::vector<vk::UniqueFramebuffer> m_framebuffers;
+
+	vk::UniqueShaderModule m_vertShaderModule;
+	vk::UniqueShaderModule m_fragShaderModule;
+
+	vk::UniqueDescriptorSetLayout m_descriptorSetLayout;
+	vk::UniqueDescriptorPool m_descriptorPool;
+	vk::DescriptorSet m_descriptorSet;
+
+	vk::UniquePipelineLayout m_pipelineLayout;
+	GraphicsPipeline::RecursiveStencilPipelines m_pipelines;
+};
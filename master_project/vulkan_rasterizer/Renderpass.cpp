@@ -4,7 +4,7 @@
 #include "NTree.hpp"
 
 
-vk::UniqueRenderPass Renderpass::Portals_One_Pass_dynamicState(vk::Device logicalDevice, vk::Format colorFormat, 
+vk::UniqueRenderPass Renderpass::Portals_One_Pass_dynamicState(vk::Device logicalDevice, vk::Format colorFormat, vk::ImageLayout colorFinalLayout,
 	vk::Format depthStencilFormat, vk::Format renderedDepthFormat, vk::Format renderedStencilFormat, int iterationCount)
 {
 	enum AttachmentDescriptionIdx
@@ -22,7 +22,7 @@ vk::UniqueRenderPass Renderpass::Portals_One_Pass_dynamicState(vk::Device logica
 	constexpr vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
 
 	const std::array<vk::AttachmentDescription, AttachmentDescriptionIdx::enum_size_AttachmentDescriptionIdx> attachmentsDescritpions = 
-	[samples, colorFormat, depthStencilFormat, renderedDepthFormat, renderedStencilFormat]()
+	[samples, colorFormat, colorFinalLayout, depthStencilFormat, renderedDepthFormat, renderedStencilFormat]()
 	{
 		std::array<vk::AttachmentDescription, AttachmentDescriptionIdx::enum_size_AttachmentDescriptionIdx> attachmentsDescritpions;
 
@@ -32,7 +32,7 @@ vk::UniqueRenderPass Renderpass::Portals_One_Pass_dynamicState(vk::Device logica
 			.setLoadOp(vk::AttachmentLoadOp::eClear)
 			.setStoreOp(vk::AttachmentStoreOp::eStore)
 			.setInitialLayout(vk::ImageLayout::eUndefined)
-			.setFinalLayout(vk::ImageLayout::ePresentSrcKHR)
+			.setFinalLayout(colorFinalLayout)
 			;
 
 		attachmentsDescritpions[depthStencil] = vk::AttachmentDescription()
@@ -227,6 +227,26 @@ vk::UniqueRenderPass Renderpass::Portals_One_Pass_dynamicState(vk::Device logica
 				.setDstStageMask(vk::PipelineStageFlagBits::eFragmentShader)
 				.setDstAccessMask(vk::AccessFlagBits::eShaderRead)
 			);
+
+			// the portal pass writes the camera indices and appends the visible objects to the draw commands of the scene pass
+			dependencies.push_back(vk::SubpassDependency{}
+				.setSrcSubpass(previousPortalSubpassIdx)
+				.setDstSubpass(sceneSubpassIdx)
+				.setSrcStageMask(vk::PipelineStageFlagBits::eFragmentShader)
+				.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+				.setDstStageMask(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader)
+				.setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead)
+			);
+
+			// hardware stencil layers test against the stencil values written by the portal pass
+			dependencies.push_back(vk::SubpassDependency{}
+				.setSrcSubpass(previousPortalSubpassIdx)
+				.setDstSubpass(sceneSubpassIdx)
+				.setSrcStageMask(vk::PipelineStageFlagBits::eLateFragmentTests)
+				.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+				.setDstStageMask(vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+				.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			);
 		}
 
 		{
@@ -249,6 +269,16 @@ vk::UniqueRenderPass Renderpass::Portals_One_Pass_dynamicState(vk::Device logica
 				.setDstAccessMask(vk::AccessFlagBits::eShaderRead)
 			);
 
+			// the portal pass clears the stencil and writes the masks of the next layer
+			dependencies.push_back(vk::SubpassDependency{}
+				.setSrcSubpass(sceneSubpassIdx)
+				.setDstSubpass(portalSubpassIdx)
+				.setSrcStageMask(vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+				.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+				.setDstStageMask(vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+				.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			);
+
 			// self dependency to wait for writes to portal index helper
 			dependencies.push_back(vk::SubpassDependency{}
 				.setSrcSubpass(portalSubpassIdx)
@@ -270,3 +300,195 @@ vk::UniqueRenderPass Renderpass::Portals_One_Pass_dynamicState(vk::Device logica
 
 	return logicalDevice.createRenderPassUnique(renderPassCreateInfo);
 }
+
+vk::UniqueRenderPass Renderpass::SingleSubpass(vk::Device logicalDevice, vk::Format colorFormat, vk::ImageLayout colorFinalLayout, vk::Format depthStencilFormat)
+{
+	enum AttachmentDescriptionIdx
+	{
+		color,
+		depthStencil,
+
+		enum_size_AttachmentDescriptionIdx
+	};
+
+	constexpr vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+
+	std::array<vk::AttachmentDescription, AttachmentDescriptionIdx::enum_size_AttachmentDescriptionIdx> attachmentsDescritpions;
+
+	attachmentsDescritpions[color] = vk::AttachmentDescription()
+		.setFormat(colorFormat)
+		.setSamples(samples)
+		.setLoadOp(vk::AttachmentLoadOp::eClear)
+		.setStoreOp(vk::AttachmentStoreOp::eStore)
+		.setInitialLayout(vk::ImageLayout::eUndefined)
+		.setFinalLayout(colorFinalLayout)
+		;
+
+	attachmentsDescritpions[depthStencil] = vk::AttachmentDescription()
+		.setFormat(depthStencilFormat)
+		.setSamples(samples)
+		.setLoadOp(vk::AttachmentLoadOp::eClear)
+		.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+		.setStencilLoadOp(vk::AttachmentLoadOp::eClear)
+		.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+		.setInitialLayout(vk::ImageLayout::eUndefined)
+		.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+		;
+
+	const vk::AttachmentReference colorAttachment(color, vk::ImageLayout::eColorAttachmentOptimal);
+	const vk::AttachmentReference depthStencilAttachment(depthStencil, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+	const vk::SubpassDescription subpass = vk::SubpassDescription{}
+		.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+		.setColorAttachmentCount(1).setPColorAttachments(&colorAttachment)
+		.setPDepthStencilAttachment(&depthStencilAttachment)
+		;
+
+	// the previous frame might still use the depth stencil attachment
+	const vk::SubpassDependency dependencies[] = {
+		vk::SubpassDependency{}
+			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(0)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eBottomOfPipe)
+			.setSrcAccessMask(vk::AccessFlagBits::eMemoryRead)
+			.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite),
+
+		vk::SubpassDependency{}
+			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(0)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eLateFragmentTests)
+			.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setDstStageMask(vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+			.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite),
+	};
+
+	vk::RenderPassCreateInfo renderPassCreateInfo = vk::RenderPassCreateInfo()
+		.setAttachmentCount(GetSizeUint32(attachmentsDescritpions)).setPAttachments(std::data(attachmentsDescritpions))
+		.setSubpassCount(1).setPSubpasses(&subpass)
+		.setDependencyCount(GetSizeUint32(dependencies)).setPDependencies(std::data(dependencies))
+		;
+
+	return logicalDevice.createRenderPassUnique(renderPassCreateInfo);
+}
+
+vk::UniqueRenderPass Renderpass::TextureAtlas(vk::Device logicalDevice, vk::Format colorFormat, vk::Format depthFormat,
+	vk::AttachmentLoadOp colorLoadOp)
+{
+	enum AttachmentDescriptionIdx
+	{
+		color,
+		depth,
+
+		enum_size_AttachmentDescriptionIdx
+	};
+
+	constexpr vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+
+	std::array<vk::AttachmentDescription, AttachmentDescriptionIdx::enum_size_AttachmentDescriptionIdx> attachmentsDescritpions;
+
+	// the previous content of the atlas was already sampled, unless it is loaded
+	attachmentsDescritpions[color] = vk::AttachmentDescription()
+		.setFormat(colorFormat)
+		.setSamples(samples)
+		.setLoadOp(colorLoadOp)
+		.setStoreOp(vk::AttachmentStoreOp::eStore)
+		.setInitialLayout(colorLoadOp == vk::AttachmentLoadOp::eLoad ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eUndefined)
+		.setFinalLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		;
+
+	attachmentsDescritpions[depth] = vk::AttachmentDescription()
+		.setFormat(depthFormat)
+		.setSamples(samples)
+		.setLoadOp(vk::AttachmentLoadOp::eClear)
+		.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+		.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+		.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+		.setInitialLayout(vk::ImageLayout::eUndefined)
+		.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+		;
+
+	const vk::AttachmentReference colorAttachment(color, vk::ImageLayout::eColorAttachmentOptimal);
+	const vk::AttachmentReference depthAttachment(depth, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+	const vk::SubpassDescription subpass = vk::SubpassDescription{}
+		.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+		.setColorAttachmentCount(1).setPColorAttachments(&colorAttachment)
+		.setPDepthStencilAttachment(&depthAttachment)
+		;
+
+	const vk::SubpassDependency dependencies[] = {
+		// the previous pass might still sample the atlas
+		vk::SubpassDependency{}
+			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(0)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eFragmentShader)
+			.setSrcAccessMask(vk::AccessFlags())
+			.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite),
+
+		vk::SubpassDependency{}
+			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(0)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eLateFragmentTests)
+			.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setDstStageMask(vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+			.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite),
+
+		// the parent views sample the atlas
+		vk::SubpassDependency{}
+			.setSrcSubpass(0)
+			.setDstSubpass(VK_SUBPASS_EXTERNAL)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setDstStageMask(vk::PipelineStageFlagBits::eFragmentShader)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead),
+	};
+
+	vk::RenderPassCreateInfo renderPassCreateInfo = vk::RenderPassCreateInfo()
+		.setAttachmentCount(GetSizeUint32(attachmentsDescritpions)).setPAttachments(std::data(attachmentsDescritpions))
+		.setSubpassCount(1).setPSubpasses(&subpass)
+		.setDependencyCount(GetSizeUint32(dependencies)).setPDependencies(std::data(dependencies))
+		;
+
+	return logicalDevice.createRenderPassUnique(renderPassCreateInfo);
+}
+
+vk::UniqueRenderPass Renderpass::Overlay(vk::Device logicalDevice, vk::Format colorFormat, vk::ImageLayout colorFinalLayout)
+{
+	// every pixel is written, so the previous content is not needed
+	const vk::AttachmentDescription colorAttachmentDescription = vk::AttachmentDescription()
+		.setFormat(colorFormat)
+		.setSamples(vk::SampleCountFlagBits::e1)
+		.setLoadOp(vk::AttachmentLoadOp::eDontCare)
+		.setStoreOp(vk::AttachmentStoreOp::eStore)
+		.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+		.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+		.setInitialLayout(vk::ImageLayout::eUndefined)
+		.setFinalLayout(colorFinalLayout)
+		;
+
+	const vk::AttachmentReference colorAttachment(0, vk::ImageLayout::eColorAttachmentOptimal);
+
+	const vk::SubpassDescription subpass = vk::SubpassDescription{}
+		.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+		.setColorAttachmentCount(1).setPColorAttachments(&colorAttachment)
+		;
+
+	// the previous pass wrote the image and the storage buffers read by the fragment shader
+	const vk::SubpassDependency dependency = vk::SubpassDependency{}
+		.setSrcSubpass(VK_SUBPASS_EXTERNAL)
+		.setDstSubpass(0)
+		.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eFragmentShader)
+		.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eShaderWrite)
+		.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eFragmentShader)
+		.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eShaderRead);
+
+	vk::RenderPassCreateInfo renderPassCreateInfo = vk::RenderPassCreateInfo()
+		.setAttachmentCount(1).setPAttachments(&colorAttachmentDescription)
+		.setSubpassCount(1).setPSubpasses(&subpass)
+		.setDependencyCount(1).setPDependencies(&dependency)
+		;
+
+	return logicalDevice.createRenderPassUnique(renderPassCreateInfo);
+}
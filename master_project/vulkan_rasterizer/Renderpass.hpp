@@ -1,5 +1,18 @@
 #pragma once
 struct Renderpass
 {
-	static vk::UniqueRenderPass Portals_One_Pass_dynamicState(vk::Device logicalDevice, vk::Format colorFormat, vk::Format depthStencilFormat, vk::Format renderedDepthFormat, vk::Format renderedStencilFormat, int iterationCount);
+	// colorFinalLayout is ePresentSrcKHR for swapchain images and eTransferSrcOptimal for offscreen ones, see Swapchain::finalLayout
+	static vk::UniqueRenderPass Portals_One_Pass_dynamicState(vk::Device logicalDevice, vk::Format colorFormat, vk::ImageLayout colorFinalLayout, vk::Format depthStencilFormat, vk::Format renderedDepthFormat, vk::Format renderedStencilFormat, int iterationCount);
+
+	// single subpass which presents the color attachment, the depth first renderer masks its recursion with the stencil
+	static vk::UniqueRenderPass SingleSubpass(vk::Device logicalDevice, vk::Format colorFormat, vk::ImageLayout colorFinalLayout, vk::Format depthStencilFormat);
+
+	// single subpass rendering into the texture atlas, which is sampled by the following passes
+	// colorLoadOp eLoad keeps the previous content of the atlas, it has to be in the shader read layout
+	static vk::UniqueRenderPass TextureAtlas(vk::Device logicalDevice, vk::Format colorFormat, vk::Format depthFormat,
+		vk::AttachmentLoadOp colorLoadOp = vk::AttachmentLoadOp::eClear);
+
+	// single subpass which overwrites every pixel of an image the breadth first render pass already left in colorFinalLayout
+	// its fragment shader reads the storage buffers written by that pass, see HeatmapPass
+	static vk::UniqueRenderPass Overlay(vk::Device logicalDevice, vk::Format colorFormat, vk::ImageLayout colorFinalLayout);
 };
@@ -2,38 +2,137 @@
 #include "Scene.hpp"
 #include "MeshDataManager.hpp"
 #include "PushConstants.hpp"
+#include "UniformBufferObjects.hpp"
+#include "GetSizeUint32.hpp"
+#include "Ray.hpp"
 
 Scene::Scene(VmaAllocator allocator)
-	: m_drawIndexedIndirectBuffer()
-	, m_drawIndexedIndirectBufferElementCount(0)
+	: m_objectBuffer()
+	, m_objectBufferSize(0)
+	, m_drawIndexedIndirectBuffer()
+	, m_drawCommandSetCount(0)
+	, m_drawIndexedIndirectBufferFrameStride(0)
 	, m_allocator(allocator)
 {
+}
+
+void Scene::Add(int MeshIdx, const Transform& transform, glm::vec4 debugColor /*= glm::vec4(0.f)*/)
+{
+	m_objects.push_back(SceneObject{ transform, MeshIdx, debugColor });
+}
+
+AsyncUploader::Ticket Scene::CreateGpuData(const MeshDataManager& meshdataManager, gsl::span<const TriangleMesh> triangleMeshes,
+	int frameCount, int drawCommandSetCount, vk::DeviceSize storageBufferOffsetAlignment, AsyncUploader& uploader)
+{
+	gsl::span<const MeshDataRef> meshDataRefs = meshdataManager.GetMeshes();
+	assert(meshDataRefs.size() == triangleMeshes.size());
+
+	// buffers must not be empty, so reserve at least one element
+	const uint32_t objectElementCount = std::max(GetSizeUint32(m_objects), 1u);
+
+	std::vector<Ssbo_SceneObject> objectData;
+	objectData.reserve(m_objects.size());
+	m_objectBoundingSpheres.clear();
+	m_objectBoundingSpheres.reserve(m_objects.size());
+
+	for (const SceneObject& object : m_objects)
+	{
+		Ssbo_SceneObject data = {};
+		data.model = object.transform.ToMat();
+		data.normalMat = glm::transpose(glm::inverse(data.model));
+		data.debugColor = object.debugColor;
 
-	// TODO: arbitrary values, benchmark what we really need
-	constexpr int MaxElements = 20;
+		// bounding sphere of the model space AABB, the radius is scaled by the biggest axis scale
+		{
+			const AABB& modelBounds = triangleMeshes[object.meshIdx].GetModelBoundingBox();
+			const glm::vec3 modelCenter = (modelBounds.minBounds + modelBounds.maxBounds) * 0.5f;
+			const float modelRadius = glm::length(modelBounds.maxBounds - modelCenter);
 
+			const float maxScale = std::max({
+				glm::length(glm::vec3(data.model[0])),
+				glm::length(glm::vec3(data.model[1])),
+				glm::length(glm::vec3(data.model[2])) });
 
-	VmaAllocationCreateInfo vmaAllocInfo_gpuOnly = {};
-	vmaAllocInfo_gpuOnly.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+			data.boundingSphere = glm::vec4(glm::vec3(data.model * glm::vec4(modelCenter, 1.f)), modelRadius * maxScale);
+		}
+
+		const MeshDataRef& meshRef = meshDataRefs[object.meshIdx];
+		static_assert(std::extent_v<decltype(Ssbo_SceneObject::lodFirstIndex)> == MeshDataRef::maxLodCount, "lod count of the object buffer has to match the meshes");
+		for (int lodIndex = 0; lodIndex < MeshDataRef::maxLodCount; ++lodIndex)
+		{
+			data.lodFirstIndex[lodIndex] = meshRef.lods[lodIndex].firstIndex;
+			data.lodIndexCount[lodIndex] = meshRef.lods[lodIndex].indexCount;
+		}
+
+		objectData.push_back(data);
+		m_objectBoundingSpheres.push_back(data.boundingSphere);
+	}
+
+	m_objectBufferSize = objectElementCount * sizeof(Ssbo_SceneObject);
+
+	{
+		VmaAllocationCreateInfo vmaAllocInfo_gpuOnly = {};
+		vmaAllocInfo_gpuOnly.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+
+		const gsl::span<const uint32_t> queueFamilies = uploader.GetDestinationQueueFamilies();
+		const vk::BufferCreateInfo objectBufferCreateInfo = vk::BufferCreateInfo{}
+			.setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst)
+			.setSize(m_objectBufferSize)
+			.setSharingMode(uploader.GetDestinationSharingMode())
+			.setQueueFamilyIndexCount(gsl::narrow<uint32_t>(queueFamilies.size()))
+			.setPQueueFamilyIndices(queueFamilies.data());
+
+		m_objectBuffer = UniqueVmaBuffer(m_allocator, objectBufferCreateInfo, vmaAllocInfo_gpuOnly);
+	}
 
 	{
-		m_drawIndexedIndirectBufferMaxElements = MaxElements;
-		const vk::BufferCreateInfo vertexBufferCreateInfo = vk::BufferCreateInfo{}
-			.setUsage(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst)
-			.setSize(m_drawIndexedIndirectBufferMaxElements * sizeof(vk::DrawIndexedIndirectCommand));
+		m_drawCommandSetCount = drawCommandSetCount;
+		m_drawIndexedIndirectBufferFrameStride = VulkanUtils::AlignUp(
+			CalcDrawCommandSetSize() * drawCommandSetCount, storageBufferOffsetAlignment);
+
+		VmaAllocationCreateInfo vmaAllocInfo_gpuOnly = {};
+		vmaAllocInfo_gpuOnly.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+
+		const vk::BufferCreateInfo indirectBufferCreateInfo = vk::BufferCreateInfo{}
+			.setUsage(vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer)
+			.setSize(CalcDrawCommandOffset(frameCount, 0));
 
-		m_drawIndexedIndirectBuffer = UniqueVmaBuffer(allocator, vertexBufferCreateInfo, vmaAllocInfo_gpuOnly);
+		m_drawIndexedIndirectBuffer = UniqueVmaBuffer(m_allocator, indirectBufferCreateInfo, vmaAllocInfo_gpuOnly);
 	}
 
+	if (objectData.empty())
+	{
+		return AsyncUploader::noUpload;
+	}
 
+	// Copy object data to GPU
+	const vk::DeviceSize objectDataSizeBytes = objectData.size() * sizeof(objectData[0]);
+	return uploader.Upload(objectDataSizeBytes, [&](const AsyncUploader::Staging& staging, vk::CommandBuffer copyCommandBuffer)
+		{
+			std::memcpy(staging.mappedMemory, objectData.data(), static_cast<size_t>(objectDataSizeBytes));
+			copyCommandBuffer.copyBuffer(staging.buffer, m_objectBuffer.Get(), vk::BufferCopy(staging.offset, 0, objectDataSizeBytes));
+		});
 }
 
-void Scene::Add(int MeshIdx, const Transform& transform, glm::vec4 debugColor /*= glm::vec4(0.f)*/)
+void Scene::Draw(MeshDataManager& meshdataManager, vk::PipelineLayout pipelineLayout, vk::CommandBuffer drawCommandBuffer,
+	int frameIndex, int drawCommandSetIndex, uint32_t layerStartIndex, uint32_t layerEndIndex) const
 {
-	m_objects.push_back(SceneObject{ transform, MeshIdx, debugColor });
+	drawCommandBuffer.bindIndexBuffer(meshdataManager.GetIndexBuffer(), 0, MeshDataManager::IndexBufferIndexType);
+	vk::DeviceSize vertexBufferOffset = 0;
+	drawCommandBuffer.bindVertexBuffers(0, meshdataManager.GetVertexBuffer(), vertexBufferOffset);
+
+	PushConstant_sceneObject pushConstant = {};
+	pushConstant.layerStartIndex = layerStartIndex;
+	pushConstant.objectInstanceStride = layerEndIndex - layerStartIndex;
+	pushConstant.instanceListOffset = GetObjectCount() * layerStartIndex;
+
+	drawCommandBuffer.pushConstants<PushConstant_sceneObject>(pipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pushConstant);
+	drawCommandBuffer.drawIndexedIndirect(m_drawIndexedIndirectBuffer.Get(), CalcDrawCommandOffset(frameIndex, drawCommandSetIndex),
+		GetSizeUint32(m_objects), sizeof(vk::DrawIndexedIndirectCommand));
 }
 
-void Scene::Draw(MeshDataManager& meshdataManager, vk::PipelineLayout pipelineLayout, vk::CommandBuffer drawCommandBuffer, uint32_t layerStartIndex, uint32_t layerEndIndex) const
+void Scene::DrawEachObject(MeshDataManager& meshdataManager, vk::CommandBuffer drawCommandBuffer, gsl::span<const glm::vec4> cullPlanes,
+	const std::optional<LodSelectInfo>& lodSelectInfo) const
 {
 	drawCommandBuffer.bindIndexBuffer(meshdataManager.GetIndexBuffer(), 0, MeshDataManager::IndexBufferIndexType);
 	vk::DeviceSize vertexBufferOffset = 0;
@@ -41,18 +140,84 @@ void Scene::Draw(MeshDataManager& meshdataManager, vk::PipelineLayout pipelineLa
 
 	gsl::span<const MeshDataRef> meshDataRefs = meshdataManager.GetMeshes();
 
-	const int instanceCount = layerEndIndex - layerStartIndex;
+	for (gsl::index objectIndex = 0; objectIndex < gsl::narrow<gsl::index>(m_objects.size()); ++objectIndex)
+	{
+		const glm::vec4& sphere = m_objectBoundingSpheres[objectIndex];
+		const bool isVisible = std::all_of(std::begin(cullPlanes), std::end(cullPlanes), [&sphere](const glm::vec4& plane)
+			{
+				return glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w >= -sphere.w * glm::length(glm::vec3(plane));
+			});
+
+		if (!isVisible)
+		{
+			continue;
+		}
 
-	for (const SceneObject& object : m_objects)
+		int lodIndex = 0;
+		if (lodSelectInfo)
+		{
+			const float distance = glm::distance(lodSelectInfo->cameraPosition, glm::vec3(sphere));
+			const float projectedRadius = MeshLodSelection::CalcProjectedRadius(sphere.w, distance, lodSelectInfo->projectionScale);
+			lodIndex = MeshLodSelection::Select(projectedRadius, lodSelectInfo->recursionDepth);
+		}
+
+		const MeshLod& lod = meshDataRefs[m_objects[objectIndex].meshIdx].lods[lodIndex];
+		drawCommandBuffer.drawIndexed(lod.indexCount, 1, lod.firstIndex, 0, gsl::narrow<uint32_t>(objectIndex));
+	}
+}
+
+std::optional<float> Scene::RayTrace(const Ray& ray, gsl::span<const TriangleMesh> triangleMeshes) const
+{
+	std::optional<float> closestDistance;
+
+	for (gsl::index objectIndex = 0; objectIndex < gsl::narrow<gsl::index>(m_objects.size()); ++objectIndex)
 	{
+		// the bounding sphere is much cheaper than moving the ray into model space
+		const glm::vec4& sphere = m_objectBoundingSpheres[objectIndex];
+		const float closestT = glm::clamp(glm::dot(glm::vec3(sphere) - ray.origin, ray.direction), 0.f, ray.distance);
+		if (glm::distance(ray.CalcPosition(closestT), glm::vec3(sphere)) > sphere.w)
+		{
+			continue;
+		}
+
+		const SceneObject& object = m_objects[objectIndex];
+		const glm::mat4 model = object.transform.ToMat();
+		const glm::mat4 inverseModel = glm::inverse(model);
 
-		PushConstant_sceneObject pushConstant = {};
-		pushConstant.model = object.transform.ToMat();
-		pushConstant.layerStartIndex = layerStartIndex;
-		pushConstant.debugColor = object.debugColor;
+		const Ray modelRay = Ray::FromStartAndEndpoint(
+			glm::vec3(inverseModel * glm::vec4(ray.origin, 1.f)),
+			glm::vec3(inverseModel * glm::vec4(ray.CalcEndPoint(), 1.f)));
 
-		drawCommandBuffer.pushConstants<PushConstant_sceneObject>(pipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pushConstant);
-		const MeshDataRef& portalMeshRef = meshDataRefs[object.meshIdx];
-		drawCommandBuffer.drawIndexed(portalMeshRef.indexCount, instanceCount, portalMeshRef.firstIndex, 0, 0);
+		const std::optional<float> modelHit = triangleMeshes[object.meshIdx].RayTrace(modelRay);
+		if (!modelHit)
+		{
+			continue;
+		}
+
+		const float distance = glm::distance(ray.origin, glm::vec3(model * glm::vec4(modelRay.CalcPosition(*modelHit), 1.f)));
+		if (!closestDistance || distance < *closestDistance)
+		{
+			closestDistance = distance;
+		}
 	}
+
+	return closestDistance;
+}
+
+vk::DescriptorBufferInfo Scene::GetDrawCommandBufferInfo(int frameIndex) const
+{
+	return vk::DescriptorBufferInfo{}
+		.setBuffer(m_drawIndexedIndirectBuffer.Get())
+		.setOffset(CalcDrawCommandOffset(frameIndex, 0))
+		.setRange(CalcDrawCommandSetSize() * m_drawCommandSetCount);
+}
+
+vk::DeviceSize Scene::CalcDrawCommandOffset(int frameIndex, int drawCommandSetIndex) const
+{
+	return static_cast<vk::DeviceSize>(frameIndex) * m_drawIndexedIndirectBufferFrameStride + drawCommandSetIndex * CalcDrawCommandSetSize();
+}
+
+vk::DeviceSize Scene::CalcDrawCommandSetSize() const
+{
+	return std::max<vk::DeviceSize>(m_objects.size(), 1) * sizeof(vk::DrawIndexedIndirectCommand);
 }
@@ -2,14 +2,19 @@
 #include <vulkan/vulkan.hpp>
 #include <gsl/gsl>
 #include <string>
+#include <optional>
 #include "Vertex.hpp"
 #include "common/VulkanUtils.hpp"
 #include "UniqueVmaObject.hpp"
 #include "MeshDataRef.hpp"
 #include "glm.hpp"
 #include "Transform.hpp"
+#include "TriangleMesh.hpp"
+#include "AsyncUploader.hpp"
 
 class MeshDataManager;
+struct Ray;
+
 struct SceneObject
 {
 	Transform transform;
@@ -17,22 +22,73 @@ struct SceneObject
 	glm::vec4 debugColor;
 };
 
+// All objects of a draw command set are drawn with a single drawIndexedIndirect, a set has one command per object
+// the instances of an object are placed behind each other, so the object index can be calculated by
+// gl_InstanceIndex / layerInstanceCount in the shader (firstInstance = objectIndex * layerInstanceCount)
+// The draw commands are written on the GPU, the culling resets them and the portal pass appends
+// the cameras which can see an object to its instance list
+// usually a layer uses a single set, layers drawn with the hardware stencil use one set per camera, see GraphicsBackend::Render
 class Scene
 {
 public:
 	Scene(VmaAllocator allocator);
 
 	void Add(int MeshIdx, const Transform& transform, glm::vec4 debugColor = glm::vec4(0.f));
-	void Draw(MeshDataManager& meshdataManager, vk::PipelineLayout pipelineLayout, vk::CommandBuffer drawCommandBuffer, uint32_t layerStartIndex, uint32_t layerEndIndex) const;
 
+	// uploads the object data into the object buffer and creates the indirect buffer
+	// must be called once after all objects were added
+	// triangleMeshes are used for the bounding volumes and have to match the meshes of the meshdataManager
+	// the object buffer can be used once the returned upload is complete
+	AsyncUploader::Ticket CreateGpuData(const MeshDataManager& meshdataManager, gsl::span<const TriangleMesh> triangleMeshes,
+		int frameCount, int drawCommandSetCount, vk::DeviceSize storageBufferOffsetAlignment, AsyncUploader& uploader);
+
+	void Draw(MeshDataManager& meshdataManager, vk::PipelineLayout pipelineLayout, vk::CommandBuffer drawCommandBuffer,
+		int frameIndex, int drawCommandSetIndex, uint32_t layerStartIndex, uint32_t layerEndIndex) const;
+
+	// camera of the view the objects are drawn for, see MeshLodSelection
+	struct LodSelectInfo
+	{
+		glm::vec3 cameraPosition;
+
+		// projection[1][1]
+		float projectionScale;
+		int recursionDepth;
+	};
+
+	// draws each object whose bounding sphere is in front of all cullPlanes (world space) with a single drawIndexed
+	// the object index is passed as firstInstance, push constants have to be set by the caller
+	// without lodSelectInfo the objects are drawn with full detail
+	void DrawEachObject(MeshDataManager& meshdataManager, vk::CommandBuffer drawCommandBuffer, gsl::span<const glm::vec4> cullPlanes,
+		const std::optional<LodSelectInfo>& lodSelectInfo) const;
+
+	// world space distance to the closest object hit by the ray, the same triangleMeshes as in CreateGpuData
+	std::optional<float> RayTrace(const Ray& ray, gsl::span<const TriangleMesh> triangleMeshes) const;
+
+	vk::Buffer GetObjectBuffer() const { return m_objectBuffer.Get(); }
+	vk::DeviceSize GetObjectBufferSize() const { return m_objectBufferSize; }
+	int GetObjectCount() const { return gsl::narrow<int>(m_objects.size()); }
+
+	// draw commands of all sets of a frame, written by the culling and the portal pass
+	vk::DescriptorBufferInfo GetDrawCommandBufferInfo(int frameIndex) const;
 
 private:
-	
+	vk::DeviceSize CalcDrawCommandOffset(int frameIndex, int drawCommandSetIndex) const;
+	vk::DeviceSize CalcDrawCommandSetSize() const;
+
 	std::vector<SceneObject> m_objects;
 
+	// world space bounding sphere of each object, xyz center, w radius
+	std::vector<glm::vec4> m_objectBoundingSpheres;
+
+	// per object data (Ssbo_SceneObject)
+	UniqueVmaBuffer m_objectBuffer;
+	vk::DeviceSize m_objectBufferSize;
+
+	// one draw command per object for each set of each frame
+	// the commands of a frame start at a multiple of m_drawIndexedIndirectBufferFrameStride, so they can be bound as storage buffer
 	UniqueVmaBuffer m_drawIndexedIndirectBuffer;
-	int m_drawIndexedIndirectBufferElementCount;
-	int m_drawIndexedIndirectBufferMaxElements;
+	int m_drawCommandSetCount;
+	vk::DeviceSize m_drawIndexedIndirectBufferFrameStride;
 
 	VmaAllocator m_allocator;
 };
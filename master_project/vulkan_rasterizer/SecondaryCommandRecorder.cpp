@@ -0,0 +1,139 @@
+#include "pch.hpp"
+#include "SecondaryCommandRecorder.hpp"
+#include "Profiler.hpp"
+#include "AllocationTracker.hpp"
+
+SecondaryCommandRecorder::SecondaryCommandRecorder(vk::Device device, uint32_t queueFamilyIndex, int frameCount, int threadCount, size_t maxJobCount)
+	: m_device(device)
+{
+	assert(threadCount > 0);
+	m_jobs.reserve(maxJobCount);
+	m_recordedBuffers.reserve(maxJobCount);
+
+	const vk::CommandPoolCreateInfo commandPoolCreateInfo = vk::CommandPoolCreateInfo{}
+		.setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+		.setQueueFamilyIndex(queueFamilyIndex);
+
+	m_threadFrameResources.resize(threadCount);
+	for (std::vector<ThreadFrameResources>& frameResources : m_threadFrameResources)
+	{
+		frameResources.resize(frameCount);
+		for (ThreadFrameResources& resources : frameResources)
+		{
+			resources.commandPool = device.createCommandPoolUnique(commandPoolCreateInfo);
+		}
+	}
+
+	m_threads.reserve(threadCount);
+	for (int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		m_threads.emplace_back(&SecondaryCommandRecorder::WorkerLoop, this, threadIndex);
+	}
+}
+
+SecondaryCommandRecorder::~SecondaryCommandRecorder()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_jobAvailable.notify_all();
+
+	for (std::thread& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void SecondaryCommandRecorder::BeginFrame(int frameIndex)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	assert(m_jobs.empty());
+	m_frameIndex = frameIndex;
+
+	// no job is queued, so none of the threads uses its pool
+	for (std::vector<ThreadFrameResources>& frameResources : m_threadFrameResources)
+	{
+		ThreadFrameResources& resources = frameResources[frameIndex];
+		m_device.resetCommandPool(resources.commandPool.get(), {});
+		resources.usedCommandBufferCount = 0;
+	}
+}
+
+void SecondaryCommandRecorder::Record(const vk::CommandBufferInheritanceInfo& inheritanceInfo, RecordFunction recordFunction)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(Job{ inheritanceInfo, std::move(recordFunction) });
+		m_recordedBuffers.emplace_back();
+	}
+	m_jobAvailable.notify_one();
+}
+
+void SecondaryCommandRecorder::Finish(std::vector<vk::CommandBuffer>& outBuffers)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobsFinished.wait(lock, [this]() { return m_finishedJobCount == m_jobs.size(); });
+
+	outBuffers.assign(m_recordedBuffers.begin(), m_recordedBuffers.end());
+	m_recordedBuffers.clear();
+	m_jobs.clear();
+	m_nextJobIndex = 0;
+	m_finishedJobCount = 0;
+}
+
+void SecondaryCommandRecorder::WorkerLoop(int threadIndex)
+{
+	const AllocationTracker::Scope allocationScope(AllocationTracker::Subsystem::Recording);
+	Profiler::SetThreadName("recording thread " + std::to_string(threadIndex));
+
+	for (;;)
+	{
+		Job job;
+		size_t jobIndex;
+		int frameIndex;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [this]() { return m_isStopping || m_nextJobIndex < m_jobs.size(); });
+			if (m_isStopping)
+			{
+				return;
+			}
+
+			jobIndex = m_nextJobIndex++;
+			job = m_jobs[jobIndex];
+			frameIndex = m_frameIndex;
+		}
+
+		PROFILE_SCOPE("SecondaryCommandRecorder::Record");
+		vk::CommandBuffer commandBuffer = AcquireCommandBuffer(m_threadFrameResources[threadIndex][frameIndex]);
+		commandBuffer.begin(vk::CommandBufferBeginInfo{}
+			.setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+			.setPInheritanceInfo(&job.inheritanceInfo));
+
+		job.recordFunction(commandBuffer);
+		commandBuffer.end();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_recordedBuffers[jobIndex] = commandBuffer;
+			++m_finishedJobCount;
+		}
+		m_jobsFinished.notify_one();
+	}
+}
+
+vk::CommandBuffer SecondaryCommandRecorder::AcquireCommandBuffer(ThreadFrameResources& resources) const
+{
+	if (resources.usedCommandBufferCount == resources.commandBuffers.size())
+	{
+		std::vector<vk::UniqueCommandBuffer> allocatedBuffers = m_device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{}
+			.setCommandPool(resources.commandPool.get())
+			.setLevel(vk::CommandBufferLevel::eSecondary)
+			.setCommandBufferCount(1));
+
+		resources.commandBuffers.push_back(std::move(allocatedBuffers[0]));
+	}
+
+	return resources.commandBuffers[resources.usedCommandBufferCount++].get();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <gsl/gsl>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// records secondary command buffers on worker threads, the primary command buffer executes them in the order they were queued
+// the buffers stay valid until the next BeginFrame of their frame index, so they can be submitted again
+// a command pool must not be used by two threads at once, so each thread has its own pool per frame in flight
+class SecondaryCommandRecorder
+{
+public:
+	using RecordFunction = std::function<void(vk::CommandBuffer)>;
+
+	// the job storage is reserved for maxJobCount Record calls per frame
+	SecondaryCommandRecorder(vk::Device device, uint32_t queueFamilyIndex, int frameCount, int threadCount, size_t maxJobCount);
+	~SecondaryCommandRecorder();
+
+	SecondaryCommandRecorder(const SecondaryCommandRecorder&) = delete;
+	SecondaryCommandRecorder& operator=(const SecondaryCommandRecorder&) = delete;
+
+	// resets the command pools of the frame, the gpu has to be done with their previous use
+	void BeginFrame(int frameIndex);
+
+	// the buffer is begun for the subpass of inheritanceInfo and ended after recordFunction returns
+	// everything referenced by recordFunction has to stay alive until Finish returns
+	void Record(const vk::CommandBufferInheritanceInfo& inheritanceInfo, RecordFunction recordFunction);
+
+	// waits for the queued recordings, outBuffers is overwritten with the buffers in the order of the Record calls
+	// reusing outBuffers and the job storage of the recorder, recording the same number of buffers again does not allocate
+	void Finish(std::vector<vk::CommandBuffer>& outBuffers);
+
+	int GetThreadCount() const { return gsl::narrow<int>(m_threads.size()); }
+
+private:
+	struct Job
+	{
+		vk::CommandBufferInheritanceInfo inheritanceInfo;
+		RecordFunction recordFunction;
+	};
+
+	// command buffers are allocated when needed and reused after the pool was reset
+	struct ThreadFrameResources
+	{
+		vk::UniqueCommandPool commandPool;
+		std::vector<vk::UniqueCommandBuffer> commandBuffers;
+		size_t usedCommandBufferCount = 0;
+	};
+
+	void WorkerLoop(int threadIndex);
+	vk::CommandBuffer AcquireCommandBuffer(ThreadFrameResources& resources) const;
+
+	vk::Device m_device;
+
+	// [threadIndex][frameIndex]
+	std::vector<std::vector<ThreadFrameResources>> m_threadFrameResources;
+
+	// everything below is guarded by the mutex
+	std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	std::condition_variable m_jobsFinished;
+	int m_frameIndex = 0;
+	std::vector<Job> m_jobs;
+	std::vector<vk::CommandBuffer> m_recordedBuffers;
+	size_t m_nextJobIndex = 0;
+	size_t m_finishedJobCount = 0;
+	bool m_isStopping = false;
+
+	std::vector<std::thread> m_threads;
+};
@@ -12,6 +12,36 @@ namespace
 
 	const vk::PresentModeKHR preferedPresentationModes[] = { vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate };
 
+	std::vector<vk::UniqueImageView> CreateImageViews(vk::Device device, gsl::span<const vk::Image> images, vk::Format format)
+	{
+		const vk::ImageViewCreateInfo imageViewCreateInfoPrototype = vk::ImageViewCreateInfo()
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(format)
+			.setComponents(vk::ComponentMapping()
+				.setR(vk::ComponentSwizzle::eIdentity)
+				.setG(vk::ComponentSwizzle::eIdentity)
+				.setB(vk::ComponentSwizzle::eIdentity)
+				.setA(vk::ComponentSwizzle::eIdentity))
+			.setSubresourceRange(vk::ImageSubresourceRange()
+				.setAspectMask(vk::ImageAspectFlagBits::eColor)
+				.setBaseMipLevel(0)
+				.setLevelCount(1)
+				.setBaseArrayLayer(0)
+				.setLayerCount(1))
+			;
+
+		std::vector<vk::UniqueImageView> imageViews;
+		imageViews.reserve(images.size());
+		for (vk::Image image : images)
+		{
+			const vk::ImageViewCreateInfo imageViewCreateInfo = vk::ImageViewCreateInfo(imageViewCreateInfoPrototype)
+				.setImage(image);
+			imageViews.push_back(device.createImageViewUnique(imageViewCreateInfo));
+		}
+
+		return imageViews;
+	}
+
 }
 
 
@@ -56,29 +86,37 @@ Swapchain Swapchain::Create(vk::PhysicalDevice physicalDevice, vk::Device device
 	swapchain.swapchain = device.createSwapchainKHRUnique(swapchainCreateInfo);
 
 	swapchain.images = device.getSwapchainImagesKHR(swapchain.swapchain.get());
-	const vk::ImageViewCreateInfo imageViewCreateInfoPrototype = vk::ImageViewCreateInfo()
-		.setViewType(vk::ImageViewType::e2D)
+	swapchain.imageViews = CreateImageViews(device, swapchain.images, swapchain.surfaceFormat.format);
+
+	return swapchain;
+}
+
+Swapchain Swapchain::CreateOffscreen(vk::Device device, VmaAllocator allocator, vk::Extent2D extent, uint32_t imageCount)
+{
+	Swapchain swapchain;
+	swapchain.surfaceFormat = preferedSurfaceFormats[0];
+	swapchain.presentMode = vk::PresentModeKHR::eImmediate;
+	swapchain.extent = extent;
+	swapchain.finalLayout = vk::ImageLayout::eTransferSrcOptimal;
+
+	const vk::ImageCreateInfo imageCreateInfo = vk::ImageCreateInfo{}
+		.setImageType(vk::ImageType::e2D)
+		.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc)
 		.setFormat(swapchain.surfaceFormat.format)
-		.setComponents(vk::ComponentMapping()
-			.setR(vk::ComponentSwizzle::eIdentity)
-			.setG(vk::ComponentSwizzle::eIdentity)
-			.setB(vk::ComponentSwizzle::eIdentity)
-			.setA(vk::ComponentSwizzle::eIdentity))
-		.setSubresourceRange(vk::ImageSubresourceRange()
-			.setAspectMask(vk::ImageAspectFlagBits::eColor)
-			.setBaseMipLevel(0)
-			.setLevelCount(1)
-			.setBaseArrayLayer(0)
-			.setLayerCount(1))
-		;
-
-	swapchain.imageViews.reserve(swapchain.images.size());
-	for (vk::Image image : swapchain.images)
+		.setExtent(vk::Extent3D(extent.width, extent.height, 1))
+		.setTiling(vk::ImageTiling::eOptimal)
+		.setArrayLayers(1)
+		.setMipLevels(1);
+
+	VmaAllocationCreateInfo imageAllocCreateInfo = {};
+	imageAllocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+	for (uint32_t i = 0; i < imageCount; ++i)
 	{
-		const vk::ImageViewCreateInfo imageViewCreateInfo = vk::ImageViewCreateInfo(imageViewCreateInfoPrototype)
-			.setImage(image);
-		swapchain.imageViews.push_back(device.createImageViewUnique(imageViewCreateInfo));
+		swapchain.offscreenImages.emplace_back(allocator, imageCreateInfo, imageAllocCreateInfo);
+		swapchain.images.push_back(swapchain.offscreenImages.back().Get());
 	}
+	swapchain.imageViews = CreateImageViews(device, swapchain.images, swapchain.surfaceFormat.format);
 
 	return swapchain;
 }
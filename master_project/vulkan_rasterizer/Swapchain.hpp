@@ -2,16 +2,27 @@
 #include <cstdint>
 #include <vulkan/vulkan.hpp>
 #include <vector>
+#include "UniqueVmaObject.hpp"
 
 struct Swapchain
 {
 	static Swapchain Create(vk::PhysicalDevice physicalDevice, vk::Device device, vk::SurfaceKHR surface, vk::Extent2D extent);
+
+	// images for rendering without a window, there is no swapchain and the images can be copied from after rendering
+	static Swapchain CreateOffscreen(vk::Device device, VmaAllocator allocator, vk::Extent2D extent, uint32_t imageCount);
 	
+	// null for offscreen images
 	vk::UniqueSwapchainKHR swapchain;
 	std::vector<vk::Image> images;
 	std::vector<vk::UniqueImageView> imageViews;
 	vk::Extent2D extent;
 
+	// only used by offscreen images, images point to them
+	std::vector<UniqueVmaImage> offscreenImages;
+
+	// the layout the render passes leave the images in
+	vk::ImageLayout finalLayout = vk::ImageLayout::ePresentSrcKHR;
+
 	vk::SurfaceFormatKHR surfaceFormat;
 	vk::PresentModeKHR presentMode;
 };
@@ -0,0 +1,824 @@
+#include "pch.hpp"
+#include "TextureAtlasRenderer.hpp"
+#include <numeric>
+#include "common/VulkanUtils.hpp"
+#include "common/VulkanDebug.hpp"
+#include "GetSizeUint32.hpp"
+#include "Renderpass.hpp"
+#include "GraphicsPipeline.hpp"
+#include "PushConstants.hpp"
+#include "UniformBufferObjects.hpp"
+#include "MeshDataManager.hpp"
+#include "Scene.hpp"
+#include "PortalManager.hpp"
+#include "TriangleMesh.hpp"
+#include "PortalViewUtils.hpp"
+
+namespace
+{
+	// xy scale and zw offset from the screen position to the uv of the slot, the slot covers the screen bounds
+	glm::vec4 CalcAtlasTransform(const glm::vec4& screenBounds, const vk::Rect2D& slot, vk::Extent2D atlasExtent)
+	{
+		const glm::vec2 atlasSize(static_cast<float>(atlasExtent.width), static_cast<float>(atlasExtent.height));
+		const glm::vec2 slotOffset(static_cast<float>(slot.offset.x), static_cast<float>(slot.offset.y));
+		const glm::vec2 slotSize(static_cast<float>(slot.extent.width), static_cast<float>(slot.extent.height));
+
+		const glm::vec2 minBounds(screenBounds.x, screenBounds.y);
+		const glm::vec2 boundsSize = glm::vec2(screenBounds.z, screenBounds.w) - minBounds;
+
+		const glm::vec2 scale = slotSize / (boundsSize * atlasSize);
+		const glm::vec2 offset = slotOffset / atlasSize - minBounds * scale;
+
+		return glm::vec4(scale, offset);
+	}
+
+	vk::Extent2D CalcSlotExtent(const glm::vec2& sizePixels, float scale)
+	{
+		return vk::Extent2D(
+			std::max(1u, static_cast<uint32_t>(std::ceil(sizePixels.x * scale))),
+			std::max(1u, static_cast<uint32_t>(std::ceil(sizePixels.y * scale))));
+	}
+
+	glm::vec2 CalcSizePixels(const glm::vec4& screenBounds, vk::Extent2D extent)
+	{
+		const glm::vec2 boundsSize(screenBounds.z - screenBounds.x, screenBounds.w - screenBounds.y);
+		return boundsSize * 0.5f * glm::vec2(static_cast<float>(extent.width), static_cast<float>(extent.height));
+	}
+
+	// the same portal seen through the same portals gets the same key in every frame
+	uint64_t CalcChildPathKey(uint64_t parentKey, int portalIndex, PortalEndpointIndex endpoint)
+	{
+		const uint64_t step = static_cast<uint64_t>(portalIndex * PortalEndpointIndex::GetRange() + endpoint.ToIndex()) + 1;
+		return parentKey ^ (step + 0x9e3779b97f4a7c15ull + (parentKey << 6) + (parentKey >> 2));
+	}
+
+	bool ContainsBounds(const glm::vec4& outer, const glm::vec4& inner)
+	{
+		return outer.x <= inner.x && outer.y <= inner.y && outer.z >= inner.z && outer.w >= inner.w;
+	}
+
+	glm::vec4 ExpandBounds(const glm::vec4& screenBounds, float margin)
+	{
+		const glm::vec2 expansion = glm::vec2(screenBounds.z - screenBounds.x, screenBounds.w - screenBounds.y) * margin;
+		return glm::clamp(screenBounds + glm::vec4(-expansion, expansion), glm::vec4(-1.f), glm::vec4(1.f));
+	}
+
+	bool HasCameraMoved(const glm::mat4& cachedCameraMat, const glm::mat4& cameraMat, float maxTranslation, float maxAngleDegrees)
+	{
+		const float translation = glm::distance(glm::vec3(cachedCameraMat[3]), glm::vec3(cameraMat[3]));
+
+		// forward and up axis, so rolling is noticed as well
+		const float minCosAngle = std::cos(glm::radians(maxAngleDegrees));
+		const float cosAngleUp = glm::dot(glm::normalize(glm::vec3(cachedCameraMat[1])), glm::normalize(glm::vec3(cameraMat[1])));
+		const float cosAngleForward = glm::dot(glm::normalize(glm::vec3(cachedCameraMat[2])), glm::normalize(glm::vec3(cameraMat[2])));
+
+		return translation > maxTranslation || cosAngleUp < minCosAngle || cosAngleForward < minCosAngle;
+	}
+}
+
+std::optional<vk::Rect2D> TextureAtlasRenderer::ShelfPacker::Pack(vk::Extent2D size)
+{
+	if (m_shelfX + size.width > m_extent.width)
+	{
+		m_shelfY += m_shelfHeight;
+		m_shelfX = 0;
+		m_shelfHeight = 0;
+	}
+
+	if (size.width > m_extent.width || m_shelfY + size.height > m_extent.height)
+	{
+		return std::nullopt;
+	}
+
+	const vk::Rect2D rect(vk::Offset2D(m_shelfX, m_shelfY), size);
+
+	m_shelfX += size.width + m_padding;
+	m_shelfHeight = std::max(m_shelfHeight, size.height + m_padding);
+	m_usedExtent.width = std::max(m_usedExtent.width, std::min(m_shelfX, m_extent.width));
+	m_usedExtent.height = std::max(m_usedExtent.height, std::min(m_shelfY + m_shelfHeight, m_extent.height));
+
+	return rect;
+}
+
+TextureAtlasRenderer::TextureAtlasRenderer(const CreateInfo& createInfo)
+	: m_extent(createInfo.swapchainExtent)
+	, m_atlasExtent(createInfo.swapchainExtent)
+	, m_cachePacker(createInfo.swapchainExtent, slotPadding)
+{
+	const vk::Device device = createInfo.logicalDevice;
+
+	m_renderPass = Renderpass::SingleSubpass(device, createInfo.colorFormat, createInfo.colorFinalLayout, createInfo.depthFormat);
+	m_atlasRenderPass = Renderpass::TextureAtlas(device, createInfo.colorFormat, createInfo.depthFormat);
+	m_cacheRenderPass_load = Renderpass::TextureAtlas(device, createInfo.colorFormat, createInfo.depthFormat, vk::AttachmentLoadOp::eLoad);
+
+	// create Framebuffer
+	{
+		vk::FramebufferCreateInfo framebufferPrototype = vk::FramebufferCreateInfo{}
+			.setWidth(m_extent.width)
+			.setHeight(m_extent.height)
+			.setRenderPass(m_renderPass.get())
+			.setLayers(1);
+
+		for (const vk::UniqueImageView& imageView : createInfo.swapchainImageViews)
+		{
+			vk::ImageView fbAttachments[] = {
+				imageView.get(),
+				createInfo.depthView,
+			};
+			m_framebuffers.push_back(device.createFramebufferUnique(
+				vk::FramebufferCreateInfo{ framebufferPrototype }
+				.setAttachmentCount(GetSizeUint32(fbAttachments))
+				.setPAttachments(fbAttachments))
+			);
+		}
+	}
+
+	// create Atlas
+	{
+		VmaAllocationCreateInfo vmaAllocImage = {};
+		vmaAllocImage.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+		const vk::ImageCreateInfo atlasImageCreateInfo = vk::ImageCreateInfo{}
+			.setImageType(vk::ImageType::e2D)
+			.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled)
+			.setFormat(createInfo.colorFormat)
+			.setExtent(vk::Extent3D(m_atlasExtent.width, m_atlasExtent.height, 1))
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setArrayLayers(1)
+			.setMipLevels(1);
+
+		for (int i = 0; i < atlasCount; ++i)
+		{
+			m_atlasImages[i] = UniqueVmaImage(createInfo.allocator, atlasImageCreateInfo, vmaAllocImage);
+			VulkanDebug::SetObjectName(device, m_atlasImages[i].Get(), (std::string("texture atlas") + std::to_string(i)).c_str());
+
+			m_atlasImageViews[i] = device.createImageViewUnique(vk::ImageViewCreateInfo{}
+				.setViewType(vk::ImageViewType::e2D)
+				.setFormat(createInfo.colorFormat)
+				.setImage(m_atlasImages[i].Get())
+				.setSubresourceRange(vk::ImageSubresourceRange()
+					.setAspectMask(vk::ImageAspectFlagBits::eColor)
+					.setBaseMipLevel(0)
+					.setLevelCount(1)
+					.setBaseArrayLayer(0)
+					.setLayerCount(1)));
+		}
+
+		m_cacheImage = UniqueVmaImage(createInfo.allocator, atlasImageCreateInfo, vmaAllocImage);
+		VulkanDebug::SetObjectName(device, m_cacheImage.Get(), "impostor cache atlas");
+
+		m_cacheImageView = device.createImageViewUnique(vk::ImageViewCreateInfo{}
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(createInfo.colorFormat)
+			.setImage(m_cacheImage.Get())
+			.setSubresourceRange(vk::ImageSubresourceRange()
+				.setAspectMask(vk::ImageAspectFlagBits::eColor)
+				.setBaseMipLevel(0)
+				.setLevelCount(1)
+				.setBaseArrayLayer(0)
+				.setLayerCount(1)));
+
+		// the depth is not needed after a pass, so all atlases share it
+		m_atlasDepthImage = UniqueVmaImage(createInfo.allocator, vk::ImageCreateInfo{ atlasImageCreateInfo }
+			.setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment)
+			.setFormat(createInfo.depthFormat),
+			vmaAllocImage);
+		VulkanDebug::SetObjectName(device, m_atlasDepthImage.Get(), "texture atlas depth");
+
+		m_atlasDepthImageView = device.createImageViewUnique(vk::ImageViewCreateInfo{}
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(createInfo.depthFormat)
+			.setImage(m_atlasDepthImage.Get())
+			.setSubresourceRange(vk::ImageSubresourceRange()
+				.setAspectMask(VulkanUtils::GetDepthStencilAspectMask(createInfo.depthFormat))
+				.setBaseMipLevel(0)
+				.setLevelCount(1)
+				.setBaseArrayLayer(0)
+				.setLayerCount(1)));
+
+		for (int i = 0; i < atlasCount; ++i)
+		{
+			vk::ImageView fbAttachments[] = {
+				m_atlasImageViews[i].get(),
+				m_atlasDepthImageView.get(),
+			};
+
+			m_atlasFramebuffers[i] = device.createFramebufferUnique(vk::FramebufferCreateInfo{}
+				.setWidth(m_atlasExtent.width)
+				.setHeight(m_atlasExtent.height)
+				.setRenderPass(m_atlasRenderPass.get())
+				.setLayers(1)
+				.setAttachmentCount(GetSizeUint32(fbAttachments))
+				.setPAttachments(fbAttachments));
+		}
+
+		// the clear and the load pass are compatible, so the framebuffer can be used with both
+		{
+			vk::ImageView fbAttachments[] = {
+				m_cacheImageView.get(),
+				m_atlasDepthImageView.get(),
+			};
+
+			m_cacheFramebuffer = device.createFramebufferUnique(vk::FramebufferCreateInfo{}
+				.setWidth(m_atlasExtent.width)
+				.setHeight(m_atlasExtent.height)
+				.setRenderPass(m_atlasRenderPass.get())
+				.setLayers(1)
+				.setAttachmentCount(GetSizeUint32(fbAttachments))
+				.setPAttachments(fbAttachments));
+		}
+
+		m_atlasSampler = device.createSamplerUnique(vk::SamplerCreateInfo{}
+			.setMagFilter(vk::Filter::eLinear)
+			.setMinFilter(vk::Filter::eLinear)
+			.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+			.setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+			.setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+			.setUnnormalizedCoordinates(false)
+			.setCompareEnable(false)
+			.setMipmapMode(vk::SamplerMipmapMode::eNearest)
+			.setMinLod(0.f)
+			.setMaxLod(0.f));
+	}
+
+	m_vertShaderModule = VulkanUtils::CreateShaderModuleFromFile("recursive.vert.spv", device);
+	m_fragShaderModule = VulkanUtils::CreateShaderModuleFromFile("recursive_atlas.frag.spv", device);
+
+	// set 0 holds the texture and the scene objects, set 1 the atlas of the next depth or the impostor cache
+	{
+		vk::DescriptorSetLayoutBinding descriptorSetBindings[] = {
+			vk::DescriptorSetLayoutBinding{}
+				.setBinding(0)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+				.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+			vk::DescriptorSetLayoutBinding{}
+				.setBinding(1)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+				.setStageFlags(vk::ShaderStageFlagBits::eVertex),
+		};
+
+		m_descriptorSetLayout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{}
+			.setBindingCount(GetSizeUint32(descriptorSetBindings))
+			.setPBindings(descriptorSetBindings));
+
+		const vk::DescriptorSetLayoutBinding atlasBinding = vk::DescriptorSetLayoutBinding{}
+			.setBinding(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+		m_descriptorSetLayout_atlas = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{}
+			.setBindingCount(1)
+			.setPBindings(&atlasBinding));
+
+		vk::DescriptorPoolSize descriptorPoolSizes[] =
+		{
+			vk::DescriptorPoolSize{}
+				.setType(vk::DescriptorType::eCombinedImageSampler)
+				.setDescriptorCount(1 + atlasCount + 1),
+
+			vk::DescriptorPoolSize{}
+				.setType(vk::DescriptorType::eStorageBuffer)
+				.setDescriptorCount(1),
+		};
+
+		m_descriptorPool = device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{}
+			.setPoolSizeCount(GetSizeUint32(descriptorPoolSizes)).setPPoolSizes(descriptorPoolSizes)
+			.setMaxSets(1 + atlasCount + 1));
+
+		m_descriptorSet = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{}
+			.setDescriptorPool(m_descriptorPool.get())
+			.setDescriptorSetCount(1)
+			.setPSetLayouts(&(m_descriptorSetLayout.get())))[0];
+
+		const std::array<vk::DescriptorSetLayout, atlasCount> atlasSetLayouts = [this]()
+		{
+			std::array<vk::DescriptorSetLayout, atlasCount> atlasSetLayouts;
+			atlasSetLayouts.fill(m_descriptorSetLayout_atlas.get());
+			return atlasSetLayouts;
+		}();
+
+		const std::vector<vk::DescriptorSet> atlasSets = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{}
+			.setDescriptorPool(m_descriptorPool.get())
+			.setDescriptorSetCount(GetSizeUint32(atlasSetLayouts))
+			.setPSetLayouts(std::data(atlasSetLayouts)));
+		std::copy(std::begin(atlasSets), std::end(atlasSets), std::begin(m_descriptorSets_atlas));
+
+		m_descriptorSet_cache = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo{}
+			.setDescriptorPool(m_descriptorPool.get())
+			.setDescriptorSetCount(1)
+			.setPSetLayouts(&(m_descriptorSetLayout_atlas.get())))[0];
+
+		const vk::DescriptorImageInfo imageInfo = vk::DescriptorImageInfo{}
+			.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(createInfo.textureView)
+			.setSampler(createInfo.textureSampler);
+
+		std::array<vk::DescriptorImageInfo, atlasCount> atlasImageInfos;
+		for (int i = 0; i < atlasCount; ++i)
+		{
+			atlasImageInfos[i] = vk::DescriptorImageInfo{}
+				.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+				.setImageView(m_atlasImageViews[i].get())
+				.setSampler(m_atlasSampler.get());
+		}
+
+		const vk::DescriptorImageInfo cacheImageInfo = vk::DescriptorImageInfo{}
+			.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(m_cacheImageView.get())
+			.setSampler(m_atlasSampler.get());
+
+		std::vector<vk::WriteDescriptorSet> writeDescriptorSets = {
+			vk::WriteDescriptorSet{}
+				.setDstSet(m_descriptorSet)
+				.setDstBinding(0)
+				.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+				.setDstArrayElement(0)
+				.setDescriptorCount(1).setPImageInfo(&imageInfo),
+
+			vk::WriteDescriptorSet{}
+				.setDstSet(m_descriptorSet)
+				.setDstBinding(1)
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+				.setDstArrayElement(0)
+				.setDescriptorCount(1).setPBufferInfo(&createInfo.sceneObjects),
+		};
+
+		for (int i = 0; i < atlasCount; ++i)
+		{
+			writeDescriptorSets.push_back(vk::WriteDescriptorSet{}
+				.setDstSet(m_descriptorSets_atlas[i])
+				.setDstBinding(0)
+				.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+				.setDstArrayElement(0)
+				.setDescriptorCount(1).setPImageInfo(&atlasImageInfos[i]));
+		}
+
+		writeDescriptorSets.push_back(vk::WriteDescriptorSet{}
+			.setDstSet(m_descriptorSet_cache)
+			.setDstBinding(0)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setDstArrayElement(0)
+			.setDescriptorCount(1).setPImageInfo(&cacheImageInfo));
+
+		device.updateDescriptorSets(writeDescriptorSets, {});
+	}
+
+	// create Pipeline Layout
+	{
+		const vk::DescriptorSetLayout setLayouts[] = {
+			m_descriptorSetLayout.get(),
+			m_descriptorSetLayout_atlas.get(),
+		};
+
+		const vk::PushConstantRange pushConstantRange = vk::PushConstantRange{}
+			.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)
+			.setOffset(0)
+			.setSize(sizeof(PushConstant_recursive));
+
+		m_pipelineLayout = device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{}
+			.setSetLayoutCount(GetSizeUint32(setLayouts)).setPSetLayouts(setLayouts)
+			.setPushConstantRangeCount(1).setPPushConstantRanges(&pushConstantRange));
+	}
+
+	// create Graphic pipelines
+	{
+		const vk::PipelineShaderStageCreateInfo shaderStages[] =
+		{
+			vk::PipelineShaderStageCreateInfo{}
+				.setStage(vk::ShaderStageFlagBits::eVertex)
+				.setModule(m_vertShaderModule.get())
+				.setPName("main"),
+
+			vk::PipelineShaderStageCreateInfo{}
+				.setStage(vk::ShaderStageFlagBits::eFragment)
+				.setModule(m_fragShaderModule.get())
+				.setPName("main"),
+		};
+
+		GraphicsPipeline::TextureAtlasPipelineCreateInfo pipelineCreateInfo;
+		pipelineCreateInfo.logicalDevice = device;
+		pipelineCreateInfo.pipelineCache = createInfo.pipelineCache;
+		pipelineCreateInfo.pipelineLayout = m_pipelineLayout.get();
+		pipelineCreateInfo.pipelineShaderStageCreationInfos = shaderStages;
+
+		pipelineCreateInfo.renderpass = m_renderPass.get();
+		m_pipeline = GraphicsPipeline::CreateTextureAtlasPipeline(pipelineCreateInfo);
+
+		pipelineCreateInfo.renderpass = m_atlasRenderPass.get();
+		m_pipeline_atlas = GraphicsPipeline::CreateTextureAtlasPipeline(pipelineCreateInfo);
+	}
+}
+
+void TextureAtlasRenderer::Draw(const DrawInfo& drawInfo, const ImpostorCacheOptions& cacheOptions, gsl::span<const float> resolutionScales)
+{
+	assert(drawInfo.meshDataManager && drawInfo.scene && drawInfo.portalManager);
+
+	if (m_isCacheResetPending || cacheOptions.startDepth != m_cacheStartDepth)
+	{
+		ResetImpostorCache();
+		m_cacheStartDepth = cacheOptions.startDepth;
+	}
+
+	const std::vector<DepthViews> depthViews = CollectViews(drawInfo, cacheOptions, resolutionScales);
+
+	constexpr float inverseDepthBufferClearValue = 0.f;
+
+	const vk::ClearValue clearValues[] = {
+		drawInfo.clearColor,
+		vk::ClearDepthStencilValue(inverseDepthBufferClearValue, 0),
+	};
+
+	vk::CommandBuffer drawBuffer = drawInfo.drawBuffer;
+
+	// deepest views first, each depth samples the atlas the depth below it rendered into
+	for (int depth = gsl::narrow<int>(depthViews.size()) - 1; depth >= 0; --depth)
+	{
+		const bool isRootView = depth == 0;
+		const bool isCacheDepth = m_cacheStartDepth > 0 && depth == m_cacheStartDepth;
+		const bool isChildCacheDepth = m_cacheStartDepth > 0 && depth + 1 == m_cacheStartDepth;
+		const DepthViews* childViews = depth + 1 < gsl::narrow<int>(depthViews.size()) ? &depthViews[depth + 1] : nullptr;
+
+		vk::RenderPassBeginInfo renderPassBeginInfo = vk::RenderPassBeginInfo{}
+			.setRenderPass(isRootView ? m_renderPass.get() : m_atlasRenderPass.get())
+			.setFramebuffer(isRootView ? m_framebuffers[drawInfo.imageIndex].get() : m_atlasFramebuffers[depth % atlasCount].get())
+			.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), depthViews[depth].usedExtent))
+			.setClearValueCount(GetSizeUint32(clearValues)).setPClearValues(clearValues);
+
+		if (isCacheDepth)
+		{
+			const bool hasRefreshedViews = std::any_of(std::begin(depthViews[depth].views), std::end(depthViews[depth].views), [](const View& view)
+				{
+					return !view.isCached;
+				});
+
+			// all views are reused, the atlas stays as it is
+			if (!hasRefreshedViews)
+			{
+				continue;
+			}
+
+			renderPassBeginInfo
+				.setRenderPass(m_isCacheImageInitialized ? m_cacheRenderPass_load.get() : m_atlasRenderPass.get())
+				.setFramebuffer(m_cacheFramebuffer.get());
+
+			m_isCacheImageInitialized = true;
+		}
+
+		drawBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+
+		drawBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, isRootView ? m_pipeline.get() : m_pipeline_atlas.get());
+
+		const vk::DescriptorSet descriptorSets[] = {
+			m_descriptorSet,
+			isChildCacheDepth && childViews ? m_descriptorSet_cache : m_descriptorSets_atlas[(depth + 1) % atlasCount],
+		};
+		drawBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout.get(), 0, descriptorSets, {});
+
+		for (const View& view : depthViews[depth].views)
+		{
+			if (view.isCached)
+			{
+				continue;
+			}
+
+			// the load pass keeps the old content of the slot, what the scene does not cover has to be cleared
+			if (isCacheDepth)
+			{
+				drawBuffer.clearAttachments(
+					vk::ClearAttachment(vk::ImageAspectFlagBits::eColor, 0, drawInfo.clearColor),
+					vk::ClearRect(view.slot, 0, 1));
+			}
+
+			DrawView(drawInfo, view, depth, childViews);
+		}
+
+		drawBuffer.endRenderPass();
+	}
+}
+
+std::vector<TextureAtlasRenderer::DepthViews> TextureAtlasRenderer::CollectViews(const DrawInfo& drawInfo, const ImpostorCacheOptions& cacheOptions,
+	gsl::span<const float> resolutionScales)
+{
+	const PortalManager& portalManager = *drawInfo.portalManager;
+	gsl::span<const Portal> portals = portalManager.GetPortals();
+	const int maxDepth = gsl::narrow<int>(drawInfo.maxVisiblePortalsForRecursion.size());
+
+	std::vector<DepthViews> depthViews(1);
+	{
+		View rootView;
+		rootView.cameraMat = drawInfo.cameraMat;
+		rootView.viewMat = glm::inverse(drawInfo.cameraMat);
+		rootView.screenBounds = PortalViewUtils::fullScreenBounds;
+		rootView.clipPlane = PortalViewUtils::noClipPlane;
+		rootView.slot = vk::Rect2D(vk::Offset2D(0, 0), m_extent);
+
+		depthViews[0].views.push_back(std::move(rootView));
+		depthViews[0].usedExtent = m_extent;
+	}
+
+	for (int depth = 0; depth < gsl::narrow<int>(depthViews.size()); ++depth)
+	{
+		const int maxVisiblePortalCount = depth < maxDepth ? drawInfo.maxVisiblePortalsForRecursion[depth] : 0;
+		std::vector<SlotCandidate> candidates;
+
+		for (int viewIndex = 0; viewIndex < gsl::narrow<int>(depthViews[depth].views.size()); ++viewIndex)
+		{
+			View& view = depthViews[depth].views[viewIndex];
+			int visiblePortalCount = 0;
+
+			// the portals of a cached view are part of its cached image
+			if (view.isCached)
+			{
+				continue;
+			}
+
+			for (int portalIndex = 0; portalIndex < gsl::narrow<int>(portals.size()); ++portalIndex)
+			{
+				const Portal& portal = portals[portalIndex];
+
+				for (auto endPoint = PortalEndpointIndex::First(); endPoint <= PortalEndpointIndex::Last(); ++endPoint)
+				{
+					if (view.entryPortalIndex >= 0 && !portalManager.IsPotentiallyVisible(view.entryPortalIndex, PortalEndpointIndex(view.entryEndpoint),
+						glm::vec3(view.cameraMat[3]), portalIndex, endPoint))
+					{
+						continue;
+					}
+
+					View childView;
+					childView.cameraMat = portal.toOtherEndpoint[endPoint] * view.cameraMat;
+					childView.viewMat = glm::inverse(childView.cameraMat);
+					childView.pathKey = CalcChildPathKey(view.pathKey, portalIndex, endPoint);
+					childView.entryPortalIndex = portalIndex;
+					childView.entryEndpoint = static_cast<PortalEndpoint>(endPoint);
+
+					const Ssbo_CameraClipData clipData = portalManager.CalcChildClipData(drawInfo.projection, view.viewMat, view.screenBounds,
+						childView.viewMat, portalIndex, endPoint, drawInfo.triangleMeshes);
+
+					// outside of the view or the portals we are looking through
+					if (PortalViewUtils::IsEmpty(clipData.screenBounds))
+					{
+						continue;
+					}
+
+					const int portalDrawIndex = gsl::narrow<int>(view.portalDraws.size());
+					view.portalDraws.push_back(PortalDraw{ portalIndex, static_cast<PortalEndpoint>(endPoint), -1 });
+
+					const bool shouldRecurse = visiblePortalCount < maxVisiblePortalCount
+						&& PortalViewUtils::CalcCoveredPixels(clipData.screenBounds, m_extent) >= static_cast<float>(drawInfo.minPortalCoverage);
+
+					if (!shouldRecurse)
+					{
+						continue;
+					}
+
+					++visiblePortalCount;
+
+					childView.screenBounds = clipData.screenBounds;
+					childView.clipPlane = glm::transpose(childView.viewMat) * clipData.clipPlane;
+
+					const glm::vec2 sizePixels = CalcSizePixels(clipData.screenBounds, m_extent);
+					candidates.push_back(SlotCandidate{ viewIndex, portalDrawIndex, std::move(childView), sizePixels });
+				}
+			}
+		}
+
+		if (candidates.empty())
+		{
+			break;
+		}
+
+		const int childDepth = depth + 1;
+		const float resolutionScale = resolutionScales.empty()
+			? 1.f
+			: resolutionScales[std::min(childDepth, gsl::narrow<int>(resolutionScales.size())) - 1];
+
+		const bool isCacheDepth = cacheOptions.startDepth > 0 && childDepth == cacheOptions.startDepth;
+		DepthViews childViews = isCacheDepth
+			? AssignCacheSlots(candidates, depthViews[depth], cacheOptions, resolutionScale)
+			: AssignAtlasSlots(candidates, depthViews[depth], resolutionScale);
+
+		if (childViews.views.empty())
+		{
+			break;
+		}
+
+		depthViews.push_back(std::move(childViews));
+	}
+
+	return depthViews;
+}
+
+TextureAtlasRenderer::DepthViews TextureAtlasRenderer::AssignAtlasSlots(std::vector<SlotCandidate>& candidates, DepthViews& parentViews,
+	float resolutionScale) const
+{
+	// the slots keep the resolution of the depth, unless all of them together don't fit into the atlas
+	const float candidatePixels = std::accumulate(std::begin(candidates), std::end(candidates), 0.f, [](float sum, const SlotCandidate& candidate)
+		{
+			return sum + candidate.sizePixels.x * candidate.sizePixels.y;
+		});
+
+	const float atlasPixels = static_cast<float>(m_atlasExtent.width) * static_cast<float>(m_atlasExtent.height);
+	const float scale = std::min(resolutionScale, std::sqrt(atlasPixels * atlasFillFactor / candidatePixels));
+
+	// tall slots first, so the shelves waste less space
+	std::vector<int> packOrder(candidates.size());
+	std::iota(std::begin(packOrder), std::end(packOrder), 0);
+	std::sort(std::begin(packOrder), std::end(packOrder), [&candidates](int lhs, int rhs)
+		{
+			return candidates[lhs].sizePixels.y > candidates[rhs].sizePixels.y;
+		});
+
+	DepthViews childViews;
+	ShelfPacker packer(m_atlasExtent, slotPadding);
+
+	for (int candidateIndex : packOrder)
+	{
+		SlotCandidate& candidate = candidates[candidateIndex];
+
+		// portals without a slot are drawn flat
+		const std::optional<vk::Rect2D> slot = packer.Pack(CalcSlotExtent(candidate.sizePixels, scale));
+		if (!slot)
+		{
+			continue;
+		}
+
+		candidate.view.slot = *slot;
+		parentViews.views[candidate.parentViewIndex].portalDraws[candidate.portalDrawIndex].childViewIndex =
+			gsl::narrow<int>(childViews.views.size());
+		childViews.views.push_back(std::move(candidate.view));
+	}
+
+	childViews.usedExtent = packer.GetUsedExtent();
+	return childViews;
+}
+
+TextureAtlasRenderer::DepthViews TextureAtlasRenderer::AssignCacheSlots(std::vector<SlotCandidate>& candidates, DepthViews& parentViews,
+	const ImpostorCacheOptions& cacheOptions, float resolutionScale)
+{
+	DepthViews childViews;
+	int refreshCount = 0;
+
+	// candidates without a usable slot, they are packed after the others
+	std::vector<int> newSlotCandidates;
+
+	const auto addChildView = [&parentViews, &childViews](SlotCandidate& candidate)
+	{
+		parentViews.views[candidate.parentViewIndex].portalDraws[candidate.portalDrawIndex].childViewIndex =
+			gsl::narrow<int>(childViews.views.size());
+		childViews.views.push_back(std::move(candidate.view));
+	};
+
+	for (int candidateIndex = 0; candidateIndex < gsl::narrow<int>(candidates.size()); ++candidateIndex)
+	{
+		SlotCandidate& candidate = candidates[candidateIndex];
+
+		const auto entryIt = m_cacheEntries.find(candidate.view.pathKey);
+		if (entryIt == std::end(m_cacheEntries))
+		{
+			newSlotCandidates.push_back(candidateIndex);
+			continue;
+		}
+
+		CacheEntry& entry = entryIt->second;
+		const bool isCovered = ContainsBounds(entry.screenBounds, candidate.view.screenBounds);
+		const bool isStale = HasCameraMoved(entry.cameraMat, candidate.view.cameraMat, cacheOptions.maxTranslation, cacheOptions.maxAngleDegrees);
+
+		// reused as it is, the parent maps the cached screen bounds onto the portal
+		if (isCovered && (!isStale || refreshCount >= cacheOptions.maxRefreshesPerFrame))
+		{
+			candidate.view.screenBounds = entry.screenBounds;
+			candidate.view.slot = entry.slot;
+			candidate.view.isCached = true;
+			addChildView(candidate);
+			continue;
+		}
+
+		++refreshCount;
+
+		// the old slot is kept unless the portal became a lot larger
+		const glm::vec4 cacheBounds = ExpandBounds(candidate.view.screenBounds, cacheBoundsMargin);
+		const vk::Extent2D slotExtent = CalcSlotExtent(CalcSizePixels(cacheBounds, m_extent), resolutionScale);
+		if (slotExtent.width > entry.slot.extent.width * 2 || slotExtent.height > entry.slot.extent.height * 2)
+		{
+			m_cacheEntries.erase(entryIt);
+			newSlotCandidates.push_back(candidateIndex);
+			continue;
+		}
+
+		entry = CacheEntry{ candidate.view.cameraMat, cacheBounds, entry.slot };
+		candidate.view.screenBounds = cacheBounds;
+		candidate.view.slot = entry.slot;
+		addChildView(candidate);
+	}
+
+	// tall slots first, so the shelves waste less space
+	std::sort(std::begin(newSlotCandidates), std::end(newSlotCandidates), [&candidates](int lhs, int rhs)
+		{
+			return candidates[lhs].sizePixels.y > candidates[rhs].sizePixels.y;
+		});
+
+	for (int candidateIndex : newSlotCandidates)
+	{
+		SlotCandidate& candidate = candidates[candidateIndex];
+		const glm::vec4 cacheBounds = ExpandBounds(candidate.view.screenBounds, cacheBoundsMargin);
+
+		// the slots are never freed, a full atlas is emptied in the next frame and these portals are drawn flat until then
+		const std::optional<vk::Rect2D> slot = m_cachePacker.Pack(CalcSlotExtent(CalcSizePixels(cacheBounds, m_extent), resolutionScale));
+		if (!slot)
+		{
+			m_isCacheResetPending = true;
+			continue;
+		}
+
+		m_cacheEntries[candidate.view.pathKey] = CacheEntry{ candidate.view.cameraMat, cacheBounds, *slot };
+		candidate.view.screenBounds = cacheBounds;
+		candidate.view.slot = *slot;
+		addChildView(candidate);
+	}
+
+	childViews.usedExtent = m_cachePacker.GetUsedExtent();
+	return childViews;
+}
+
+void TextureAtlasRenderer::ResetImpostorCache()
+{
+	m_cacheEntries.clear();
+	m_cachePacker = ShelfPacker(m_atlasExtent, slotPadding);
+	m_isCacheImageInitialized = false;
+	m_isCacheResetPending = false;
+}
+
+void TextureAtlasRenderer::DrawView(const DrawInfo& drawInfo, const View& view, int depth, const DepthViews* childViews) const
+{
+	vk::CommandBuffer drawBuffer = drawInfo.drawBuffer;
+	MeshDataManager& meshDataManager = *drawInfo.meshDataManager;
+
+	const vk::ShaderStageFlags pushConstantStages = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment;
+
+	drawBuffer.setViewport(0, vk::Viewport(
+		static_cast<float>(view.slot.offset.x), static_cast<float>(view.slot.offset.y),
+		static_cast<float>(view.slot.extent.width), static_cast<float>(view.slot.extent.height),
+		0.f, 1.f));
+	drawBuffer.setScissor(0, view.slot);
+
+	const glm::mat4 viewProj = drawInfo.projection * view.viewMat;
+	const glm::vec4 crop = PortalViewUtils::CalcCrop(view.screenBounds);
+
+	// draw Scene
+	{
+		PushConstant_recursive pushConstant = {};
+		pushConstant.viewProj = viewProj;
+		pushConstant.clipPlane = view.clipPlane;
+		pushConstant.crop = crop;
+		pushConstant.drawMode = PushConstant_recursive::sceneObject;
+		drawBuffer.pushConstants<PushConstant_recursive>(m_pipelineLayout.get(), pushConstantStages, 0, pushConstant);
+
+		const std::array<glm::vec4, 6> cullPlanes = PortalViewUtils::CalcCullPlanes(viewProj, view.screenBounds, view.clipPlane);
+		const std::optional<Scene::LodSelectInfo> lodSelectInfo = drawInfo.useMeshLods
+			? std::make_optional(Scene::LodSelectInfo{ glm::vec3(view.cameraMat[3]), drawInfo.projection[1][1], depth })
+			: std::nullopt;
+		drawInfo.scene->DrawEachObject(meshDataManager, drawBuffer, cullPlanes, lodSelectInfo);
+
+		// the camera can only be seen through portals
+		if (depth > 0)
+		{
+			const MeshDataRef& cameraMeshRef = meshDataManager.GetMeshes()[meshDataManager.GetMeshes().size() - 1];
+
+			PushConstant_recursive cameraPushConstant =
+				PortalViewUtils::CreateMeshPushConstant(viewProj, view.clipPlane, drawInfo.cameraMat, PushConstant_recursive::premultipliedMesh);
+			cameraPushConstant.crop = crop;
+
+			drawBuffer.pushConstants<PushConstant_recursive>(m_pipelineLayout.get(), pushConstantStages, 0, cameraPushConstant);
+			drawBuffer.drawIndexed(cameraMeshRef.indexCount, 1, cameraMeshRef.firstIndex, 0, 0);
+		}
+	}
+
+	// draw Portals
+	gsl::span<const Portal> portals = drawInfo.portalManager->GetPortals();
+
+	for (const PortalDraw& portalDraw : view.portalDraws)
+	{
+		const Portal& portal = portals[portalDraw.portalIndex];
+		const MeshDataRef& portalMeshRef = meshDataManager.GetMeshes()[portal.meshIndex];
+		const bool isAtlasPortal = portalDraw.childViewIndex >= 0;
+
+		PushConstant_recursive pushConstant = PortalViewUtils::CreateMeshPushConstant(viewProj, view.clipPlane,
+			portal.transform[PortalEndpointIndex(portalDraw.endpoint)],
+			isAtlasPortal ? PushConstant_recursive::atlasPortal : PushConstant_recursive::flatPortal);
+		pushConstant.crop = crop;
+
+		if (isAtlasPortal)
+		{
+			assert(childViews);
+			const View& childView = childViews->views[portalDraw.childViewIndex];
+			pushConstant.atlasTransform = CalcAtlasTransform(childView.screenBounds, childView.slot, m_atlasExtent);
+		}
+
+		drawBuffer.pushConstants<PushConstant_recursive>(m_pipelineLayout.get(), pushConstantStages, 0, pushConstant);
+		drawBuffer.drawIndexed(portalMeshRef.indexCount, 1, portalMeshRef.firstIndex, 0, 0);
+	}
+}
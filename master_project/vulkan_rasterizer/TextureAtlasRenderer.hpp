@@ -0,0 +1,196 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <gsl/gsl>
+#include <optional>
+#include <unordered_map>
+#include "glm.hpp"
+#include "Portal.hpp"
+#include "UniqueVmaObject.hpp"
+#include "RecursiveStencilRenderer.hpp"
+
+// render to texture portal renderer, the view behind each visible portal is rendered into a slot of a texture atlas
+// and sampled when the portal is drawn in the parent view
+// the slots are sized by the screen bounds of the views, so deep recursion is only as expensive as the pixels it covers
+// views of the same recursion depth share one atlas, two atlases are used alternately, so a view never samples the atlas it renders into
+class TextureAtlasRenderer
+{
+public:
+	// the views of one recursion depth are kept in a persistent atlas and reused while their camera barely moves
+	// each view is identified by the portals it is seen through, stale views are refreshed over several frames
+	struct ImpostorCacheOptions
+	{
+		// recursion depth of the cached views, 0 disables the cache
+		int startDepth = 0;
+
+		// how far the camera of a cached view may move before it is stale, in world units and degrees
+		float maxTranslation = 0.05f;
+		float maxAngleDegrees = 1.f;
+
+		// stale views which still cover their portal are refreshed later, views without a usable entry are always rendered
+		int maxRefreshesPerFrame = 2;
+	};
+
+	struct CreateInfo
+	{
+		vk::Device logicalDevice;
+		vk::PipelineCache pipelineCache;
+		VmaAllocator allocator;
+		vk::Extent2D swapchainExtent;
+		vk::Format colorFormat;
+		vk::ImageLayout colorFinalLayout;
+		gsl::span<const vk::UniqueImageView> swapchainImageViews;
+
+		vk::Format depthFormat;
+		vk::ImageView depthView;
+
+		vk::ImageView textureView;
+		vk::Sampler textureSampler;
+		vk::DescriptorBufferInfo sceneObjects;
+	};
+
+	// the portal views are found the same way as by the depth first renderer
+	using DrawInfo = RecursiveStencilRenderer::DrawInfo;
+
+	explicit TextureAtlasRenderer(const CreateInfo& createInfo);
+
+	// records the atlas passes of all recursion depths, followed by the render pass of the root view
+	// resolutionScales[i] scales the slots of recursion depth i + 1, deeper depths use the last one, the slots are upsampled by the parent
+	void Draw(const DrawInfo& drawInfo, const ImpostorCacheOptions& cacheOptions, gsl::span<const float> resolutionScales);
+
+private:
+	static constexpr int atlasCount = 2;
+
+	// cached views are rendered a bit larger than their portal, so they stay usable while the camera moves
+	static constexpr float cacheBoundsMargin = 0.1f;
+
+	// shelf packing leaves gaps, so the slots of a depth are scaled down to fill only part of the atlas
+	static constexpr float atlasFillFactor = 0.7f;
+
+	// keeps linear filtering from reading the neighbouring slot
+	static constexpr uint32_t slotPadding = 1;
+
+	struct PortalDraw
+	{
+		int portalIndex;
+		PortalEndpoint endpoint;
+
+		// index of the view in the next depth, -1 if the portal is drawn flat
+		int childViewIndex;
+	};
+
+	struct View
+	{
+		glm::mat4 cameraMat;
+		glm::mat4 viewMat;
+
+		// see Ssbo_CameraClipData, the clip plane is in world space
+		glm::vec4 screenBounds;
+		glm::vec4 clipPlane;
+
+		// the root view covers the whole swapchain image
+		vk::Rect2D slot;
+
+		std::vector<PortalDraw> portalDraws;
+
+		// hash of the portals the view is seen through, the root view has 0
+		uint64_t pathKey = 0;
+
+		// portal the view looks through, -1 for the root view
+		int entryPortalIndex = -1;
+		PortalEndpoint entryEndpoint = PortalEndpoint::A;
+
+		// the view is sampled from the impostor cache as it is, it is not drawn and has no portal draws
+		bool isCached = false;
+	};
+
+	struct DepthViews
+	{
+		std::vector<View> views;
+
+		// part of the atlas covered by the slots of the depth
+		vk::Extent2D usedExtent;
+	};
+
+	// views which get a slot if they fit into the atlas
+	struct SlotCandidate
+	{
+		int parentViewIndex;
+		int portalDrawIndex;
+		View view;
+		glm::vec2 sizePixels;
+	};
+
+	// fills the atlas row by row, each row is as high as its tallest slot
+	class ShelfPacker
+	{
+	public:
+		ShelfPacker(vk::Extent2D extent, uint32_t padding) : m_extent(extent), m_padding(padding) {}
+
+		std::optional<vk::Rect2D> Pack(vk::Extent2D size);
+		vk::Extent2D GetUsedExtent() const { return m_usedExtent; }
+
+	private:
+		vk::Extent2D m_extent;
+		uint32_t m_padding;
+
+		uint32_t m_shelfX = 0;
+		uint32_t m_shelfY = 0;
+		uint32_t m_shelfHeight = 0;
+		vk::Extent2D m_usedExtent;
+	};
+
+	struct CacheEntry
+	{
+		// camera and screen bounds the view was rendered with
+		glm::mat4 cameraMat;
+		glm::vec4 screenBounds;
+		vk::Rect2D slot;
+	};
+
+	std::vector<DepthViews> CollectViews(const DrawInfo& drawInfo, const ImpostorCacheOptions& cacheOptions, gsl::span<const float> resolutionScales);
+	DepthViews AssignAtlasSlots(std::vector<SlotCandidate>& candidates, DepthViews& parentViews, float resolutionScale) const;
+	DepthViews AssignCacheSlots(std::vector<SlotCandidate>& candidates, DepthViews& parentViews, const ImpostorCacheOptions& cacheOptions,
+		float resolutionScale);
+	void ResetImpostorCache();
+
+	void DrawView(const DrawInfo& drawInfo, const View& view, int depth, const DepthViews* childViews) const;
+
+	vk::Extent2D m_extent;
+	vk::Extent2D m_atlasExtent;
+
+	vk::UniqueRenderPass m_renderPass;
+	std::vector<vk::UniqueFramebuffer> m_framebuffers;
+
+	vk::UniqueRenderPass m_atlasRenderPass;
+	std::array<UniqueVmaImage, atlasCount> m_atlasImages;
+	std::array<vk::UniqueImageView, atlasCount> m_atlasImageViews;
+	UniqueVmaImage m_atlasDepthImage;
+	vk::UniqueImageView m_atlasDepthImageView;
+	std::array<vk::UniqueFramebuffer, atlasCount> m_atlasFramebuffers;
+	vk::UniqueSampler m_atlasSampler;
+
+	// the cache atlas shares the depth of the other atlases, the load pass keeps the slots which are not refreshed
+	vk::UniqueRenderPass m_cacheRenderPass_load;
+	UniqueVmaImage m_cacheImage;
+	vk::UniqueImageView m_cacheImageView;
+	vk::UniqueFramebuffer m_cacheFramebuffer;
+	std::unordered_map<uint64_t, CacheEntry> m_cacheEntries;
+	ShelfPacker m_cachePacker;
+	int m_cacheStartDepth = 0;
+	bool m_isCacheImageInitialized = false;
+	bool m_isCacheResetPending = false;
+
+	vk::UniqueShaderModule m_vertShaderModule;
+	vk::UniqueShaderModule m_fragShaderModule;
+
+	vk::UniqueDescriptorSetLayout m_descriptorSetLayout;
+	vk::UniqueDescriptorSetLayout m_descriptorSetLayout_atlas;
+	vk::UniqueDescriptorPool m_descriptorPool;
+	vk::DescriptorSet m_descriptorSet;
+	std::array<vk::DescriptorSet, atlasCount> m_descriptorSets_atlas;
+	vk::DescriptorSet m_descriptorSet_cache;
+
+	vk::UniquePipelineLayout m_pipelineLayout;
+	vk::UniquePipeline m_pipeline;
+	vk::UniquePipeline m_pipeline_atlas;
+};
@@ -5,4 +5,48 @@
 struct Ubo_GlobalRenderData
 {
 	alignas(16) glm::mat4 proj;
+
+	// model of the camera mesh drawn in the recursion layers, see PushConstant_sceneObject
+	glm::mat4 mainCameraMat;
+};
+
+// layout of a single element of the scene object storage buffer (std430)
+struct Ssbo_SceneObject
+{
+	alignas(16) glm::mat4 model;
+	glm::mat4 normalMat;
+	glm::vec4 debugColor;
+
+	// xyz world space center, w radius, used by the culling
+	glm::vec4 boundingSphere;
+
+	// index ranges of the lods (MeshDataRef::maxLodCount), the culling copies one of them into the draw commands
+	uint32_t lodFirstIndex[4];
+	uint32_t lodIndexCount[4];
+};
+static_assert(sizeof(Ssbo_SceneObject) % 16 == 0, "std430 array stride of the struct is a multiple of 16");
+
+// clipping of a camera of the NTree to the portals it is looking through (std430)
+struct Ssbo_CameraClipData
+{
+	// screen bounds of the portal chain in normalized device coordinates, xy min, zw max
+	// min > max if the portal chain is not visible at all
+	alignas(16) glm::vec4 screenBounds;
+
+	// view space plane of the destination portal, everything in front of it (negative distance) is clipped
+	glm::vec4 clipPlane;
+};
+
+// header of the heatmap buffer (std430), followed by two counters per pixel: the shaded fragments and the deepest layer + 1
+struct Ssbo_HeatmapHeader
+{
+	// see HeatmapMode, the shaders only count while it is not Off
+	uint32_t mode;
+	uint32_t width;
+	uint32_t layerCount;
+	uint32_t padding;
+
+	// first stencil value of each layer after the first, the shaders find the layer of a stencil value with it
+	int32_t layerStartIndices[8];
 };
+static_assert(sizeof(Ssbo_HeatmapHeader) % 16 == 0, "the pixels start at a multiple of 16");
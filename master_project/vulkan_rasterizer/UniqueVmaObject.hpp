@@ -23,9 +23,9 @@ public:
 
 	~UniqueVmaObject();
 
-	Type Get() { return m_object; }
-	VmaAllocator GetAllocator() { return m_allocator; }
-	VmaAllocation GetAllocation() { return m_allocation; }
+	Type Get() const { return m_object; }
+	VmaAllocator GetAllocator() const { return m_allocator; }
+	VmaAllocation GetAllocation() const { return m_allocation; }
 private:
 
 	Type m_object;
@@ -0,0 +1,119 @@
+#include "pch.hpp"
+#include "UploadRingBuffer.hpp"
+#include "common/VulkanUtils.hpp"
+
+namespace
+{
+	constexpr vk::BufferUsageFlags uploadBufferUsage =
+		vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc;
+}
+
+UploadRingBuffer::UploadRingBuffer(VmaAllocator allocator, const vk::PhysicalDeviceLimits& limits, int frameCount,
+	gsl::span<const vk::DeviceSize> frameRegionSizes, vk::DeviceSize stagingSize, gsl::span<const uint32_t> queueFamilies)
+{
+	// the alignments are powers of two, so the largest one satisfies all of them
+	m_alignment = std::max({
+		limits.minUniformBufferOffsetAlignment,
+		limits.minStorageBufferOffsetAlignment,
+		limits.optimalBufferCopyOffsetAlignment,
+		vk::DeviceSize(16) });
+
+	vk::DeviceSize partitionSize = 0;
+	for (vk::DeviceSize regionSize : frameRegionSizes)
+	{
+		m_frameRegionOffsets.push_back(partitionSize);
+		m_frameRegionSizes.push_back(regionSize);
+		partitionSize += VulkanUtils::AlignUp(regionSize, m_alignment);
+	}
+	m_partitionSize = partitionSize;
+
+	m_stagingBegin = m_partitionSize * frameCount;
+	m_stagingEnd = m_stagingBegin + VulkanUtils::AlignUp(stagingSize, m_alignment);
+	m_stagingHead = m_stagingBegin;
+	m_stagingTail = m_stagingBegin;
+
+	// mapped for its whole lifetime, coherent so the writes need no flush
+	VmaAllocationCreateInfo allocCreateInfo = {};
+	allocCreateInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
+	allocCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	allocCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	const bool isShared = queueFamilies.size() > 1;
+	m_buffer = UniqueVmaBuffer(allocator, vk::BufferCreateInfo{}
+		.setSize(std::max<vk::DeviceSize>(m_stagingEnd, 1))
+		.setUsage(uploadBufferUsage)
+		.setSharingMode(isShared ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive)
+		.setQueueFamilyIndexCount(isShared ? static_cast<uint32_t>(queueFamilies.size()) : 0)
+		.setPQueueFamilyIndices(isShared ? queueFamilies.data() : nullptr),
+		allocCreateInfo);
+
+	VmaAllocationInfo allocationInfo;
+	vmaGetAllocationInfo(m_buffer.GetAllocator(), m_buffer.GetAllocation(), &allocationInfo);
+	m_mappedMemory = static_cast<std::byte*>(allocationInfo.pMappedData);
+}
+
+UploadRingBuffer::Allocation UploadRingBuffer::GetFrameRegion(int regionIndex, int frameIndex) const
+{
+	const vk::DeviceSize offset = m_partitionSize * frameIndex + m_frameRegionOffsets[regionIndex];
+
+	Allocation allocation;
+	allocation.buffer = m_buffer.Get();
+	allocation.offset = offset;
+	allocation.size = m_frameRegionSizes[regionIndex];
+	allocation.mappedMemory = m_mappedMemory + offset;
+	return allocation;
+}
+
+std::optional<UploadRingBuffer::Allocation> UploadRingBuffer::AllocateStaging(vk::DeviceSize size)
+{
+	const vk::DeviceSize alignedSize = VulkanUtils::AlignUp(std::max<vk::DeviceSize>(size, 1), m_alignment);
+
+	if (m_stagingAllocationCount == 0)
+	{
+		m_stagingHead = m_stagingBegin;
+		m_stagingTail = m_stagingBegin;
+	}
+
+	// the free space is behind the head up to the end and in front of the tail, or between head and tail once the head wrapped around
+	std::optional<vk::DeviceSize> offset;
+	if (m_stagingAllocationCount == 0 || m_stagingHead > m_stagingTail)
+	{
+		if (m_stagingHead + alignedSize <= m_stagingEnd)
+		{
+			offset = m_stagingHead;
+		}
+		else if (m_stagingBegin + alignedSize <= m_stagingTail)
+		{
+			// the rest behind the head stays unused until the tail wraps around as well
+			offset = m_stagingBegin;
+		}
+	}
+	else if (m_stagingHead + alignedSize <= m_stagingTail)
+	{
+		offset = m_stagingHead;
+	}
+
+	if (!offset)
+	{
+		return std::nullopt;
+	}
+
+	m_stagingHead = *offset + alignedSize;
+	++m_stagingAllocationCount;
+
+	Allocation allocation;
+	allocation.buffer = m_buffer.Get();
+	allocation.offset = *offset;
+	allocation.size = size;
+	allocation.mappedMemory = m_mappedMemory + *offset;
+	return allocation;
+}
+
+void UploadRingBuffer::ReleaseStaging(const Allocation& allocation)
+{
+	assert(m_stagingAllocationCount > 0);
+	assert(allocation.buffer == m_buffer.Get());
+
+	m_stagingTail = allocation.offset + VulkanUtils::AlignUp(std::max<vk::DeviceSize>(allocation.size, 1), m_alignment);
+	--m_stagingAllocationCount;
+}
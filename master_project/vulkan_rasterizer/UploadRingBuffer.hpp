@@ -0,0 +1,59 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <gsl/gsl>
+#include <optional>
+#include <vector>
+#include "UniqueVmaObject.hpp"
+
+// a persistently mapped, host coherent buffer with a partition for each frame in flight and a staging ring behind them
+// each partition holds the frame regions, which are at the same place each frame, so descriptor sets which are written once can use them.
+// the staging ring is handed out by AllocateStaging and released in the same order, so an upload queue can free it when each upload finishes
+// nothing is mapped, created or destroyed for the uploads
+class UploadRingBuffer
+{
+public:
+	struct Allocation
+	{
+		vk::Buffer buffer;
+		vk::DeviceSize offset = 0;
+		vk::DeviceSize size = 0;
+		std::byte* mappedMemory = nullptr;
+
+		vk::DescriptorBufferInfo GetDescriptorBufferInfo() const { return vk::DescriptorBufferInfo(buffer, offset, size); }
+	};
+
+	UploadRingBuffer() = default;
+
+	// frameRegionSizes are the sizes of the regions of each partition, see GetFrameRegion
+	// the buffer can be used as uniform, storage and transfer source buffer
+	// with more than one queue family it is shared concurrently, as the staging is read by the transfer queue
+	UploadRingBuffer(VmaAllocator allocator, const vk::PhysicalDeviceLimits& limits, int frameCount,
+		gsl::span<const vk::DeviceSize> frameRegionSizes, vk::DeviceSize stagingSize, gsl::span<const uint32_t> queueFamilies);
+
+	// regionIndex is the index of its size in frameRegionSizes
+	Allocation GetFrameRegion(int regionIndex, int frameIndex) const;
+
+	// aligned for any use of the buffer, nullopt if the free part of the ring is too small
+	// the allocation stays valid until ReleaseStaging is called for it
+	std::optional<Allocation> AllocateStaging(vk::DeviceSize size);
+
+	// must be called in the order of the AllocateStaging calls
+	void ReleaseStaging(const Allocation& allocation);
+
+private:
+	UniqueVmaBuffer m_buffer;
+	std::byte* m_mappedMemory = nullptr;
+	vk::DeviceSize m_alignment = 1;
+	vk::DeviceSize m_partitionSize = 0;
+
+	// relative to the start of a partition
+	std::vector<vk::DeviceSize> m_frameRegionOffsets;
+	std::vector<vk::DeviceSize> m_frameRegionSizes;
+
+	// relative to the start of the buffer, the ring is full if head and tail are the same with allocations in use
+	vk::DeviceSize m_stagingBegin = 0;
+	vk::DeviceSize m_stagingEnd = 0;
+	vk::DeviceSize m_stagingHead = 0;
+	vk::DeviceSize m_stagingTail = 0;
+	int m_stagingAllocationCount = 0;
+};
@@ -4,15 +4,79 @@
 #include "pch.hpp"
 
 #include "Application_rasterizer.hpp"
+#include "Profiler.hpp"
 
 
-int main(int /*argc*/, char* /*argv*/[])
+int main(int argc, char* argv[])
 {
-	SDL_Init(SDL_INIT_EVERYTHING);
+	// --depth-first selects the stencil recursion renderer and --texture-atlas the render to texture one, instead of the breadth first one
+	// --headless renders --frames <count> frames without a window, --write-frames <prefix> writes them as png
+	// --benchmark <prefix> measures each recursion config along --camera-path <file> (default: the level cameras)
+	// with --warmup-frames <count> and --benchmark-frames <count> frames per config
+	// --trace <file> writes the profiler zones as chrome trace when the application quits
+	// --target-fps <rate> is the frame rate the adaptive recursion aims for (default: the refresh rate of the display)
+	ApplicationOptions options;
+	std::string traceFile;
+	for (int i = 1; i < argc; ++i)
 	{
-		Application_Rasterizer app{};
+		const bool hasValue = i + 1 < argc;
+		if (std::strcmp(argv[i], "--depth-first") == 0)
+		{
+			options.rendererType = RendererType::DepthFirstStencil;
+		}
+		else if (std::strcmp(argv[i], "--texture-atlas") == 0)
+		{
+			options.rendererType = RendererType::TextureAtlas;
+		}
+		else if (std::strcmp(argv[i], "--headless") == 0)
+		{
+			options.isHeadless = true;
+		}
+		else if (std::strcmp(argv[i], "--frames") == 0 && hasValue)
+		{
+			options.headlessFrameCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--write-frames") == 0 && hasValue)
+		{
+			options.frameOutputPrefix = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--benchmark") == 0 && hasValue)
+		{
+			options.benchmarkOutputPrefix = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--camera-path") == 0 && hasValue)
+		{
+			options.cameraPathFile = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--warmup-frames") == 0 && hasValue)
+		{
+			options.benchmarkSettings.warmupFrameCount = std::max(std::atoi(argv[++i]), 0);
+		}
+		else if (std::strcmp(argv[i], "--benchmark-frames") == 0 && hasValue)
+		{
+			options.benchmarkSettings.measuredFrameCount = std::max(std::atoi(argv[++i]), 1);
+		}
+		else if (std::strcmp(argv[i], "--trace") == 0 && hasValue)
+		{
+			traceFile = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--target-fps") == 0 && hasValue)
+		{
+			options.targetFrameRate = std::max(std::atof(argv[++i]), 0.0);
+		}
+	}
+
+	// the video subsystem needs a display, headless runs only use sdl for its main
+	SDL_Init(options.isHeadless ? 0 : SDL_INIT_EVERYTHING);
+	{
+		Application_Rasterizer app{ options };
 		while (app.Update());
 	}
+
+	if (!traceFile.empty() && !Profiler::WriteChromeTrace(traceFile))
+	{
+		std::printf("could not write the profiler trace to %s \n", traceFile.c_str());
+	}
 	SDL_Quit();
 		
 
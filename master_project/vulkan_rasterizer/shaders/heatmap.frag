@@ -0,0 +1,50 @@
+#version 450
+
+// shows the counters of the scene and portal shaders, see HeatmapPass
+
+layout(location = 0) out vec4 outColor;
+
+// see Ssbo_HeatmapHeader
+layout(set = 0, binding = 0) readonly buffer Heatmap {
+	uint mode;
+	uint width;
+	uint layerCount;
+	uint padding;
+	int layerStartIndices[8];
+	uint pixels[];
+} hm;
+
+// see HeatmapMode
+const uint mode_overdraw = 1;
+
+// shaded fragments of a pixel which are shown in the hottest color
+const float maxOverdraw = 16.0;
+
+// blue over green to red
+vec3 HeatColor(float t)
+{
+	return clamp(vec3(1.5) - abs(vec3(4.0 * t) - vec3(3.0, 2.0, 1.0)), 0.0, 1.0);
+}
+
+void main()
+{
+	uint pixelIndex = uint(gl_FragCoord.y) * hm.width + uint(gl_FragCoord.x);
+
+	if(hm.mode == mode_overdraw)
+	{
+		uint shadedCount = hm.pixels[pixelIndex * 2];
+		outColor = shadedCount == 0 ? vec4(0.0, 0.0, 0.0, 1.0) : vec4(HeatColor(min(shadedCount / maxOverdraw, 1.0)), 1.0);
+		return;
+	}
+
+	// no scene object was drawn into the pixel, so it only shows the clear color
+	uint layerPlusOne = hm.pixels[pixelIndex * 2 + 1];
+	if(layerPlusOne == 0)
+	{
+		outColor = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+
+	float t = hm.layerCount > 1 ? float(layerPlusOne - 1) / float(hm.layerCount - 1) : 0.0;
+	outColor = vec4(HeatColor(t), 1.0);
+}
@@ -1,5 +1,9 @@
 #version 450
 
+#ifdef STENCIL_EXPORT
+#extension GL_ARB_shader_stencil_export : require
+#endif
+
 layout(location = 0) in flat int inInstanceIndex;
 
 layout(location = 0) out float outRenderedDepth;
@@ -10,8 +14,42 @@ layout(location = 2) out uint outRenderedStencil;
 #ifdef SUBSEQUENT_PASS
 layout (input_attachment_index = 0, set = 3, binding = 0) uniform subpassInput inputDepth;
 layout (input_attachment_index = 1, set = 3, binding = 1) uniform usubpassInput inputStencil;
+
+// fragments discarded by the tests against the rendered stencil and depth, see DrawOptions::collectLayerStatistics
+// four counters per stencil value: scene stencil, scene depth, portal stencil and portal depth
+layout(set = 7, binding = 7) buffer DiscardCounters {
+	uint isEnabled;
+	uint counts[];
+} dcnt;
+
+void CountDiscard(int stencilValue, int counterIndex)
+{
+	if(dcnt.isEnabled != 0)
+	{
+		atomicAdd(dcnt.counts[stencilValue * 4 + counterIndex], 1);
+	}
+}
 #endif
 
+// see DrawOptions::heatmap and Ssbo_HeatmapHeader, two counters per pixel: the shaded fragments and the deepest layer + 1
+layout(set = 7, binding = 8) buffer Heatmap {
+	uint mode;
+	uint width;
+	uint layerCount;
+	uint padding;
+	int layerStartIndices[8];
+	uint pixels[];
+} hm;
+
+void CountShadedFragment()
+{
+	if(hm.mode != 0)
+	{
+		uint pixelIndex = uint(gl_FragCoord.y) * hm.width + uint(gl_FragCoord.x);
+		atomicAdd(hm.pixels[pixelIndex * 2], 1);
+	}
+}
+
 layout(set = 2, binding = 0) uniform ubo_cameraMats
 {
 	mat4 mats[];
@@ -25,6 +63,47 @@ layout(set = 4, binding = 0) buffer CameraIndices {
     int cIndices[];
 } ci;
 
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout(set = 7, binding = 0) buffer DrawCommands {
+	DrawCommand commands[];
+} dc;
+
+layout(set = 7, binding = 1) buffer InstanceLists {
+	int instances[];
+} il;
+
+layout(set = 7, binding = 2) readonly buffer ObjectVisibility {
+	uint bits[];
+} ov;
+
+// see PortalManager::CreateCameraClipData
+struct CameraClipData
+{
+	vec4 screenBounds;
+	vec4 clipPlane;
+};
+
+layout(set = 7, binding = 3) readonly buffer CameraClipDatas {
+	CameraClipData cameras[];
+} ccd;
+
+// covered pixels of each camera of the NTree, counted this frame and the counts of the previous frame
+layout(set = 7, binding = 4) buffer PortalCoverage {
+	uint counts[];
+} cov;
+
+layout(set = 7, binding = 5) readonly buffer PreviousPortalCoverage {
+	uint counts[];
+} prevCov;
+
 layout(push_constant) uniform PushConstant {
 	mat4 model;
 	vec4 debugColor;
@@ -33,16 +112,73 @@ layout(push_constant) uniform PushConstant {
 	int portalIndex;
 	int maxVisiblePortalCount;
 	int currentPortalCount;
+	int objectCount;
+	int nextDrawCommandSetIndex;
+	int nextLayerInstanceCount;
+	int minPortalCoverage;
+	int isNextLayerHardwareStencil;
 } pc;
 
+// counts the fragment and checks if the portal was too small last frame to be worth a camera
+// the coverage of the current frame is only known after the pass, so we use the previous one
+bool UpdateCoverage(int cameraIndex)
+{
+	// counting stops at the threshold, so big portals don't fight for the same counter
+	if(cov.counts[cameraIndex] < uint(pc.minPortalCoverage))
+	{
+		atomicAdd(cov.counts[cameraIndex], 1);
+	}
+
+	// zero means the portal was not visible last frame, so we don't know and spawn the camera
+	uint previousCoverage = prevCov.counts[cameraIndex];
+	return previousCoverage != 0 && previousCoverage < uint(pc.minPortalCoverage);
+}
+
+// appends the objects which were not culled for the camera to the draw commands of the next layer
+// hardware stencil layers have a draw command set per camera, it draws each object once or not at all
+void AppendVisibleObjects(int cameraIndex, int nextLayerInstanceIndex)
+{
+	int wordCount = (pc.objectCount + 31) / 32;
+	int firstCommandIndex = pc.nextDrawCommandSetIndex * pc.objectCount;
+	int instanceListOffset = pc.objectCount * pc.nextLayerStartIndex;
+	bool isDrawCommandSetPerCamera = pc.isNextLayerHardwareStencil != 0;
+
+	for(int wordIndex = 0; wordIndex < wordCount; ++wordIndex)
+	{
+		uint visibilityBits = ov.bits[cameraIndex * wordCount + wordIndex];
+		while(visibilityBits != 0)
+		{
+			int bitIndex = findLSB(visibilityBits);
+			visibilityBits &= visibilityBits - 1;
+
+			int objectIndex = wordIndex * 32 + bitIndex;
+			int instanceListIndex = instanceListOffset + objectIndex * pc.nextLayerInstanceCount;
+			if(isDrawCommandSetPerCamera)
+			{
+				// the set of the camera follows the first set of the layer, firstInstance was set by the culling
+				int commandIndex = (pc.nextDrawCommandSetIndex + 1 + nextLayerInstanceIndex) * pc.objectCount + objectIndex;
+				dc.commands[commandIndex].instanceCount = 1;
+				il.instances[instanceListIndex + nextLayerInstanceIndex] = nextLayerInstanceIndex;
+			}
+			else
+			{
+				uint instanceNum = atomicAdd(dc.commands[firstCommandIndex + objectIndex].instanceCount, 1);
+				il.instances[instanceListIndex + int(instanceNum)] = nextLayerInstanceIndex;
+			}
+		}
+	}
+}
+
 void main() 
 {
-	
+	CountShadedFragment();
+
 	int cameraIndexAndStencilCompare = inInstanceIndex + pc.layerStartIndex;
 
 #ifdef SUBSEQUENT_PASS
 	if(cameraIndexAndStencilCompare != subpassLoad(inputStencil).r)
 	{
+		CountDiscard(cameraIndexAndStencilCompare, 2);
 		discard;
 	}
 
@@ -60,6 +196,7 @@ void main()
 
 	if(gl_FragCoord.z >= renderedDepthValue)
 	{
+		CountDiscard(cameraIndexAndStencilCompare, 3);
 		discard;
 	}
 
@@ -67,7 +204,27 @@ void main()
 
 	bool isLastPortalPass = pc.maxVisiblePortalCount == 0;
 
-	if(isLastPortalPass)
+	int currentPortalCameraIndex = 0;
+	bool isBelowCoverageThreshold = false;
+	if(!isLastPortalPass)
+	{
+		int currentViewMatIndex = cameraIndexAndStencilCompare == 0 ? 0 :  ci.cIndices[cameraIndexAndStencilCompare];
+
+		int firstPortalCameraIndex = currentViewMatIndex * pc.currentPortalCount + 1;
+		currentPortalCameraIndex = firstPortalCameraIndex + pc.portalIndex;
+
+		isBelowCoverageThreshold = UpdateCoverage(currentPortalCameraIndex);
+
+		// cameras without screen bounds were pruned on the cpu and have no valid matrix, they would only show the clear color
+		vec4 screenBounds = ccd.cameras[currentPortalCameraIndex].screenBounds;
+		isBelowCoverageThreshold = isBelowCoverageThreshold || screenBounds.x >= screenBounds.z || screenBounds.y >= screenBounds.w;
+	}
+
+	// 0 never matches a camera of a hardware stencil layer
+	int nextLayerStencilValue = 0;
+
+	// small portals are shaded like the portals of the last pass and don't spawn a camera
+	if(isLastPortalPass || isBelowCoverageThreshold)
 	{
 		outRenderedStencil = 0;
 		outColor = gl_FrontFacing ? vec4(0.75) : vec4(0.25);
@@ -80,11 +237,6 @@ void main()
 		int firstHelperIndex = cameraIndexAndStencilCompare * pc.currentPortalCount;
 		int helperIndex = firstHelperIndex + pc.portalIndex;
 
-		int currentViewMatIndex = cameraIndexAndStencilCompare == 0 ? 0 :  ci.cIndices[cameraIndexAndStencilCompare];
-
-		int firstPortalCameraIndex = currentViewMatIndex * pc.currentPortalCount + 1;
-		int currentPortalCameraIndex = firstPortalCameraIndex + pc.portalIndex;
-
 		int firstCameraIndicesIndexAndStencilWrite = pc.nextLayerStartIndex + (inInstanceIndex * pc.maxVisiblePortalCount);
 		// count previous visible portals
 		// we can use a fixed iteration count here, as the other portals won't have be processed / written and will always be zero
@@ -96,11 +248,17 @@ void main()
 
 		if (previousVisiblePortals < pc.maxVisiblePortalCount)
 		{
-			// mark that we are a visible portal
-			atomicExchange(pih.indices[helperIndex], previousVisiblePortals + 1);
+			// mark that we are a visible portal, only the first fragment sees the unmarked value
+			bool isFirstFragment = atomicCompSwap(pih.indices[helperIndex], 0, previousVisiblePortals + 1) == 0;
 			// write our camera index into camera index buffer
 			atomicExchange(ci.cIndices[firstCameraIndicesIndexAndStencilWrite + previousVisiblePortals],  currentPortalCameraIndex);
+
+			if(isFirstFragment)
+			{
+				AppendVisibleObjects(currentPortalCameraIndex, firstCameraIndicesIndexAndStencilWrite + previousVisiblePortals - pc.nextLayerStartIndex);
+			}
 			outRenderedStencil = firstCameraIndicesIndexAndStencilWrite + previousVisiblePortals;
+			nextLayerStencilValue = firstCameraIndicesIndexAndStencilWrite + previousVisiblePortals - pc.nextLayerStartIndex + 1;
 			outColor = vec4(vec3(0.0),1.f);// pc.debugColor;
 		}
 		else
@@ -111,6 +269,11 @@ void main()
 		}
 	}
 
+#ifdef STENCIL_EXPORT
+	// stencil op is replace, so this is written to the stencil attachment
+	gl_FragStencilRefARB = pc.isNextLayerHardwareStencil != 0 ? nextLayerStencilValue : 0;
+#endif
+
 	if(gl_FrontFacing)
 	{
 		outRenderedDepth = gl_FragCoord.z;
@@ -20,6 +20,42 @@ layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out flat int outInstanceIndex;
 
+// screen bounds of the portals a camera is looking through and the plane of the destination portal
+// see PortalManager::CreateCameraClipData
+struct CameraClipData
+{
+	vec4 screenBounds;
+	vec4 clipPlane;
+};
+
+layout(set = 7, binding = 3) readonly buffer CameraClipDatas {
+	CameraClipData cameras[];
+} ccd;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+	float gl_ClipDistance[5];
+};
+
+// fragments outside of the portal bounds or in front of the destination portal are never generated
+void ClipToCamera(uint viewMatIndex, vec4 viewPos)
+{
+	vec4 screenBounds = ccd.cameras[viewMatIndex].screenBounds;
+	gl_ClipDistance[0] = gl_Position.x - screenBounds.x * gl_Position.w;
+	gl_ClipDistance[1] = screenBounds.z * gl_Position.w - gl_Position.x;
+	gl_ClipDistance[2] = gl_Position.y - screenBounds.y * gl_Position.w;
+	gl_ClipDistance[3] = screenBounds.w * gl_Position.w - gl_Position.y;
+	gl_ClipDistance[4] = dot(ccd.cameras[viewMatIndex].clipPlane, viewPos);
+}
+
+void ClipAll()
+{
+	for(int i = 0; i < 5; ++i)
+	{
+		gl_ClipDistance[i] = -1.0;
+	}
+}
+
 const uint invalid_matIndex = ~0;
 
 layout(push_constant) uniform PushConstant {
@@ -30,6 +66,11 @@ layout(push_constant) uniform PushConstant {
 	int portalIndex;
 	int maxVisiblePortalCount;
 	int currentPortalCount;
+	int objectCount;
+	int nextDrawCommandSetIndex;
+	int nextLayerInstanceCount;
+	int minPortalCoverage;
+	int isNextLayerHardwareStencil;
 } pc;
 
 void main() {
@@ -45,16 +86,18 @@ void main() {
 	{
 		mat4 viewMat = u_cMats.mats[viewMatIndex];
 
-		gl_Position = 
-		u_grd.proj *
+		vec4 viewPos =
 		viewMat *
 		pc.model *
 		vec4(inPosition, 1.0);
 
+		gl_Position = u_grd.proj * viewPos;
+		ClipToCamera(viewMatIndex, viewPos);
 	}
 	else
 	{
 		gl_Position = vec4(1);
+		ClipAll();
 	}
 
 	//gl_Position = vec4(clamp(inPosition, vec3(-1.f), vec3(1)), 1.0);
@@ -0,0 +1,67 @@
+#version 450
+
+// fragment shader of the renderers which find the portal views on the cpu, see RecursiveStencilRenderer
+// the views are masked by the stencil test or the portal mesh, so there are no manual tests and early fragment tests stay enabled
+// TEXTURE_ATLAS adds the portals which sample the view behind them from the atlas, see TextureAtlasRenderer
+
+layout(set = 0, binding = 0) uniform sampler2D texSampler;
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in flat vec4 inDebugColor;
+
+#ifdef TEXTURE_ATLAS
+layout(set = 1, binding = 0) uniform sampler2D atlasSampler;
+layout(location = 3) in vec4 inScreenPosition;
+#endif
+
+layout(location = 0) out vec4 outColor;
+
+layout(push_constant) uniform PushConstant {
+	mat4 viewProj;
+	vec4 clipPlane;
+	vec4 crop;
+	vec4 atlasTransform;
+	int drawMode;
+} pc;
+
+// see PushConstant_recursive::DrawMode
+const int drawMode_flatPortal = 2;
+const int drawMode_atlasPortal = 3;
+
+const vec3 directionalLightDir = normalize(vec3(1.0,1.0,1.0));
+
+void main() {
+
+	// portals which are not recursed are shaded like the portals of the last breadth first pass
+	if(pc.drawMode == drawMode_flatPortal)
+	{
+		outColor = gl_FrontFacing ? vec4(0.75) : vec4(0.25);
+		return;
+	}
+
+#ifdef TEXTURE_ATLAS
+	// the view behind the portal was rendered with the same projection, so it is found at the same screen position
+	if(pc.drawMode == drawMode_atlasPortal)
+	{
+		vec2 screenPosition = inScreenPosition.xy / inScreenPosition.w;
+		outColor = vec4(texture(atlasSampler, screenPosition * pc.atlasTransform.xy + pc.atlasTransform.zw).xyz, 1.0);
+		return;
+	}
+#endif
+
+	vec3 color = texture(texSampler,fragTexCoord).xyz;
+	if(inDebugColor.w != 0)
+	{
+		color = inDebugColor.xyz;
+	}
+
+	const float ambient = 0.4;
+
+	vec3 normal = normalize(fragNormal);
+	float diffuse = max(0, dot(directionalLightDir, normal));
+
+	color = color * min(diffuse + ambient, 1.0);
+
+	outColor = vec4(color,1.0);
+}
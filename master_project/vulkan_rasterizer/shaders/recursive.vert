@@ -0,0 +1,76 @@
+#version 450
+
+// vertex shader of the renderers which find the portal views on the cpu, see RecursiveStencilRenderer
+// the view is pushed for each draw, so there is no buffer with the cameras of the NTree
+// views rendered into the texture atlas are cropped to their screen bounds
+
+layout(push_constant) uniform PushConstant {
+	mat4 viewProj;
+	vec4 clipPlane;
+	vec4 crop;
+	vec4 atlasTransform;
+	int drawMode;
+} pc;
+
+// see PushConstant_recursive::DrawMode
+const int drawMode_sceneObject = 0;
+
+struct SceneObject
+{
+	mat4 model;
+	mat4 normalMat;
+	vec4 debugColor;
+	vec4 boundingSphere;
+	uint lodFirstIndex[4];
+	uint lodIndexCount[4];
+};
+
+layout(set = 0, binding = 1) readonly buffer SceneObjects {
+	SceneObject objects[];
+} so;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out flat vec4 outDebugColor;
+
+// clip space position before the crop, used to find the atlas slot texel behind a portal
+layout(location = 3) out vec4 outScreenPosition;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+	float gl_ClipDistance[1];
+};
+
+void main() {
+
+	vec4 pos = vec4(inPosition, 1.0);
+
+	// scene objects are drawn with their object index as instance, see Scene::DrawEachObject
+	// other meshes have the model matrix in viewProj, their normals stay in model space
+	if(pc.drawMode == drawMode_sceneObject)
+	{
+		SceneObject object = so.objects[gl_InstanceIndex];
+		pos = object.model * pos;
+		fragNormal = vec3(object.normalMat * vec4(inNormal, 0.0));
+		outDebugColor = object.debugColor;
+	}
+	else
+	{
+		fragNormal = inNormal;
+		outDebugColor = vec4(0.0);
+	}
+
+	vec4 screenPosition = pc.viewProj * pos;
+	outScreenPosition = screenPosition;
+
+	gl_Position = vec4(screenPosition.xy * pc.crop.xy + pc.crop.zw * screenPosition.w, screenPosition.zw);
+
+	// everything between the camera and the destination portal
+	gl_ClipDistance[0] = dot(pc.clipPlane, pos);
+
+	fragTexCoord = inTexCoord;
+}
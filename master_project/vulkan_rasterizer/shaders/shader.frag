@@ -5,41 +5,107 @@ layout(set = 0, binding = 0) uniform sampler2D texSampler;
 layout(location = 0) in vec3 fragNormal;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in flat int inInstanceIndex;
+layout(location = 3) in flat vec4 inDebugColor;
 
 layout(location = 0) out vec4 outColor;
 
 #ifdef SUBSEQUENT_PASS
 layout (input_attachment_index = 0, set = 3, binding = 0) uniform subpassInput inputDepth;
 layout (input_attachment_index = 1, set = 3, binding = 1) uniform usubpassInput inputStencil;
+
+// fragments discarded by the tests against the rendered stencil and depth, see DrawOptions::collectLayerStatistics
+// four counters per stencil value: scene stencil, scene depth, portal stencil and portal depth
+layout(set = 7, binding = 7) buffer DiscardCounters {
+	uint isEnabled;
+	uint counts[];
+} dcnt;
+
+void CountDiscard(int stencilValue, int counterIndex)
+{
+	if(dcnt.isEnabled != 0)
+	{
+		atomicAdd(dcnt.counts[stencilValue * 4 + counterIndex], 1);
+	}
+}
+#else
+// the heatmap writes to a storage buffer, which would let the driver move the depth and stencil tests behind the shader
+// the hardware stencil layers rely on them to mask the fragments before MarkRecursionLayer
+layout(early_fragment_tests) in;
 #endif
 
+// see DrawOptions::heatmap and Ssbo_HeatmapHeader, two counters per pixel: the shaded fragments and the deepest layer + 1
+layout(set = 7, binding = 8) buffer Heatmap {
+	uint mode;
+	uint width;
+	uint layerCount;
+	uint padding;
+	int layerStartIndices[8];
+	uint pixels[];
+} hm;
+
+void CountShadedFragment()
+{
+	if(hm.mode != 0)
+	{
+		uint pixelIndex = uint(gl_FragCoord.y) * hm.width + uint(gl_FragCoord.x);
+		atomicAdd(hm.pixels[pixelIndex * 2], 1);
+	}
+}
+
+void MarkRecursionLayer(int stencilValue)
+{
+	if(hm.mode != 0)
+	{
+		uint layer = 0;
+		for(uint i = 0; i + 1 < hm.layerCount; ++i)
+		{
+			if(hm.layerStartIndices[i] <= stencilValue)
+			{
+				++layer;
+			}
+		}
+
+		uint pixelIndex = uint(gl_FragCoord.y) * hm.width + uint(gl_FragCoord.x);
+		atomicMax(hm.pixels[pixelIndex * 2 + 1], layer + 1);
+	}
+}
+
 const vec3 directionalLightDir = normalize(vec3(1.0,1.0,1.0));
 
 layout(push_constant) uniform PushConstant {
  	mat4 model;
 	vec4 debugColor;
 	int layerStartIndex;
+	int objectInstanceStride;
+	int instanceListOffset;
 } pc;
 
 void main() {
 
+	CountShadedFragment();
+
 	int stencilCompareValue = inInstanceIndex + pc.layerStartIndex;
 #ifdef SUBSEQUENT_PASS
 	if(stencilCompareValue != subpassLoad(inputStencil).r)
 	{
+		CountDiscard(stencilCompareValue, 0);
 		discard;
 	}
 
 	if(gl_FragCoord.z >= abs(subpassLoad(inputDepth).r))
 	{
+		CountDiscard(stencilCompareValue, 1);
 		discard;
 	}
 #endif
 
+	// the hardware stencil variant is masked before the shader, so the layer is known in both variants
+	MarkRecursionLayer(stencilCompareValue);
+
 	vec3 color = texture(texSampler,fragTexCoord).xyz;
-	if(pc.debugColor.w != 0)
+	if(inDebugColor.w != 0)
 	{
-		color = pc.debugColor.xyz;
+		color = inDebugColor.xyz;
 	}
 
 
@@ -4,10 +4,13 @@ layout(push_constant) uniform PushConstant {
  	mat4 model;
 	vec4 debugColor;
 	int layerStartIndex;
+	int objectInstanceStride;
+	int instanceListOffset;
 } pc;
 
 layout(set = 1, binding = 0) uniform Ubo_GlobalRenderData {
     mat4 proj;
+	mat4 mainCameraMat;
 } u_grd;
 
 layout(constant_id = 1) const int maxCameraMatCount = 3257437;
@@ -24,17 +27,94 @@ layout(location = 2) in vec2 inTexCoord;
 layout(location = 0) out vec3 fragNormal;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out flat int outInstanceIndex;
+layout(location = 3) out flat vec4 outDebugColor;
 
 layout(set = 4, binding = 0) buffer CameraIndices {
     int cIndices[];
 } ci;
 
+struct SceneObject
+{
+	mat4 model;
+	mat4 normalMat;
+	vec4 debugColor;
+	vec4 boundingSphere;
+	uint lodFirstIndex[4];
+	uint lodIndexCount[4];
+};
+
+layout(set = 6, binding = 0) readonly buffer SceneObjects {
+	SceneObject objects[];
+} so;
+
+// the culling and the portal pass write the cameras which can see an object, see cull.comp
+layout(set = 7, binding = 1) readonly buffer InstanceLists {
+	int instances[];
+} il;
+
+// screen bounds of the portals a camera is looking through and the plane of the destination portal
+// see PortalManager::CreateCameraClipData
+struct CameraClipData
+{
+	vec4 screenBounds;
+	vec4 clipPlane;
+};
+
+layout(set = 7, binding = 3) readonly buffer CameraClipDatas {
+	CameraClipData cameras[];
+} ccd;
+
+out gl_PerVertex {
+	vec4 gl_Position;
+	float gl_ClipDistance[5];
+};
+
+// fragments outside of the portal bounds or in front of the destination portal are never generated
+void ClipToCamera(uint viewMatIndex, vec4 viewPos)
+{
+	vec4 screenBounds = ccd.cameras[viewMatIndex].screenBounds;
+	gl_ClipDistance[0] = gl_Position.x - screenBounds.x * gl_Position.w;
+	gl_ClipDistance[1] = screenBounds.z * gl_Position.w - gl_Position.x;
+	gl_ClipDistance[2] = gl_Position.y - screenBounds.y * gl_Position.w;
+	gl_ClipDistance[3] = screenBounds.w * gl_Position.w - gl_Position.y;
+	gl_ClipDistance[4] = dot(ccd.cameras[viewMatIndex].clipPlane, viewPos);
+}
+
+void ClipAll()
+{
+	for(int i = 0; i < 5; ++i)
+	{
+		gl_ClipDistance[i] = -1.0;
+	}
+}
+
 const uint invalid_matIndex = ~0;
 
 void main() {
 
-	int cameraIndicesIndex = gl_InstanceIndex + pc.layerStartIndex;
-	outInstanceIndex = gl_InstanceIndex;
+	// objects drawn by the scene encode their object index in the instance index, see Scene::Draw
+	int cameraInstanceIndex = gl_InstanceIndex;
+	mat4 model = pc.model;
+	mat4 normalMat;
+	if(pc.objectInstanceStride > 0)
+	{
+		int objectIndex = gl_InstanceIndex / pc.objectInstanceStride;
+		cameraInstanceIndex = il.instances[pc.instanceListOffset + gl_InstanceIndex];
+
+		model = so.objects[objectIndex].model;
+		normalMat = so.objects[objectIndex].normalMat;
+		outDebugColor = so.objects[objectIndex].debugColor;
+	}
+	else
+	{
+		// a negative stride draws the camera mesh
+		model = pc.objectInstanceStride < 0 ? u_grd.mainCameraMat : pc.model;
+		normalMat = transpose(inverse(model));
+		outDebugColor = pc.debugColor;
+	}
+
+	int cameraIndicesIndex = cameraInstanceIndex + pc.layerStartIndex;
+	outInstanceIndex = cameraInstanceIndex;
 
 	uint viewMatIndex = cameraIndicesIndex == 0 ? 0 :  ci.cIndices[cameraIndicesIndex];
 
@@ -42,16 +122,19 @@ void main() {
 	{
 		mat4 viewMat = u_cMats.mats[viewMatIndex];
 
-		gl_Position = 
-		u_grd.proj *
+		vec4 viewPos =
 		viewMat *
-		pc.model *
+		model *
 		vec4(inPosition, 1.0);
-		fragNormal = vec3(transpose(inverse(pc.model)) * vec4(inNormal, 0.0));
+
+		gl_Position = u_grd.proj * viewPos;
+		ClipToCamera(viewMatIndex, viewPos);
+		fragNormal = vec3(normalMat * vec4(inNormal, 0.0));
 	}
 	else
 	{
 		gl_Position = vec4(1);
+		ClipAll();
 		fragNormal = inNormal;
 	}
 